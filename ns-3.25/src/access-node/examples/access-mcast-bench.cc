@@ -0,0 +1,230 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2015 UFRGS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Alexsander de Souza <asouza@inf.ufrgs.br>
+ */
+
+/*
+ * IPTV replication benchmark for AccessNetDevice
+ *
+ *   CPE-0 ... CPE-n --- [AN] --- NAS (multicast sources)
+ *
+ * Every subscriber joins one of the available channels, the NAS streams
+ * all of them. Run it with increasing --subscribers and --channels to
+ * measure how the multicast forwarding cost scales, e.g.:
+ *
+ *   for n in 100 1000 5000; do
+ *     ./waf --run "access-mcast-bench --subscribers=$n --channels=50"
+ *   done
+ */
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/csma-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/applications-module.h"
+#include "ns3/access-net-device.h"
+#include "ns3/ancp-helper.h"
+#include "ns3/access-node-helper.h"
+#include "ns3/system-wall-clock-ms.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("AnMCastBench");
+
+static const std::string MCAST_PROFILE = "IPTV";
+
+ApplicationContainer nasApps;
+std::list<Address> channelList;
+
+int AncpNasNewAdjacency(const Mac48Address &anName)
+{
+  NS_LOG_FUNCTION(anName);
+
+  Ptr<AncpNasAgent> nasAgent = DynamicCast<AncpNasAgent, Application>(nasApps.Get(0));
+  std::list<Address> emptyList;
+
+  return nasAgent->SendMCastServiceProfile(anName, MCAST_PROFILE, channelList,
+                                           emptyList, emptyList, false, false);
+}
+
+int AncpNasPortUp(const Mac48Address &anName, const std::string &circuitId,
+                  uint32_t rateUp, uint32_t rateDown, uint32_t tagMode)
+{
+  NS_LOG_FUNCTION(anName << circuitId);
+
+  Ptr<AncpNasAgent> nasAgent = DynamicCast<AncpNasAgent, Application>(nasApps.Get(0));
+
+  return nasAgent->SendMCastPortConfigCommand(anName, circuitId, MCAST_PROFILE);
+}
+
+int AncpNasPortDown(const Mac48Address &anName, const std::string &circuitId)
+{
+  NS_LOG_FUNCTION(anName << circuitId);
+  return(0);
+}
+
+void ActivateAccessLoops(NetDeviceContainer anDevices)
+{
+  for (auto it = anDevices.Begin(); it != anDevices.End(); ++it)
+    {
+      (*it)->SetLineProtocolStatus(true);
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+  uint32_t nSubscribers = 500;
+  uint32_t nChannels = 20;
+  uint32_t simDuration = 30;
+  Time streamInterval = MilliSeconds(1);
+
+  CommandLine cmd;
+
+  cmd.AddValue("subscribers", "Number of CPEs behind the access node", nSubscribers);
+  cmd.AddValue("channels", "Number of IPTV channels streamed by the NAS", nChannels);
+  cmd.AddValue("duration", "Simulated time, in seconds", simDuration);
+  cmd.AddValue("interval", "Time between packets of each channel", streamInterval);
+
+  cmd.Parse(argc, argv);
+
+  NS_ABORT_MSG_IF(nChannels == 0 || nChannels > 0xFFFF, "Invalid number of channels");
+
+  NodeContainer cpes;
+  cpes.Create(nSubscribers);
+
+  NodeContainer anNode;
+  anNode.Create(1);
+
+  NodeContainer nasNode;
+  nasNode.Create(1);
+
+  CsmaHelper csma;
+  csma.SetChannelAttribute("DataRate", StringValue("1Gbps"));
+  csma.SetChannelAttribute("Delay", TimeValue(MicroSeconds(5)));
+
+  NetDeviceContainer cpeDevices;
+  NetDeviceContainer anDevices;
+
+  for (uint32_t i = 0; i < nSubscribers; i++)
+    {
+      NetDeviceContainer link = csma.Install(NodeContainer(cpes.Get(i), anNode));
+      cpeDevices.Add(link.Get(0));
+      anDevices.Add(link.Get(1));
+    }
+
+  NetDeviceContainer nasLink = csma.Install(NodeContainer(anNode.Get(0), nasNode));
+
+  AccessNodeHelper anHelper;
+  NetDeviceContainer anDev = anHelper.CreateAccessNodeDevice(anNode.Get(0), anDevices, nasLink.Get(0));
+
+  InternetStackHelper internet;
+  internet.Install(cpes);
+  internet.Install(nasNode);
+  internet.Install(anNode);
+
+  /* Single broadcast domain, the AN is a bridge */
+  Ipv4AddressHelper ipv4;
+  ipv4.SetBase("10.0.0.0", "255.255.0.0");
+  Ipv4InterfaceContainer nasInterfaces = ipv4.Assign(NetDeviceContainer(nasLink.Get(1), anDev));
+  ipv4.Assign(cpeDevices);
+
+  Ipv4StaticRoutingHelper multicast;
+  multicast.SetDefaultMulticastRoute(nasNode.Get(0), nasLink.Get(1));
+  multicast.SetDefaultMulticastRoute(anNode.Get(0), anDev.Get(0));
+  for (uint32_t i = 0; i < nSubscribers; i++)
+    {
+      multicast.SetDefaultMulticastRoute(cpes.Get(i), cpeDevices.Get(i));
+    }
+
+  /* ANCP control plane, provisions the multicast profile on every port */
+  ApplicationContainer ancpApps = anHelper.InstallAccessNodeControl(anNode.Get(0), nasInterfaces.GetAddress(0));
+  ancpApps.Start(Seconds(1.0));
+  ancpApps.Stop(Seconds(simDuration));
+
+  AncpHelper ancp;
+  ancp.SetNasAttribute("NewAdjCallback", CallbackValue(MakeCallback(AncpNasNewAdjacency)));
+  ancp.SetNasAttribute("PortUpCallback", CallbackValue(MakeCallback(AncpNasPortUp)));
+  ancp.SetNasAttribute("PortDownCallback", CallbackValue(MakeCallback(AncpNasPortDown)));
+
+  nasApps = ancp.InstallNas(nasNode.Get(0), nasInterfaces.GetAddress(0));
+  nasApps.Start(Seconds(0.0));
+  nasApps.Stop(Seconds(simDuration));
+
+  Simulator::Schedule(Seconds(2.0), &ActivateAccessLoops, anDevices);
+
+  /* One source per channel at the NAS, one sink per subscriber */
+  ApplicationContainer sinkApps;
+
+  for (uint32_t ch = 0; ch < nChannels; ch++)
+    {
+      Ipv4Address group((224U << 24) | (1U << 16) | ch);
+      channelList.push_back(group);
+
+      MulticastSourceHelper source;
+      source.SetAttribute("Group", Ipv4AddressValue(group));
+      source.SetAttribute("Interval", TimeValue(streamInterval));
+      source.SetAttribute("PacketSize", UintegerValue(1316));
+
+      ApplicationContainer srcApp = source.Install(nasNode.Get(0));
+      srcApp.Start(Seconds(1.0));
+      srcApp.Stop(Seconds(simDuration));
+    }
+
+  /*
+   * The first REPORT of each CPE only provisions its port (the multicast
+   * profile arrives via ANCP afterwards), streaming starts on the next
+   * general query.
+   */
+  Ptr<UniformRandomVariable> jitter = CreateObject<UniformRandomVariable> ();
+
+  for (uint32_t i = 0; i < nSubscribers; i++)
+    {
+      Ipv4Address group((224U << 24) | (1U << 16) | (i % nChannels));
+
+      MulticastSinkHelper sink(group);
+      ApplicationContainer app = sink.Install(cpes.Get(i));
+      app.Start(Seconds(3.0 + jitter->GetValue(0.0, 1.0)));
+      app.Stop(Seconds(simDuration - 1));
+      sinkApps.Add(app);
+    }
+
+  SystemWallClockMs wallClock;
+  wallClock.Start();
+
+  Simulator::Stop(Seconds(simDuration));
+  Simulator::Run();
+
+  int64_t elapsed = wallClock.End();
+
+  uint64_t totalRx = 0;
+  for (auto it = sinkApps.Begin(); it != sinkApps.End(); ++it)
+    {
+      totalRx += DynamicCast<MulticastSink, Application>(*it)->GetTotalRx();
+    }
+
+  std::cout << "subscribers=" << nSubscribers
+            << " channels=" << nChannels
+            << " duration=" << simDuration << "s"
+            << " rx_bytes=" << totalRx
+            << " wall_ms=" << elapsed
+            << std::endl;
+
+  Simulator::Destroy();
+  return 0;
+}
@@ -18,6 +18,7 @@
  * Author: Alexsander de Souza <asouza@inf.ufrgs.br>
  */
 
+#include <algorithm>
 #include "ns3/log.h"
 #include "access-channel.h"
 
@@ -39,7 +40,8 @@ AccessChannel::GetTypeId(void)
 }
 
 AccessChannel::AccessChannel ()
-  : Channel()
+  : Channel(),
+  m_nDevices(0)
 {
   NS_LOG_FUNCTION_NOARGS();
 }
@@ -61,36 +63,56 @@ void
 AccessChannel::AddChannel(Ptr<Channel> accessChannel)
 {
   m_channels.push_back(accessChannel);
+  m_firstDevice.push_back(m_nDevices);
+  m_nDevices += accessChannel->GetNDevices();
 }
 
-uint32_t
-AccessChannel::GetNDevices(void) const
+void
+AccessChannel::Reindex(void) const
 {
-  uint32_t ndevices = 0;
+  NS_LOG_FUNCTION(this << m_channels.size());
 
-  for (ChannelList::const_iterator iter = m_channels.begin();
-       iter != m_channels.end(); iter++)
+  m_nDevices = 0;
+
+  for (uint32_t k = 0; k < m_channels.size(); ++k)
     {
-      ndevices += (*iter)->GetNDevices();
+      m_firstDevice[k] = m_nDevices;
+      m_nDevices += m_channels[k]->GetNDevices();
     }
-  return ndevices;
 }
 
+uint32_t
+AccessChannel::GetNDevices(void) const
+{
+  uint32_t nDevices = 0;
+
+  /* No allocation nor writes while the index is up to date */
+  for (auto &channel : m_channels)
+    nDevices += channel->GetNDevices();
+
+  if (nDevices != m_nDevices)
+    Reindex();
+
+  return m_nDevices;
+}
 
 Ptr<NetDevice>
 AccessChannel::GetDevice(uint32_t i) const
 {
-  uint32_t ndevices = 0;
+  if (i >= m_nDevices)
+    return 0;
 
-  for (ChannelList::const_iterator iter = m_channels.begin();
-       iter != m_channels.end(); iter++)
+  /* Last channel starting at or before i, empty channels are skipped */
+  uint32_t k = std::upper_bound(m_firstDevice.begin(), m_firstDevice.end(), i)
+    - m_firstDevice.begin() - 1;
+  uint32_t next = (k + 1 < m_firstDevice.size()) ? m_firstDevice[k + 1] : m_nDevices;
+
+  if (m_channels[k]->GetNDevices() != next - m_firstDevice[k])
     {
-      if ((i - ndevices) < (*iter)->GetNDevices())
-        {
-          return (*iter)->GetDevice(i - ndevices);
-        }
-      ndevices += (*iter)->GetNDevices();
+      Reindex();
+      return GetDevice(i);
     }
-  return 0;
+
+  return m_channels[k]->GetDevice(i - m_firstDevice[k]);
 }
 } // namespace ns3
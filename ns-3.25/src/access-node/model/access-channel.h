@@ -20,11 +20,22 @@
 #ifndef __ACCESS_CHANNEL_H__
 #define __ACCESS_CHANNEL_H__
 
+#include <vector>
 #include "ns3/net-device.h"
 #include "ns3/channel.h"
 
 namespace ns3
 {
+/**
+ * \brief Aggregate of the channels attached to an Access Node
+ *
+ * Devices are numbered in channel order through a prefix sum of the
+ * device count of each channel, so GetDevice() is a binary search.
+ * Channels only gain devices: GetNDevices() adds up their current counts
+ * and rebuilds the index when the total moved, GetDevice() uses the
+ * numbering of the last GetNDevices() call and only checks the channel
+ * it lands on.
+ */
 class AccessChannel : public Channel
 {
 public:
@@ -39,9 +50,13 @@ public:
   virtual Ptr<NetDevice> GetDevice(uint32_t i) const;
 
 private:
-  typedef std::list< Ptr<Channel> > ChannelList;
+  typedef std::vector< Ptr<Channel> > ChannelList;
+
+  void Reindex(void) const;
 
   ChannelList m_channels;
+  mutable std::vector<uint32_t> m_firstDevice;  /*!< Index of the first device of each channel */
+  mutable uint32_t m_nDevices;
 };
 }
 #endif /* __ACCESS_CHANNEL_H__ */
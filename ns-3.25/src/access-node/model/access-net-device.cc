@@ -55,6 +55,21 @@ AccessNetDevice::GetTypeId(void)
                                     TimeValue(Seconds(30)),
                                     MakeTimeAccessor(&AccessNetDevice::m_portMapTtl),
                                     MakeTimeChecker())
+                      .AddAttribute("ShaperBurst",
+                                    "Token bucket size of the subscriber line shapers, in bytes.",
+                                    UintegerValue(16000),
+                                    MakeUintegerAccessor(&AccessNetDevice::m_shaperBurst),
+                                    MakeUintegerChecker<uint32_t> (1))
+                      .AddAttribute("ShaperQueueLimit",
+                                    "Max packets waiting for tokens in a subscriber line shaper.",
+                                    UintegerValue(100),
+                                    MakeUintegerAccessor(&AccessNetDevice::m_shaperQueueLimit),
+                                    MakeUintegerChecker<uint32_t> ())
+                      .AddAttribute("QueryBatchSize",
+                                    "Access ports queried per event, IGMP queries are spread over the query interval.",
+                                    UintegerValue(64),
+                                    MakeUintegerAccessor(&AccessNetDevice::m_mcastQueryBatch),
+                                    MakeUintegerChecker<uint32_t> (1))
   ;
 
   return tid;
@@ -68,7 +83,12 @@ AccessNetDevice::AccessNetDevice() :
   m_address(Mac48Address("00:00:00:00:00:00")),
   m_ifIndex(0),
   m_mtu(1500),
-  m_agent(0)
+  m_agent(0),
+  m_shaperBurst(16000),
+  m_shaperQueueLimit(100),
+  m_mcastQuery(0),
+  m_mcastQueryNext(0),
+  m_mcastQueryBatch(64)
 {
   NS_LOG_FUNCTION_NOARGS();
   m_channel = CreateObject<AccessChannel> ();
@@ -87,11 +107,17 @@ void AccessNetDevice::DoDispose(void)
   m_access_ports.clear();
   m_accessProfiles.clear();
   m_mcastProfiles.clear();
-  m_portMap.clear();
+  m_portMap.Clear();
+  m_portHosts.clear();
+  m_mcastActiveGroups.clear();
   m_channel = 0;
   m_node = 0;
   m_agent = 0;
   Simulator::Cancel(m_mcastQueryTimer);
+  Simulator::Cancel(m_mcastQueryBatchEvent);
+  m_mcastQuery = 0;
+  m_mcastQueryPorts.clear();
+  Simulator::Cancel(m_agingTimer);
   BridgedNetDevice::DoDispose();
 }
 
@@ -136,6 +162,40 @@ void AccessNetDevice::AddAccessPort(Ptr< NetDevice > port)
   m_node->RegisterProtocolHandler(MakeCallback(&AccessNetDevice::ReceiveFromAccessPort, this),
                                   0, port, true);
   m_channel->AddChannel(port->GetChannel());
+
+  /* One callback per physical port, dispatched to the subscribers behind it */
+  port->AddLinkChangeCallback(MakeCallback(&AccessNetDevice::AccessPortLinkChanged, this).Bind(port));
+}
+
+Ptr<NetDevice> AccessNetDevice::GetUplinkPort(void) const
+{
+  return m_uplink;
+}
+
+bool AccessNetDevice::SendUpstream(Ptr<Packet> packet, const Address& source,
+                                   const Address& dest, uint16_t protocolNumber)
+{
+  NS_LOG_FUNCTION(this << packet);
+  NS_ASSERT_MSG(m_uplink != nullptr, "Uplink port not set");
+
+  return m_uplink->SendFrom(packet, source, dest, protocolNumber);
+}
+
+uint32_t AccessNetDevice::GetNPortHosts(Ptr<NetDevice> port) const
+{
+  auto hosts = m_portHosts.find(port);
+
+  return (hosts != m_portHosts.end()) ? hosts->second.size() : 0;
+}
+
+uint32_t AccessNetDevice::GetShaperBurst(void) const
+{
+  return m_shaperBurst;
+}
+
+uint32_t AccessNetDevice::GetShaperQueueLimit(void) const
+{
+  return m_shaperQueueLimit;
 }
 
 uint32_t AccessNetDevice::GetNBridgePorts(void) const
@@ -273,11 +333,11 @@ void AccessNetDevice::ForwardUnicast(Ptr<const Packet> packet, uint16_t protocol
 {
   NS_LOG_FUNCTION(this << packet);
 
-  Ptr<NetDevice> outPort = SelectAccessPortForMac(dst, packet);
+  AccessPort *entry = SelectAccessPortForMac(dst, packet);
 
-  if (outPort != NULL && outPort->IsLinkUp())
+  if (entry != nullptr && entry->GetAccessPort()->IsLinkUp())
     {
-      outPort->SendFrom(packet->Copy(), src, dst, protocol);
+      entry->Send(AccessPort::DOWNSTREAM, packet, src, dst, protocol);
     }
   else
     {
@@ -291,7 +351,12 @@ void AccessNetDevice::ForwardUpstream(Ptr<const Packet> packet, uint16_t protoco
 
   /* TODO create DHCP option 82 hook */
 
-  m_uplink->SendFrom(packet->Copy(), src, dst, protocol);
+  AccessPort *entry = m_portMap.Find(src);
+
+  if (entry != nullptr && entry->GetAccessPort() != nullptr)
+    entry->Send(AccessPort::UPSTREAM, packet, src, dst, protocol);
+  else
+    SendUpstream(packet->Copy(), src, dst, protocol);
 }
 
 void AccessNetDevice::ForwardBroadcast(Ptr<const Packet> packet, uint16_t protocol, Mac48Address &src, Mac48Address &dst)
@@ -300,10 +365,25 @@ void AccessNetDevice::ForwardBroadcast(Ptr<const Packet> packet, uint16_t protoc
 
   for (Ptr<NetDevice> &port :m_access_ports)
     {
-      if (port->IsLinkUp())
+      if (!port->IsLinkUp())
+        continue;
+
+      /* Once per line, through the shaper of a subscriber behind it, so
+       * broadcasts are queued behind the unicast and multicast traffic */
+      AccessPort *access = nullptr;
+      auto hosts = m_portHosts.find(port);
+
+      if (hosts != m_portHosts.end())
         {
-          port->SendFrom(packet->Copy(), src, dst, protocol);
+          for (auto &mac : hosts->second)
+            if ((access = m_portMap.Find(mac)) != nullptr)
+              break;
         }
+
+      if (access != nullptr)
+        access->Send(AccessPort::DOWNSTREAM, packet, src, dst, protocol);
+      else
+        port->SendFrom(packet->Copy(), src, dst, protocol);
     }
 }
 
@@ -336,19 +416,23 @@ void AccessNetDevice::ForwardMulticast(Ptr<const Packet> packet, uint16_t protoc
   /* FIXME Handle Link-local IPv4 (224.0.0.0/24) */
   /* FIXME Handle Link-local IPv6 (FF02::1) */
 
-  /* Use membership to forward */
-  for (auto &iter :m_portMap)
+  /* Use membership index to forward */
+  auto members = m_mcastActiveGroups.find(group);
+
+  if (members == m_mcastActiveGroups.end())
+    return;
+
+  /* Members share the frame, each port copies it only when it goes out */
+  for (const Mac48Address &cpe : members->second)
     {
-      const AccessPort& access = iter.second;
+      AccessPort *access = m_portMap.Find(cpe);
 
-      if (access.IsMember(group))
-        {
-          Ptr<NetDevice> port = access.GetAccessPort();
-          if (port->IsLinkUp())
-            {
-              port->SendFrom(packet->Copy(), src, dst, protocol);
-            }
-        }
+      if (access == nullptr || !access->IsMember(group))
+        continue;
+
+      Ptr<NetDevice> port = access->GetAccessPort();
+      if (port != nullptr && port->IsLinkUp())
+        access->Send(AccessPort::DOWNSTREAM, packet, src, dst, protocol);
     }
 }
 
@@ -362,61 +446,124 @@ bool AccessNetDevice::SendFrom(Ptr<Packet> packet, const Address& source,
   // use the learned state if destination is unicast
   if (!dst.IsGroup())
     {
-      Ptr<NetDevice> outPort = SelectAccessPortForMac(dst, packet);
-      if (outPort != NULL)
+      AccessPort *entry = SelectAccessPortForMac(dst, packet);
+      if (entry != nullptr)
         {
-          outPort->SendFrom(packet, source, dest, protocolNumber);
-          return true;
+          return entry->Send(AccessPort::DOWNSTREAM, packet, source, dest, protocolNumber);
         }
     }
 
   // not unicast or no state has been setup for that mac,
   // send through uplink port
-  m_uplink->SendFrom(packet, source, dest, protocolNumber);
-
-  return true;
+  return SendUpstream(packet, source, dest, protocolNumber);
 }
 
 void AccessNetDevice::LearnAccessPort(Mac48Address &source, Ptr<NetDevice> port, Ptr<const Packet> pkt)
 {
   NS_LOG_FUNCTION(this << source << port);
 
+  Time now = Simulator::Now();
   AccessPort &entry = m_portMap[source];
 
+  entry.SetTtl(now + m_portMapTtl);
+
   if (entry.GetAccessPort() == 0)
     {
       entry.SetAccessPort(this, port, source);
+      m_portHosts[port].insert(source);
+
+      if (!m_agingTimer.IsRunning())
+        {
+          m_portMap.SetAgingPeriod(m_portMapTtl);
+          m_agingTimer = Simulator::Schedule(m_portMap.GetAgingTick(),
+                                             &AccessNetDevice::HandleAgingTimer, this);
+        }
+
+      /* Refreshes only touch the TTL, the wheel re-files lazily */
+      m_portMap.Arm(source, now);
     }
 
-  entry.SetTtl(Simulator::Now() + m_portMapTtl);
   entry.AccPacket(AccessPort::UPSTREAM, pkt);
 }
 
-Ptr<NetDevice> AccessNetDevice::SelectAccessPortForMac(Mac48Address &source, Ptr<const Packet> pkt)
+AccessPort *AccessNetDevice::SelectAccessPortForMac(Mac48Address &source, Ptr<const Packet> pkt)
 {
   NS_LOG_FUNCTION(this << source);
 
-  auto iter = m_portMap.find(source);
+  AccessPort *entry = m_portMap.Find(source);
 
-  if (iter != m_portMap.end())
+  if (entry != nullptr)
     {
-      Time now = Simulator::Now();
-      AccessPort &entry = iter->second;
-
-      if (entry.GetTtl() < now)
+      if (entry->GetTtl() < Simulator::Now())
         {
-          m_portMap.erase(iter);
+          ExpireAccessPort(source);
         }
-      else if (entry.GetShowTime())
+      else if (entry->GetShowTime())
         {
-          entry.AccPacket(AccessPort::DOWNSTREAM, pkt);
-          return entry.GetAccessPort();
+          entry->AccPacket(AccessPort::DOWNSTREAM, pkt);
+          return entry;
         }
     }
 
   return nullptr;
 }
 
+void AccessNetDevice::ExpireAccessPort(const Mac48Address &source)
+{
+  NS_LOG_FUNCTION(this << source);
+
+  AccessPort *entry = m_portMap.Find(source);
+
+  if (entry == nullptr)
+    return;
+
+  for (auto &group : entry->GetMulticastGroups())
+    SendIgmpLeaveUpstream(group, source);
+
+  /* Unhook from the physical port link-change dispatch */
+  auto hosts = m_portHosts.find(entry->GetAccessPort());
+
+  if (hosts != m_portHosts.end())
+    {
+      hosts->second.erase(source);
+      if (hosts->second.empty())
+        m_portHosts.erase(hosts);
+    }
+
+  m_portMap.Erase(source);
+}
+
+void AccessNetDevice::HandleAgingTimer(void)
+{
+  NS_LOG_FUNCTION(this);
+
+  for (auto &mac : m_portMap.Advance(Simulator::Now()))
+    ExpireAccessPort(mac);
+
+  /* Idle while there is nothing to age */
+  if (m_portMap.HasArmed())
+    m_agingTimer = Simulator::Schedule(m_portMap.GetAgingTick(),
+                                       &AccessNetDevice::HandleAgingTimer, this);
+}
+
+void AccessNetDevice::AccessPortLinkChanged(Ptr<NetDevice> port)
+{
+  NS_LOG_FUNCTION(this << port);
+
+  auto hosts = m_portHosts.find(port);
+
+  if (hosts == m_portHosts.end())
+    return;
+
+  for (auto &mac : hosts->second)
+    {
+      AccessPort *entry = m_portMap.Find(mac);
+
+      if (entry != nullptr)
+        entry->LinkStateChangedHandler();
+    }
+}
+
 bool AccessNetDevice::Send(Ptr<Packet> packet, const Address& dest,
                            uint16_t protocolNumber)
 {
@@ -690,27 +837,67 @@ void AccessNetDevice::HandleMCastQueryTimer(void)
   hIp.SetTtl(1);
   hIp.SetPayloadSize(hIgmp.GetSerializedSize());
 
-  Ptr<Packet> pktIp4 = Create<Packet>();
-  pktIp4->AddHeader(hIgmp);
-  pktIp4->AddHeader(hIp);
-  Mac48Address dst = Mac48Address::GetMulticast(multicastGroup);
+  /* Shared by every port this round, copies only add a reference */
+  m_mcastQuery = Create<Packet>();
+  m_mcastQuery->AddHeader(hIgmp);
+  m_mcastQuery->AddHeader(hIp);
 
   /* FIXME Prepare MLD query message */
 
-  /* Purge stale entries and query existing groups */
-  for (auto &iter : m_portMap)
+  /* Query each physical port once, whatever the number of CPEs behind it */
+  Simulator::Cancel(m_mcastQueryBatchEvent);
+  m_mcastQueryPorts.clear();
+  m_mcastQueryNext = 0;
+
+  for (auto &iter : m_portHosts)
+    m_mcastQueryPorts.push_back(iter.first);
+
+  uint32_t batches = (m_mcastQueryPorts.size() + m_mcastQueryBatch - 1) / m_mcastQueryBatch;
+  Time interval = Seconds(AccessPort::QUERY_INTERVAL);
+  Time spacing = batches > 1 ? Time::From(interval.GetTimeStep() / batches) : interval;
+
+  SendMCastQueryBatch(spacing);
+
+  m_mcastQueryTimer = Simulator::Schedule(interval, &AccessNetDevice::HandleMCastQueryTimer, this);
+}
+
+void AccessNetDevice::SendMCastQueryBatch(Time spacing)
+{
+  NS_LOG_FUNCTION(this << m_mcastQueryNext << m_mcastQueryPorts.size());
+
+  Mac48Address dst = Mac48Address::GetMulticast(Ipv4Address("224.0.0.1"));
+  uint32_t last = std::min<uint32_t>(m_mcastQueryNext + m_mcastQueryBatch, m_mcastQueryPorts.size());
+
+  for (; m_mcastQueryNext < last; ++m_mcastQueryNext)
     {
-      AccessPort& access = iter.second;
-      access.CleanupMulticastMembership();
-      Ptr<NetDevice> port = access.GetAccessPort();
-      if (port && port->IsLinkUp())
+      Ptr<NetDevice> port = m_mcastQueryPorts[m_mcastQueryNext];
+
+      /* Purge stale memberships of the subscribers on this port */
+      auto hosts = m_portHosts.find(port);
+
+      if (hosts == m_portHosts.end())
+        continue; /* every subscriber expired meanwhile */
+
+      for (auto &mac : hosts->second)
         {
-          port->SendFrom(pktIp4->Copy(), m_address, dst, Ipv4L3Protocol::PROT_NUMBER);
+          AccessPort *access = m_portMap.Find(mac);
+
+          if (access == nullptr)
+            continue;
+
+          for (auto &group : access->CleanupMulticastMembership())
+            SendIgmpLeaveUpstream(group, mac);
+        }
+
+      if (port->IsLinkUp())
+        {
+          port->SendFrom(m_mcastQuery->Copy(), m_address, dst, Ipv4L3Protocol::PROT_NUMBER);
         }
     }
 
-  m_mcastQueryTimer = Simulator::Schedule(Seconds(AccessPort::QUERY_INTERVAL),
-                                          &AccessNetDevice::HandleMCastQueryTimer, this);
+  if (m_mcastQueryNext < m_mcastQueryPorts.size())
+    m_mcastQueryBatchEvent = Simulator::Schedule(spacing, &AccessNetDevice::SendMCastQueryBatch,
+                                                 this, spacing);
 }
 
 void AccessNetDevice::SendIgmpJoinUpstream(const Address& group, const Mac48Address &src)
@@ -746,12 +933,15 @@ void AccessNetDevice::SendIgmpJoinUpstream(const Address& group, const Mac48Addr
 void AccessNetDevice::SendIgmpLeaveUpstream(const Address& group, const Mac48Address &src)
 {
   NS_LOG_FUNCTION(this << group);
-  if (m_mcastActiveGroups[group].empty())
+
+  auto members = m_mcastActiveGroups.find(group);
+
+  if (members == m_mcastActiveGroups.end())
     return;
 
-  m_mcastActiveGroups[group].erase(src);
+  members->second.erase(src);
 
-  if (m_mcastActiveGroups[group].empty())
+  if (members->second.empty())
     SendIgmpLeaveUpstream(group);
 }
 
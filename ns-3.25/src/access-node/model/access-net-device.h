@@ -24,9 +24,11 @@
 #include "ns3/access-channel.h"
 #include "ns3/mac48-address.h"
 #include "ns3/data-rate.h"
+#include "ns3/event-id.h"
 #include "ns3/access-profile.h"
 #include "ns3/mcast-profile.h"
 #include "ns3/access-port.h"
+#include "ns3/access-port-table.h"
 
 namespace ns3
 {
@@ -53,6 +55,20 @@ public:
  */
   void SetUplinkPort(Ptr< NetDevice > uplink);
 
+/**
+ * \brief Get Uplink port
+ */
+  Ptr<NetDevice> GetUplinkPort(void) const;
+
+/**
+ * \brief Send a frame out the Uplink port
+ *
+ * The port is looked up on each call, so line shapers created before the
+ * uplink is set send through it once it is.
+ */
+  bool SendUpstream(Ptr<Packet> packet, const Address& source,
+                    const Address& dest, uint16_t protocolNumber);
+
 /*
  * \brief Add access port
  */
@@ -74,6 +90,17 @@ public:
  */
   void AddAccessProfile(Ptr<AccessProfile>profile);
 
+/**
+ * \brief Number of subscribers learned behind a physical access port
+ */
+  uint32_t GetNPortHosts(Ptr<NetDevice> port) const;
+
+/**
+ * \brief Line shaper parameters, used when an Access Profile is applied
+ */
+  uint32_t GetShaperBurst(void) const;
+  uint32_t GetShaperQueueLimit(void) const;
+
 /**
  * Inherited from BridgedNetDevice
  */
@@ -115,7 +142,9 @@ protected:
 
   void LearnAccessPort(Mac48Address &source, Ptr<NetDevice> port, Ptr<const Packet> pkt);
 
-  Ptr<NetDevice> SelectAccessPortForMac(Mac48Address &source, Ptr<const Packet> pkt);
+  AccessPort *SelectAccessPortForMac(Mac48Address &source, Ptr<const Packet> pkt);
+
+  void ExpireAccessPort(const Mac48Address &source);
 
 private:
 
@@ -152,11 +181,21 @@ private:
 
   void HandleMCastQueryTimer(void);
 
+  void SendMCastQueryBatch(Time spacing);
+
+  void HandleAgingTimer(void);
+
+  void AccessPortLinkChanged(Ptr<NetDevice> port);
+
   NetDevice::ReceiveCallback m_rxCallback;
   NetDevice::PromiscReceiveCallback m_promiscRxCallback;
 
   Time m_portMapTtl;
-  std::map<Mac48Address, AccessPort > m_portMap;
+  AccessPortTable m_portMap;
+  EventId m_agingTimer;
+
+  /* Subscribers learned behind each physical access port */
+  std::map<Ptr<NetDevice>, std::set<Mac48Address> > m_portHosts;
 
   Ptr< NetDevice > m_uplink;
   std::vector< Ptr<NetDevice> > m_access_ports;
@@ -168,12 +207,25 @@ private:
   uint16_t m_mtu;
 
   Ptr<AncpAnAgent> m_agent;
+  uint32_t m_shaperBurst;
+  uint32_t m_shaperQueueLimit;
 
   std::map<std::string, Ptr<AccessProfile> > m_accessProfiles;
   std::map<std::string, Ptr<MCastProfile> > m_mcastProfiles;
 
   EventId m_mcastQueryTimer;
 
+  /* General query fan-out: one shared query packet per interval, sent to
+   * each physical port once, in batches spread over the interval */
+  Ptr<Packet> m_mcastQuery;
+  std::vector< Ptr<NetDevice> > m_mcastQueryPorts;
+  uint32_t m_mcastQueryNext;
+  uint32_t m_mcastQueryBatch;
+  EventId m_mcastQueryBatchEvent;
+
+  /* Multicast forwarding index: group -> subscribers (CPE MAC) joined to it.
+   * Kept in sync by snooping, NAS commands and membership cleanup, so
+   * ForwardMulticast only visits actual members. */
   std::map<Address, std::set<Mac48Address> > m_mcastActiveGroups;
   Ptr < Socket > m_sock_igmp;     //!< IGMP socket
 };
@@ -0,0 +1,355 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2015 UFRGS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Alexsander de Souza <asouza@inf.ufrgs.br>
+ */
+
+#include <algorithm>
+#include "ns3/log.h"
+#include "ns3/assert.h"
+#include "ns3/net-device.h"
+#include "access-net-device.h"
+#include "access-port-table.h"
+
+namespace ns3
+{
+NS_LOG_COMPONENT_DEFINE("AccessPortTable");
+
+const uint32_t AccessPortTable::WHEEL_SLOTS = 64;
+const uint32_t AccessPortTable::EMPTY = 0xFFFFFFFF;
+
+static const uint32_t INITIAL_SLOTS = 256; /* power of 2 */
+
+AccessPortTable::Iterator::Iterator(std::deque<Entry>::iterator it,
+                                    std::deque<Entry>::iterator end) :
+  m_it(it),
+  m_end(end)
+{
+  SkipFree();
+}
+
+AccessPortTable::Value &AccessPortTable::Iterator::operator*() const
+{
+  return m_it->value;
+}
+
+AccessPortTable::Value *AccessPortTable::Iterator::operator->() const
+{
+  return &m_it->value;
+}
+
+AccessPortTable::Iterator &AccessPortTable::Iterator::operator++()
+{
+  ++m_it;
+  SkipFree();
+  return *this;
+}
+
+bool AccessPortTable::Iterator::operator!=(const Iterator &other) const
+{
+  return m_it != other.m_it;
+}
+
+void AccessPortTable::Iterator::SkipFree()
+{
+  while (m_it != m_end && !m_it->used)
+    ++m_it;
+}
+
+AccessPortTable::AccessPortTable() :
+  m_mask(INITIAL_SLOTS - 1),
+  m_size(0),
+  m_wheel(WHEEL_SLOTS),
+  m_wheelPos(0),
+  m_wheelTick(Seconds(1)),
+  m_armed(0)
+{
+  NS_LOG_FUNCTION_NOARGS();
+  m_slots.assign(INITIAL_SLOTS, Slot {0, EMPTY});
+}
+
+AccessPortTable::~AccessPortTable()
+{
+  NS_LOG_FUNCTION_NOARGS();
+}
+
+uint64_t AccessPortTable::MakeKey(const Mac48Address &mac)
+{
+  uint8_t buf[6];
+  mac.CopyTo(buf);
+
+  uint64_t key = 0;
+  for (int i = 0; i < 6; ++i)
+    key = (key << 8) | buf[i];
+
+  return key;
+}
+
+uint32_t AccessPortTable::Hash(uint64_t key) const
+{
+  /* Fibonacci hashing, CPE MACs are mostly sequential */
+  return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & m_mask;
+}
+
+uint32_t AccessPortTable::Lookup(uint64_t key) const
+{
+  for (uint32_t pos = Hash(key);; pos = (pos + 1) & m_mask)
+    {
+      const Slot &slot = m_slots[pos];
+
+      if (slot.index == EMPTY)
+        return EMPTY;
+
+      if (slot.key == key)
+        return slot.index;
+    }
+}
+
+void AccessPortTable::Insert(uint64_t key, uint32_t index)
+{
+  uint32_t pos = Hash(key);
+
+  while (m_slots[pos].index != EMPTY)
+    pos = (pos + 1) & m_mask;
+
+  m_slots[pos].key = key;
+  m_slots[pos].index = index;
+}
+
+void AccessPortTable::Grow()
+{
+  NS_LOG_FUNCTION(this << m_slots.size());
+
+  std::vector<Slot> old;
+  old.swap(m_slots);
+
+  m_slots.assign(old.size() * 2, Slot {0, EMPTY});
+  m_mask = m_slots.size() - 1;
+
+  for (auto &slot : old)
+    {
+      if (slot.index != EMPTY)
+        Insert(slot.key, slot.index);
+    }
+}
+
+AccessPort *AccessPortTable::Find(const Mac48Address &mac)
+{
+  uint32_t index = Lookup(MakeKey(mac));
+
+  if (index == EMPTY)
+    return nullptr;
+
+  return &m_pool[index].value.second;
+}
+
+AccessPort &AccessPortTable::operator[](const Mac48Address &mac)
+{
+  uint64_t key = MakeKey(mac);
+  uint32_t index = Lookup(key);
+
+  if (index != EMPTY)
+    return m_pool[index].value.second;
+
+  /* Keep load factor under 1/2 */
+  if (2 * (m_size + 1) > m_slots.size())
+    Grow();
+
+  if (m_free.empty())
+    {
+      index = m_pool.size();
+      m_pool.emplace_back();
+    }
+  else
+    {
+      index = m_free.back();
+      m_free.pop_back();
+    }
+
+  Entry &entry = m_pool[index];
+  entry.value.first = mac;
+  entry.used = true;
+
+  Insert(key, index);
+  ++m_size;
+
+  return entry.value.second;
+}
+
+void AccessPortTable::Erase(const Mac48Address &mac)
+{
+  uint64_t key = MakeKey(mac);
+  uint32_t pos = Hash(key);
+
+  while (m_slots[pos].index != EMPTY && m_slots[pos].key != key)
+    pos = (pos + 1) & m_mask;
+
+  if (m_slots[pos].index == EMPTY)
+    return;
+
+  Entry &entry = m_pool[m_slots[pos].index];
+  Disarm(entry);
+  entry.value.second = AccessPort();
+  entry.used = false;
+  m_free.push_back(m_slots[pos].index);
+  --m_size;
+
+  /* Backward-shift deletion, no tombstones */
+  uint32_t hole = pos;
+
+  for (uint32_t next = (pos + 1) & m_mask; m_slots[next].index != EMPTY; next = (next + 1) & m_mask)
+    {
+      uint32_t home = Hash(m_slots[next].key);
+
+      /* Move it if its home is not in the cyclic range (hole, next] */
+      if (((next - home) & m_mask) >= ((next - hole) & m_mask))
+        {
+          m_slots[hole] = m_slots[next];
+          hole = next;
+        }
+    }
+
+  m_slots[hole].index = EMPTY;
+}
+
+void AccessPortTable::Clear()
+{
+  NS_LOG_FUNCTION(this);
+
+  m_slots.assign(INITIAL_SLOTS, Slot {0, EMPTY});
+  m_mask = INITIAL_SLOTS - 1;
+  m_size = 0;
+  m_pool.clear();
+  m_free.clear();
+
+  for (auto &bucket : m_wheel)
+    bucket.clear();
+  m_armed = 0;
+}
+
+uint32_t AccessPortTable::GetSize() const
+{
+  return m_size;
+}
+
+AccessPortTable::Iterator AccessPortTable::begin()
+{
+  return Iterator(m_pool.begin(), m_pool.end());
+}
+
+AccessPortTable::Iterator AccessPortTable::end()
+{
+  return Iterator(m_pool.end(), m_pool.end());
+}
+
+void AccessPortTable::SetAgingPeriod(Time ttl)
+{
+  NS_LOG_FUNCTION(this << ttl);
+  m_wheelTick = Time::From(std::max<int64_t>(ttl.GetTimeStep() / WHEEL_SLOTS, 1));
+}
+
+Time AccessPortTable::GetAgingTick() const
+{
+  return m_wheelTick;
+}
+
+uint32_t AccessPortTable::WheelOffset(Time deadline, Time now) const
+{
+  int64_t delta = (deadline - now).GetTimeStep();
+  int64_t tick = m_wheelTick.GetTimeStep();
+  int64_t offset = (delta + tick - 1) / tick;
+
+  /* Never the bucket being processed, far deadlines are re-filed later */
+  return std::min<int64_t>(std::max<int64_t>(offset, 1), WHEEL_SLOTS - 1);
+}
+
+void AccessPortTable::Arm(const Mac48Address &mac, Time now)
+{
+  uint32_t index = Lookup(MakeKey(mac));
+
+  if (index == EMPTY)
+    return;
+
+  Entry &entry = m_pool[index];
+
+  if (entry.wheelSlot >= 0)
+    return; /* already armed, refreshed TTL is handled lazily */
+
+  uint32_t slot = (m_wheelPos + WheelOffset(entry.value.second.GetTtl(), now)) % WHEEL_SLOTS;
+
+  m_wheel[slot].push_back(index);
+  entry.wheelSlot = slot;
+  ++m_armed;
+}
+
+void AccessPortTable::Disarm(Entry &entry)
+{
+  if (entry.wheelSlot < 0)
+    return;
+
+  /* Bucket reference is left behind, it'll be skipped */
+  entry.wheelSlot = -1;
+  --m_armed;
+}
+
+bool AccessPortTable::HasArmed() const
+{
+  return m_armed > 0;
+}
+
+std::list<Mac48Address> AccessPortTable::Advance(Time now)
+{
+  NS_LOG_FUNCTION(this << now);
+
+  std::list<Mac48Address> expired;
+  std::vector<uint32_t> bucket;
+
+  bucket.swap(m_wheel[m_wheelPos]);
+
+  for (uint32_t index : bucket)
+    {
+      Entry &entry = m_pool[index];
+
+      /* Stale reference: erased, re-filed or reused since */
+      if (!entry.used || entry.wheelSlot != (int32_t)m_wheelPos)
+        continue;
+
+      Time ttl = entry.value.second.GetTtl();
+
+      if (ttl < now)
+        {
+          Disarm(entry);
+          expired.push_back(entry.value.first);
+        }
+      else
+        {
+          uint32_t slot = (m_wheelPos + WheelOffset(ttl, now)) % WHEEL_SLOTS;
+          m_wheel[slot].push_back(index);
+          entry.wheelSlot = slot;
+        }
+    }
+
+  /* Give the storage back, avoid reallocating every lap */
+  bucket.clear();
+  if (m_wheel[m_wheelPos].empty())
+    m_wheel[m_wheelPos].swap(bucket);
+
+  m_wheelPos = (m_wheelPos + 1) % WHEEL_SLOTS;
+
+  return expired;
+}
+} //  namespace ns3
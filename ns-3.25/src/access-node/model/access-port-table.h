@@ -0,0 +1,161 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2015 UFRGS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Alexsander de Souza <asouza@inf.ufrgs.br>
+ */
+#ifndef __ACCESS_PORT_TABLE_H__
+#define __ACCESS_PORT_TABLE_H__
+
+#include <deque>
+#include <list>
+#include <vector>
+#include "ns3/nstime.h"
+#include "ns3/mac48-address.h"
+#include "ns3/data-rate.h"
+#include "ns3/access-profile.h"
+#include "ns3/mcast-profile.h"
+#include "ns3/access-port.h"
+
+namespace ns3
+{
+/**
+ * \brief Subscriber table of an Access Node, indexed by CPE MAC
+ *
+ * Open addressing hash (linear probing, backward-shift deletion) over
+ * the 48-bit MAC. Entries live in a stable pool, so references to an
+ * AccessPort stay valid until the entry is erased.
+ *
+ * Aging uses a timing wheel spanning the entry TTL. Refreshing an entry
+ * only updates its TTL; when its bucket fires the entry is either
+ * re-filed or reported as expired, so each tick costs O(bucket).
+ */
+class AccessPortTable
+{
+private:
+  typedef std::pair<Mac48Address, AccessPort> Value;
+
+  struct Entry
+  {
+    Entry() : used(false), wheelSlot(-1) {}
+
+    Value value;
+    bool used;
+    int32_t wheelSlot;  /*!< Wheel bucket holding this entry, -1 if not armed */
+  };
+
+public:
+  static const uint32_t WHEEL_SLOTS;   /*!< Timing wheel resolution */
+
+  class Iterator
+  {
+  public:
+    Iterator(std::deque<Entry>::iterator it, std::deque<Entry>::iterator end);
+
+    Value &operator*() const;
+    Value *operator->() const;
+    Iterator &operator++();
+    bool operator!=(const Iterator &other) const;
+
+  private:
+    void SkipFree();
+
+    std::deque<Entry>::iterator m_it;
+    std::deque<Entry>::iterator m_end;
+  };
+
+  AccessPortTable();
+  ~AccessPortTable();
+
+  /**
+   * \brief Lookup an entry
+   * \return entry or nullptr if not present
+   */
+  AccessPort *Find(const Mac48Address &mac);
+
+  /**
+   * \brief Lookup an entry, creating a blank one if not present
+   */
+  AccessPort &operator[](const Mac48Address &mac);
+
+  void Erase(const Mac48Address &mac);
+  void Clear();
+  uint32_t GetSize() const;
+
+  Iterator begin();
+  Iterator end();
+
+  /**
+   * \brief Set the time span covered by the timing wheel
+   * \param ttl         entry time-to-live
+   */
+  void SetAgingPeriod(Time ttl);
+
+  /**
+   * \return interval between wheel ticks
+   */
+  Time GetAgingTick() const;
+
+  /**
+   * \brief Put an entry under aging control, using its current TTL
+   * \param mac         entry key
+   * \param now         current time
+   */
+  void Arm(const Mac48Address &mac, Time now);
+
+  /**
+   * \return true if any entry is under aging control
+   */
+  bool HasArmed() const;
+
+  /**
+   * \brief Process the current wheel bucket and move to the next one
+   * \param now         current time
+   * \return entries whose TTL is over, still present in the table
+   */
+  std::list<Mac48Address> Advance(Time now);
+
+private:
+  struct Slot
+  {
+    uint64_t key;
+    uint32_t index;   /*!< Pool index, EMPTY if free */
+  };
+
+  static const uint32_t EMPTY;
+
+  static uint64_t MakeKey(const Mac48Address &mac);
+  uint32_t Hash(uint64_t key) const;
+  uint32_t Lookup(uint64_t key) const;
+  void Insert(uint64_t key, uint32_t index);
+  void Grow();
+  uint32_t WheelOffset(Time deadline, Time now) const;
+  void Disarm(Entry &entry);
+
+  std::vector<Slot> m_slots;
+  uint32_t m_mask;
+  uint32_t m_size;
+
+  std::deque<Entry> m_pool;
+  std::vector<uint32_t> m_free;
+
+  std::vector<std::vector<uint32_t> > m_wheel;
+  uint32_t m_wheelPos;
+  Time m_wheelTick;
+  uint32_t m_armed;
+};
+} //  namespace ns3
+#endif /* __ACCESS_PORT_TABLE_H__ */
@@ -57,6 +57,8 @@ AccessPort::~AccessPort()
   NS_LOG_FUNCTION_NOARGS();
   m_accessNode = nullptr;
   m_access_prof = nullptr;
+  m_shaper[DOWNSTREAM] = nullptr;
+  m_shaper[UPSTREAM] = nullptr;
   m_mcast_prof = nullptr;
   m_port = nullptr;
 }
@@ -118,7 +120,8 @@ void AccessPort::SetAccessPort(Ptr<AccessNetDevice> anDev,
   os << source;
   m_circuitId = os.str();
 
-  m_port->AddLinkChangeCallback(MakeCallback(&AccessPort::LinkStateChangedHandler, this));
+  if (m_access_prof != nullptr)
+    ConfigureShapers(); /* Provisioned before the CPE showed up */
 
   if (m_port->IsLinkUp())
     SetShowTime(true); /* Already up */
@@ -165,19 +168,54 @@ int AccessPort::ApplyProfile(Ptr<AccessProfile>prof)
   if (m_port == nullptr)
     return 0; /* Done for now */
 
-  Ptr<Channel> chan = m_port->GetChannel();
+  ConfigureShapers();
 
-  for (uint32_t i = 0; i < chan->GetNDevices(); ++i)
-    {
-      Ptr<CsmaNetDevice> dev = DynamicCast<CsmaNetDevice, NetDevice>(chan->GetDevice(i));
+  return 0;
+}
+
+void AccessPort::ConfigureShapers()
+{
+  NS_LOG_FUNCTION(this);
+
+  DataRate rates[2];
+  rates[DOWNSTREAM] = m_access_prof->GetDownstreamRate();
+  rates[UPSTREAM] = m_access_prof->GetUpstreamRate();
 
-      if (dev == m_port)
-        dev->SetDataRate(m_access_prof->GetDownstreamRate());
+  /* The uplink is resolved per packet, it may not be set yet */
+  TokenBucketShaper::SendCallback egress[2];
+  egress[DOWNSTREAM] = MakeCallback(&NetDevice::SendFrom, m_port);
+  egress[UPSTREAM] = MakeCallback(&AccessNetDevice::SendUpstream, m_accessNode);
+
+  for (int dir = DOWNSTREAM; dir <= UPSTREAM; ++dir)
+    {
+      if (rates[dir].GetBitRate() == 0)
+        {
+          m_shaper[dir] = nullptr; /* unshaped */
+        }
+      else if (m_shaper[dir] != nullptr)
+        {
+          m_shaper[dir]->SetRate(rates[dir]);
+        }
       else
-        dev->SetDataRate(m_access_prof->GetUpstreamRate());
+        {
+          m_shaper[dir] = Create<TokenBucketShaper>(rates[dir],
+                                                    m_accessNode->GetShaperBurst(),
+                                                    m_accessNode->GetShaperQueueLimit(),
+                                                    egress[dir]);
+        }
     }
+}
 
-  return 0;
+bool AccessPort::Send(enum AccessPort::PacketDir dir, Ptr<const Packet> pkt, const Address &src,
+                      const Address &dst, uint16_t protocol)
+{
+  if (m_shaper[dir] != nullptr)
+    return m_shaper[dir]->Send(pkt, src, dst, protocol);
+
+  if (dir == DOWNSTREAM)
+    return m_port->SendFrom(pkt->Copy(), src, dst, protocol);
+
+  return m_accessNode->SendUpstream(pkt->Copy(), src, dst, protocol);
 }
 
 void AccessPort::AccPacket(enum AccessPort::PacketDir dir, Ptr<const Packet> pkt)
@@ -289,10 +327,23 @@ bool AccessPort::IsMember(const Address &mcGroup) const
   return true;
 }
 
-void AccessPort::CleanupMulticastMembership()
+std::list<Address> AccessPort::GetMulticastGroups() const
+{
+  NS_LOG_FUNCTION(this);
+
+  std::list<Address> groups;
+
+  for (auto &iter: m_mcastGroups)
+    groups.push_back(iter.first);
+
+  return groups;
+}
+
+std::list<Address> AccessPort::CleanupMulticastMembership()
 {
   NS_LOG_FUNCTION(this);
 
+  std::list<Address> expired;
   auto it = m_mcastGroups.begin();
 
   while (it != m_mcastGroups.end())
@@ -300,10 +351,14 @@ void AccessPort::CleanupMulticastMembership()
       auto cur = it;
       ++it;
 
-      if ((Simulator::Now() - cur->second) > (2 * QUERY_INTERVAL))
+      if ((Simulator::Now() - cur->second) > Seconds(2 * QUERY_INTERVAL))
         {
-          LeaveMulticastGroup(cur->first);
+          Address group = cur->first;
+          if (LeaveMulticastGroup(group))
+            expired.push_back(group);
         }
     }
+
+  return expired;
 }
 }
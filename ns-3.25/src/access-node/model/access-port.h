@@ -21,8 +21,10 @@
 #define __ACCESS_PORT_H__
 
 #include <map>
+#include <list>
 #include "ns3/address.h"
 #include "ns3/nstime.h"
+#include "ns3/token-bucket-shaper.h"
 
 namespace ns3
 {
@@ -63,14 +65,39 @@ public:
 
   void AccPacket(enum PacketDir dir, Ptr<const Packet>pkt);
 
+  /**
+   * \brief Send a packet to/from this subscriber, through the line shaper
+   * when an access profile is applied
+   *
+   * The packet is not modified, the egress device gets a copy when it is
+   * actually sent.
+   * \return false if the packet was dropped
+   */
+  bool Send(enum PacketDir dir, Ptr<const Packet>pkt, const Address &src,
+            const Address &dst, uint16_t protocol);
+
   void NasInitiatedMulticastGroup(const Address &mcGroup, bool allow);
   bool EnterMulticastGroup(const Address &mcGroup);
   bool LeaveMulticastGroup(const Address &mcGroup);
   bool IsMember(const Address &mcGroup) const;
-  void CleanupMulticastMembership();
+  std::list<Address> GetMulticastGroups() const;
+
+  /**
+   * \brief Drop memberships not refreshed for two query intervals
+   * \return groups that were left
+   */
+  std::list<Address> CleanupMulticastMembership();
+
+  /**
+   * \brief Update showtime after a physical port state change
+   *
+   * Called by the AccessNetDevice, which owns the link-change callback of
+   * the physical port.
+   */
+  void LinkStateChangedHandler(void);
 
 private:
-  void LinkStateChangedHandler(void);
+  void ConfigureShapers();
 
   Ptr<AccessNetDevice>m_accessNode;
   Ptr<NetDevice>m_port;
@@ -85,6 +112,7 @@ private:
   uint64_t m_dsPkts;
 
   Ptr<AccessProfile> m_access_prof;
+  Ptr<TokenBucketShaper> m_shaper[2];   /*!< Indexed by PacketDir */
   Ptr<MCastProfile> m_mcast_prof;
 
   std::map < Address, Time > m_mcastGroups;
@@ -0,0 +1,153 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2015 UFRGS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Alexsander de Souza <asouza@inf.ufrgs.br>
+ */
+
+#include <cmath>
+#include <algorithm>
+#include "ns3/log.h"
+#include "ns3/packet.h"
+#include "ns3/simulator.h"
+#include "token-bucket-shaper.h"
+
+namespace ns3
+{
+NS_LOG_COMPONENT_DEFINE("TokenBucketShaper");
+
+TokenBucketShaper::TokenBucketShaper(DataRate rate, uint32_t burst, uint32_t queueLimit,
+                                     SendCallback send) :
+  m_rate(rate),
+  m_burst(burst),
+  m_queueLimit(queueLimit),
+  m_send(send),
+  m_tokens(burst),
+  m_lastRefill(Simulator::Now()),
+  m_drops(0)
+{
+  NS_LOG_FUNCTION(this << rate << burst << queueLimit);
+}
+
+TokenBucketShaper::~TokenBucketShaper()
+{
+  NS_LOG_FUNCTION(this);
+  Simulator::Cancel(m_dequeueEvent);
+}
+
+void TokenBucketShaper::SetRate(DataRate rate)
+{
+  NS_LOG_FUNCTION(this << rate);
+
+  Refill();
+  m_rate = rate;
+
+  if (m_dequeueEvent.IsRunning())
+    {
+      Simulator::Cancel(m_dequeueEvent);
+      ScheduleDequeue();
+    }
+}
+
+DataRate TokenBucketShaper::GetRate() const
+{
+  return m_rate;
+}
+
+void TokenBucketShaper::Refill()
+{
+  Time now = Simulator::Now();
+
+  m_tokens += m_rate.GetBitRate() * (now - m_lastRefill).GetSeconds() / 8;
+  m_tokens = std::min<double>(m_tokens, m_burst);
+  m_lastRefill = now;
+}
+
+bool TokenBucketShaper::Conforms(uint32_t size) const
+{
+  /* Packets larger than the bucket go out on a full bucket */
+  return m_tokens >= std::min(size, m_burst);
+}
+
+bool TokenBucketShaper::Send(Ptr<const Packet> packet, const Address &src, const Address &dst, uint16_t protocol)
+{
+  NS_LOG_FUNCTION(this << packet);
+
+  Refill();
+
+  uint32_t size = packet->GetSize();
+
+  if (m_queue.empty() && Conforms(size))
+    {
+      m_tokens -= size;
+      return m_send(packet->Copy(), src, dst, protocol);
+    }
+
+  if (m_queue.size() >= m_queueLimit)
+    {
+      NS_LOG_LOGIC(this << " queue full, dropping");
+      ++m_drops;
+      return false;
+    }
+
+  m_queue.push_back(Item {packet, src, dst, protocol});
+
+  if (!m_dequeueEvent.IsRunning())
+    ScheduleDequeue();
+
+  return true;
+}
+
+void TokenBucketShaper::ScheduleDequeue()
+{
+  uint32_t size = std::min(m_queue.front().packet->GetSize(), m_burst);
+  double missing = std::max(size - m_tokens, 0.0);
+
+  /* One event per conforming packet, never a zero delay retry */
+  int64_t ns = std::ceil(missing * 8e9 / m_rate.GetBitRate());
+  m_dequeueEvent = Simulator::Schedule(NanoSeconds(std::max<int64_t>(ns, 1)),
+                                       &TokenBucketShaper::Dequeue, this);
+}
+
+void TokenBucketShaper::Dequeue()
+{
+  NS_LOG_FUNCTION(this << m_queue.size());
+
+  Refill();
+
+  while (!m_queue.empty() && Conforms(m_queue.front().packet->GetSize()))
+    {
+      Item item = m_queue.front();
+      m_queue.pop_front();
+
+      m_tokens -= item.packet->GetSize();
+      m_send(item.packet->Copy(), item.src, item.dst, item.protocol);
+    }
+
+  if (!m_queue.empty())
+    ScheduleDequeue();
+}
+
+uint32_t TokenBucketShaper::GetQueueSize() const
+{
+  return m_queue.size();
+}
+
+uint64_t TokenBucketShaper::GetDrops() const
+{
+  return m_drops;
+}
+} //  namespace ns3
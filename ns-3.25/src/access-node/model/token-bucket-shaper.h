@@ -0,0 +1,98 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2015 UFRGS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Alexsander de Souza <asouza@inf.ufrgs.br>
+ */
+#ifndef __TOKEN_BUCKET_SHAPER_H__
+#define __TOKEN_BUCKET_SHAPER_H__
+
+#include <deque>
+#include "ns3/simple-ref-count.h"
+#include "ns3/callback.h"
+#include "ns3/address.h"
+#include "ns3/data-rate.h"
+#include "ns3/event-id.h"
+#include "ns3/nstime.h"
+
+namespace ns3
+{
+class Packet;
+
+/**
+ * \brief Token bucket shaper for one direction of a subscriber line
+ *
+ * Conforming packets go straight to the egress. Otherwise they wait in a
+ * FIFO bounded by the queue limit, and a single event is scheduled for
+ * the time the head packet has enough tokens.
+ *
+ * Packets are taken read-only, so a frame replicated to many ports is
+ * queued once; the egress gets its own copy, to add headers to, only
+ * when the packet is sent.
+ */
+class TokenBucketShaper : public SimpleRefCount<TokenBucketShaper>
+{
+public:
+  typedef Callback<bool, Ptr<Packet>, const Address &, const Address &, uint16_t> SendCallback;
+
+  /**
+   * \param rate        sustained rate
+   * \param burst       bucket size, in bytes
+   * \param queueLimit  max number of packets waiting for tokens
+   * \param send        egress, usually NetDevice::SendFrom
+   */
+  TokenBucketShaper(DataRate rate, uint32_t burst, uint32_t queueLimit, SendCallback send);
+  ~TokenBucketShaper();
+
+  void SetRate(DataRate rate);
+  DataRate GetRate() const;
+
+  /**
+   * \brief Send a packet, or queue it until it conforms
+   * \return false if the packet was dropped
+   */
+  bool Send(Ptr<const Packet> packet, const Address &src, const Address &dst, uint16_t protocol);
+
+  uint32_t GetQueueSize() const;
+  uint64_t GetDrops() const;
+
+private:
+  struct Item
+  {
+    Ptr<const Packet> packet;
+    Address src;
+    Address dst;
+    uint16_t protocol;
+  };
+
+  void Refill();
+  bool Conforms(uint32_t size) const;
+  void ScheduleDequeue();
+  void Dequeue();
+
+  DataRate m_rate;
+  uint32_t m_burst;
+  uint32_t m_queueLimit;
+  SendCallback m_send;
+
+  double m_tokens;        /*!< Available bytes, may go negative for oversized packets */
+  Time m_lastRefill;
+  std::deque<Item> m_queue;
+  EventId m_dequeueEvent;
+  uint64_t m_drops;
+};
+} //  namespace ns3
+#endif /* __TOKEN_BUCKET_SHAPER_H__ */
@@ -1,55 +1,493 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2015 UFRGS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Alexsander de Souza <asouza@inf.ufrgs.br>
+ */
 
-// Include a header file from your module to test.
-#include "ns3/access-node.h"
-
-// An essential include is test.h
+#include <algorithm>
+#include <vector>
 #include "ns3/test.h"
+#include "ns3/simulator.h"
+#include "ns3/packet.h"
+#include "ns3/string.h"
+#include "ns3/node-container.h"
+#include "ns3/net-device-container.h"
+#include "ns3/csma-helper.h"
+#include "ns3/csma-channel.h"
+#include "ns3/csma-net-device.h"
+#include "ns3/internet-stack-helper.h"
+#include "ns3/ipv4-address-helper.h"
+#include "ns3/access-channel.h"
+#include "ns3/access-port-table.h"
+#include "ns3/access-net-device.h"
+#include "ns3/access-node-helper.h"
+#include "ns3/token-bucket-shaper.h"
 
-// Do not put your test classes in namespace ns3.  You may find it useful
-// to use the using directive to access the ns3 namespace directly
 using namespace ns3;
 
-// This is an example TestCase.
-class AccessNodeTestCase1 : public TestCase
+static Mac48Address
+MakeMac(uint64_t key)
+{
+  uint8_t buf[6];
+
+  for (int i = 5; i >= 0; --i, key >>= 8)
+    buf[i] = key & 0xFF;
+
+  Mac48Address mac;
+  mac.CopyFrom(buf);
+  return mac;
+}
+
+/* Same hash as the table, with its initial 256 slots */
+static uint32_t
+HomeSlot(uint64_t key)
+{
+  return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & 255;
+}
+
+/* MACs whose home slot is the given one */
+static std::vector<Mac48Address>
+FindMacs(uint32_t slot, uint32_t count)
+{
+  std::vector<Mac48Address> macs;
+
+  for (uint64_t key = 1; macs.size() < count; ++key)
+    {
+      if (HomeSlot(key) == slot)
+        macs.push_back(MakeMac(key));
+    }
+
+  return macs;
+}
+
+class AccessPortTableWrapTestCase : public TestCase
+{
+public:
+  AccessPortTableWrapTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void CheckPresent (AccessPortTable &table, const std::vector<Mac48Address> &macs,
+                     const std::vector<bool> &present);
+};
+
+AccessPortTableWrapTestCase::AccessPortTableWrapTestCase ()
+  : TestCase ("Insert and erase around a cluster wrapping the end of the table")
+{
+}
+
+void
+AccessPortTableWrapTestCase::CheckPresent (AccessPortTable &table, const std::vector<Mac48Address> &macs,
+                                           const std::vector<bool> &present)
+{
+  for (uint32_t i = 0; i < macs.size (); ++i)
+    {
+      AccessPort *entry = table.Find (macs[i]);
+
+      if (!present[i])
+        {
+          NS_TEST_EXPECT_MSG_EQ ((entry == nullptr), true, "Erased entry " << macs[i] << " still found");
+          continue;
+        }
+
+      NS_TEST_EXPECT_MSG_NE ((entry == nullptr), true, "Entry " << macs[i] << " lost");
+      if (entry != nullptr)
+        NS_TEST_EXPECT_MSG_EQ (entry->GetTtl (), Seconds (i + 1), "Wrong entry for " << macs[i]);
+    }
+}
+
+void
+AccessPortTableWrapTestCase::DoRun (void)
+{
+  AccessPortTable table;
+
+  /* A cluster homed at the two last slots, spilling over slots 0 and 1,
+   * followed by entries homed at slot 0 that get pushed further */
+  std::vector<Mac48Address> macs = FindMacs (254, 2);
+  std::vector<Mac48Address> tail = FindMacs (255, 3);
+  std::vector<Mac48Address> head = FindMacs (0, 2);
+
+  macs.insert (macs.end (), tail.begin (), tail.end ());
+  macs.insert (macs.end (), head.begin (), head.end ());
+
+  std::vector<bool> present (macs.size (), true);
+
+  for (uint32_t i = 0; i < macs.size (); ++i)
+    table[macs[i]].SetTtl (Seconds (i + 1));
+
+  NS_TEST_ASSERT_MSG_EQ (table.GetSize (), macs.size (), "Wrong table size");
+  CheckPresent (table, macs, present);
+
+  /* Holes at the end of the table must pull wrapped entries back */
+  uint32_t order[] = { 2, 0, 5, 3 };
+
+  for (uint32_t i : order)
+    {
+      table.Erase (macs[i]);
+      present[i] = false;
+      CheckPresent (table, macs, present);
+    }
+
+  NS_TEST_ASSERT_MSG_EQ (table.GetSize (), macs.size () - 4, "Wrong table size after erase");
+
+  /* Re-inserted entries go back into the shifted cluster */
+  for (uint32_t i : order)
+    {
+      table[macs[i]].SetTtl (Seconds (i + 1));
+      present[i] = true;
+    }
+
+  CheckPresent (table, macs, present);
+
+  /* Erasing an absent key leaves the table alone */
+  table.Erase (MakeMac (0xFFFFFFFFFFFFULL));
+  NS_TEST_ASSERT_MSG_EQ (table.GetSize (), macs.size (), "Erase of a missing key changed the size");
+}
+
+class AccessPortTableGrowTestCase : public TestCase
+{
+public:
+  AccessPortTableGrowTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+AccessPortTableGrowTestCase::AccessPortTableGrowTestCase ()
+  : TestCase ("Grow the table past its load factor")
+{
+}
+
+void
+AccessPortTableGrowTestCase::DoRun (void)
+{
+  AccessPortTable table;
+  const uint32_t count = 1000;   /* 256 initial slots, grows three times */
+
+  for (uint32_t i = 0; i < count; ++i)
+    {
+      AccessPort &entry = table[MakeMac (i + 1)];
+
+      NS_TEST_ASSERT_MSG_EQ (entry.GetTtl (), Time (0), "New entry is not blank");
+      entry.SetTtl (Seconds (i + 1));
+    }
+
+  NS_TEST_ASSERT_MSG_EQ (table.GetSize (), count, "Wrong table size");
+
+  for (uint32_t i = 0; i < count; ++i)
+    {
+      AccessPort *entry = table.Find (MakeMac (i + 1));
+
+      NS_TEST_ASSERT_MSG_NE ((entry == nullptr), true, "Entry lost while growing");
+      NS_TEST_EXPECT_MSG_EQ (entry->GetTtl (), Seconds (i + 1), "Wrong entry after growing");
+    }
+
+  /* Lookup of an existing key must not create a new entry */
+  table[MakeMac (1)];
+  NS_TEST_ASSERT_MSG_EQ (table.GetSize (), count, "Existing key inserted twice");
+
+  for (uint32_t i = 0; i < count; i += 2)
+    table.Erase (MakeMac (i + 1));
+
+  uint32_t iterated = 0;
+
+  for (auto &value : table)
+    {
+      NS_TEST_EXPECT_MSG_EQ (table.Find (value.first), &value.second, "Iterator out of sync with lookups");
+      ++iterated;
+    }
+
+  NS_TEST_ASSERT_MSG_EQ (table.GetSize (), count / 2, "Wrong table size after erase");
+  NS_TEST_ASSERT_MSG_EQ (iterated, count / 2, "Iterator visited erased entries");
+
+  for (uint32_t i = 1; i < count; i += 2)
+    NS_TEST_EXPECT_MSG_NE ((table.Find (MakeMac (i + 1)) == nullptr), true, "Entry lost after erase");
+}
+
+class AccessPortTableAgingTestCase : public TestCase
+{
+public:
+  AccessPortTableAgingTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+AccessPortTableAgingTestCase::AccessPortTableAgingTestCase ()
+  : TestCase ("Refreshed entries are re-filed on the aging wheel, not expired")
+{
+}
+
+void
+AccessPortTableAgingTestCase::DoRun (void)
+{
+  AccessPortTable table;
+  Mac48Address idle = MakeMac (1);
+  Mac48Address active = MakeMac (2);
+
+  /* 64s over 64 slots, one tick per second */
+  table.SetAgingPeriod (Seconds (64));
+  NS_TEST_ASSERT_MSG_EQ (table.GetAgingTick (), Seconds (1), "Wrong aging tick");
+
+  table[idle].SetTtl (Seconds (10));
+  table[active].SetTtl (Seconds (10));
+  table.Arm (idle, Seconds (0));
+  table.Arm (active, Seconds (0));
+  NS_TEST_ASSERT_MSG_EQ (table.HasArmed (), true, "Entries not armed");
+
+  Time idleExpired;
+  Time activeExpired;
+
+  for (uint32_t t = 1; t <= 120; ++t)
+    {
+      Time now = Seconds (t);
+
+      /* Refreshed only until its first deadline, then left to age */
+      if (t == 5)
+        table.Find (active)->SetTtl (Seconds (40));
+
+      for (auto &mac : table.Advance (now))
+        {
+          NS_TEST_ASSERT_MSG_NE ((table.Find (mac) == nullptr), true, "Expired entry not in the table");
+          NS_TEST_ASSERT_MSG_LT (table.Find (mac)->GetTtl (), now, "Entry expired before its TTL");
+
+          if (mac == idle)
+            idleExpired = now;
+          else if (mac == active)
+            activeExpired = now;
+
+          table.Erase (mac);
+        }
+    }
+
+  NS_TEST_ASSERT_MSG_EQ_TOL (idleExpired.GetSeconds (), 11, 1, "Idle entry expired at the wrong time");
+  NS_TEST_ASSERT_MSG_EQ_TOL (activeExpired.GetSeconds (), 41, 1, "Refreshed entry expired at the wrong time");
+  NS_TEST_ASSERT_MSG_EQ (table.HasArmed (), false, "Wheel still armed after all entries expired");
+  NS_TEST_ASSERT_MSG_EQ (table.GetSize (), 0, "Table not empty");
+}
+
+class AccessNetDeviceAgingTestCase : public TestCase
+{
+public:
+  AccessNetDeviceAgingTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void SendFromCpe (Ptr<NetDevice> cpe);
+  void CheckHosts (uint32_t expected);
+
+  Ptr<AccessNetDevice> m_anDev;
+  Ptr<NetDevice> m_port;
+};
+
+AccessNetDeviceAgingTestCase::AccessNetDeviceAgingTestCase ()
+  : TestCase ("Expired subscribers are removed from their access port")
+{
+}
+
+void
+AccessNetDeviceAgingTestCase::SendFromCpe (Ptr<NetDevice> cpe)
+{
+  cpe->Send (Create<Packet> (100), Mac48Address::GetBroadcast (), 0x0800);
+}
+
+void
+AccessNetDeviceAgingTestCase::CheckHosts (uint32_t expected)
+{
+  NS_TEST_EXPECT_MSG_EQ (m_anDev->GetNPortHosts (m_port), expected,
+                         "Wrong number of hosts at " << Simulator::Now ().GetSeconds () << "s");
+}
+
+void
+AccessNetDeviceAgingTestCase::DoRun (void)
+{
+  NodeContainer cpe;
+  cpe.Create (1);
+
+  NodeContainer an;
+  an.Create (2);   /* Access node and the NAS behind it */
+
+  CsmaHelper csma;
+  csma.SetChannelAttribute ("DataRate", StringValue ("1Gbps"));
+
+  NetDeviceContainer access = csma.Install (NodeContainer (cpe.Get (0), an.Get (0)));
+  NetDeviceContainer uplink = csma.Install (an);
+  NetDeviceContainer ports (access.Get (1));
+
+  AccessNodeHelper helper;
+  helper.SetDeviceAttribute ("ExpirationTime", TimeValue (Seconds (2)));
+  m_anDev = DynamicCast<AccessNetDevice> (helper.CreateAccessNodeDevice (an.Get (0), ports, uplink.Get (0)).Get (0));
+  m_port = access.Get (1);
+  m_port->SetLineProtocolStatus (true);
+
+  InternetStackHelper internet;
+  internet.Install (cpe);
+  internet.Install (an);
+
+  Ipv4AddressHelper ipv4;
+  ipv4.SetBase ("10.0.0.0", "255.255.0.0");
+  Ipv4InterfaceContainer nasInterfaces = ipv4.Assign (NetDeviceContainer (uplink.Get (1), DynamicCast<NetDevice> (m_anDev)));
+  ipv4.Assign (NetDeviceContainer (access.Get (0)));
+
+  /* No NAS listening, the agent only has to exist for port showtime */
+  helper.InstallAccessNodeControl (an.Get (0), nasInterfaces.GetAddress (0));
+
+  Simulator::Schedule (Seconds (1), &AccessNetDeviceAgingTestCase::SendFromCpe, this, access.Get (0));
+  Simulator::Schedule (Seconds (0.5), &AccessNetDeviceAgingTestCase::CheckHosts, this, 0);
+  Simulator::Schedule (Seconds (1.5), &AccessNetDeviceAgingTestCase::CheckHosts, this, 1);
+  Simulator::Schedule (Seconds (6), &AccessNetDeviceAgingTestCase::CheckHosts, this, 0);
+
+  Simulator::Stop (Seconds (10));
+  Simulator::Run ();
+  Simulator::Destroy ();
+
+  m_anDev = 0;
+  m_port = 0;
+}
+
+class AccessChannelGrowTestCase : public TestCase
+{
+public:
+  AccessChannelGrowTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+AccessChannelGrowTestCase::AccessChannelGrowTestCase ()
+  : TestCase ("Devices attached after a channel was added are indexed")
+{
+}
+
+void
+AccessChannelGrowTestCase::DoRun (void)
+{
+  std::vector<Ptr<CsmaChannel> > channels;
+  Ptr<AccessChannel> aggregate = CreateObject<AccessChannel> ();
+
+  for (uint32_t i = 0; i < 3; ++i)
+    {
+      channels.push_back (CreateObject<CsmaChannel> ());
+      channels[i]->Attach (CreateObject<CsmaNetDevice> ());
+      aggregate->AddChannel (channels[i]);
+    }
+
+  NS_TEST_ASSERT_MSG_EQ (aggregate->GetNDevices (), 3, "Wrong device count");
+  NS_TEST_ASSERT_MSG_EQ (aggregate->GetDevice (2), channels[2]->GetDevice (0), "Wrong last device");
+
+  /* Growth of the first channel shifts every device after it */
+  Ptr<CsmaNetDevice> late = CreateObject<CsmaNetDevice> ();
+  channels[0]->Attach (late);
+
+  NS_TEST_ASSERT_MSG_EQ (aggregate->GetNDevices (), 4, "Stale device count");
+  NS_TEST_ASSERT_MSG_EQ (aggregate->GetDevice (1), late, "Late device not indexed");
+  NS_TEST_ASSERT_MSG_EQ (aggregate->GetDevice (3), channels[2]->GetDevice (0), "Last device not shifted");
+
+  /* Growth of the channel a lookup lands on is noticed by the lookup */
+  late = CreateObject<CsmaNetDevice> ();
+  channels[1]->Attach (late);
+
+  NS_TEST_ASSERT_MSG_EQ (aggregate->GetDevice (2), channels[1]->GetDevice (0), "Wrong device after growth");
+  NS_TEST_ASSERT_MSG_EQ (aggregate->GetDevice (3), late, "Late device not indexed by the lookup");
+  NS_TEST_ASSERT_MSG_EQ (aggregate->GetDevice (4), channels[2]->GetDevice (0), "Last device not shifted");
+  NS_TEST_ASSERT_MSG_EQ ((aggregate->GetDevice (5) == 0), true, "Device out of range");
+  NS_TEST_ASSERT_MSG_EQ (aggregate->GetNDevices (), 5, "Stale device count");
+
+  /* Appended channels keep an up to date index */
+  Ptr<CsmaChannel> empty = CreateObject<CsmaChannel> ();
+  aggregate->AddChannel (empty);
+  channels.push_back (CreateObject<CsmaChannel> ());
+  channels[3]->Attach (CreateObject<CsmaNetDevice> ());
+  aggregate->AddChannel (channels[3]);
+
+  NS_TEST_ASSERT_MSG_EQ (aggregate->GetNDevices (), 6, "Wrong count after AddChannel");
+  NS_TEST_ASSERT_MSG_EQ (aggregate->GetDevice (5), channels[3]->GetDevice (0), "Device after an empty channel");
+}
+
+class TokenBucketShaperTestCase : public TestCase
 {
 public:
-  AccessNodeTestCase1 ();
-  virtual ~AccessNodeTestCase1 ();
+  TokenBucketShaperTestCase ();
 
 private:
   virtual void DoRun (void);
+  bool Egress (Ptr<Packet> packet, const Address &src, const Address &dst, uint16_t protocol);
+  void CheckQueue (Ptr<TokenBucketShaper> shaper);
+
+  std::vector<Time> m_sent;
+  Ptr<const Packet> m_original;
 };
 
-// Add some help text to this case to describe what it is intended to test
-AccessNodeTestCase1::AccessNodeTestCase1 ()
-  : TestCase ("AccessNode test case (does nothing)")
+TokenBucketShaperTestCase::TokenBucketShaperTestCase ()
+  : TestCase ("Conforming packets go out at once, the rest wait for tokens or are dropped")
+{
+}
+
+bool
+TokenBucketShaperTestCase::Egress (Ptr<Packet> packet, const Address &src, const Address &dst, uint16_t protocol)
 {
+  NS_TEST_EXPECT_MSG_NE ((PeekPointer (packet) == PeekPointer (m_original)), true, "Egress got the queued packet itself");
+
+  /* As a device adding its own header would */
+  packet->AddPaddingAtEnd (14);
+  m_sent.push_back (Simulator::Now ());
+  return true;
 }
 
-// This destructor does nothing but we include it as a reminder that
-// the test case should clean up after itself
-AccessNodeTestCase1::~AccessNodeTestCase1 ()
+void
+TokenBucketShaperTestCase::CheckQueue (Ptr<TokenBucketShaper> shaper)
 {
+  NS_TEST_EXPECT_MSG_EQ (m_sent.size (), 3, "Wrong number of conforming packets");
+  NS_TEST_EXPECT_MSG_EQ (shaper->GetQueueSize (), 2, "Wrong number of packets waiting for tokens");
 }
 
-//
-// This method is the pure virtual method from class TestCase that every
-// TestCase must implement
-//
 void
-AccessNodeTestCase1::DoRun (void)
+TokenBucketShaperTestCase::DoRun (void)
 {
-  // A wide variety of test macros are available in src/core/test.h
-  NS_TEST_ASSERT_MSG_EQ (true, true, "true doesn't equal true for some reason");
-  // Use this one for floating point comparisons
-  NS_TEST_ASSERT_MSG_EQ_TOL (0.01, 0.01, 0.001, "Numbers are not equal within tolerance");
+  /* One byte per microsecond, three 1000 byte packets in the bucket */
+  Ptr<TokenBucketShaper> shaper = Create<TokenBucketShaper> (DataRate ("8Mbps"), 3000, 2,
+                                                             MakeCallback (&TokenBucketShaperTestCase::Egress, this));
+  m_original = Create<Packet> (1000);
+  Mac48Address src = MakeMac (1);
+  Mac48Address dst = MakeMac (2);
+
+  /* Three conform, two are queued and the last one is dropped */
+  for (uint32_t i = 0; i < 6; ++i)
+    {
+      Simulator::Schedule (Seconds (0), &TokenBucketShaper::Send, shaper, m_original, src, dst, 0x0800);
+    }
+
+  /* Bucket refilled by then, conforms again */
+  Simulator::Schedule (MilliSeconds (10), &TokenBucketShaper::Send, shaper, m_original, src, dst, 0x0800);
+
+  Simulator::Schedule (Seconds (0), &TokenBucketShaperTestCase::CheckQueue, this, shaper);
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_sent.size (), 6, "Wrong number of packets sent");
+  NS_TEST_EXPECT_MSG_EQ (m_sent[2], Seconds (0), "Conforming packet delayed");
+  NS_TEST_EXPECT_MSG_EQ (m_sent[3], MilliSeconds (1), "Queued packet sent before its tokens");
+  NS_TEST_EXPECT_MSG_EQ (m_sent[4], MilliSeconds (2), "Queued packet sent before its tokens");
+  NS_TEST_EXPECT_MSG_EQ (m_sent[5], MilliSeconds (10), "Packet after a refill delayed");
+  NS_TEST_EXPECT_MSG_EQ (shaper->GetDrops (), 1, "Queue limit not enforced");
+  NS_TEST_EXPECT_MSG_EQ (m_original->GetSize (), 1000, "Queued packet modified by the egress");
+
+  Simulator::Destroy ();
 }
 
-// The TestSuite class names the TestSuite, identifies what type of TestSuite,
-// and enables the TestCases to be run.  Typically, only the constructor for
-// this class must be defined
-//
 class AccessNodeTestSuite : public TestSuite
 {
 public:
@@ -59,10 +497,12 @@ public:
 AccessNodeTestSuite::AccessNodeTestSuite ()
   : TestSuite ("access-node", UNIT)
 {
-  // TestDuration for TestCase can be QUICK, EXTENSIVE or TAKES_FOREVER
-  AddTestCase (new AccessNodeTestCase1, TestCase::QUICK);
+  AddTestCase (new AccessPortTableWrapTestCase, TestCase::QUICK);
+  AddTestCase (new AccessPortTableGrowTestCase, TestCase::QUICK);
+  AddTestCase (new AccessPortTableAgingTestCase, TestCase::QUICK);
+  AddTestCase (new AccessNetDeviceAgingTestCase, TestCase::QUICK);
+  AddTestCase (new AccessChannelGrowTestCase, TestCase::QUICK);
+  AddTestCase (new TokenBucketShaperTestCase, TestCase::QUICK);
 }
 
-// Do not forget to allocate an instance of this TestSuite
 static AccessNodeTestSuite accessNodeTestSuite;
-
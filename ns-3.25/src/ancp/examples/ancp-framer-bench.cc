@@ -0,0 +1,200 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2015 UFRGS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Alexsander de Souza <asouza@inf.ufrgs.br>
+ */
+
+/*
+ * ANCP stream reassembly benchmark
+ *
+ * Serializes a burst of multicast service profiles into a single byte
+ * stream, cuts it into fixed size segments and feeds them to the
+ * StreamFramer used by the adjacencies. With --legacy=true the old
+ * AddAtEnd + RemoveHeader retry loop runs on the same input, e.g.:
+ *
+ *   ./waf --run "ancp-framer-bench --messages=200 --legacy=true"
+ */
+
+#include <vector>
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/ancp-header.h"
+#include "ns3/stream-framer.h"
+#include "ns3/system-wall-clock-ms.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("AncpFramerBench");
+
+static Ptr<Packet> BuildStream(uint32_t nMessages, uint32_t nGroups)
+{
+  std::list<Address> groups;
+
+  for (uint32_t i = 0; i < nGroups; i++)
+    groups.push_back(Ipv4Address((224U << 24) | (1U << 16) | i));
+
+  Ptr<Packet> stream = Create<Packet> ();
+
+  for (uint32_t i = 0; i < nMessages; i++)
+    {
+      AncpHeader message;
+      message.SetMsgType(AncpHeader::MSG_PROVISIONING);
+      message.SetPartitionId(0);
+      message.SetTransactionId(i + 1);
+
+      AncpTlvMCastServiceProfile *mcast_tlv = new AncpTlvMCastServiceProfile();
+      mcast_tlv->GetFlowName().SetSrvProfileName("IPTV");
+
+      AncpTlvMCastListAction &white = mcast_tlv->GetAction(AncpTlvMCastListAction::WHITELIST);
+      white.SetOperation(AncpTlvMCastListAction::ADD);
+      white.SetListType(AncpTlvMCastListAction::IPv4);
+      for (auto &ad: groups)
+        white.AddFlow(ad);
+
+      AncpTlvMCastListAction &grey = mcast_tlv->GetAction(AncpTlvMCastListAction::GREYLIST);
+      grey.SetOperation(AncpTlvMCastListAction::ADD);
+      grey.SetListType(AncpTlvMCastListAction::IPv4);
+      for (auto &ad: groups)
+        grey.AddFlow(ad);
+
+      message.AddTlv(mcast_tlv);
+
+      Ptr<Packet> pkt = Create<Packet> ();
+      pkt->AddHeader(message);
+      stream->AddAtEnd(pkt);
+    }
+
+  return stream;
+}
+
+static std::vector<Ptr<Packet> > Segment(Ptr<Packet> stream, uint32_t segSize)
+{
+  std::vector<Ptr<Packet> > segments;
+
+  for (uint32_t off = 0; off < stream->GetSize(); off += segSize)
+    segments.push_back(stream->CreateFragment(off, std::min(segSize, stream->GetSize() - off)));
+
+  return segments;
+}
+
+/* Reassembly as done by the adjacency before StreamFramer */
+static uint32_t RunLegacy(const std::vector<Ptr<Packet> > &segments)
+{
+  Ptr<Packet> fragment = nullptr;
+  uint32_t nMessages = 0;
+
+  for (auto &seg : segments)
+    {
+      Ptr<Packet> packet = seg->Copy();
+
+      while (packet->GetSize() > 0)
+        {
+          if (fragment != nullptr)
+            {
+              fragment->AddAtEnd(packet);
+              packet = fragment;
+              fragment = nullptr;
+            }
+
+          /* AncpHeader reads the version byte before checking the size */
+          AncpHeader request;
+          if (packet->GetSize() < 5 || packet->RemoveHeader(request) == 0)
+            {
+              fragment = packet;
+              break;
+            }
+
+          ++nMessages;
+        }
+    }
+
+  return nMessages;
+}
+
+static uint32_t RunFramer(const std::vector<Ptr<Packet> > &segments)
+{
+  StreamFramer framer(2, 4, 4);
+  uint32_t nMessages = 0;
+
+  for (auto &seg : segments)
+    {
+      framer.Push(seg);
+
+      Ptr<Packet> packet;
+      while ((packet = framer.Pop()))
+        {
+          AncpHeader request;
+          if (packet->RemoveHeader(request) != 0)
+            ++nMessages;
+        }
+    }
+
+  return nMessages;
+}
+
+int
+main(int argc, char *argv[])
+{
+  uint32_t nMessages = 100;
+  uint32_t nGroups = 255;
+  bool legacy = false;
+
+  CommandLine cmd;
+
+  cmd.AddValue("messages", "Number of service profiles in the stream", nMessages);
+  cmd.AddValue("groups", "Multicast groups per list (max 255)", nGroups);
+  cmd.AddValue("legacy", "Also run the AddAtEnd/RemoveHeader reassembly", legacy);
+
+  cmd.Parse(argc, argv);
+
+  NS_ABORT_MSG_IF(nGroups > 255, "Invalid number of groups");
+
+  Ptr<Packet> stream = BuildStream(nMessages, nGroups);
+  const uint32_t segSizes[] = { 1, 7, 64, 536, 1460 };
+
+  std::cout << "messages=" << nMessages
+            << " stream_bytes=" << stream->GetSize() << std::endl;
+
+  for (uint32_t segSize : segSizes)
+    {
+      std::vector<Ptr<Packet> > segments = Segment(stream, segSize);
+      SystemWallClockMs wallClock;
+
+      wallClock.Start();
+      uint32_t framed = RunFramer(segments);
+      int64_t framerMs = wallClock.End();
+
+      std::cout << "segment=" << segSize
+                << " framer_msgs=" << framed
+                << " framer_ms=" << framerMs;
+
+      if (legacy)
+        {
+          wallClock.Start();
+          uint32_t parsed = RunLegacy(segments);
+          int64_t legacyMs = wallClock.End();
+
+          std::cout << " legacy_msgs=" << parsed
+                    << " legacy_ms=" << legacyMs;
+        }
+
+      std::cout << std::endl;
+    }
+
+  return 0;
+}
@@ -24,6 +24,7 @@
 #include "ns3/net-device.h"
 #include "ns3/channel.h"
 #include "ns3/socket.h"
+#include "ns3/uinteger.h"
 #include "ns3/packet.h"
 #include "ns3/ipv4.h"
 #include <algorithm>
@@ -34,6 +35,10 @@ namespace ns3
 {
 NS_LOG_COMPONENT_DEFINE("AncpAdjacency");
 
+/* TCP/IP encapsulation: 16-bit id, then the message length without it */
+static const uint32_t ANCP_LENGTH_OFFSET = 2;
+static const uint32_t ANCP_ENCAP_SIZE = 4;
+
 AncpAdjacency::AncpAdjacency(Mac48Address &mac, uint32_t port,
                              Ptr<Socket> &ancp_sock, bool is_nas) :
   m_IsNAS(is_nas),
@@ -49,11 +54,12 @@ AncpAdjacency::AncpAdjacency(Mac48Address &mac, uint32_t port,
   m_TheirPort(0),
   m_socket(ancp_sock),
   m_transactionId(0),
-  m_fragment(nullptr)
+  m_framer(ANCP_LENGTH_OFFSET, ANCP_ENCAP_SIZE, ANCP_ENCAP_SIZE)
 {
   NS_LOG_FUNCTION(this << "ANCP ADJ " << m_MyMac << " NAS=" << m_IsNAS);
 
   m_socket->SetRecvCallback(MakeCallback(&AncpAdjacency::NetHandler, this));
+  m_socket->SetSendCallback(MakeCallback(&AncpAdjacency::SendCallback, this));
 }
 
 AncpAdjacency::~AncpAdjacency()
@@ -61,10 +67,12 @@ AncpAdjacency::~AncpAdjacency()
   NS_LOG_FUNCTION(this);
 
   Simulator::Cancel(m_AdjTimer);
+  Simulator::Cancel(m_flushEvent);
 
   if (m_socket != 0)
     {
       m_socket->SetRecvCallback(MakeNullCallback<void, Ptr<Socket> > ());
+      m_socket->SetSendCallback(MakeNullCallback<void, Ptr<Socket>, uint32_t> ());
       m_socket->Close();
       m_socket = 0;
     }
@@ -91,20 +99,15 @@ void AncpAdjacency::NetHandler(Ptr<Socket> socket)
 
   while ((packet = socket->RecvFrom(from)))
     {
-      while (packet->GetSize() > 0)
-        {
-          if (m_fragment != nullptr)
-            {
-              m_fragment->AddAtEnd(packet);
-              packet = m_fragment;
-              m_fragment = nullptr;
-            }
+      m_framer.Push(packet);
 
+      while ((packet = m_framer.Pop()))
+        {
           AncpHeader request;
           if (packet->RemoveHeader(request) == 0)
             {
-              m_fragment = packet;
-              break;
+              NS_LOG_WARN(this << " Malformed message, discarding");
+              continue;
             }
 
           /* ignore all messages until Adjacency is established */
@@ -522,25 +525,97 @@ int AncpAdjacency::SendControlMessage(AncpHeader &msg)
     NS_LOG_WARN(msg);
   }
 
-  if (m_output_queue.empty())
-    Simulator::Schedule(MilliSeconds(1), &AncpAdjacency::ProccessOutputQueue, this);
+  m_output_queue.push_back(pkt);
+
+  if (!m_outputQueueTrace.IsNull())
+    m_outputQueueTrace(m_TheirMac, m_output_queue.size());
 
-  m_output_queue.push_front(pkt);
+  /* Everything queued in this event goes out in the same burst */
+  if (!m_flushEvent.IsRunning())
+    m_flushEvent = Simulator::ScheduleNow(&AncpAdjacency::FlushOutputQueue, this);
 
   return(0);
 }
 
-void AncpAdjacency::ProccessOutputQueue()
+void AncpAdjacency::SetOutputTraces(OutputQueueCb queue, OutputFlushCb flush)
 {
   NS_LOG_FUNCTION(this);
 
-  Ptr<Packet> pkt = m_output_queue.back();
+  m_outputQueueTrace = queue;
+  m_outputFlushTrace = flush;
+}
 
-  if (m_socket->Send(pkt, 0) < 0)
-    NS_LOG_WARN(this << " Failed to send Control Message");
+void AncpAdjacency::SendCallback(Ptr<Socket> socket, uint32_t available)
+{
+  NS_LOG_FUNCTION(this << available);
+
+  if (!m_output_queue.empty() && !m_flushEvent.IsRunning())
+    FlushOutputQueue();
+}
+
+uint32_t AncpAdjacency::GetTxBufferSize() const
+{
+  UintegerValue size;
+
+  /* Not TCP, what is available now is all there is */
+  if (!m_socket->GetAttributeFailSafe("SndBufSize", size))
+    return 0;
+
+  return size.Get();
+}
+
+void AncpAdjacency::FlushOutputQueue()
+{
+  NS_LOG_FUNCTION(this << m_output_queue.size());
+
+  uint32_t room = m_socket->GetTxAvailable();
+  Ptr<Packet> burst = nullptr;
+  uint32_t count = 0;
+
+  while (!m_output_queue.empty())
+    {
+      Ptr<Packet> pkt = m_output_queue.front();
+
+      if (pkt->GetSize() > room)
+        break;
+
+      room -= pkt->GetSize();
+      m_output_queue.pop_front();
+      ++count;
+
+      /* Queued packets are not shared, the first one carries the burst */
+      if (burst == nullptr)
+        burst = pkt;
+      else
+        burst->AddAtEnd(pkt);
+    }
+
+  if (burst == nullptr && room > 0 && room >= GetTxBufferSize())
+    {
+      /* Nothing in flight, so no send callback is coming: the head message
+       * is larger than the whole socket buffer, it goes out in pieces */
+      Ptr<Packet> head = m_output_queue.front();
+
+      NS_LOG_LOGIC(this << " Splitting " << head->GetSize() << " bytes message");
+      burst = head->CreateFragment(0, room);
+      head->RemoveAtStart(room);
+    }
+
+  if (burst == nullptr)
+    {
+      /* Socket buffer is full, wait for the send callback */
+      NS_LOG_LOGIC(this << " Output blocked, " << room << " bytes available");
+      return;
+    }
+
+  uint32_t bytes = burst->GetSize();
+
+  if (m_socket->Send(burst, 0) < 0)
+    NS_LOG_WARN(this << " Failed to send " << count << " Control Messages");
 
-  m_output_queue.pop_back();
-  if (!m_output_queue.empty())
-    Simulator::Schedule(MilliSeconds(1), &AncpAdjacency::ProccessOutputQueue, this);
+  if (!m_outputFlushTrace.IsNull())
+    m_outputFlushTrace(m_TheirMac, count, bytes);
+  if (!m_outputQueueTrace.IsNull())
+    m_outputQueueTrace(m_TheirMac, m_output_queue.size());
 }
 }  // namespace ns3
@@ -21,7 +21,7 @@
 #ifndef __ANCP_ADJACENCY_H__
 #define __ANCP_ADJACENCY_H__
 
-#include <list>
+#include <deque>
 #include <ns3/simple-ref-count.h>
 #include <ns3/string.h>
 #include <ns3/event-id.h>
@@ -29,6 +29,7 @@
 #include <ns3/callback.h>
 #include <ns3/ptr.h>
 #include <ns3/ipv4-address.h>
+#include <ns3/stream-framer.h>
 #include <ns3/ancp-header.h>
 
 namespace ns3
@@ -40,6 +41,10 @@ class AncpAdjacency : public SimpleRefCount<AncpAdjacency>
 {
 public:
   typedef Callback<int, Mac48Address&, AncpHeader& > AncpHandlerCb;
+  /* adjacency name, messages waiting in the output queue */
+  typedef Callback<void, const Mac48Address&, uint32_t> OutputQueueCb;
+  /* adjacency name, messages and bytes handed to TCP in one send */
+  typedef Callback<void, const Mac48Address&, uint32_t, uint32_t> OutputFlushCb;
 
   enum {
     ADJ_ST_SYNSENT,
@@ -73,6 +78,13 @@ public:
 
   int SendControlMessage(AncpHeader &msg);
 
+  /**
+   * \brief Report output queue activity
+   * \param queue       invoked whenever the queue depth changes
+   * \param flush       invoked for every burst sent to the socket
+   */
+  void SetOutputTraces(OutputQueueCb queue, OutputFlushCb flush);
+
   Mac48Address GetAdjacencyName() const;
 
 protected:
@@ -101,7 +113,13 @@ protected:
   uint32_t GetTransactionId(uint8_t msg_type);
 
 private:
-  void ProccessOutputQueue();
+  /**
+   * \brief Coalesce queued messages into TCP sends, as long as they fit
+   * in the socket buffer. Resumed by the socket send callback.
+   */
+  void FlushOutputQueue();
+  uint32_t GetTxBufferSize() const;
+  void SendCallback(Ptr<Socket> socket, uint32_t available);
 
   bool m_IsNAS;                               /**< Whether this adjacency is a NAS */
   uint m_State;                               /**< Adjacency state */
@@ -126,9 +144,12 @@ private:
 
   uint32_t m_transactionId;                   /**< TransactionId Counter */
 
-  std::list<Ptr<Packet> >  m_output_queue;    /**< Adjacency output queue */
+  std::deque<Ptr<Packet> > m_output_queue;    /**< Adjacency output queue */
+  EventId m_flushEvent;                       /**< Pending output flush */
+  OutputQueueCb m_outputQueueTrace;
+  OutputFlushCb m_outputFlushTrace;
 
-  Ptr<Packet> m_fragment;
+  StreamFramer m_framer;                      /**< Input stream reassembly */
 };
 }
 #endif /* __ANCP_ADJACENCY_H__ */
@@ -25,6 +25,7 @@
 #include "ns3/socket-factory.h"
 #include "ns3/packet.h"
 #include "ns3/ipv4.h"
+#include "ns3/trace-source-accessor.h"
 
 #include "ancp-header.h"
 #include "ancp-an-agent.h"
@@ -65,7 +66,15 @@ AncpAnAgent::GetTypeId(void)
                       .AddAttribute("MCastLineConfigCallback", "Callback invoked on Multicast LineConfig events.",
                                     CallbackValue(),
                                     MakeCallbackAccessor(&AncpAnAgent::m_mcastLineConfigHandler),
-                                    MakeCallbackChecker());
+                                    MakeCallbackChecker())
+                      .AddTraceSource("OutputQueue",
+                                      "Control messages waiting in an adjacency output queue.",
+                                      MakeTraceSourceAccessor(&AncpAnAgent::m_outputQueueTrace),
+                                      "ns3::AncpAnAgent::OutputQueueTracedCallback")
+                      .AddTraceSource("OutputFlush",
+                                      "Control messages and bytes coalesced into one TCP send.",
+                                      MakeTraceSourceAccessor(&AncpAnAgent::m_outputFlushTrace),
+                                      "ns3::AncpAnAgent::OutputFlushTracedCallback");
 
 
   return tid;
@@ -153,6 +162,8 @@ Ptr<AncpAdjacency> AncpAnAgent::CreateAdjacency(Address &nas)
   m_AdjList.insert(m_AdjList.begin(), std::make_pair(nas, new_adj));
 
   new_adj->SetCapabilities(m_capList);
+  new_adj->SetOutputTraces(MakeCallback(&AncpAnAgent::NotifyOutputQueue, this),
+                           MakeCallback(&AncpAnAgent::NotifyOutputFlush, this));
   new_adj->Start(MakeCallback(&AncpAnAgent::HandleAncpMessage, this));
 
   return new_adj;
@@ -345,4 +356,14 @@ int AncpAnAgent::HandleAncpMessage(Mac48Address &adj_name, AncpHeader &msg)
 
   return(0);
 }
+
+void AncpAnAgent::NotifyOutputQueue(const Mac48Address &adj, uint32_t depth)
+{
+  m_outputQueueTrace(adj, depth);
+}
+
+void AncpAnAgent::NotifyOutputFlush(const Mac48Address &adj, uint32_t messages, uint32_t bytes)
+{
+  m_outputFlushTrace(adj, messages, bytes);
+}
 } // Namespace ns3
@@ -23,6 +23,7 @@
 
 #include <ns3/application.h>
 #include <ns3/event-id.h>
+#include <ns3/traced-callback.h>
 #include <ns3/ancp-header.h>
 #include <ns3/ancp-adj.h>
 
@@ -48,6 +49,9 @@ public:
                    bool, bool > AncpAnMCastProfileCb;
   typedef Callback<int, const std::string&, int, const Address & > AncpAnMCastCommandCb;
 
+  typedef void (* OutputQueueTracedCallback)(const Mac48Address &adj, uint32_t depth);
+  typedef void (* OutputFlushTracedCallback)(const Mac48Address &adj, uint32_t messages, uint32_t bytes);
+
   static TypeId GetTypeId(void);
 
   AncpAnAgent();
@@ -80,12 +84,18 @@ protected:
 private:
   Ptr<AncpAdjacency> CreateAdjacency(Address &nas);
 
+  void NotifyOutputQueue(const Mac48Address &adj, uint32_t depth);
+  void NotifyOutputFlush(const Mac48Address &adj, uint32_t messages, uint32_t bytes);
+
   Mac48Address m_MyMac;                            /**< local interface MAC address */
   Ipv4Address m_MyAddr;                            /**< local interface IPv4 address */
   uint32_t m_MyPort;                               /**< local port number */
   Ipv4Address m_NasAddr;                           /**< Primary NAS address */
 
   AdjacencyList m_AdjList;
+
+  TracedCallback<const Mac48Address&, uint32_t> m_outputQueueTrace;
+  TracedCallback<const Mac48Address&, uint32_t, uint32_t> m_outputFlushTrace;
   AncpHeader::AncpCapList m_capList;               /**< Node capability list */
 
   AncpAnLineConfigCb m_lineConfigHandler;
@@ -18,6 +18,7 @@
  * Author: Alexsander de Souza <asouza@inf.ufrgs.br>
  */
 
+#include <array>
 #include "ns3/log.h"
 #include "ns3/abort.h"
 #include "ns3/assert.h"
@@ -25,6 +25,7 @@
 #include "ns3/socket-factory.h"
 #include "ns3/packet.h"
 #include "ns3/ipv4.h"
+#include "ns3/trace-source-accessor.h"
 
 #include "ancp-header.h"
 #include "ancp-nas-agent.h"
@@ -60,7 +61,15 @@ AncpNasAgent::GetTypeId(void)
                       .AddAttribute("NewAdjCallback", "Callback invoked on New ANCP adjacency events.",
                                     CallbackValue(),
                                     MakeCallbackAccessor(&AncpNasAgent::m_newAdjacencyHandler),
-                                    MakeCallbackChecker());
+                                    MakeCallbackChecker())
+                      .AddTraceSource("OutputQueue",
+                                      "Control messages waiting in an adjacency output queue.",
+                                      MakeTraceSourceAccessor(&AncpNasAgent::m_outputQueueTrace),
+                                      "ns3::AncpNasAgent::OutputQueueTracedCallback")
+                      .AddTraceSource("OutputFlush",
+                                      "Control messages and bytes coalesced into one TCP send.",
+                                      MakeTraceSourceAccessor(&AncpNasAgent::m_outputFlushTrace),
+                                      "ns3::AncpNasAgent::OutputFlushTracedCallback");
 
   return tid;
 }
@@ -149,6 +158,8 @@ void AncpNasAgent::AcceptHandler(Ptr<Socket> socket, const Address& from)
   m_AdjList.insert(m_AdjList.begin(), std::make_pair(from, new_adj));
 
   new_adj->SetCapabilities(m_capList);
+  new_adj->SetOutputTraces(MakeCallback(&AncpNasAgent::NotifyOutputQueue, this),
+                           MakeCallback(&AncpNasAgent::NotifyOutputFlush, this));
   new_adj->Start(MakeCallback(&AncpNasAgent::HandleAncpMessage, this));
 }
 
@@ -402,4 +413,14 @@ int AncpNasAgent::SendMCastCommand(const Mac48Address &anName,
 
   return adj->SendControlMessage(message);
 }
+
+void AncpNasAgent::NotifyOutputQueue(const Mac48Address &adj, uint32_t depth)
+{
+  m_outputQueueTrace(adj, depth);
+}
+
+void AncpNasAgent::NotifyOutputFlush(const Mac48Address &adj, uint32_t messages, uint32_t bytes)
+{
+  m_outputFlushTrace(adj, messages, bytes);
+}
 } // Namespace ns3
@@ -23,6 +23,7 @@
 
 #include <ns3/application.h>
 #include <ns3/event-id.h>
+#include <ns3/traced-callback.h>
 #include <ns3/ancp-header.h>
 #include <ns3/ancp-adj.h>
 
@@ -47,6 +48,9 @@ public:
   typedef Callback<int, const Mac48Address&, const std::string&, const Address&, bool> AncpNasMCastAdmissionCb;
   typedef Callback<int, const Mac48Address&> AncpNasNewAdjacencyCb;
 
+  typedef void (* OutputQueueTracedCallback)(const Mac48Address &adj, uint32_t depth);
+  typedef void (* OutputFlushTracedCallback)(const Mac48Address &adj, uint32_t messages, uint32_t bytes);
+
   static TypeId GetTypeId(void);
 
   AncpNasAgent();
@@ -90,11 +94,17 @@ private:
 
   Ptr<AncpAdjacency> GetAdjacency(const Mac48Address &anName) const;
 
+  void NotifyOutputQueue(const Mac48Address &adj, uint32_t depth);
+  void NotifyOutputFlush(const Mac48Address &adj, uint32_t messages, uint32_t bytes);
+
   Ptr<Socket>              m_Sock;                 /**< AF_INET TCP listen-socket */
   Mac48Address m_MyMac;                            /**< local interface MAC address */
   Ipv4Address m_MyAddr;                            /**< local interface IPv4 address */
   uint32_t m_MyPort;                               /**< local port number */
   AdjacencyList m_AdjList;
+
+  TracedCallback<const Mac48Address&, uint32_t> m_outputQueueTrace;
+  TracedCallback<const Mac48Address&, uint32_t, uint32_t> m_outputFlushTrace;
   AncpHeader::AncpCapList m_capList;               /**< Node capability list */
 
   AncpNasPortUpCb m_portUpHandler;
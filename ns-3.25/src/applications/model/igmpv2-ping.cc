@@ -89,7 +89,7 @@ void Igmpv2Ping::StartApplication(void)
 {
   NS_LOG_FUNCTION_NOARGS();
   NS_LOG_INFO("aqui StartApplication Ping");
-  if(m_sock_pkt > 0)
+  if(m_sock_pkt != 0)
     return;
 
   Ptr<NetDevice> netdev = GetNode()->GetDevice(0);
@@ -97,7 +97,7 @@ void Igmpv2Pong::CreateServerSocket(void)
 {
   NS_LOG_FUNCTION_NOARGS();
 
-  if(m_sock_pkt > 0)
+  if(m_sock_pkt != 0)
     return;
 
   Ptr<NetDevice> netdev = GetNode()->GetDevice(0);
@@ -0,0 +1,149 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2015 UFRGS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Alexsander de Souza <asouza@inf.ufrgs.br>
+ */
+
+#include <algorithm>
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "bfd-echo.h"
+#include "bfd-echo-engine.h"
+
+namespace ns3 {
+NS_LOG_COMPONENT_DEFINE("BfdEchoEngine");
+NS_OBJECT_ENSURE_REGISTERED(BfdEchoEngine);
+
+const uint32_t BfdEchoEngine::WHEEL_SLOTS = 256;
+
+static Ptr<BfdEchoEngine> g_engine;
+
+TypeId
+BfdEchoEngine::GetTypeId(void)
+{
+  static TypeId tid = TypeId("ns3::BfdEchoEngine")
+                      .SetParent<Object> ()
+                      .AddConstructor<BfdEchoEngine> ()
+                      .AddAttribute("Tick",
+                                    "Resolution of the echo timing wheel",
+                                    TimeValue(MilliSeconds(10)),
+                                    MakeTimeAccessor(&BfdEchoEngine::m_tick),
+                                    MakeTimeChecker(NanoSeconds(1)))
+  ;
+
+  return tid;
+}
+
+Ptr<BfdEchoEngine> BfdEchoEngine::Get(void)
+{
+  if (g_engine == 0)
+    {
+      g_engine = CreateObject<BfdEchoEngine>();
+      Simulator::ScheduleDestroy(&BfdEchoEngine::Release);
+    }
+
+  return g_engine;
+}
+
+void BfdEchoEngine::Release(void)
+{
+  g_engine->Dispose();
+  g_engine = 0;
+}
+
+BfdEchoEngine::BfdEchoEngine() :
+  m_wheel(WHEEL_SLOTS),
+  m_pos(0),
+  m_armed(0)
+{
+  NS_LOG_FUNCTION_NOARGS();
+}
+
+BfdEchoEngine::~BfdEchoEngine()
+{
+  NS_LOG_FUNCTION_NOARGS();
+}
+
+void BfdEchoEngine::DoDispose(void)
+{
+  NS_LOG_FUNCTION(this);
+  Simulator::Cancel(m_event);
+  m_wheel.clear();
+  m_armed = 0;
+  Object::DoDispose();
+}
+
+void BfdEchoEngine::Arm(Ptr<BfdEchoAgent> agent, uint32_t serial, Time delay)
+{
+  NS_LOG_FUNCTION(this << agent << serial << delay);
+
+  File(Timer {agent, serial, Simulator::Now() + delay});
+}
+
+void BfdEchoEngine::File(const Timer &timer)
+{
+  if (!m_event.IsRunning())
+    {
+      m_nextTick = Simulator::Now() + m_tick;
+      m_event = Simulator::Schedule(m_tick, &BfdEchoEngine::Advance, this);
+    }
+
+  /* Never after the deadline, far deadlines are re-filed later */
+  int64_t ticks = (timer.deadline - m_nextTick).GetTimeStep() / m_tick.GetTimeStep();
+  ticks = std::min<int64_t>(std::max<int64_t>(ticks, 0), WHEEL_SLOTS - 1);
+
+  m_wheel[(m_pos + ticks) % WHEEL_SLOTS].push_back(timer);
+  ++m_armed;
+}
+
+void BfdEchoEngine::Advance(void)
+{
+  NS_LOG_FUNCTION(this << m_pos);
+
+  Time now = Simulator::Now();
+  uint32_t current = m_pos;
+  Bucket bucket;
+
+  bucket.swap(m_wheel[current]);
+  m_armed -= bucket.size();
+  m_pos = (m_pos + 1) % WHEEL_SLOTS;
+  m_nextTick = now + m_tick;
+
+  for (auto &timer : bucket)
+    {
+      if (timer.deadline >= m_nextTick)
+        {
+          File(timer);
+          continue;
+        }
+
+      /* Zero means the timer is stale */
+      Time next = timer.agent->EchoTimerExpired(timer.serial);
+
+      if (next.IsStrictlyPositive())
+        File(Timer {timer.agent, timer.serial, now + next});
+    }
+
+  /* Give the storage back, avoid reallocating every lap */
+  bucket.clear();
+  if (m_wheel[current].empty())
+    m_wheel[current].swap(bucket);
+
+  if (m_armed > 0 && !m_event.IsRunning())
+    m_event = Simulator::Schedule(m_tick, &BfdEchoEngine::Advance, this);
+}
+}
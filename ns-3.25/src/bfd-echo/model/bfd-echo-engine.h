@@ -0,0 +1,88 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2015 UFRGS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Alexsander de Souza <asouza@inf.ufrgs.br>
+ */
+#ifndef BFD_ECHO_ENGINE_H
+#define BFD_ECHO_ENGINE_H
+
+#include <vector>
+#include "ns3/object.h"
+#include "ns3/nstime.h"
+#include "ns3/event-id.h"
+
+namespace ns3 {
+class BfdEchoAgent;
+
+/**
+ * \brief Echo timers of all the BfdEchoAgent of a simulation
+ *
+ * Agents are filed in a timing wheel by the time of their next echo.
+ * A single event per tick sends every echo due, so the number of
+ * events no longer grows with the number of sessions. Deadlines beyond
+ * the wheel span are re-filed when their bucket fires.
+ */
+class BfdEchoEngine : public Object
+{
+public:
+  static TypeId GetTypeId(void);
+
+  /**
+   * \brief Shared instance, released on Simulator::Destroy()
+   */
+  static Ptr<BfdEchoEngine> Get(void);
+
+  BfdEchoEngine();
+  virtual ~BfdEchoEngine();
+
+  /**
+   * \brief Schedule the next echo of an agent
+   * \param agent       echo source
+   * \param serial      agent timer serial, the timer is stale once it changes
+   * \param delay       time until the echo
+   */
+  void Arm(Ptr<BfdEchoAgent> agent, uint32_t serial, Time delay);
+
+protected:
+  virtual void DoDispose(void);
+
+private:
+  struct Timer
+  {
+    Ptr<BfdEchoAgent> agent;
+    uint32_t serial;
+    Time deadline;
+  };
+
+  typedef std::vector<Timer> Bucket;
+
+  static const uint32_t WHEEL_SLOTS;   /**< Timing wheel resolution */
+
+  static void Release(void);
+
+  void File(const Timer &timer);
+  void Advance(void);
+
+  std::vector<Bucket> m_wheel;
+  uint32_t m_pos;                      /**< Bucket processed by the next tick */
+  Time m_nextTick;
+  Time m_tick;
+  uint32_t m_armed;                    /**< Timers in the wheel, stale included */
+  EventId m_event;
+};
+}
+#endif /* BFD_ECHO_ENGINE_H */
@@ -20,6 +20,9 @@
 
 #include "ns3/log.h"
 #include "ns3/abort.h"
+#include "ns3/boolean.h"
+#include "ns3/uinteger.h"
+#include "ns3/random-variable-stream.h"
 #include "ns3/ipv4.h"
 #include "ns3/ipv4-address.h"
 #include "ns3/ipv4-interface.h"
@@ -34,6 +37,7 @@
 #include "ns3/ethernet-header.h"
 #include "ns3/udp-l4-protocol.h"
 #include "bfd-echo.h"
+#include "bfd-echo-engine.h"
 
 namespace ns3 {
 NS_LOG_COMPONENT_DEFINE("BfdEchoAgent");
@@ -60,6 +64,20 @@ BfdEchoAgent::GetTypeId(void)
                                     TimeValue(Seconds(5)),
                                     MakeTimeAccessor(&BfdEchoAgent::m_pingInterval),
                                     MakeTimeChecker())
+                      .AddAttribute("DetectMultiplier",
+                                    "Lost echoes before the session goes down",
+                                    UintegerValue(3),
+                                    MakeUintegerAccessor(&BfdEchoAgent::m_detectMult),
+                                    MakeUintegerChecker<uint32_t>(1))
+                      .AddAttribute("Jitter",
+                                    "Reduce each interval by up to 25%, as in RFC 5880",
+                                    BooleanValue(false),
+                                    MakeBooleanAccessor(&BfdEchoAgent::m_jitter),
+                                    MakeBooleanChecker())
+                      .AddTraceSource("StateChanged",
+                                      "The session went up or down",
+                                      MakeTraceSourceAccessor(&BfdEchoAgent::m_stateTrace),
+                                      "ns3::BfdEchoAgent::StateTracedCallback")
   ;
 
   return tid;
@@ -70,9 +88,12 @@ BfdEchoAgent::BfdEchoAgent() :
   m_sock_pkt(nullptr),
   m_sock_udp(nullptr),
   m_myAddress(Ipv4Address::GetAny()),
+  m_echoSerial(0),
+  m_up(false),
   m_echo_prepared(false)
 {
   NS_LOG_FUNCTION_NOARGS();
+  m_jitterVar = CreateObject<UniformRandomVariable>();
 }
 
 BfdEchoAgent::~BfdEchoAgent ()
@@ -83,6 +104,7 @@ BfdEchoAgent::~BfdEchoAgent ()
 void BfdEchoAgent::DoDispose(void)
 {
   NS_LOG_FUNCTION(this);
+  m_jitterVar = 0;
   Application::DoDispose();
 }
 
@@ -90,7 +112,8 @@ void BfdEchoAgent::StartApplication(void)
 {
   NS_LOG_FUNCTION_NOARGS();
 
-  m_pingEvent = Simulator::Schedule(m_pingInterval, &BfdEchoAgent::SendEcho, this);
+  m_lastRx = Simulator::Now();
+  ArmEchoTimer(m_pingInterval);
 }
 
 void BfdEchoAgent::StopApplication()
@@ -106,8 +129,9 @@ void BfdEchoAgent::StopApplication()
   m_sock_udp = nullptr;
   m_sock_pkt = nullptr;
   m_echo_prepared = false;
+  m_up = false;
 
-  Simulator::Remove(m_pingEvent);
+  ++m_echoSerial;
 }
 
 void BfdEchoAgent::CreateServerSocket(void)
@@ -142,6 +166,10 @@ void BfdEchoAgent::CreateServerSocket(void)
   m_sock_pkt->Bind(sock_addr);
   m_sock_pkt->ShutdownRecv();
 
+  m_echoDst.SetPhysicalAddress(m_gwHwAddress);
+  m_echoDst.SetSingleDevice(m_netdev->GetIfIndex());
+  m_echoDst.SetProtocol(0x0800);
+
   /* UDP socket */
   TypeId tid_udp = TypeId::LookupByName("ns3::UdpSocketFactory");
   m_sock_udp = Socket::CreateSocket(GetNode(), tid_udp);
@@ -221,8 +249,8 @@ void BfdEchoAgent::LinkStateChangedHandler(void)
   m_myAddress = Ipv4Address::GetAny();
   m_echo_prepared = false;
 
-  Simulator::Remove(m_pingEvent);
   SendEcho();
+  ArmEchoTimer(m_pingInterval);
 }
 
 void BfdEchoAgent::SendEcho()
@@ -232,19 +260,36 @@ void BfdEchoAgent::SendEcho()
   CreateServerSocket();
   BuildEchoPacket();
 
-  if (m_sock_pkt != nullptr)
+  if (m_sock_pkt != nullptr && m_echo_prepared)
     {
-      PacketSocketAddress dst;
+      if (m_sock_pkt->SendTo(m_echoPacket->Copy(), 0, m_echoDst) < 0)
+        NS_LOG_WARN(this << " Failed to send " << m_echoPacket);
+    }
+}
 
-      dst.SetPhysicalAddress(m_gwHwAddress);
-      dst.SetSingleDevice(m_netdev->GetIfIndex());
-      dst.SetProtocol(0x0800);
+void BfdEchoAgent::ArmEchoTimer(Time delay)
+{
+  BfdEchoEngine::Get()->Arm(this, ++m_echoSerial, delay);
+}
 
-      if (m_sock_pkt->SendTo(m_echoPacket->Copy(), 0, dst) < 0)
-        NS_LOG_WARN(this << " Failed to send " << m_echoPacket);
+Time BfdEchoAgent::EchoTimerExpired(uint32_t serial)
+{
+  if (serial != m_echoSerial)
+    return Time(0);
+
+  if (m_up && Simulator::Now() - m_lastRx >= m_pingInterval * m_detectMult)
+    {
+      NS_LOG_INFO(this << " BFD session down, no echo since " << m_lastRx.GetSeconds());
+      m_up = false;
+      m_stateTrace(false);
     }
 
-  m_pingEvent = Simulator::Schedule(m_pingInterval, &BfdEchoAgent::SendEcho, this);
+  SendEcho();
+
+  if (!m_jitter)
+    return m_pingInterval;
+
+  return Seconds(m_pingInterval.GetSeconds() * (1 - m_jitterVar->GetValue(0, 0.25)));
 }
 
 void BfdEchoAgent::NetHandler(Ptr<Socket> socket)
@@ -257,9 +302,23 @@ void BfdEchoAgent::NetHandler(Ptr<Socket> socket)
   while ((packet = socket->RecvFrom(from)))
     {
       NS_LOG_LOGIC(this << packet);
+
+      m_lastRx = Simulator::Now();
+
+      if (!m_up)
+        {
+          NS_LOG_INFO(this << " BFD session up");
+          m_up = true;
+          m_stateTrace(true);
+        }
     }
 }
 
+bool BfdEchoAgent::IsUp() const
+{
+  return m_up;
+}
+
 void BfdEchoAgent::Print(std::ostream& os) const
 {
   os << "[BFD_ECHO: " << GetNode()->GetId() << "] ";
@@ -21,17 +21,26 @@
 #define BFD_ECHO_H
 #include <ns3/application.h>
 #include <ns3/event-id.h>
+#include <ns3/traced-callback.h>
 #include "ns3/address.h"
 #include "ns3/mac48-address.h"
+#include "ns3/packet-socket-address.h"
 
 namespace ns3 {
 class Socket;
 class Packet;
 class NetDevice;
+class UniformRandomVariable;
 
 class BfdEchoAgent : public Application
 {
 public:
+  /**
+   * TracedCallback signature for session state changes
+   * \param [in] up        new state, false once DetectMultiplier echoes are lost
+   */
+  typedef void (* StateTracedCallback)(bool up);
+
   static TypeId GetTypeId(void);
 
   BfdEchoAgent();
@@ -40,6 +49,10 @@ public:
 
   virtual void Print(std::ostream& os) const;
 
+  /**
+   * \return true once an echo came back, false after DetectMultiplier
+   * intervals without one
+   */
   bool IsUp() const;
 protected:
   /* ns3::Application methods */
@@ -48,6 +61,8 @@ protected:
   virtual void StopApplication(void);
 
 private:
+  friend class BfdEchoEngine;
+
   enum {
     BFD_ECHO_PORT = 3785
   };
@@ -62,6 +77,14 @@ private:
 
   void SendEcho();
 
+  void ArmEchoTimer(Time delay);
+
+  /**
+   * \brief Called by the engine when the echo timer fires
+   * \return time until the next echo, zero if the timer is stale
+   */
+  Time EchoTimerExpired(uint32_t serial);
+
   bool discoverLocalAddress();
 
   Ptr<NetDevice>           m_netdev;               /**< Binded netdev */
@@ -71,10 +94,18 @@ private:
   Ipv4Address m_myAddress;
   Mac48Address m_gwHwAddress;
   Ptr<Packet>  m_echoPacket;
+  PacketSocketAddress m_echoDst;
 
-  EventId m_pingEvent;
+  uint32_t m_echoSerial;                           /**< Bumped to cancel the echo timer */
   Time m_pingInterval;
+  uint32_t m_detectMult;
+  bool m_jitter;
+  Ptr<UniformRandomVariable> m_jitterVar;
+  Time m_lastRx;
+  bool m_up;
   bool m_echo_prepared;
+
+  TracedCallback<bool> m_stateTrace;
 };
 }
 #endif /* BFD_ECHO_H */
@@ -1,55 +1,309 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2015 UFRGS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Alexsander de Souza <asouza@inf.ufrgs.br>
+ */
 
-// Include a header file from your module to test.
-#include "ns3/bfd-echo.h"
-
-// An essential include is test.h
+#include <map>
+#include <sstream>
+#include <vector>
 #include "ns3/test.h"
+#include "ns3/simulator.h"
+#include "ns3/boolean.h"
+#include "ns3/uinteger.h"
+#include "ns3/node-container.h"
+#include "ns3/simple-channel.h"
+#include "ns3/simple-net-device.h"
+#include "ns3/error-model.h"
+#include "ns3/internet-stack-helper.h"
+#include "ns3/ipv4-l3-protocol.h"
+#include "ns3/bfd-echo.h"
+#include "ns3/bfd-echo-engine.h"
 
-// Do not put your test classes in namespace ns3.  You may find it useful
-// to use the using directive to access the ns3 namespace directly
 using namespace ns3;
 
-// This is an example TestCase.
-class BfdEchoTestCase1 : public TestCase
+/* Default resolution of the echo timing wheel, timers fire up to one tick early */
+static const Time TICK = MilliSeconds (10);
+
+/*
+ * Agents and their gateway on one link. The gateway routes the echoes,
+ * addressed to the agents themselves, back to them.
+ */
+class BfdEchoTestCase : public TestCase
+{
+public:
+  BfdEchoTestCase (std::string name);
+
+protected:
+  void Setup (uint32_t nAgents);
+  Ptr<BfdEchoAgent> InstallAgent (uint32_t i, Time interval, Time start, Time stop);
+
+  void Forwarded (const Ipv4Header &header, Ptr<const Packet> packet, uint32_t interface);
+
+  NodeContainer m_agents;
+  Ptr<Node> m_gateway;
+  std::vector<Ptr<SimpleNetDevice> > m_devices;   //!< Agent devices
+  Mac48Address m_gatewayHwAddress;
+
+  std::map<Ipv4Address, std::vector<Time> > m_echoes;   //!< Echoes seen by the gateway, per agent
+};
+
+BfdEchoTestCase::BfdEchoTestCase (std::string name)
+  : TestCase (name)
+{
+}
+
+static Ptr<SimpleNetDevice>
+AddDevice (Ptr<Node> node, Ptr<SimpleChannel> channel, Ipv4Address address)
+{
+  Ptr<SimpleNetDevice> dev = CreateObject<SimpleNetDevice> ();
+  dev->SetAddress (Mac48Address::Allocate ());
+  dev->SetChannel (channel);
+  node->AddDevice (dev);
+
+  Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
+  uint32_t i = ipv4->AddInterface (dev);
+  ipv4->AddAddress (i, Ipv4InterfaceAddress (address, Ipv4Mask ("255.255.255.0")));
+  ipv4->SetUp (i);
+
+  return dev;
+}
+
+void
+BfdEchoTestCase::Setup (uint32_t nAgents)
+{
+  m_agents.Create (nAgents);
+  m_gateway = CreateObject<Node> ();
+
+  InternetStackHelper internet;
+  internet.Install (m_agents);
+  internet.Install (m_gateway);
+
+  Ptr<SimpleChannel> channel = CreateObject<SimpleChannel> ();
+
+  Ptr<SimpleNetDevice> gw = AddDevice (m_gateway, channel, Ipv4Address ("10.0.0.254"));
+  m_gatewayHwAddress = Mac48Address::ConvertFrom (gw->GetAddress ());
+
+  for (uint32_t i = 0; i < nAgents; ++i)
+    {
+      m_devices.push_back (AddDevice (m_agents.Get (i), channel, Ipv4Address (0x0a000001 + i)));
+    }
+
+  m_gateway->GetObject<Ipv4L3Protocol> ()->TraceConnectWithoutContext ("UnicastForward",
+                                                                       MakeCallback (&BfdEchoTestCase::Forwarded, this));
+}
+
+Ptr<BfdEchoAgent>
+BfdEchoTestCase::InstallAgent (uint32_t i, Time interval, Time start, Time stop)
+{
+  Ptr<BfdEchoAgent> agent = CreateObject<BfdEchoAgent> ();
+  agent->SetAttribute ("AgentAddr", Ipv4AddressValue (Ipv4Address (0x0a000001 + i)));
+  agent->SetAttribute ("GatewayAddr", Mac48AddressValue (m_gatewayHwAddress));
+  agent->SetAttribute ("PingInterval", TimeValue (interval));
+  agent->SetStartTime (start);
+  agent->SetStopTime (stop);
+  m_agents.Get (i)->AddApplication (agent);
+
+  return agent;
+}
+
+void
+BfdEchoTestCase::Forwarded (const Ipv4Header &header, Ptr<const Packet> packet, uint32_t interface)
+{
+  m_echoes[header.GetDestination ()].push_back (Simulator::Now ());
+}
+
+class BfdEchoDetectTestCase : public BfdEchoTestCase
+{
+public:
+  BfdEchoDetectTestCase (uint32_t detectMult);
+
+private:
+  virtual void DoRun (void);
+  void StateChanged (bool up);
+
+  uint32_t m_detectMult;
+  std::vector<std::pair<Time, bool> > m_states;
+};
+
+static std::string
+DetectName (uint32_t detectMult)
+{
+  std::ostringstream oss;
+  oss << "Session goes down after " << detectMult << " lost echoes, and back up";
+  return oss.str ();
+}
+
+BfdEchoDetectTestCase::BfdEchoDetectTestCase (uint32_t detectMult)
+  : BfdEchoTestCase (DetectName (detectMult)),
+    m_detectMult (detectMult)
+{
+}
+
+void
+BfdEchoDetectTestCase::StateChanged (bool up)
+{
+  m_states.push_back (std::make_pair (Simulator::Now (), up));
+}
+
+void
+BfdEchoDetectTestCase::DoRun (void)
+{
+  Setup (1);
+
+  Time interval = MilliSeconds (100);
+  Ptr<BfdEchoAgent> agent = InstallAgent (0, interval, Seconds (0), Seconds (3));
+  agent->SetAttribute ("DetectMultiplier", UintegerValue (m_detectMult));
+  agent->TraceConnectWithoutContext ("StateChanged", MakeCallback (&BfdEchoDetectTestCase::StateChanged, this));
+
+  /* Echoes coming back are lost between 1.05s and 2.05s, the last one
+   * that made it was sent at 1s */
+  Ptr<RateErrorModel> loss = CreateObject<RateErrorModel> ();
+  loss->SetRate (1.0);
+  loss->SetUnit (RateErrorModel::ERROR_UNIT_PACKET);
+  loss->Disable ();
+  m_devices[0]->SetReceiveErrorModel (loss);
+
+  Simulator::Schedule (MilliSeconds (1050), &ErrorModel::Enable, loss);
+  Simulator::Schedule (MilliSeconds (2050), &ErrorModel::Disable, loss);
+
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_states.size (), 3, "Wrong number of state changes");
+
+  NS_TEST_EXPECT_MSG_EQ (m_states[0].second, true, "Session not up");
+  /* The gateway resolves the agent first, ARP requests are jittered */
+  NS_TEST_EXPECT_MSG_GT_OR_EQ (m_states[0].first, interval, "Session up before the first echo");
+  NS_TEST_EXPECT_MSG_LT (m_states[0].first, interval + TICK, "Session not up on the first echo");
+
+  NS_TEST_EXPECT_MSG_EQ (m_states[1].second, false, "Session not down");
+  NS_TEST_EXPECT_MSG_EQ (m_states[1].first, Seconds (1) + interval * m_detectMult,
+                         "Session not down after DetectMultiplier intervals");
+
+  NS_TEST_EXPECT_MSG_EQ (m_states[2].second, true, "Session not back up");
+  NS_TEST_EXPECT_MSG_EQ (m_states[2].first, MilliSeconds (2100), "Session not up on the first echo back");
+
+  NS_TEST_EXPECT_MSG_EQ (agent->IsUp (), false, "Stopped agent still up");
+
+  Simulator::Destroy ();
+}
+
+class BfdEchoJitterTestCase : public BfdEchoTestCase
 {
 public:
-  BfdEchoTestCase1 ();
-  virtual ~BfdEchoTestCase1 ();
+  BfdEchoJitterTestCase ();
 
 private:
   virtual void DoRun (void);
 };
 
-// Add some help text to this case to describe what it is intended to test
-BfdEchoTestCase1::BfdEchoTestCase1 ()
-  : TestCase ("BfdEcho test case (does nothing)")
+BfdEchoJitterTestCase::BfdEchoJitterTestCase ()
+  : BfdEchoTestCase ("Jittered intervals are reduced by up to 25%")
+{
+}
+
+void
+BfdEchoJitterTestCase::DoRun (void)
 {
+  Setup (1);
+
+  Time interval = MilliSeconds (100);
+  Ptr<BfdEchoAgent> agent = InstallAgent (0, interval, Seconds (0), Seconds (10));
+  agent->SetAttribute ("Jitter", BooleanValue (true));
+
+  Simulator::Run ();
+
+  std::vector<Time> &echoes = m_echoes[Ipv4Address ("10.0.0.1")];
+  NS_TEST_ASSERT_MSG_GT (echoes.size (), 100, "Intervals not reduced");
+
+  Time shortest = Time::Max ();
+  Time longest = Time (0);
+  for (uint32_t i = 1; i < echoes.size (); ++i)
+    {
+      shortest = std::min (shortest, echoes[i] - echoes[i - 1]);
+      longest = std::max (longest, echoes[i] - echoes[i - 1]);
+    }
+
+  NS_TEST_EXPECT_MSG_GT (shortest, interval * 3 / 4 - TICK, "Interval reduced by more than 25%");
+  NS_TEST_EXPECT_MSG_LT_OR_EQ (longest, interval, "Interval longer than PingInterval");
+  NS_TEST_EXPECT_MSG_LT (shortest, longest, "Intervals not jittered");
+
+  /* Uniform over 75-100%, the sequence stays close to the mean */
+  double mean = (echoes.back () - echoes.front ()).GetSeconds () / (echoes.size () - 1);
+  NS_TEST_EXPECT_MSG_EQ_TOL (mean, 0.0875 - TICK.GetSeconds () / 2, 0.005, "Intervals not jittered uniformly");
+
+  Simulator::Destroy ();
 }
 
-// This destructor does nothing but we include it as a reminder that
-// the test case should clean up after itself
-BfdEchoTestCase1::~BfdEchoTestCase1 ()
+class BfdEchoWheelTestCase : public BfdEchoTestCase
+{
+public:
+  BfdEchoWheelTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+BfdEchoWheelTestCase::BfdEchoWheelTestCase ()
+  : BfdEchoTestCase ("Agents sharing the timing wheel keep their own intervals")
 {
 }
 
-//
-// This method is the pure virtual method from class TestCase that every
-// TestCase must implement
-//
 void
-BfdEchoTestCase1::DoRun (void)
+BfdEchoWheelTestCase::DoRun (void)
 {
-  // A wide variety of test macros are available in src/core/test.h
-  NS_TEST_ASSERT_MSG_EQ (true, true, "true doesn't equal true for some reason");
-  // Use this one for floating point comparisons
-  NS_TEST_ASSERT_MSG_EQ_TOL (0.01, 0.01, 0.001, "Numbers are not equal within tolerance");
+  Setup (3);
+
+  /* The last one is past the wheel span (256 ticks), re-filed on the way */
+  Time interval[] = { MilliSeconds (100), MilliSeconds (250), Seconds (3) };
+  Time start[] = { Seconds (0), MilliSeconds (13), MilliSeconds (500) };
+  uint32_t count[] = { 99, 39, 3 };
+  Time stop = MilliSeconds (9950);
+
+  for (uint32_t i = 0; i < 3; ++i)
+    {
+      InstallAgent (i, interval[i], start[i], stop);
+    }
+
+  Simulator::Run ();
+
+  for (uint32_t i = 0; i < 3; ++i)
+    {
+      std::vector<Time> &echoes = m_echoes[Ipv4Address (0x0a000001 + i)];
+      NS_TEST_ASSERT_MSG_EQ (echoes.size (), count[i], "Wrong number of echoes for agent " << i);
+
+      /* Never late, at most one tick early */
+      Time first = start[i] + interval[i];
+      NS_TEST_EXPECT_MSG_LT_OR_EQ (echoes[0], first, "First echo late for agent " << i);
+      NS_TEST_EXPECT_MSG_GT (echoes[0], first - TICK, "First echo early for agent " << i);
+
+      /* Then on the tick grid, which the intervals are multiple of */
+      for (uint32_t k = 1; k < echoes.size (); ++k)
+        {
+          NS_TEST_EXPECT_MSG_EQ (echoes[k] - echoes[k - 1], interval[i], "Echo " << k << " of agent " << i << " off its interval");
+        }
+    }
+
+  /* Stale timers are dropped when due, the last one at 12.5s */
+  NS_TEST_EXPECT_MSG_LT_OR_EQ (Simulator::Now (), MilliSeconds (12500), "Wheel kept running after the agents stopped");
+
+  Simulator::Destroy ();
 }
 
-// The TestSuite class names the TestSuite, identifies what type of TestSuite,
-// and enables the TestCases to be run.  Typically, only the constructor for
-// this class must be defined
-//
 class BfdEchoTestSuite : public TestSuite
 {
 public:
@@ -59,10 +313,10 @@ public:
 BfdEchoTestSuite::BfdEchoTestSuite ()
   : TestSuite ("bfd-echo", UNIT)
 {
-  // TestDuration for TestCase can be QUICK, EXTENSIVE or TAKES_FOREVER
-  AddTestCase (new BfdEchoTestCase1, TestCase::QUICK);
+  AddTestCase (new BfdEchoDetectTestCase (3), TestCase::QUICK);
+  AddTestCase (new BfdEchoDetectTestCase (5), TestCase::QUICK);
+  AddTestCase (new BfdEchoJitterTestCase, TestCase::QUICK);
+  AddTestCase (new BfdEchoWheelTestCase, TestCase::QUICK);
 }
 
-// Do not forget to allocate an instance of this TestSuite
 static BfdEchoTestSuite bfdEchoTestSuite;
-
@@ -24,15 +24,17 @@
 #include "ns3/node.h"
 #include "ns3/packet.h"
 #include "ns3/log.h"
+#include "ns3/abort.h"
 #include "ns3/boolean.h"
 #include "ns3/simulator.h"
 #include "ns3/uinteger.h"
+#include "ns3/integer.h"
 #include "ns3/ipv4-l3-protocol.h"
 #include "ns3/ipv4-interface.h"
 #include "ns3/igmpv2-l4-protocol.h"
-#include "ns3/ipv4-static-routing-helper.h"
-#include "ns3/ipv4-routing-table-entry.h"
+#include "ns3/ipv4-list-routing.h"
 #include "ns3/ipv4-global-routing-helper.h"
+#include "ns3/global-router-interface.h"
 #include "ns3/ipv6-l3-protocol.h"
 #include "ns3/ipv6-interface.h"
 #include "ns3/ipv6-static-routing-helper.h"
@@ -40,6 +42,8 @@
 #include "ns3/ancp-nas-agent.h"
 #include "ns3/dhcp-server.h"
 #include "ns3/radius-client.h"
+#include "ns3/bfd-echo.h"
+#include "ns3/bng-subscriber-routing.h"
 #include "ns3/bng-control.h"
 
 namespace ns3 {
@@ -47,6 +51,9 @@ NS_LOG_COMPONENT_DEFINE("BngControl");
 
 NS_OBJECT_ENSURE_REGISTERED(BngControl);
 
+const uint32_t BngControl::IDLE_WHEEL_SLOTS = 64;
+const uint32_t BngControl::INTERIM_SLOTS = 64;
+
 TypeId
 BngControl::GetTypeId(void)
 {
@@ -54,11 +61,38 @@ BngControl::GetTypeId(void)
                       .SetParent<Application>()
                       .AddConstructor<BngControl>()
                       .AddAttribute("SessionIdleTimeout",
-                                    "Idle session timeout",
+                                    "Idle session timeout, zero disables it",
                                     TimeValue(Seconds(15)),
                                     MakeTimeAccessor(&BngControl::m_sessionTimeout),
                                     MakeTimeChecker())
-
+                      .AddAttribute("SessionIdleTick",
+                                    "Resolution of the idle session timing wheel",
+                                    TimeValue(Seconds(1)),
+                                    MakeTimeAccessor(&BngControl::m_idleTick),
+                                    MakeTimeChecker(NanoSeconds(1)))
+                      .AddAttribute("InterimInterval",
+                                    "Accounting Interim-Update interval, zero disables it",
+                                    TimeValue(Seconds(0)),
+                                    MakeTimeAccessor(&BngControl::m_interimInterval),
+                                    MakeTimeChecker())
+                      .AddAttribute("SubscriberRoutingPriority",
+                                    "Priority of the subscriber host routes in the node list routing",
+                                    IntegerValue(10),
+                                    MakeIntegerAccessor(&BngControl::m_subscriberRoutingPriority),
+                                    MakeIntegerChecker<int16_t>())
+                      .AddAttribute("BackupGateway",
+                                    "Next-hop for subscriber traffic while the access path is down",
+                                    Ipv4AddressValue(Ipv4Address::GetAny()),
+                                    MakeIpv4AddressAccessor(&BngControl::m_backupGateway),
+                                    MakeIpv4AddressChecker())
+                      .AddTraceSource("SessionIdleTimeout",
+                                      "A session was closed for being idle",
+                                      MakeTraceSourceAccessor(&BngControl::m_idleTimeoutTrace),
+                                      "ns3::Mac48Address::TracedCallback")
+                      .AddTraceSource("InterimUpdate",
+                                      "An accounting Interim-Update was sent for a session",
+                                      MakeTraceSourceAccessor(&BngControl::m_interimTrace),
+                                      "ns3::Mac48Address::TracedCallback")
   ;
 
   return tid;
@@ -70,7 +104,17 @@ BngControl::BngControl() :
   m_address(Mac48Address("00:00:00:00:00:00")),
   m_agent(0),
   m_radClient(0),
-  m_dhcp(0)
+  m_dhcp(0),
+  m_subscriberRouting(0),
+  m_idleWheel(IDLE_WHEEL_SLOTS),
+  m_idlePos(0),
+  m_idleSerial(0),
+  m_idleTicks(0),
+  m_nActiveSessions(0),
+  m_interimSlots(INTERIM_SLOTS),
+  m_interimPos(0),
+  m_interimNext(0),
+  m_accessPathFailed(false)
 {
   NS_LOG_FUNCTION_NOARGS();
 }
@@ -88,9 +132,20 @@ void BngControl::DoDispose(void)
   m_agent = 0;
   m_radClient = 0;
   m_dhcp = 0;
+  m_subscriberRouting = 0;
   m_regionalNetPort = 0;
   m_accessNetPort = 0;
+  m_ipv4SessionMap.clear();
   m_sessionMap.clear();
+  Simulator::Cancel(m_idleEvent);
+  Simulator::Cancel(m_interimEvent);
+  for (auto &expire : m_idleExpire)
+    Simulator::Cancel(expire.second);
+  m_idleExpire.clear();
+  m_interimSlotMap.clear();
+  m_interimSlots.clear();
+  m_idleArmed.clear();
+  m_idleWheel.clear();
   Application::DoDispose();
 }
 
@@ -125,6 +180,28 @@ void BngControl::SetAccessNetPort(Ptr< NetDevice > accessNetPort)
                                      0, m_accessNetPort, true);
 }
 
+void BngControl::SetAccessPathMonitor(Ptr<BfdEchoAgent> agent)
+{
+  NS_LOG_FUNCTION(this << agent);
+
+  agent->TraceConnectWithoutContext("StateChanged",
+                                    MakeCallback(&BngControl::AccessPathStateChanged, this));
+}
+
+void BngControl::AccessPathStateChanged(bool up)
+{
+  NS_LOG_FUNCTION(this << up);
+  NS_LOG_INFO("BNG access path " << (up ? "up" : "down"));
+
+  m_accessPathFailed = !up;
+
+  if (m_subscriberRouting == 0)
+    return;
+
+  Ptr<Ipv4> ipv4 = GetNode()->GetObject<Ipv4> ();
+  m_subscriberRouting->SetPathFailed(ipv4->GetInterfaceForDevice(m_accessNetPort), m_accessPathFailed);
+}
+
 void BngControl::ActivityMonitor(Ptr<NetDevice> device, Ptr<const Packet> packet,
                                  uint16_t protocol, Address const &source,
                                  Address const &destination, NetDevice::PacketType packetType)
@@ -142,7 +219,15 @@ void BngControl::ActivityMonitor(Ptr<NetDevice> device, Ptr<const Packet> packet
     return;
 
   SubscriberSession &session = sessionIT->second;
-  session.AccPacket(SubscriberSession::UPSTREAM, packet);
+  session.AccPacket(SubscriberSession::UPSTREAM, packet->GetSize());
+}
+
+void BngControl::DownstreamMonitor(Ipv4Address address, uint32_t size)
+{
+  auto sessionIT = m_ipv4SessionMap.find(address.Get());
+
+  if (sessionIT != m_ipv4SessionMap.end())
+    sessionIT->second->AccPacket(SubscriberSession::DOWNSTREAM, size);
 }
 
 void BngControl::AddBandwidthProfile(const Mac48Address &cpeHwId, const std::string &profName)
@@ -210,7 +295,12 @@ int BngControl::SubscriberPortUp(const Mac48Address &anId, const std::string &ci
   auto sessionP = m_sessionMap.emplace(std::make_pair(cpeHwId, SubscriberSession(anId, circuit_id, m_radClient)));
   SubscriberSession &session = sessionP.first->second;
 
+  if (!session.IsActive())
+    ++m_nActiveSessions;
+
   session.UpdateLineStatus(true, rate_up, rate_down);
+  ArmIdleTimer(cpeHwId);
+  ArmInterimUpdate(cpeHwId);
 
   auto prof = m_accessProfileMap.find(cpeHwId);
   if (prof != m_accessProfileMap.end())
@@ -236,7 +326,13 @@ int BngControl::SubscriberPortDown(const Mac48Address &anId, const std::string &
     return -1;
 
   SubscriberSession &session = sessionIT->second;
+
+  if (session.IsActive())
+    --m_nActiveSessions;
+
   session.UpdateLineStatus(false, 0, 0);
+  m_idleArmed.erase(cpeHwId);
+  CancelIdleExpire(cpeHwId);
 
   return 0;
 }
@@ -288,12 +384,9 @@ int BngControl::SubscriberIpSessionSetup(const Mac48Address &cpeHwId, const Addr
       Ptr<Ipv4> ipv4 = GetNode()->GetObject<Ipv4> ();
       int32_t ifIndex = ipv4->GetInterfaceForDevice(m_accessNetPort);
 
-      Ipv4StaticRoutingHelper ipv4RoutingHelper;
-      Ptr<Ipv4StaticRouting> staticRouting = ipv4RoutingHelper.GetStaticRouting(ipv4);
-      Ipv4Address ip4 = Ipv4Address::ConvertFrom(ip);
-      staticRouting->AddHostRouteTo(ip4, ifIndex);
-
-      Ipv4GlobalRoutingHelper::RecomputeRoutingTables();
+      /* Covered by the pool aggregate, upstream routing is left alone */
+      m_subscriberRouting->AddSubscriber(Ipv4Address::ConvertFrom(ip), ifIndex);
+      m_ipv4SessionMap[Ipv4Address::ConvertFrom(ip).Get()] = &session;
 
       /* TODO create static ARP entry */
     }
@@ -333,22 +426,8 @@ int BngControl::SubscriberIpSessionTearDown(const Mac48Address &cpeHwId, const A
       Ipv4Address oldIp = session.GetIpv4Address();
       session.SetAddressIp(Ipv4Address::GetZero());
 
-      Ptr<Ipv4> ipv4 = GetNode()->GetObject<Ipv4> ();
-
-      Ipv4StaticRoutingHelper ipv4RoutingHelper;
-      Ptr<Ipv4StaticRouting> staticRouting = ipv4RoutingHelper.GetStaticRouting(ipv4);
-      uint32_t routeCnt = staticRouting->GetNRoutes();
-
-      for (uint32_t i = 0; i < routeCnt; ++i)
-        {
-          const Ipv4RoutingTableEntry &entry = staticRouting->GetRoute(i);
-          if (entry.GetDest() == oldIp)
-            {
-              staticRouting->RemoveRoute(i);
-              break;
-            }
-        }
-      Ipv4GlobalRoutingHelper::RecomputeRoutingTables();
+      m_subscriberRouting->RemoveSubscriber(oldIp);
+      m_ipv4SessionMap.erase(oldIp.Get());
 
       /* TODO remove ARP entry */
     }
@@ -401,7 +480,7 @@ void BngControl::StartApplication(void)
 {
   NS_LOG_FUNCTION(this);
 
-  m_sessionSweepEvent = Simulator::Schedule(m_sessionTimeout / 2, &BngControl::IdleSessionSweep, this);
+  SetupSubscriberRouting();
 
   /* Create IGMP socket (Downstream) */
   m_sock_igmp_down = Socket::CreateSocket(GetNode(), TypeId::LookupByName("ns3::Ipv4RawSocketFactory"));
@@ -426,6 +505,68 @@ void BngControl::StopApplication(void)
   NS_LOG_FUNCTION(this);
 }
 
+void BngControl::SetupSubscriberRouting()
+{
+  NS_LOG_FUNCTION(this);
+
+  if (m_subscriberRouting != 0)
+    return;
+
+  Ptr<Ipv4> ipv4 = GetNode()->GetObject<Ipv4> ();
+  Ptr<Ipv4ListRouting> listRouting = DynamicCast<Ipv4ListRouting>(ipv4->GetRoutingProtocol());
+
+  NS_ABORT_MSG_IF(listRouting == 0, "BNG node SHOULD use Ipv4ListRouting");
+
+  m_subscriberRouting = CreateObject<BngSubscriberRouting>();
+  m_subscriberRouting->SetForwardCallback(MakeCallback(&BngControl::DownstreamMonitor, this));
+  listRouting->AddRoutingProtocol(m_subscriberRouting, m_subscriberRoutingPriority);
+
+  SetupBackupPath();
+
+  /* Upstream only sees the lease pools, once */
+  Ptr<GlobalRouter> router = GetNode()->GetObject<GlobalRouter>();
+
+  if (router == 0 || m_dhcp == 0)
+    return;
+
+  Ipv4AddressValue poolAddress;
+  Ipv4MaskValue poolMask;
+  m_dhcp->GetAttribute("PoolAddresses", poolAddress);
+  m_dhcp->GetAttribute("PoolMask", poolMask);
+
+  /* The local pool is only created when the server starts */
+  Ipv4Address localNet = poolAddress.Get().CombineMask(poolMask.Get());
+  router->InjectRoute(localNet, poolMask.Get());
+
+  /* Pools of the subscribers behind relay agents */
+  for (uint32_t i = 0; i < m_dhcp->GetNPools(); ++i)
+    {
+      Ptr<DhcpAddressPool> pool = m_dhcp->GetPool(i);
+
+      if (pool->GetNetwork() == localNet && pool->GetMask() == poolMask.Get())
+        continue;
+
+      router->InjectRoute(pool->GetNetwork(), pool->GetMask());
+    }
+
+  Ipv4GlobalRoutingHelper::RecomputeRoutingTables();
+}
+
+void BngControl::SetupBackupPath()
+{
+  NS_LOG_FUNCTION(this << m_backupGateway);
+
+  Ptr<Ipv4> ipv4 = GetNode()->GetObject<Ipv4> ();
+  int32_t accessIf = ipv4->GetInterfaceForDevice(m_accessNetPort);
+
+  /* Computed once, failover only flips the path state */
+  if (m_backupGateway != Ipv4Address::GetAny())
+    m_subscriberRouting->SetBackupPath(accessIf, ipv4->GetInterfaceForDevice(m_regionalNetPort),
+                                       m_backupGateway);
+
+  m_subscriberRouting->SetPathFailed(accessIf, m_accessPathFailed);
+}
+
 Ipv4Address BngControl::discoverLocalAddress(Ptr<NetDevice> device)
 {
   NS_LOG_FUNCTION(device);
@@ -446,26 +587,170 @@ Ipv4Address BngControl::discoverLocalAddress(Ptr<NetDevice> device)
   return Ipv4Address::GetAny();
 }
 
-void BngControl::IdleSessionSweep()
+void BngControl::ArmInterimUpdate(const Mac48Address &cpeHwId)
 {
-  NS_LOG_FUNCTION(this);
-  for (auto &sessionE: m_sessionMap)
+  NS_LOG_FUNCTION(this << cpeHwId);
+
+  if (m_interimInterval.IsZero())
+    return;
+
+  /* Sessions keep their slot when the line comes back */
+  if (m_interimSlotMap.emplace(cpeHwId, m_interimNext).second)
     {
-      SubscriberSession &ss = sessionE.second;
+      m_interimSlots[m_interimNext].push_back(cpeHwId);
+      m_interimNext = (m_interimNext + 1) % INTERIM_SLOTS;
+    }
 
-      if (ss.IsActive() && ss.GetIdletime() > m_sessionTimeout)
-        {
-          NS_LOG_INFO(this << " Session Timeout: " << ss.GetSessionId() << " Idle time " << ss.GetIdletime().GetSeconds());
-          if (ss.GetIpv4Address() != Ipv4Address::GetAny())
-            SubscriberIpSessionTearDown(sessionE.first, ss.GetIpv4Address());
-          if (ss.GetIpv6Address() != Ipv6Address::GetAny())
-            SubscriberIpSessionTearDown(sessionE.first, ss.GetIpv6Address());
+  if (!m_interimEvent.IsRunning())
+    m_interimEvent = Simulator::Schedule(m_interimInterval / INTERIM_SLOTS,
+                                         &BngControl::AdvanceInterimSlot, this);
+}
+
+void BngControl::AdvanceInterimSlot()
+{
+  NS_LOG_FUNCTION(this << m_interimPos);
+
+  for (auto &cpeHwId : m_interimSlots[m_interimPos])
+    {
+      const SubscriberSession &ss = m_sessionMap.find(cpeHwId)->second;
 
-          SubscriberPortDown(ss.GetAnAddress(), ss.GetCircuitId());
+      /* Just started, the Start record is recent enough */
+      if (ss.IsActive() && ss.GetUptime() >= m_interimInterval / 2)
+        {
+          ss.SendInterimUpdate();
+          m_interimTrace(cpeHwId);
         }
     }
 
-  m_sessionSweepEvent = Simulator::Schedule(m_sessionTimeout / 2, &BngControl::IdleSessionSweep, this);
+  m_interimPos = (m_interimPos + 1) % INTERIM_SLOTS;
+
+  /* Restarted by ArmInterimUpdate when a session comes up again */
+  if (m_nActiveSessions > 0)
+    m_interimEvent = Simulator::Schedule(m_interimInterval / INTERIM_SLOTS,
+                                         &BngControl::AdvanceInterimSlot, this);
+}
+
+void BngControl::ArmIdleTimer(const Mac48Address &cpeHwId)
+{
+  NS_LOG_FUNCTION(this << cpeHwId);
+
+  if (m_sessionTimeout.IsZero())
+    return;
+
+  uint32_t serial = ++m_idleSerial;
+  m_idleArmed[cpeHwId] = serial;
+  CancelIdleExpire(cpeHwId);
+
+  FileIdleTimer(cpeHwId, serial, Simulator::Now() + m_sessionTimeout);
+}
+
+void BngControl::FileIdleTimer(const Mac48Address &cpeHwId, uint32_t serial, Time deadline)
+{
+  Time now = Simulator::Now();
+
+  if (deadline - now < m_idleTick)
+    {
+      m_idleExpire[cpeHwId] = Simulator::Schedule(Max(deadline - now, Time(0)),
+                                                  &BngControl::IdleSessionExpire, this,
+                                                  cpeHwId, serial);
+      return;
+    }
+
+  if (!m_idleEvent.IsRunning())
+    {
+      m_idleNextTick = now + m_idleTick;
+      m_idleEvent = Simulator::Schedule(m_idleTick, &BngControl::AdvanceIdleWheel, this);
+    }
+
+  /* Never after the deadline, far deadlines are re-filed later */
+  int64_t ticks = (deadline - m_idleNextTick).GetTimeStep() / m_idleTick.GetTimeStep();
+  ticks = std::min<int64_t>(std::max<int64_t>(ticks, 0), IDLE_WHEEL_SLOTS - 1);
+
+  m_idleWheel[(m_idlePos + ticks) % IDLE_WHEEL_SLOTS].push_back(std::make_pair(cpeHwId, serial));
+}
+
+void BngControl::AdvanceIdleWheel()
+{
+  NS_LOG_FUNCTION(this << m_idlePos);
+
+  Time now = Simulator::Now();
+  uint32_t current = m_idlePos;
+  IdleBucket bucket;
+
+  bucket.swap(m_idleWheel[current]);
+  m_idlePos = (m_idlePos + 1) % IDLE_WHEEL_SLOTS;
+  m_idleNextTick = now + m_idleTick;
+  ++m_idleTicks;
+
+  for (auto &item : bucket)
+    {
+      auto armed = m_idleArmed.find(item.first);
+
+      /* Stale: session went down or was re-armed since */
+      if (armed == m_idleArmed.end() || armed->second != item.second)
+        continue;
+
+      const SubscriberSession &ss = m_sessionMap.find(item.first)->second;
+      FileIdleTimer(item.first, item.second, now + m_sessionTimeout - ss.GetIdletime());
+    }
+
+  /* Give the storage back, avoid reallocating every lap */
+  bucket.clear();
+  if (m_idleWheel[current].empty())
+    m_idleWheel[current].swap(bucket);
+
+  /* A session re-filed above may have restarted the wheel already */
+  if (!m_idleArmed.empty() && !m_idleEvent.IsRunning())
+    m_idleEvent = Simulator::Schedule(m_idleTick, &BngControl::AdvanceIdleWheel, this);
+}
+
+void BngControl::CancelIdleExpire(const Mac48Address &cpeHwId)
+{
+  auto expire = m_idleExpire.find(cpeHwId);
+
+  if (expire == m_idleExpire.end())
+    return;
+
+  Simulator::Cancel(expire->second);
+  m_idleExpire.erase(expire);
+}
+
+uint64_t BngControl::GetNIdleTicks() const
+{
+  return m_idleTicks;
+}
+
+void BngControl::IdleSessionExpire(Mac48Address cpeHwId, uint32_t serial)
+{
+  /* This is the tracked event, it may be re-filed below */
+  m_idleExpire.erase(cpeHwId);
+
+  auto armed = m_idleArmed.find(cpeHwId);
+
+  if (armed == m_idleArmed.end() || armed->second != serial)
+    return;
+
+  SubscriberSession &ss = m_sessionMap.find(cpeHwId)->second;
+
+  if (ss.GetIdletime() < m_sessionTimeout)
+    {
+      /* Seen since it was filed */
+      FileIdleTimer(cpeHwId, serial, Simulator::Now() + m_sessionTimeout - ss.GetIdletime());
+      return;
+    }
+
+  NS_LOG_FUNCTION(this << cpeHwId);
+  NS_LOG_INFO(this << " Session Timeout: " << ss.GetSessionId() << " Idle time " << ss.GetIdletime().GetSeconds());
+
+  m_idleArmed.erase(armed);
+  m_idleTimeoutTrace(cpeHwId);
+
+  if (ss.GetIpv4Address() != Ipv4Address::GetAny())
+    SubscriberIpSessionTearDown(cpeHwId, ss.GetIpv4Address());
+  if (ss.GetIpv6Address() != Ipv6Address::GetAny())
+    SubscriberIpSessionTearDown(cpeHwId, ss.GetIpv6Address());
+
+  SubscriberPortDown(ss.GetAnAddress(), ss.GetCircuitId());
 }
 
 void BngControl::HandleReadIgmp(Ptr<Socket> socket)
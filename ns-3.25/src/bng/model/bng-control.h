@@ -22,6 +22,10 @@
 #define __BNG_NET_DEVICE_H__
 
 #include <list>
+#include <map>
+#include <set>
+#include <vector>
+#include <unordered_map>
 #include "ns3/application.h"
 #include "ns3/ipv4-address.h"
 #include "ns3/ipv6-address.h"
@@ -30,6 +34,7 @@
 #include "ns3/packet.h"
 #include "ns3/net-device.h"
 #include <ns3/event-id.h>
+#include "ns3/traced-callback.h"
 #include "ns3/bng-session.h"
 
 namespace ns3 {
@@ -39,6 +44,8 @@ class RadiusClient;
 class Packet;
 class Ipv4Interface;
 class Socket;
+class BngSubscriberRouting;
+class BfdEchoAgent;
 
 class BngControl : public Application {
 public:
@@ -90,6 +97,14 @@ public:
    */
   void SetAccessNetPort(Ptr<NetDevice> accessNetPort);
 
+  /**
+   * \brief Monitor the access path with a BFD session
+   *
+   * When the session goes down, subscriber traffic is sent to the
+   * BackupGateway through the regional port until it comes back.
+   */
+  void SetAccessPathMonitor(Ptr<BfdEchoAgent> agent);
+
   /* ANCP callbacks */
   int SubscriberPortUp(const Mac48Address &anId, const std::string &circuit_id,
                        uint32_t rate_up, uint32_t rate_down, uint32_t tag);
@@ -109,6 +124,11 @@ public:
   void AddMcastProfile(const Mac48Address &cpeHwId, const std::string &profName);
   void SetupMcastProfile(const struct McastProfile &profile);
 
+  /**
+   * \brief Number of idle timing wheel ticks run so far
+   */
+  uint64_t GetNIdleTicks() const;
+
 protected:
 
   virtual void DoDispose(void);
@@ -121,7 +141,31 @@ private:
                        uint16_t protocol, Address const &source,
                        Address const &destination, NetDevice::PacketType packetType);
 
-  void IdleSessionSweep();
+  /*
+   * Idle sessions are found with a timing wheel. Activity only updates
+   * the session last seen time; when its bucket fires the session is
+   * either filed again under the new deadline or, once the deadline is
+   * less than a tick away, given a one-shot event at the exact time.
+   */
+  void DownstreamMonitor(Ipv4Address address, uint32_t size);
+
+  void AccessPathStateChanged(bool up);
+  void SetupBackupPath();
+
+  /*
+   * Interim accounting slots split the interval in INTERIM_SLOTS ticks.
+   * Sessions are dealt round-robin over the slots when they come up, so
+   * each tick reports about the same number of sessions.
+   */
+  void ArmInterimUpdate(const Mac48Address &cpeHwId);
+  void AdvanceInterimSlot();
+
+  void ArmIdleTimer(const Mac48Address &cpeHwId);
+  void FileIdleTimer(const Mac48Address &cpeHwId, uint32_t serial, Time deadline);
+  void AdvanceIdleWheel();
+  void IdleSessionExpire(Mac48Address cpeHwId, uint32_t serial);
+  void CancelIdleExpire(const Mac48Address &cpeHwId);
+  void SetupSubscriberRouting();
   Ipv4Address discoverLocalAddress(Ptr<NetDevice> device);
   void HandleReadIgmp(Ptr<Socket> socket);
   void SendIgmpJoinUpstream(const Address& group, const Address &src);
@@ -135,14 +179,43 @@ private:
   Ptr<AncpNasAgent> m_agent;
   Ptr<RadiusClient> m_radClient;
   Ptr<DhcpServer> m_dhcp;
+  Ptr<BngSubscriberRouting> m_subscriberRouting;
 
   std::map<Mac48Address, SubscriberSession> m_sessionMap;
+  std::unordered_map<uint32_t, SubscriberSession*> m_ipv4SessionMap; /**< Downstream accounting */
   std::map<Mac48Address, std::string> m_accessProfileMap;
   std::map<Mac48Address, std::string> m_mcastProfileMap;
   std::map<std::string, struct McastProfile> m_mcastProfiles;
 
-  EventId m_sessionSweepEvent;
+  typedef std::vector<std::pair<Mac48Address, uint32_t> > IdleBucket;
+
+  static const uint32_t IDLE_WHEEL_SLOTS;   /**< Timing wheel resolution */
+
+  std::vector<IdleBucket> m_idleWheel;
+  uint32_t m_idlePos;                       /**< Bucket processed by the next tick */
+  Time m_idleNextTick;
+  Time m_idleTick;
+  uint32_t m_idleSerial;
+  std::map<Mac48Address, uint32_t> m_idleArmed; /**< Live timer of each active session */
+  std::map<Mac48Address, EventId> m_idleExpire; /**< Deadlines closer than a tick */
+  EventId m_idleEvent;
+  uint64_t m_idleTicks;
+  TracedCallback<Mac48Address> m_idleTimeoutTrace;
   Time m_sessionTimeout;
+  uint32_t m_nActiveSessions;
+
+  static const uint32_t INTERIM_SLOTS;
+
+  std::vector<std::vector<Mac48Address> > m_interimSlots;
+  std::map<Mac48Address, uint32_t> m_interimSlotMap;  /**< Slot of each session */
+  uint32_t m_interimPos;                    /**< Slot reported by the next tick */
+  uint32_t m_interimNext;                   /**< Slot given to the next session */
+  EventId m_interimEvent;
+  Time m_interimInterval;
+  TracedCallback<Mac48Address> m_interimTrace;
+  int16_t m_subscriberRoutingPriority;
+  Ipv4Address m_backupGateway;
+  bool m_accessPathFailed;
 
   Ptr<Socket> m_sock_igmp_up;
   Ptr<Socket> m_sock_igmp_down;
@@ -45,6 +45,10 @@ SubscriberSession::SubscriberSession(const Mac48Address &anId,
   m_downRate(0),
   m_startTime(Simulator::Now()),
   m_lastSeen(Simulator::Now()),
+  m_usBytes(0),
+  m_usPkts(0),
+  m_dsBytes(0),
+  m_dsPkts(0),
   m_radiusClient(radClient)
 {
   NS_LOG_FUNCTION(this << anId << circuitId);
@@ -118,6 +122,7 @@ void SubscriberSession::UpdateLineStatus(bool active, uint32_t upRate, uint32_t
       m_upRate = upRate;
       m_downRate = downRate;
       m_lastSeen = m_startTime = Simulator::Now();
+      m_usBytes = m_usPkts = m_dsBytes = m_dsPkts = 0;
       if (m_radiusClient)
         {
           m_radiusClient->DoStartAccounting(RadiusAVP::RAD_ACCT_START,
@@ -160,10 +165,33 @@ const std::string &SubscriberSession::GetCircuitId() const
   return m_circuitId;
 }
 
-void SubscriberSession::AccPacket(enum PacketDir dir, Ptr<const Packet> pkt)
+void SubscriberSession::AccPacket(enum PacketDir dir, uint32_t size)
 {
-  NS_LOG_FUNCTION(this << m_sessionId);
-  m_lastSeen = Simulator::Now();
+  switch (dir)
+    {
+    case DOWNSTREAM:
+      ++m_dsPkts;
+      m_dsBytes += size;
+      break;
+
+    case UPSTREAM:
+      ++m_usPkts;
+      m_usBytes += size;
+      /* Only the subscriber own traffic keeps the session alive */
+      m_lastSeen = Simulator::Now();
+      break;
+    }
+}
+
+void SubscriberSession::SendInterimUpdate() const
+{
+  NS_LOG_FUNCTION(this << m_sessionId << m_usBytes << m_dsBytes);
+
+  if (m_radiusClient)
+    {
+      m_radiusClient->DoInterimAccounting(m_sessionId, GetUptime().GetSeconds(),
+                                          m_usBytes, m_dsBytes, m_usPkts, m_dsPkts);
+    }
 }
 
 std::string SubscriberSession::GenerateId(const Mac48Address &anId,
@@ -49,7 +49,17 @@ public:
 
   void UpdateLineStatus(bool active, uint32_t upRate, uint32_t downRate);
 
-  void AccPacket(enum PacketDir dir, Ptr<const Packet> pkt);
+  /**
+   * \brief Account a packet of this session
+   * \param dir         packet direction
+   * \param size        IP packet size, in bytes
+   */
+  void AccPacket(enum PacketDir dir, uint32_t size);
+
+  /**
+   * \brief Report the session counters to RADIUS (Interim-Update)
+   */
+  void SendInterimUpdate() const;
 
   Time GetUptime() const;
   Time GetIdletime() const;
@@ -74,6 +84,10 @@ private:
   uint32_t m_downRate;
   Time m_startTime;
   Time m_lastSeen;
+  uint64_t m_usBytes;                   /**< Acct-Input-Octets */
+  uint64_t m_usPkts;
+  uint64_t m_dsBytes;                   /**< Acct-Output-Octets */
+  uint64_t m_dsPkts;
   Ptr<RadiusClient> m_radiusClient;
 };
 } /* namespace ns3  */
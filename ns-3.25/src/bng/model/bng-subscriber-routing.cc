@@ -0,0 +1,244 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+/*
+ * Copyright (c) 2015 UFRGS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Alexsander de Souza <asouza@inf.ufrgs.br>
+ */
+
+#include <iomanip>
+#include "ns3/log.h"
+#include "ns3/node.h"
+#include "ns3/simulator.h"
+#include "ns3/ipv4-route.h"
+#include "ns3/output-stream-wrapper.h"
+#include "ns3/bng-subscriber-routing.h"
+
+namespace ns3 {
+NS_LOG_COMPONENT_DEFINE("BngSubscriberRouting");
+
+NS_OBJECT_ENSURE_REGISTERED(BngSubscriberRouting);
+
+TypeId
+BngSubscriberRouting::GetTypeId(void)
+{
+  static TypeId tid = TypeId("ns3::BngSubscriberRouting")
+                      .SetParent<Ipv4RoutingProtocol>()
+                      .AddConstructor<BngSubscriberRouting>()
+  ;
+
+  return tid;
+}
+
+BngSubscriberRouting::BngSubscriberRouting() :
+  m_ipv4(0)
+{
+  NS_LOG_FUNCTION_NOARGS();
+}
+
+BngSubscriberRouting::~BngSubscriberRouting()
+{
+  NS_LOG_FUNCTION_NOARGS();
+}
+
+void BngSubscriberRouting::DoDispose(void)
+{
+  NS_LOG_FUNCTION_NOARGS();
+  m_hosts.clear();
+  m_paths.clear();
+  m_ipv4 = 0;
+  m_forwardCb = MakeNullCallback<void, Ipv4Address, uint32_t>();
+  Ipv4RoutingProtocol::DoDispose();
+}
+
+void BngSubscriberRouting::AddSubscriber(Ipv4Address address, uint32_t interface)
+{
+  NS_LOG_FUNCTION(this << address << interface);
+  m_hosts[address.Get()] = interface;
+}
+
+bool BngSubscriberRouting::RemoveSubscriber(Ipv4Address address)
+{
+  NS_LOG_FUNCTION(this << address);
+  return m_hosts.erase(address.Get()) > 0;
+}
+
+uint32_t BngSubscriberRouting::GetNSubscribers(void) const
+{
+  return m_hosts.size();
+}
+
+void BngSubscriberRouting::SetForwardCallback(ForwardCallback cb)
+{
+  NS_LOG_FUNCTION(this);
+  m_forwardCb = cb;
+}
+
+void BngSubscriberRouting::SetBackupPath(uint32_t interface, uint32_t backupInterface,
+                                         Ipv4Address backupGateway)
+{
+  NS_LOG_FUNCTION(this << interface << backupInterface << backupGateway);
+
+  if (interface >= m_paths.size())
+    m_paths.resize(interface + 1);
+
+  m_paths[interface].backupInterface = backupInterface;
+  m_paths[interface].backupGateway = backupGateway;
+}
+
+void BngSubscriberRouting::SetPathFailed(uint32_t interface, bool failed)
+{
+  NS_LOG_FUNCTION(this << interface << failed);
+
+  if (interface >= m_paths.size())
+    m_paths.resize(interface + 1);
+
+  m_paths[interface].failed = failed;
+}
+
+Ptr<Ipv4Route> BngSubscriberRouting::Lookup(Ipv4Address dest, Ptr<NetDevice> oif) const
+{
+  auto it = m_hosts.find(dest.Get());
+
+  if (it == m_hosts.end())
+    return 0;
+
+  uint32_t interface = it->second;
+
+  /* Subscribers are on-link, no gateway */
+  Ipv4Address gateway = Ipv4Address::GetZero();
+
+  if (interface < m_paths.size() && m_paths[interface].failed)
+    {
+      const Path &path = m_paths[interface];
+
+      if (path.backupGateway == Ipv4Address::GetAny())
+        return 0;
+
+      interface = path.backupInterface;
+      gateway = path.backupGateway;
+    }
+
+  if (!m_ipv4->IsUp(interface))
+    return 0;
+
+  Ptr<NetDevice> dev = m_ipv4->GetNetDevice(interface);
+
+  if (oif != 0 && oif != dev)
+    return 0;
+
+  Ptr<Ipv4Route> rtentry = Create<Ipv4Route>();
+  rtentry->SetDestination(dest);
+  rtentry->SetGateway(gateway);
+  rtentry->SetSource(m_ipv4->GetAddress(interface, 0).GetLocal());
+  rtentry->SetOutputDevice(dev);
+
+  return rtentry;
+}
+
+Ptr<Ipv4Route> BngSubscriberRouting::RouteOutput(Ptr<Packet> p, const Ipv4Header &header,
+                                                 Ptr<NetDevice> oif, Socket::SocketErrno &sockerr)
+{
+  NS_LOG_FUNCTION(this << header.GetDestination() << oif);
+
+  Ptr<Ipv4Route> rtentry = Lookup(header.GetDestination(), oif);
+
+  sockerr = (rtentry != 0) ? Socket::ERROR_NOTERROR : Socket::ERROR_NOROUTETOHOST;
+  return rtentry;
+}
+
+bool BngSubscriberRouting::RouteInput(Ptr<const Packet> p, const Ipv4Header &header,
+                                      Ptr<const NetDevice> idev, UnicastForwardCallback ucb,
+                                      MulticastForwardCallback mcb, LocalDeliverCallback lcb,
+                                      ErrorCallback ecb)
+{
+  NS_LOG_FUNCTION(this << header.GetDestination() << idev);
+
+  Ipv4Address dest = header.GetDestination();
+
+  /* Local and multicast delivery is left to the other protocols */
+  if (dest.IsMulticast() || dest.IsBroadcast())
+    return false;
+
+  int32_t iif = m_ipv4->GetInterfaceForDevice(idev);
+
+  if (iif < 0 || m_ipv4->IsDestinationAddress(dest, iif) || !m_ipv4->IsForwarding(iif))
+    return false;
+
+  Ptr<Ipv4Route> rtentry = Lookup(dest, 0);
+
+  if (rtentry == 0)
+    return false;
+
+  NS_LOG_LOGIC("Subscriber route to " << dest);
+
+  if (!m_forwardCb.IsNull())
+    m_forwardCb(dest, p->GetSize() + header.GetSerializedSize());
+
+  ucb(rtentry, p, header);
+  return true;
+}
+
+void BngSubscriberRouting::NotifyInterfaceUp(uint32_t interface)
+{
+  NS_LOG_FUNCTION(this << interface);
+}
+
+void BngSubscriberRouting::NotifyInterfaceDown(uint32_t interface)
+{
+  NS_LOG_FUNCTION(this << interface);
+  /* Routes are kept, Lookup() skips interfaces that are down */
+}
+
+void BngSubscriberRouting::NotifyAddAddress(uint32_t interface, Ipv4InterfaceAddress address)
+{
+  NS_LOG_FUNCTION(this << interface << address);
+}
+
+void BngSubscriberRouting::NotifyRemoveAddress(uint32_t interface, Ipv4InterfaceAddress address)
+{
+  NS_LOG_FUNCTION(this << interface << address);
+}
+
+void BngSubscriberRouting::SetIpv4(Ptr<Ipv4> ipv4)
+{
+  NS_LOG_FUNCTION(this << ipv4);
+  NS_ASSERT(m_ipv4 == 0 && ipv4 != 0);
+  m_ipv4 = ipv4;
+}
+
+void BngSubscriberRouting::PrintRoutingTable(Ptr<OutputStreamWrapper> stream) const
+{
+  std::ostream *os = stream->GetStream();
+
+  *os << "Node: " << m_ipv4->GetObject<Node>()->GetId()
+      << ", Time: " << Simulator::Now().GetSeconds() << "s"
+      << ", BngSubscriberRouting table (" << m_hosts.size() << " subscribers)" << std::endl;
+
+  for (auto &host : m_hosts)
+    {
+      *os << std::setw(16) << std::left << Ipv4Address(host.first)
+          << " if " << host.second;
+
+      if (host.second < m_paths.size() && m_paths[host.second].failed)
+        *os << " via " << m_paths[host.second].backupGateway
+            << " if " << m_paths[host.second].backupInterface;
+
+      *os << std::endl;
+    }
+  *os << std::endl;
+}
+}
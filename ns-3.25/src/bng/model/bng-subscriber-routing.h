@@ -0,0 +1,129 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+/*
+ * Copyright (c) 2015 UFRGS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Alexsander de Souza <asouza@inf.ufrgs.br>
+ */
+#ifndef __BNG_SUBSCRIBER_ROUTING_H__
+#define __BNG_SUBSCRIBER_ROUTING_H__
+
+#include <unordered_map>
+#include <vector>
+#include "ns3/ipv4-address.h"
+#include "ns3/ipv4-routing-protocol.h"
+
+namespace ns3 {
+/**
+ * \brief Subscriber host routes of a BNG
+ *
+ * Keeps one /32 per IP session, keyed by address, so adding and removing
+ * a session is O(1) and never touches the static or global routing
+ * tables. Upstream routers only learn the pool aggregates, which are
+ * injected once by BngControl.
+ */
+class BngSubscriberRouting : public Ipv4RoutingProtocol {
+public:
+  /**
+   * \brief Notified of every packet forwarded to a subscriber
+   * \param address     subscriber address
+   * \param size        IP packet size, in bytes
+   */
+  typedef Callback<void, Ipv4Address, uint32_t> ForwardCallback;
+
+  /**
+   * \brief Get the type ID.
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId(void);
+
+  BngSubscriberRouting();
+
+  virtual ~BngSubscriberRouting();
+
+  /**
+   * \brief Add (or move) a subscriber host route
+   * \param address     subscriber address
+   * \param interface   outgoing interface index
+   */
+  void AddSubscriber(Ipv4Address address, uint32_t interface);
+
+  /**
+   * \brief Remove a subscriber host route
+   * \return false if there was no route to this address
+   */
+  bool RemoveSubscriber(Ipv4Address address);
+
+  uint32_t GetNSubscribers(void) const;
+
+  void SetForwardCallback(ForwardCallback cb);
+
+  /**
+   * \brief Precompute the backup path of the subscribers behind an interface
+   * \param interface         subscriber interface
+   * \param backupInterface   outgoing interface of the backup path
+   * \param backupGateway     backup next-hop, e.g. a peer BNG
+   */
+  void SetBackupPath(uint32_t interface, uint32_t backupInterface, Ipv4Address backupGateway);
+
+  /**
+   * \brief Move the subscribers behind an interface to the backup path, or back
+   *
+   * Host routes only name their interface, the path is resolved on lookup,
+   * so switching costs the same whatever the number of subscribers.
+   */
+  void SetPathFailed(uint32_t interface, bool failed);
+
+  /* Ipv4RoutingProtocol */
+  virtual Ptr<Ipv4Route> RouteOutput(Ptr<Packet> p, const Ipv4Header &header,
+                                     Ptr<NetDevice> oif, Socket::SocketErrno &sockerr);
+
+  virtual bool RouteInput(Ptr<const Packet> p, const Ipv4Header &header,
+                          Ptr<const NetDevice> idev, UnicastForwardCallback ucb,
+                          MulticastForwardCallback mcb, LocalDeliverCallback lcb,
+                          ErrorCallback ecb);
+
+  virtual void NotifyInterfaceUp(uint32_t interface);
+  virtual void NotifyInterfaceDown(uint32_t interface);
+  virtual void NotifyAddAddress(uint32_t interface, Ipv4InterfaceAddress address);
+  virtual void NotifyRemoveAddress(uint32_t interface, Ipv4InterfaceAddress address);
+  virtual void SetIpv4(Ptr<Ipv4> ipv4);
+  virtual void PrintRoutingTable(Ptr<OutputStreamWrapper> stream) const;
+
+protected:
+
+  virtual void DoDispose(void);
+
+private:
+  Ptr<Ipv4Route> Lookup(Ipv4Address dest, Ptr<NetDevice> oif) const;
+
+  Ptr<Ipv4> m_ipv4;
+  std::unordered_map<uint32_t, uint32_t> m_hosts; /*!< address -> interface */
+  ForwardCallback m_forwardCb;
+
+  struct Path
+  {
+    Path() : failed(false), backupInterface(0), backupGateway(Ipv4Address::GetAny()) {}
+
+    bool failed;
+    uint32_t backupInterface;
+    Ipv4Address backupGateway;     /*!< Any if there is no backup */
+  };
+
+  std::vector<Path> m_paths;        /*!< Indexed by subscriber interface */
+};
+}
+#endif /* __BNG_SUBSCRIBER_ROUTING_H__ */
@@ -1,55 +1,460 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
 
-// Include a header file from your module to test.
-#include "ns3/bng.h"
+/*
+ * Copyright (c) 2015 UFRGS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Alexsander de Souza <asouza@inf.ufrgs.br>
+ */
 
-// An essential include is test.h
+#include <map>
+#include <vector>
 #include "ns3/test.h"
+#include "ns3/simulator.h"
+#include "ns3/nstime.h"
+#include "ns3/mac48-address.h"
+#include "ns3/packet.h"
+#include "ns3/node-container.h"
+#include "ns3/net-device-container.h"
+#include "ns3/csma-helper.h"
+#include "ns3/internet-stack-helper.h"
+#include "ns3/ipv4-address-helper.h"
+#include "ns3/ipv4-header.h"
+#include "ns3/ipv4-route.h"
+#include "ns3/bng-control.h"
+#include "ns3/bng-subscriber-routing.h"
 
-// Do not put your test classes in namespace ns3.  You may find it useful
-// to use the using directive to access the ns3 namespace directly
 using namespace ns3;
 
-// This is an example TestCase.
-class BngTestCase1 : public TestCase
+/*
+ * Sessions are driven through the ANCP callbacks; without an ANCP agent,
+ * DHCP server or RADIUS client the BNG only runs its timers.
+ */
+static const Mac48Address AN_ID ("00:00:00:00:0a:01");
+
+class BngIdleTimerTestCase : public TestCase
+{
+public:
+  BngIdleTimerTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void Timeout (Mac48Address cpeHwId);
+
+  std::map<Mac48Address, Time> m_timeouts;
+};
+
+BngIdleTimerTestCase::BngIdleTimerTestCase ()
+  : TestCase ("Idle sessions expire once, the wheel runs a single tick chain")
+{
+}
+
+void
+BngIdleTimerTestCase::Timeout (Mac48Address cpeHwId)
+{
+  NS_TEST_EXPECT_MSG_EQ (m_timeouts.count (cpeHwId), 0, "Session " << cpeHwId << " timed out twice");
+  m_timeouts[cpeHwId] = Simulator::Now ();
+}
+
+void
+BngIdleTimerTestCase::DoRun (void)
+{
+  Ptr<BngControl> bng = CreateObject<BngControl> ();
+
+  /* Longer than the wheel, deadlines are re-filed from inside a tick */
+  bng->SetAttribute ("SessionIdleTimeout", TimeValue (Seconds (100)));
+  bng->SetAttribute ("SessionIdleTick", TimeValue (Seconds (1)));
+  bng->TraceConnectWithoutContext ("SessionIdleTimeout", MakeCallback (&BngIdleTimerTestCase::Timeout, this));
+
+  std::string rearmed = "00:00:00:00:00:01";
+  std::string dropped = "00:00:00:00:00:02";
+
+  Simulator::Schedule (Seconds (0), &BngControl::SubscriberPortUp, bng, AN_ID, rearmed, 1000, 1000, 0);
+  Simulator::Schedule (Seconds (0), &BngControl::SubscriberPortUp, bng, AN_ID, dropped, 1000, 1000, 0);
+
+  /* Re-armed sessions count from the new start */
+  Simulator::Schedule (Seconds (10), &BngControl::SubscriberPortUp, bng, AN_ID, rearmed, 1000, 1000, 0);
+  Simulator::Schedule (Seconds (50), &BngControl::SubscriberPortDown, bng, AN_ID, dropped);
+
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_timeouts.size (), 1, "Wrong number of idle sessions");
+  NS_TEST_EXPECT_MSG_EQ (m_timeouts[Mac48Address (rearmed.c_str ())], Seconds (110), "Re-armed session expired at the wrong time");
+
+  /* One tick per second, up to the first one with nothing armed */
+  NS_TEST_EXPECT_MSG_EQ (bng->GetNIdleTicks (), 111, "Wheel ticked more than once per period");
+  NS_TEST_EXPECT_MSG_EQ (Simulator::Now (), Seconds (111), "Wheel kept running without sessions");
+
+  bng->Dispose ();
+  Simulator::Destroy ();
+}
+
+class BngIdleDisposeTestCase : public TestCase
 {
 public:
-  BngTestCase1 ();
-  virtual ~BngTestCase1 ();
+  BngIdleDisposeTestCase ();
 
 private:
   virtual void DoRun (void);
+  void Timeout (Mac48Address cpeHwId);
+
+  uint32_t m_nTimeouts;
 };
 
-// Add some help text to this case to describe what it is intended to test
-BngTestCase1::BngTestCase1 ()
-  : TestCase ("Bng test case (does nothing)")
+BngIdleDisposeTestCase::BngIdleDisposeTestCase ()
+  : TestCase ("Dispose cancels the idle wheel and pending expirations"),
+    m_nTimeouts (0)
 {
 }
 
-// This destructor does nothing but we include it as a reminder that
-// the test case should clean up after itself
-BngTestCase1::~BngTestCase1 ()
+void
+BngIdleDisposeTestCase::Timeout (Mac48Address cpeHwId)
 {
+  ++m_nTimeouts;
 }
 
-//
-// This method is the pure virtual method from class TestCase that every
-// TestCase must implement
-//
 void
-BngTestCase1::DoRun (void)
+BngIdleDisposeTestCase::DoRun (void)
 {
-  // A wide variety of test macros are available in src/core/test.h
-  NS_TEST_ASSERT_MSG_EQ (true, true, "true doesn't equal true for some reason");
-  // Use this one for floating point comparisons
-  NS_TEST_ASSERT_MSG_EQ_TOL (0.01, 0.01, 0.001, "Numbers are not equal within tolerance");
+  Ptr<BngControl> bng = CreateObject<BngControl> ();
+
+  bng->SetAttribute ("SessionIdleTimeout", TimeValue (Seconds (10)));
+  bng->SetAttribute ("SessionIdleTick", TimeValue (Seconds (1)));
+  bng->TraceConnectWithoutContext ("SessionIdleTimeout", MakeCallback (&BngIdleDisposeTestCase::Timeout, this));
+
+  /* The second one is off the tick grid, its last half second goes to a
+   * one-shot event at 10.5s */
+  Simulator::Schedule (Seconds (0), &BngControl::SubscriberPortUp, bng, AN_ID,
+                       std::string ("00:00:00:00:00:01"), 1000, 1000, 0);
+  Simulator::Schedule (MilliSeconds (500), &BngControl::SubscriberPortUp, bng, AN_ID,
+                       std::string ("00:00:00:00:00:02"), 1000, 1000, 0);
+  Simulator::Schedule (MilliSeconds (10200), &BngControl::Dispose, bng);
+
+  Simulator::Run ();
+
+  NS_TEST_EXPECT_MSG_EQ (m_nTimeouts, 1, "Expiration ran after Dispose");
+  NS_TEST_EXPECT_MSG_EQ (bng->GetNIdleTicks (), 10, "Wheel ticked after Dispose");
+
+  Simulator::Destroy ();
+}
+
+class BngInterimUpdateTestCase : public TestCase
+{
+public:
+  BngInterimUpdateTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void Interim (Mac48Address cpeHwId);
+
+  std::map<Mac48Address, std::vector<Time> > m_updates;
+};
+
+BngInterimUpdateTestCase::BngInterimUpdateTestCase ()
+  : TestCase ("Interim updates are sent every interval while sessions are active")
+{
+}
+
+void
+BngInterimUpdateTestCase::Interim (Mac48Address cpeHwId)
+{
+  m_updates[cpeHwId].push_back (Simulator::Now ());
+}
+
+void
+BngInterimUpdateTestCase::DoRun (void)
+{
+  Ptr<BngControl> bng = CreateObject<BngControl> ();
+
+  /* No idle control, one interim slot per second */
+  bng->SetAttribute ("SessionIdleTimeout", TimeValue (Seconds (0)));
+  bng->SetAttribute ("InterimInterval", TimeValue (Seconds (64)));
+  bng->TraceConnectWithoutContext ("InterimUpdate", MakeCallback (&BngInterimUpdateTestCase::Interim, this));
+
+  Mac48Address first ("00:00:00:00:00:01");
+  Mac48Address second ("00:00:00:00:00:02");
+
+  Simulator::Schedule (Seconds (0), &BngControl::SubscriberPortUp, bng, AN_ID, std::string ("00:00:00:00:00:01"), 1000, 1000, 0);
+  Simulator::Schedule (Seconds (0), &BngControl::SubscriberPortUp, bng, AN_ID, std::string ("00:00:00:00:00:02"), 1000, 1000, 0);
+  Simulator::Schedule (Seconds (100), &BngControl::SubscriberPortDown, bng, AN_ID, std::string ("00:00:00:00:00:02"));
+  Simulator::Schedule (Seconds (200), &BngControl::SubscriberPortDown, bng, AN_ID, std::string ("00:00:00:00:00:01"));
+
+  Simulator::Run ();
+
+  /* Slot 0 and 1, skipped on the first lap while the Start record is recent */
+  std::vector<Time> &updates = m_updates[first];
+  NS_TEST_ASSERT_MSG_EQ (updates.size (), 3, "Wrong number of interim updates");
+  NS_TEST_EXPECT_MSG_EQ (updates[0], Seconds (65), "First interim update at the wrong time");
+  for (uint32_t i = 1; i < updates.size (); ++i)
+    {
+      NS_TEST_EXPECT_MSG_EQ (updates[i] - updates[i - 1], Seconds (64), "Interim updates not one interval apart");
+    }
+
+  NS_TEST_ASSERT_MSG_EQ (m_updates[second].size (), 1, "Updates sent for a session that went down");
+  NS_TEST_EXPECT_MSG_EQ (m_updates[second][0], Seconds (66), "Interim update at the wrong time");
+
+  /* The slot wheel stops on its first tick after the last session went down */
+  NS_TEST_EXPECT_MSG_EQ (Simulator::Now (), Seconds (200), "Interim slots kept running without sessions");
+
+  bng->Dispose ();
+  Simulator::Destroy ();
+}
+
+/*
+ * BNG node with a regional (1), an access (2) and a backup (3) interface,
+ * each on its own link to a peer node.
+ */
+static Ptr<Ipv4>
+CreateBngNode (Ptr<BngSubscriberRouting> routing)
+{
+  NodeContainer bng;
+  NodeContainer peers;
+  bng.Create (1);
+  peers.Create (3);
+
+  CsmaHelper csma;
+  InternetStackHelper internet;
+  internet.Install (bng);
+  internet.Install (peers);
+
+  Ipv4AddressHelper ipv4;
+  const char *networks[] = { "10.0.0.0", "192.168.0.0", "10.1.0.0" };
+
+  for (uint32_t i = 0; i < 3; ++i)
+    {
+      NetDeviceContainer link = csma.Install (NodeContainer (bng.Get (0), peers.Get (i)));
+      ipv4.SetBase (networks[i], "255.255.255.0");
+      ipv4.Assign (link);
+    }
+
+  Ptr<Ipv4> stack = bng.Get (0)->GetObject<Ipv4> ();
+  routing->SetIpv4 (stack);
+  return stack;
+}
+
+static Ptr<Ipv4Route>
+RouteTo (Ptr<BngSubscriberRouting> routing, Ipv4Address dest, Ptr<NetDevice> oif = 0)
+{
+  Ipv4Header header;
+  header.SetDestination (dest);
+  Socket::SocketErrno sockerr;
+
+  return routing->RouteOutput (Create<Packet> (), header, oif, sockerr);
+}
+
+class BngSubscriberRoutingLookupTestCase : public TestCase
+{
+public:
+  BngSubscriberRoutingLookupTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+BngSubscriberRoutingLookupTestCase::BngSubscriberRoutingLookupTestCase ()
+  : TestCase ("Subscriber host routes are on-link, through their interface")
+{
+}
+
+void
+BngSubscriberRoutingLookupTestCase::DoRun (void)
+{
+  Ptr<BngSubscriberRouting> routing = CreateObject<BngSubscriberRouting> ();
+  Ptr<Ipv4> ipv4 = CreateBngNode (routing);
+  Ipv4Address host ("192.168.0.10");
+
+  routing->AddSubscriber (host, 2);
+  routing->AddSubscriber (Ipv4Address ("192.168.0.11"), 2);
+  NS_TEST_ASSERT_MSG_EQ (routing->GetNSubscribers (), 2, "Wrong number of subscribers");
+
+  Ptr<Ipv4Route> route = RouteTo (routing, host);
+  NS_TEST_ASSERT_MSG_NE ((route == 0), true, "No route to a subscriber");
+  NS_TEST_EXPECT_MSG_EQ (route->GetOutputDevice (), ipv4->GetNetDevice (2), "Wrong output device");
+  NS_TEST_EXPECT_MSG_EQ (route->GetGateway (), Ipv4Address::GetZero (), "Subscriber route has a gateway");
+  NS_TEST_EXPECT_MSG_EQ (route->GetSource (), Ipv4Address ("192.168.0.1"), "Wrong source address");
+
+  Ipv4Header header;
+  header.SetDestination (Ipv4Address ("192.168.0.12"));
+  Socket::SocketErrno sockerr;
+  NS_TEST_EXPECT_MSG_EQ ((routing->RouteOutput (Create<Packet> (), header, 0, sockerr) == 0), true, "Route to an unknown host");
+  NS_TEST_EXPECT_MSG_EQ (sockerr, Socket::ERROR_NOROUTETOHOST, "Wrong error for an unknown host");
+  NS_TEST_EXPECT_MSG_EQ ((RouteTo (routing, host, ipv4->GetNetDevice (1)) == 0), true, "Route through another device");
+
+  /* Re-added on another interface, the route moves */
+  routing->AddSubscriber (host, 3);
+  route = RouteTo (routing, host);
+  NS_TEST_ASSERT_MSG_NE ((route == 0), true, "No route to a moved subscriber");
+  NS_TEST_EXPECT_MSG_EQ (route->GetOutputDevice (), ipv4->GetNetDevice (3), "Route not moved");
+  NS_TEST_EXPECT_MSG_EQ (routing->GetNSubscribers (), 2, "Moved subscriber counted twice");
+
+  NS_TEST_EXPECT_MSG_EQ (routing->RemoveSubscriber (host), true, "Subscriber not removed");
+  NS_TEST_EXPECT_MSG_EQ (routing->RemoveSubscriber (host), false, "Subscriber removed twice");
+  NS_TEST_EXPECT_MSG_EQ ((RouteTo (routing, host) == 0), true, "Route to a removed subscriber");
+
+  /* Kept while the interface is down, but not used */
+  Ipv4Address other ("192.168.0.11");
+  ipv4->SetDown (2);
+  NS_TEST_EXPECT_MSG_EQ ((RouteTo (routing, other) == 0), true, "Route through an interface that is down");
+  ipv4->SetUp (2);
+  NS_TEST_EXPECT_MSG_EQ ((RouteTo (routing, other) == 0), false, "Route lost with the interface");
+
+  routing->Dispose ();
+  Simulator::Destroy ();
+}
+
+class BngSubscriberRoutingFailoverTestCase : public TestCase
+{
+public:
+  BngSubscriberRoutingFailoverTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+BngSubscriberRoutingFailoverTestCase::BngSubscriberRoutingFailoverTestCase ()
+  : TestCase ("Subscribers of a failed path use its backup, and come back")
+{
+}
+
+void
+BngSubscriberRoutingFailoverTestCase::DoRun (void)
+{
+  Ptr<BngSubscriberRouting> routing = CreateObject<BngSubscriberRouting> ();
+  Ptr<Ipv4> ipv4 = CreateBngNode (routing);
+  Ipv4Address host ("192.168.0.10");
+  Ipv4Address backup ("10.1.0.2");
+
+  routing->AddSubscriber (host, 2);
+
+  /* No backup, nowhere to go */
+  routing->SetPathFailed (2, true);
+  NS_TEST_EXPECT_MSG_EQ ((RouteTo (routing, host) == 0), true, "Route through a failed path");
+
+  routing->SetBackupPath (2, 3, backup);
+  Ptr<Ipv4Route> route = RouteTo (routing, host);
+  NS_TEST_ASSERT_MSG_NE ((route == 0), true, "No route through the backup path");
+  NS_TEST_EXPECT_MSG_EQ (route->GetOutputDevice (), ipv4->GetNetDevice (3), "Wrong backup device");
+  NS_TEST_EXPECT_MSG_EQ (route->GetGateway (), backup, "Wrong backup gateway");
+  NS_TEST_EXPECT_MSG_EQ (route->GetSource (), Ipv4Address ("10.1.0.1"), "Wrong backup source address");
+
+  /* Subscribers added meanwhile follow the path */
+  routing->AddSubscriber (Ipv4Address ("192.168.0.11"), 2);
+  route = RouteTo (routing, Ipv4Address ("192.168.0.11"));
+  NS_TEST_ASSERT_MSG_NE ((route == 0), true, "No backup route for a new subscriber");
+  NS_TEST_EXPECT_MSG_EQ (route->GetGateway (), backup, "New subscriber not on the backup path");
+
+  routing->SetPathFailed (2, false);
+  route = RouteTo (routing, host);
+  NS_TEST_ASSERT_MSG_NE ((route == 0), true, "No route after the path came back");
+  NS_TEST_EXPECT_MSG_EQ (route->GetOutputDevice (), ipv4->GetNetDevice (2), "Still on the backup path");
+  NS_TEST_EXPECT_MSG_EQ (route->GetGateway (), Ipv4Address::GetZero (), "Still through the backup gateway");
+
+  routing->Dispose ();
+  Simulator::Destroy ();
+}
+
+class BngSubscriberRoutingForwardTestCase : public TestCase
+{
+public:
+  BngSubscriberRoutingForwardTestCase ();
+
+private:
+  virtual void DoRun (void);
+  bool Input (Ptr<BngSubscriberRouting> routing, Ptr<NetDevice> idev, Ipv4Address dest, uint32_t size);
+  void Forwarded (Ipv4Address address, uint32_t size);
+  void Unicast (Ptr<Ipv4Route> route, Ptr<const Packet> packet, const Ipv4Header &header);
+
+  std::map<Ipv4Address, uint32_t> m_bytes;
+  uint32_t m_nUnicast;
+  Ptr<Ipv4Route> m_route;
+};
+
+BngSubscriberRoutingForwardTestCase::BngSubscriberRoutingForwardTestCase ()
+  : TestCase ("Packets forwarded to subscribers are accounted once"),
+    m_nUnicast (0)
+{
+}
+
+void
+BngSubscriberRoutingForwardTestCase::Forwarded (Ipv4Address address, uint32_t size)
+{
+  m_bytes[address] += size;
+}
+
+void
+BngSubscriberRoutingForwardTestCase::Unicast (Ptr<Ipv4Route> route, Ptr<const Packet> packet,
+                                              const Ipv4Header &header)
+{
+  ++m_nUnicast;
+  m_route = route;
+}
+
+bool
+BngSubscriberRoutingForwardTestCase::Input (Ptr<BngSubscriberRouting> routing, Ptr<NetDevice> idev,
+                                            Ipv4Address dest, uint32_t size)
+{
+  Ipv4Header header;
+  header.SetSource (Ipv4Address ("10.0.0.2"));
+  header.SetDestination (dest);
+  header.SetPayloadSize (size);
+
+  return routing->RouteInput (Create<Packet> (size), header, idev,
+                              MakeCallback (&BngSubscriberRoutingForwardTestCase::Unicast, this),
+                              MakeNullCallback<void, Ptr<Ipv4MulticastRoute>, Ptr<const Packet>, const Ipv4Header &> (),
+                              MakeNullCallback<void, Ptr<const Packet>, const Ipv4Header &, uint32_t> (),
+                              MakeNullCallback<void, Ptr<const Packet>, const Ipv4Header &, Socket::SocketErrno> ());
+}
+
+void
+BngSubscriberRoutingForwardTestCase::DoRun (void)
+{
+  Ptr<BngSubscriberRouting> routing = CreateObject<BngSubscriberRouting> ();
+  Ptr<Ipv4> ipv4 = CreateBngNode (routing);
+  Ptr<NetDevice> regional = ipv4->GetNetDevice (1);
+  Ipv4Address host ("192.168.0.10");
+
+  routing->AddSubscriber (host, 2);
+  routing->SetForwardCallback (MakeCallback (&BngSubscriberRoutingForwardTestCase::Forwarded, this));
+
+  NS_TEST_EXPECT_MSG_EQ (Input (routing, regional, host, 1000), true, "Subscriber packet not forwarded");
+  NS_TEST_EXPECT_MSG_EQ (Input (routing, regional, host, 480), true, "Subscriber packet not forwarded");
+  NS_TEST_EXPECT_MSG_EQ (m_nUnicast, 2, "Forward callback not called once per packet");
+  NS_TEST_ASSERT_MSG_NE ((m_route == 0), true, "No route given to the forward callback");
+  NS_TEST_EXPECT_MSG_EQ (m_route->GetOutputDevice (), ipv4->GetNetDevice (2), "Forwarded through the wrong device");
+
+  /* IP header included */
+  NS_TEST_EXPECT_MSG_EQ (m_bytes[host], 1520, "Wrong downstream byte count");
+
+  /* Left to the other routing protocols, not accounted */
+  NS_TEST_EXPECT_MSG_EQ (Input (routing, regional, Ipv4Address ("192.168.0.11"), 100), false, "Unknown host forwarded");
+  NS_TEST_EXPECT_MSG_EQ (Input (routing, regional, Ipv4Address ("10.0.0.1"), 100), false, "Local packet forwarded");
+  NS_TEST_EXPECT_MSG_EQ (Input (routing, regional, Ipv4Address ("224.0.0.1"), 100), false, "Multicast packet forwarded");
+  NS_TEST_EXPECT_MSG_EQ (Input (routing, regional, Ipv4Address::GetBroadcast (), 100), false, "Broadcast packet forwarded");
+
+  ipv4->SetForwarding (1, false);
+  NS_TEST_EXPECT_MSG_EQ (Input (routing, regional, host, 100), false, "Forwarded from a non-forwarding interface");
+
+  NS_TEST_EXPECT_MSG_EQ (m_nUnicast, 2, "Forward callback called for packets not routed");
+  NS_TEST_EXPECT_MSG_EQ (m_bytes.size (), 1, "Packets not routed were accounted");
+  NS_TEST_EXPECT_MSG_EQ (m_bytes[host], 1520, "Packets not routed were accounted");
+
+  m_route = 0;
+  routing->Dispose ();
+  Simulator::Destroy ();
 }
 
-// The TestSuite class names the TestSuite, identifies what type of TestSuite,
-// and enables the TestCases to be run.  Typically, only the constructor for
-// this class must be defined
-//
 class BngTestSuite : public TestSuite
 {
 public:
@@ -59,10 +464,12 @@ public:
 BngTestSuite::BngTestSuite ()
   : TestSuite ("bng", UNIT)
 {
-  // TestDuration for TestCase can be QUICK, EXTENSIVE or TAKES_FOREVER
-  AddTestCase (new BngTestCase1, TestCase::QUICK);
+  AddTestCase (new BngIdleTimerTestCase, TestCase::QUICK);
+  AddTestCase (new BngIdleDisposeTestCase, TestCase::QUICK);
+  AddTestCase (new BngInterimUpdateTestCase, TestCase::QUICK);
+  AddTestCase (new BngSubscriberRoutingLookupTestCase, TestCase::QUICK);
+  AddTestCase (new BngSubscriberRoutingFailoverTestCase, TestCase::QUICK);
+  AddTestCase (new BngSubscriberRoutingForwardTestCase, TestCase::QUICK);
 }
 
-// Do not forget to allocate an instance of this TestSuite
 static BngTestSuite bngTestSuite;
-
@@ -50,13 +50,28 @@ namespace ns3 {
 DhcpLease::DhcpLease(Mac48Address& hwId, Ipv4Address& ip) :
   m_hwId(hwId),
   m_address(ip),
-  m_lease_forever(false)
+  m_lease_forever(false),
+  m_bound(false),
+  m_armed(false),
+  m_generation(0)
 {
   NS_LOG_FUNCTION(this << hwId << ip);
 
   m_expirationTime = Simulator::Now() + Seconds(GRANTED_LEASE_TIME);
 }
 
+void
+DhcpLease::Reset(Mac48Address& hwId, Ipv4Address& ip)
+{
+  NS_LOG_FUNCTION(this << hwId << ip);
+
+  m_hwId = hwId;
+  m_address = ip;
+  m_lease_forever = false;
+  m_bound = false;
+  m_expirationTime = Simulator::Now() + Seconds(GRANTED_LEASE_TIME);
+}
+
 DhcpLease::~DhcpLease()
 {
   NS_LOG_FUNCTION(this);
@@ -83,12 +98,39 @@ DhcpLease::Renew(uint32_t grant_time)
   m_expirationTime = Simulator::Now() + Seconds(grant_time);
 }
 
+void
+DhcpLease::SetBound(bool bound)
+{
+  NS_LOG_FUNCTION(this << bound);
+  m_bound = bound;
+}
+
+bool
+DhcpLease::IsBound(void) const
+{
+  return m_bound;
+}
+
 Ipv4Address
 DhcpLease::GetLeasedAddress(void) const
 {
   return m_address;
 }
 
+Mac48Address
+DhcpLease::GetClientId(void) const
+{
+  return m_hwId;
+}
+
+void
+DhcpLease::Invalidate(void)
+{
+  NS_LOG_FUNCTION(this);
+  m_armed = false;
+  ++m_generation;
+}
+
 bool
 DhcpLease::operator<(const Time& cur_time) const
 {
@@ -108,7 +150,8 @@ DhcpLease::operator==(const Ipv4Address& leaseAddr) const
 
 AbstractDhcpServer::AbstractDhcpServer() :
   m_port(DHCP_BOOTPS_PORT),
-  m_leaseTime(GRANTED_LEASE_TIME)
+  m_leaseTime(GRANTED_LEASE_TIME),
+  m_offerHoldTime(OFFER_HOLD_TIME)
 {
   // NS_LOG_FUNCTION_NOARGS();
   m_leaseCb   = MakeNullCallback<int, const Mac48Address&, const Address&>();
@@ -120,7 +163,9 @@ AbstractDhcpServer::~AbstractDhcpServer()
   // NS_LOG_FUNCTION_NOARGS();
 
   m_leaseDb.clear();
-  Simulator::Remove(m_expireEvent);
+  m_spareLeases.clear();
+  m_pools.clear();
+  Simulator::Cancel(m_expireEvent);
 }
 
 void
@@ -137,6 +182,26 @@ AbstractDhcpServer::SetReleaseCallback(DhcpReleaseCb cb)
   m_releaseCb = cb;
 }
 
+void
+AbstractDhcpServer::AddPool(Ipv4Address network, Ipv4Mask mask)
+{
+  NS_LOG_FUNCTION(this << network << mask);
+  m_pools.push_back(Create<DhcpAddressPool>(network, mask));
+}
+
+uint32_t
+AbstractDhcpServer::GetNPools(void) const
+{
+  return m_pools.size();
+}
+
+Ptr<DhcpAddressPool>
+AbstractDhcpServer::GetPool(uint32_t i) const
+{
+  NS_ASSERT(i < m_pools.size());
+  return m_pools[i];
+}
+
 void
 AbstractDhcpServer::GetOwnLease(Ptr<NetDevice>netdev, Ptr<Ipv4>ipv4)
 {
@@ -150,9 +215,15 @@ AbstractDhcpServer::GetOwnLease()
 {
   Ptr<DhcpLease> lease = Create<DhcpLease>(m_myMacAddr, m_myAddr);
   lease->SetExpirationMode(true);
+  lease->SetBound(true);
   m_leaseDb.insert(m_leaseDb.begin(), std::make_pair(m_myMacAddr, lease));
 
-  m_lastLeasedAddress = m_myAddr.GetSubnetDirectedBroadcast(m_poolMask);
+  /* Local pool goes first, it serves the directly attached clients */
+  if (FindPool(m_myAddr) == 0)
+    m_pools.insert(m_pools.begin(), Create<DhcpAddressPool>(m_poolAddress, m_poolMask));
+
+  FindPool(m_myAddr)->Reserve(m_myAddr);
+  UpdateFreeAddresses();
 }
 
 void
@@ -188,8 +259,8 @@ AbstractDhcpServer::ReceivePacket(DhcpHeader& dhcpHeader, Mac48Address& from)
 
   case DhcpOption::DHCP_TYPE_RELEASE:
 
-    /* FIXME process RELEASE */
-    NS_LOG_WARN("RELEASE from client " << from);
+    /* Give the address back */
+    HandleRelease(from, dhcpHeader);
     break;
 
   default:
@@ -202,12 +273,33 @@ AbstractDhcpServer::HandleDiscovery(Mac48Address& client, DhcpHeader& request)
 {
   NS_LOG_FUNCTION(this << client << request);
 
+  Ptr<DhcpAddressPool> pool = SelectPool(request.GetGIAddr());
+
+  if (pool == 0)
+  {
+    NS_LOG_WARN("No pool for relay " << request.GetGIAddr());
+    return;
+  }
+
   /*
    * Fetch a lease for this client
    * don't care what the value of DHCP_OPT_REQUESTED_IP_ADDRESS is
    */
-  Ptr<DhcpLease> lease = GetLeaseForClient(client);
-  lease->Renew(m_leaseTime);
+  Ptr<DhcpLease> lease = GetLeaseForClient(client, pool, Ipv4Address::GetAny());
+
+  if (lease == 0)
+  {
+    /* Nothing to offer, the client retries or picks another server */
+    NS_LOG_WARN("No address available for " << client);
+    return;
+  }
+
+  /* Hold the address until the client answers, a bound lease keeps its time */
+  if (!lease->IsBound())
+  {
+    lease->Renew(m_offerHoldTime);
+    ArmLease(lease);
+  }
 
   /* prepare OFFER to client */
   DhcpHeader response;
@@ -217,6 +309,7 @@ AbstractDhcpServer::HandleDiscovery(Mac48Address& client, DhcpHeader& request)
   response.SetYIAddr(lease->GetLeasedAddress());
   response.SetCIAddr(Ipv4Address::GetAny());
   response.SetSIAddr(m_myAddr);
+  response.SetGIAddr(request.GetGIAddr());
 
   /* Create options */
   DhcpHeader::DhcpOptionList options;
@@ -225,7 +318,7 @@ AbstractDhcpServer::HandleDiscovery(Mac48Address& client, DhcpHeader& request)
                                (uint8_t)DhcpOption::DHCP_TYPE_OFFER));
 
   options.push_back(DhcpOption((uint8_t)DhcpOption::DHCP_OPT_SUBNET_MASK,
-                               m_poolMask.Get()));
+                               pool->GetMask().Get()));
 
   options.push_back(DhcpOption((uint8_t)DhcpOption::DHCP_OPT_RENEWAL_TIME_VALUE,
                                ((uint32_t)m_leaseTime / 2)));
@@ -249,8 +342,13 @@ AbstractDhcpServer::HandleRequest(Mac48Address& client, DhcpHeader& request)
 {
   NS_LOG_FUNCTION(this << client << request);
 
-  /* Fetch a lease for this client */
-  Ptr<DhcpLease> lease = GetLeaseForClient(client);
+  Ptr<DhcpAddressPool> pool = SelectPool(request.GetGIAddr());
+
+  if (pool == 0)
+  {
+    NS_LOG_WARN("No pool for relay " << request.GetGIAddr());
+    return;
+  }
 
   /* Check requested address */
   const DhcpOption *opt_req_addr =
@@ -264,16 +362,40 @@ AbstractDhcpServer::HandleRequest(Mac48Address& client, DhcpHeader& request)
 
   Ipv4Address req_addr(*opt_req_addr);
 
+  auto known = m_leaseDb.find(client);
+  Ptr<DhcpLease> previous = known != m_leaseDb.end() ? known->second : 0;
+
+  /* Fetch a lease for this client */
+  Ptr<DhcpLease> lease = GetLeaseForClient(client, pool, req_addr);
+
+  if (lease == 0)
+  {
+    NS_LOG_WARN("pool exhausted, refusing " << client);
+    SendNak(client, request);
+    return;
+  }
+
   if (lease->GetLeasedAddress() != req_addr)
   {
     NS_LOG_WARN("mismatch in REQUESTED_IP_ADDRESS: our " << lease->GetLeasedAddress() << " theirs " << req_addr);
 
-    // TODO send DHCKNak
+    /* Allocated just now and never armed, it would hold the address forever */
+    if (lease != previous)
+      ReleaseLease(m_leaseDb.find(client));
+
+    SendNak(client, request);
     return;
   }
 
-  /* Renew existing lease */
+  /* Bind an offered lease, or renew an existing one */
+  if (!lease->IsBound())
+  {
+    lease->SetBound(true);
+    ++m_activeLeases;
+  }
+
   lease->Renew(m_leaseTime);
+  ArmLease(lease);
 
   /* Notify external services */
 
@@ -290,6 +412,7 @@ AbstractDhcpServer::HandleRequest(Mac48Address& client, DhcpHeader& request)
   response.SetCHAddr(client);
   response.SetCIAddr(Ipv4Address::GetAny());
   response.SetSIAddr(m_myAddr);
+  response.SetGIAddr(request.GetGIAddr());
 
   /* Create options */
   DhcpHeader::DhcpOptionList options;
@@ -298,7 +421,7 @@ AbstractDhcpServer::HandleRequest(Mac48Address& client, DhcpHeader& request)
                                (uint8_t)DhcpOption::DHCP_TYPE_ACK));
 
   options.push_back(DhcpOption((uint8_t)DhcpOption::DHCP_OPT_SUBNET_MASK,
-                               m_poolMask.Get()));
+                               pool->GetMask().Get()));
 
   options.push_back(DhcpOption((uint8_t)DhcpOption::DHCP_OPT_RENEWAL_TIME_VALUE,
                                (uint32_t)(m_leaseTime / 2)));
@@ -317,40 +440,204 @@ AbstractDhcpServer::HandleRequest(Mac48Address& client, DhcpHeader& request)
   SendMessage(client, response);
 }
 
-Ptr<DhcpLease>AbstractDhcpServer::GetLeaseForClient(Mac48Address& clientId)
+void
+AbstractDhcpServer::HandleRelease(Mac48Address& client, DhcpHeader& request)
+{
+  NS_LOG_FUNCTION(this << client << request);
+
+  auto it = m_leaseDb.find(client);
+
+  if (it == m_leaseDb.end() || it->second->GetLeasedAddress() != request.GetCIAddr())
+  {
+    NS_LOG_WARN("RELEASE from unknown client " << client);
+    return;
+  }
+
+  ReleaseLease(it);
+}
+
+void
+AbstractDhcpServer::SendNak(Mac48Address& client, DhcpHeader& request)
+{
+  NS_LOG_FUNCTION(this << client);
+
+  DhcpHeader response;
+  response.SetOp(DhcpHeader::BOOT_REPLY);
+  response.SetTransactionId(request.GetTransactionId());
+  response.SetCHAddr(client);
+  response.SetYIAddr(Ipv4Address::GetAny());
+  response.SetCIAddr(Ipv4Address::GetAny());
+  response.SetSIAddr(m_myAddr);
+  response.SetGIAddr(request.GetGIAddr());
+
+  DhcpHeader::DhcpOptionList options;
+
+  options.push_back(DhcpOption((uint8_t)DhcpOption::DHCP_OPT_MESSAGE_TYPE,
+                               (uint8_t)DhcpOption::DHCP_TYPE_NACK));
+
+  options.push_back(DhcpOption((uint8_t)DhcpOption::DHCP_OPT_DHCP_SERVER_IDENTIFIER,
+                               m_myAddr.Get()));
+
+  options.push_back(DhcpOption((uint8_t)DhcpOption::DHCP_OPT_END));
+
+  response.AddOptionList(options);
+
+  SendMessage(client, response);
+}
+
+Ptr<DhcpAddressPool>AbstractDhcpServer::SelectPool(Ipv4Address giaddr)
+{
+  if (m_pools.empty())
+    return 0;
+
+  /* Directly attached client */
+  if (giaddr == Ipv4Address::GetAny())
+    return m_pools.front();
+
+  Ptr<DhcpAddressPool> pool = FindPool(giaddr);
+
+  /* The relay address is never leased */
+  if (pool != 0 && pool->Reserve(giaddr))
+    UpdateFreeAddresses();
+
+  return pool;
+}
+
+Ptr<DhcpAddressPool>AbstractDhcpServer::FindPool(Ipv4Address addr) const
+{
+  for (auto &pool : m_pools)
+  {
+    if (pool->Contains(addr))
+      return pool;
+  }
+
+  return 0;
+}
+
+void
+AbstractDhcpServer::ReleaseLease(DhcpLeaseDatabase::iterator it)
 {
-  NS_LOG_FUNCTION(this << clientId);
+  Mac48Address clientId = it->first;
+  Ptr<DhcpLease> lease = it->second;
+  Ipv4Address addr = lease->GetLeasedAddress();
+
+  NS_LOG_FUNCTION(this << clientId << addr);
+
+  Ptr<DhcpAddressPool> pool = FindPool(addr);
+
+  if (pool != 0)
+    pool->Release(addr);
+
+  bool bound = lease->IsBound();
+
+  m_leaseDb.erase(it);
+  lease->Invalidate();
+  m_spareLeases.push_back(lease);
+
+  UpdateFreeAddresses();
+
+  /* An offer nobody took was never announced */
+  if (!bound)
+    return;
+
+  --m_activeLeases;
+
+  if (!m_releaseCb.IsNull())
+    m_releaseCb(clientId, addr);
+}
+
+void
+AbstractDhcpServer::ArmLease(Ptr<DhcpLease>lease)
+{
+  m_expireWheel.Insert(lease, Simulator::Now());
+
+  if (!m_expireEvent.IsRunning())
+    m_expireEvent = Simulator::Schedule(m_expireWheel.GetNextTick() - Simulator::Now(),
+                                        &AbstractDhcpServer::ExpireLeases, this);
+}
+
+void
+AbstractDhcpServer::ExpireLeases(void)
+{
+  NS_LOG_FUNCTION(this);
+
+  std::list<Ptr<DhcpLease> > expired = m_expireWheel.Advance(Simulator::Now());
+
+  for (auto &lease : expired)
+  {
+    auto it = m_leaseDb.find(lease->GetClientId());
+
+    if (it == m_leaseDb.end() || it->second != lease)
+      continue;
+
+    NS_LOG_INFO("Lease expired: " << lease->GetClientId() << " " << lease->GetLeasedAddress());
+
+    if (lease->IsBound())
+      ++m_expiredLeases;
+
+    ReleaseLease(it);
+  }
+
+  if (!m_expireWheel.IsEmpty())
+    m_expireEvent = Simulator::Schedule(m_expireWheel.GetNextTick() - Simulator::Now(),
+                                        &AbstractDhcpServer::ExpireLeases, this);
+}
+
+void
+AbstractDhcpServer::UpdateFreeAddresses(void)
+{
+  uint32_t nFree = 0;
+
+  for (auto &pool : m_pools)
+    nFree += pool->GetNFree();
+
+  m_freeAddresses = nFree;
+}
+
+Ptr<DhcpLease>AbstractDhcpServer::GetLeaseForClient(Mac48Address       & clientId,
+                                                    Ptr<DhcpAddressPool>pool,
+                                                    Ipv4Address         hint)
+{
+  NS_LOG_FUNCTION(this << clientId << hint);
 
   auto it = m_leaseDb.find(clientId);
 
   if (it != m_leaseDb.end())
-    return it->second;
+  {
+    if (pool->Contains(it->second->GetLeasedAddress()))
+      return it->second;
+
+    /* Client moved to another relay, its address is useless there */
+    ReleaseLease(it);
+  }
 
   /* Not found, select a new address in the pool */
-  bool got_new = false;
+  Ipv4Address new_addr = Ipv4Address::GetAny();
+
+  if (hint != Ipv4Address::GetAny() && pool->Reserve(hint))
+    new_addr = hint;
+  else
+    new_addr = pool->Allocate();
 
-  // FIXME possible infinite loop here
-  Ipv4Address new_addr;
+  if (new_addr == Ipv4Address::GetAny())
+    return 0;
 
-  while (!got_new)
+  Ptr<DhcpLease> new_lease;
+
+  if (m_spareLeases.empty())
+  {
+    new_lease = Create<DhcpLease>(clientId, new_addr);
+  }
+  else
   {
-    new_addr = Ipv4Address(m_lastLeasedAddress.Get() - 1);
-    got_new  = true;
-
-    for (it = m_leaseDb.begin(); it != m_leaseDb.end(); it++)
-    {
-      if (*(it->second) == new_addr)
-      {
-        got_new             = false;
-        m_lastLeasedAddress = new_addr;
-        break;
-      }
-    }
+    new_lease = m_spareLeases.back();
+    m_spareLeases.pop_back();
+    new_lease->Reset(clientId, new_addr);
   }
 
-  m_lastLeasedAddress = new_addr;
-  Ptr<DhcpLease> new_lease = Create<DhcpLease>(clientId, m_lastLeasedAddress);
-  m_leaseDb.insert(m_leaseDb.begin(), std::make_pair(clientId, new_lease));
+  m_leaseDb.insert(std::make_pair(clientId, new_lease));
+
+  UpdateFreeAddresses();
 
   return new_lease;
 }
@@ -28,6 +28,7 @@
 #define ABSTRACT_DHCP_SERVER_H
 
 #include <map>
+#include <vector>
 #include "ns3/application.h"
 #include "ns3/simple-ref-count.h"
 #include "ns3/event-id.h"
@@ -37,8 +38,11 @@
 #include "ns3/ipv4.h"
 #include "ns3/mac48-address.h"
 #include "ns3/traced-value.h"
+#include "ns3/dhcp-address-pool.h"
+#include "ns3/dhcp-lease-wheel.h"
 
 #define GRANTED_LEASE_TIME      4
+#define OFFER_HOLD_TIME         2
 
 namespace ns3 {
 class Packet;
@@ -61,6 +65,14 @@ public:
   DhcpLease(Mac48Address& hwId,
             Ipv4Address & ip);
 
+  /**
+   * Recycle this lease for another client
+   * \param hwId       Client HW address
+   * \param ip         Leased IPv4
+   */
+  void Reset(Mac48Address& hwId,
+             Ipv4Address & ip);
+
   /**
    * Default destructor
    */
@@ -85,11 +97,32 @@ public:
    */
   void Renew(uint32_t grant_time);
 
+  /**
+   * Mark the lease as acknowledged to the client
+   * \param bound         False while only offered
+   */
+  void SetBound(bool bound);
+
+  /**
+   * Check if the client acknowledged this lease, or if it was only offered
+   */
+  bool IsBound(void) const;
+
   /**
    * Get Leased Address
    */
   Ipv4Address GetLeasedAddress(void) const;
 
+  /**
+   * Get Client HW address
+   */
+  Mac48Address GetClientId(void) const;
+
+  /**
+   * Detach this lease from its client, pending timers are ignored
+   */
+  void Invalidate(void);
+
   /**
    * Check if this lease has expired
    * \param cur_time      Current Time
@@ -104,10 +137,15 @@ public:
 
 private:
 
+  friend class DhcpLeaseWheel;
+
   Mac48Address m_hwId;    /**< Client hardware address */
   Ipv4Address  m_address; /**< Client designated IP address */
   Time m_expirationTime;  /**< Lease expiration time */
   bool m_lease_forever;   /**< Static lease */
+  bool m_bound;           /**< Acknowledged, not just offered */
+  bool m_armed;           /**< Under expiration control */
+  uint32_t m_generation;  /**< Bumped on every Invalidate() */
 };
 
 class AbstractDhcpServer {
@@ -137,6 +175,25 @@ public:
 
   void SetReleaseCallback(DhcpReleaseCb cb);
 
+  /**
+   * \brief Add a lease pool for clients behind a relay agent
+   * \param network     Subnet address, must contain the relay (giaddr)
+   * \param mask        Subnet mask
+   */
+  void AddPool(Ipv4Address network,
+               Ipv4Mask    mask);
+
+  /**
+   * \brief Number of lease pools, the local one and those added for relays
+   */
+  uint32_t GetNPools(void) const;
+
+  /**
+   * \brief Get a lease pool
+   * \param i   Pool index, the local one first once the server is up
+   */
+  Ptr<DhcpAddressPool>GetPool(uint32_t i) const;
+
 protected:
 
   void GetOwnLease();
@@ -150,23 +207,62 @@ protected:
   Ipv4Address  m_poolAddress; /**< IPv4 lease pool */
   Ipv4Mask     m_poolMask;    /**< IPv4 network mask */
   uint32_t     m_leaseTime;   /**< Lease time (sec) */
+  uint32_t     m_offerHoldTime; /**< Address held for an unanswered offer (sec) */
+
+  TracedValue<uint32_t> m_activeLeases;   /**< Leases bound to clients */
+  TracedValue<uint32_t> m_freeAddresses;  /**< Available addresses, all pools */
+  TracedValue<uint32_t> m_expiredLeases;  /**< Leases removed on expiration */
 
 private:
 
   typedef std::map<Mac48Address, Ptr<DhcpLease> >DhcpLeaseDatabase;
 
-  Ptr<DhcpLease>GetLeaseForClient(Mac48Address& clientId);
+  /**
+   * Fetch the client lease, allocating one from the pool if needed
+   * \param clientId   Client HW address
+   * \param pool       Pool serving the client
+   * \param hint       Address requested by the client, if any
+   * \return the lease, or 0 if the pool is exhausted
+   */
+  Ptr<DhcpLease>GetLeaseForClient(Mac48Address       & clientId,
+                                  Ptr<DhcpAddressPool>pool,
+                                  Ipv4Address         hint);
+
+  /**
+   * Pool serving a client, according to the relay agent address
+   */
+  Ptr<DhcpAddressPool>SelectPool(Ipv4Address giaddr);
+
+  /**
+   * Pool holding an address
+   */
+  Ptr<DhcpAddressPool>FindPool(Ipv4Address addr) const;
+
+  void ReleaseLease(DhcpLeaseDatabase::iterator it);
+
+  /**
+   * Watch lease expiration, starting the timer if needed
+   */
+  void ArmLease(Ptr<DhcpLease>lease);
+  void ExpireLeases(void);
+  void UpdateFreeAddresses(void);
 
   void HandleDiscovery(Mac48Address& client,
                        DhcpHeader  & request);
   void HandleRequest(Mac48Address& client,
                      DhcpHeader  & request);
+  void HandleRelease(Mac48Address& client,
+                     DhcpHeader  & request);
+  void SendNak(Mac48Address& client,
+               DhcpHeader  & request);
 
   virtual void SendMessage(Mac48Address& clientId,
                            DhcpHeader  & response) = 0;
 
-  Ipv4Address m_lastLeasedAddress; /**< Last IPv4 lease address */
+  std::vector<Ptr<DhcpAddressPool> > m_pools; /**< Lease pools, local one first */
+  std::vector<Ptr<DhcpLease> > m_spareLeases; /**< Released leases, for reuse */
   DhcpLeaseDatabase m_leaseDb;     /**< Lease database */
+  DhcpLeaseWheel m_expireWheel;    /**< Lease expiration timers */
   EventId m_expireEvent;           /**< Expired leases GC */
   DhcpLeaseCb   m_leaseCb;
   DhcpReleaseCb m_releaseCb;
@@ -0,0 +1,196 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+/*
+ * Copyright (c) 2015 UFRGS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Alexsander de Souza <asouza@inf.ufrgs.br>
+ */
+
+#include "ns3/log.h"
+#include "ns3/assert.h"
+#include "dhcp-address-pool.h"
+
+NS_LOG_COMPONENT_DEFINE("DhcpAddressPool");
+
+namespace ns3 {
+DhcpAddressPool::DhcpAddressPool(Ipv4Address network, Ipv4Mask mask) :
+  m_network(network.CombineMask(mask)),
+  m_mask(mask),
+  m_size(0),
+  m_nFree(0),
+  m_fresh(0)
+{
+  NS_LOG_FUNCTION(this << network << mask);
+
+  uint32_t hosts = ~mask.Get();
+
+  /* Neither the network nor the broadcast address are leased */
+  if (hosts > 1)
+    m_size = hosts - 1;
+
+  m_bitmap.assign((m_size + 63) / 64, 0);
+  m_queued.assign((m_size + 63) / 64, 0);
+
+  /* Highest address first, as the server always did */
+  m_fresh = m_size;
+  m_nFree = m_size;
+}
+
+DhcpAddressPool::~DhcpAddressPool()
+{
+  NS_LOG_FUNCTION(this);
+}
+
+bool
+DhcpAddressPool::GetBit(const std::vector<uint64_t>& bitmap, uint32_t offset)
+{
+  return (bitmap[offset / 64] >> (offset % 64)) & 1;
+}
+
+void
+DhcpAddressPool::SetBit(std::vector<uint64_t>& bitmap, uint32_t offset, bool value)
+{
+  if (value)
+    bitmap[offset / 64] |= (uint64_t(1) << (offset % 64));
+  else
+    bitmap[offset / 64] &= ~(uint64_t(1) << (offset % 64));
+}
+
+bool
+DhcpAddressPool::IsUsed(uint32_t offset) const
+{
+  return GetBit(m_bitmap, offset);
+}
+
+void
+DhcpAddressPool::SetUsed(uint32_t offset, bool used)
+{
+  SetBit(m_bitmap, offset, used);
+}
+
+bool
+DhcpAddressPool::Contains(Ipv4Address addr) const
+{
+  uint32_t offset = addr.Get() - m_network.Get() - 1;
+
+  return addr.CombineMask(m_mask) == m_network && offset < m_size;
+}
+
+bool
+DhcpAddressPool::IsFree(Ipv4Address addr) const
+{
+  return Contains(addr) && !IsUsed(addr.Get() - m_network.Get() - 1);
+}
+
+Ipv4Address
+DhcpAddressPool::Allocate(void)
+{
+  while (!m_freeList.empty())
+  {
+    uint32_t offset = m_freeList.back();
+    m_freeList.pop_back();
+    SetBit(m_queued, offset, false);
+
+    /* Reserved behind our back */
+    if (IsUsed(offset))
+      continue;
+
+    SetUsed(offset, true);
+    --m_nFree;
+
+    return Ipv4Address(m_network.Get() + 1 + offset);
+  }
+
+  while (m_fresh > 0)
+  {
+    uint32_t offset = --m_fresh;
+
+    /* Reserved, or released and allocated again */
+    if (IsUsed(offset))
+      continue;
+
+    SetUsed(offset, true);
+    --m_nFree;
+
+    return Ipv4Address(m_network.Get() + 1 + offset);
+  }
+
+  NS_LOG_WARN(this << " pool " << m_network << " exhausted");
+  return Ipv4Address::GetAny();
+}
+
+bool
+DhcpAddressPool::Reserve(Ipv4Address addr)
+{
+  NS_LOG_FUNCTION(this << addr);
+
+  if (!IsFree(addr))
+    return false;
+
+  SetUsed(addr.Get() - m_network.Get() - 1, true);
+  --m_nFree;
+
+  return true;
+}
+
+void
+DhcpAddressPool::Release(Ipv4Address addr)
+{
+  NS_LOG_FUNCTION(this << addr);
+
+  if (!Contains(addr))
+    return;
+
+  uint32_t offset = addr.Get() - m_network.Get() - 1;
+
+  if (!IsUsed(offset))
+    return;
+
+  SetUsed(offset, false);
+  ++m_nFree;
+
+  /* Reserved since its last release, the old entry is valid again */
+  if (GetBit(m_queued, offset))
+    return;
+
+  SetBit(m_queued, offset, true);
+  m_freeList.push_back(offset);
+}
+
+Ipv4Address
+DhcpAddressPool::GetNetwork(void) const
+{
+  return m_network;
+}
+
+Ipv4Mask
+DhcpAddressPool::GetMask(void) const
+{
+  return m_mask;
+}
+
+uint32_t
+DhcpAddressPool::GetSize(void) const
+{
+  return m_size;
+}
+
+uint32_t
+DhcpAddressPool::GetNFree(void) const
+{
+  return m_nFree;
+}
+} // Namespace ns3
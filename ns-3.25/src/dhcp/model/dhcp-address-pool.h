@@ -0,0 +1,119 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+/*
+ * Copyright (c) 2015 UFRGS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Alexsander de Souza <asouza@inf.ufrgs.br>
+ */
+
+#ifndef DHCP_ADDRESS_POOL_H
+#define DHCP_ADDRESS_POOL_H
+
+#include <vector>
+#include "ns3/simple-ref-count.h"
+#include "ns3/ipv4-address.h"
+
+namespace ns3 {
+/**
+ * \ingroup dhcpclientserver
+ * \class DhcpAddressPool
+ * \brief Free addresses of one subnet
+ *
+ * A bitmap tells which host addresses are in use. Addresses never handed
+ * out are taken from a cursor going down the subnet, released ones go to
+ * a free list that is tried first, so a large pool costs nothing until
+ * used. Reserving a specific address only marks the bitmap, a stale free
+ * list entry is skipped when popped; a second bitmap keeps an address
+ * from being queued twice. Allocation and release are O(1) amortized.
+ */
+class DhcpAddressPool : public SimpleRefCount<DhcpAddressPool>{
+public:
+
+  /**
+   * Pool constructor
+   * \param network     Subnet address
+   * \param mask        Subnet mask
+   */
+  DhcpAddressPool(Ipv4Address network,
+                  Ipv4Mask    mask);
+
+  virtual
+  ~DhcpAddressPool();
+
+  /**
+   * Check if an address belongs to this subnet
+   */
+  bool Contains(Ipv4Address addr) const;
+
+  /**
+   * Check if an address of this subnet is available
+   */
+  bool IsFree(Ipv4Address addr) const;
+
+  /**
+   * Take the next free address
+   * \return the address, or 0.0.0.0 if the pool is exhausted
+   */
+  Ipv4Address Allocate(void);
+
+  /**
+   * Take a specific address
+   * \return false if it is in use or out of the subnet
+   */
+  bool Reserve(Ipv4Address addr);
+
+  /**
+   * Give an address back to the pool
+   */
+  void Release(Ipv4Address addr);
+
+  Ipv4Address GetNetwork(void) const;
+  Ipv4Mask    GetMask(void) const;
+
+  /**
+   * Number of usable host addresses
+   */
+  uint32_t GetSize(void) const;
+
+  /**
+   * Number of available addresses
+   */
+  uint32_t GetNFree(void) const;
+
+private:
+
+  static bool GetBit(const std::vector<uint64_t>& bitmap,
+                     uint32_t                     offset);
+  static void SetBit(std::vector<uint64_t>& bitmap,
+                     uint32_t               offset,
+                     bool                   value);
+
+  bool IsUsed(uint32_t offset) const;
+  void SetUsed(uint32_t offset,
+               bool     used);
+
+  Ipv4Address m_network;             /**< Subnet address */
+  Ipv4Mask    m_mask;                /**< Subnet mask */
+  uint32_t    m_size;                /**< Host addresses, without network and broadcast */
+  uint32_t    m_nFree;               /**< Available addresses */
+  uint32_t    m_fresh;               /**< Offsets below it were never handed out */
+  std::vector<uint64_t> m_bitmap;    /**< In-use flags, indexed by host offset */
+  std::vector<uint64_t> m_queued;    /**< Offsets present in the free list */
+  std::vector<uint32_t> m_freeList;  /**< Released offsets, may hold stale entries */
+};
+} // namespace ns3
+
+#endif /* DHCP_ADDRESS_POOL_H */
@@ -96,7 +96,7 @@ void DhcpClient::StartApplication(void)
 {
   NS_LOG_FUNCTION_NOARGS();
 
-  if (m_sock_pkt > 0)
+  if (m_sock_pkt != 0)
     return;
 
   Ptr<NetDevice> netdev = GetNode()->GetDevice(0);
@@ -174,13 +174,13 @@ void DhcpClient::SetupIp(DhcpHeader &offer)
   uint32_t lease_time = DHCP_DFT_LEASE_TIME;
 
   /* Have netmask? */
-  if ((opt = offer.GetOptionByType(DhcpOption::DHCP_OPT_SUBNET_MASK)) > 0)
+  if ((opt = offer.GetOptionByType(DhcpOption::DHCP_OPT_SUBNET_MASK)) != 0)
     {
       m_myMask = Ipv4Mask(*opt);
     }
 
   /* Have lease time? */
-  if ((opt = offer.GetOptionByType(DhcpOption::DHCP_OPT_IP_ADDRESS_LEASE_TIME)) > 0)
+  if ((opt = offer.GetOptionByType(DhcpOption::DHCP_OPT_IP_ADDRESS_LEASE_TIME)) != 0)
     {
       lease_time = *opt;
     }
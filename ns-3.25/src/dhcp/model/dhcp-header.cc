@@ -287,6 +287,18 @@ Ipv4Address DhcpHeader::GetSIAddr(void) const
   return m_SIAddr;
 }
 
+void DhcpHeader::SetGIAddr(Ipv4Address addr)
+{
+  NS_LOG_FUNCTION(this << addr);
+  m_GIAddr = addr;
+}
+
+Ipv4Address DhcpHeader::GetGIAddr(void) const
+{
+  NS_LOG_FUNCTION_NOARGS();
+  return m_GIAddr;
+}
+
 void DhcpHeader::SetCHAddr(Mac48Address addr)
 {
   NS_LOG_FUNCTION(this << addr);
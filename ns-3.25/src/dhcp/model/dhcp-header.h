@@ -186,6 +186,19 @@ public:
    */
   Ipv4Address GetSIAddr (void) const;
 
+  /**
+   * Set Relay Agent address
+   * \param addr      IPv4 address
+   *
+   * Set by relay agents, selects the lease pool
+   */
+  void SetGIAddr (Ipv4Address addr);
+
+  /**
+   * Get Relay Agent address
+   */
+  Ipv4Address GetGIAddr (void) const;
+
   /**
    * Set client HW address
    * \param mac           MAC address
@@ -0,0 +1,180 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+/*
+ * Copyright (c) 2015 UFRGS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Alexsander de Souza <asouza@inf.ufrgs.br>
+ */
+
+#include <algorithm>
+#include "ns3/log.h"
+#include "ns3/assert.h"
+#include "abstract-dhcp-server.h"
+#include "dhcp-lease-wheel.h"
+
+NS_LOG_COMPONENT_DEFINE("DhcpLeaseWheel");
+
+namespace ns3 {
+const uint32_t DhcpLeaseWheel::INNER_SLOTS = 256;
+const uint32_t DhcpLeaseWheel::OUTER_SLOTS = 64;
+
+DhcpLeaseWheel::DhcpLeaseWheel() :
+  m_inner(INNER_SLOTS),
+  m_outer(OUTER_SLOTS),
+  m_current(0),
+  m_tick(Seconds(1)),
+  m_count(0)
+{
+  NS_LOG_FUNCTION(this);
+}
+
+DhcpLeaseWheel::~DhcpLeaseWheel()
+{
+  NS_LOG_FUNCTION(this);
+}
+
+void
+DhcpLeaseWheel::SetTick(Time tick)
+{
+  NS_LOG_FUNCTION(this << tick);
+  NS_ASSERT_MSG(m_count == 0, "Wheel resolution can't change while in use");
+  NS_ASSERT(tick.IsStrictlyPositive());
+
+  m_tick = tick;
+}
+
+uint64_t
+DhcpLeaseWheel::TickOf(Time t) const
+{
+  /* First tick strictly after t, leases expire after their deadline */
+  return t.GetTimeStep() / m_tick.GetTimeStep() + 1;
+}
+
+bool
+DhcpLeaseWheel::IsStale(const Item& item) const
+{
+  /* Released (and maybe handed to another client) since it was filed */
+  return item.generation != item.lease->m_generation;
+}
+
+void
+DhcpLeaseWheel::File(const Item& item)
+{
+  uint64_t expires = std::max(TickOf(item.lease->m_expirationTime), m_current);
+  uint64_t lap = m_current / INNER_SLOTS;
+
+  if (expires / INNER_SLOTS == lap)
+    m_inner[expires % INNER_SLOTS].push_back(item);
+  else if (expires / INNER_SLOTS - lap < OUTER_SLOTS)
+    m_outer[(expires / INNER_SLOTS) % OUTER_SLOTS].push_back(item);
+  else
+    m_overflow.push_back(item);
+}
+
+void
+DhcpLeaseWheel::Refile(Bucket& bucket)
+{
+  Bucket items;
+  items.swap(bucket);
+
+  for (auto &item : items)
+  {
+    if (IsStale(item))
+    {
+      --m_count;
+      continue;
+    }
+
+    File(item);
+  }
+}
+
+void
+DhcpLeaseWheel::Insert(Ptr<DhcpLease>lease, Time now)
+{
+  NS_LOG_FUNCTION(this << lease->GetLeasedAddress());
+
+  if (lease->m_armed || lease->m_lease_forever)
+    return;
+
+  /* Nothing pending, it's safe to jump to the present */
+  if (m_count == 0)
+    m_current = TickOf(now);
+
+  lease->m_armed = true;
+  File(Item { lease, lease->m_generation });
+  ++m_count;
+}
+
+bool
+DhcpLeaseWheel::IsEmpty(void) const
+{
+  return m_count == 0;
+}
+
+Time
+DhcpLeaseWheel::GetNextTick(void) const
+{
+  return Time::From(m_current * m_tick.GetTimeStep());
+}
+
+std::list<Ptr<DhcpLease> >
+DhcpLeaseWheel::Advance(Time now)
+{
+  NS_LOG_FUNCTION(this << now << m_current);
+
+  std::list<Ptr<DhcpLease> > expired;
+
+  /* Start of an inner lap, bring the next chunk down */
+  if (m_current % INNER_SLOTS == 0)
+  {
+    uint64_t lap = m_current / INNER_SLOTS;
+
+    if (lap % OUTER_SLOTS == 0)
+      Refile(m_overflow);
+
+    Refile(m_outer[lap % OUTER_SLOTS]);
+  }
+
+  Bucket bucket;
+  bucket.swap(m_inner[m_current % INNER_SLOTS]);
+
+  ++m_current;
+
+  for (auto &item : bucket)
+  {
+    if (IsStale(item))
+    {
+      --m_count;
+      continue;
+    }
+
+    if (*item.lease < now)
+    {
+      item.lease->m_armed = false;
+      expired.push_back(item.lease);
+      --m_count;
+    }
+    else
+    {
+      /* Renewed since it was filed */
+      File(item);
+    }
+  }
+
+  return expired;
+}
+} // Namespace ns3
@@ -0,0 +1,108 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+/*
+ * Copyright (c) 2015 UFRGS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Alexsander de Souza <asouza@inf.ufrgs.br>
+ */
+
+#ifndef DHCP_LEASE_WHEEL_H
+#define DHCP_LEASE_WHEEL_H
+
+#include <list>
+#include <vector>
+#include "ns3/ptr.h"
+#include "ns3/nstime.h"
+
+namespace ns3 {
+class DhcpLease;
+
+/**
+ * \ingroup dhcpclientserver
+ * \class DhcpLeaseWheel
+ * \brief Two-level timer wheel for lease expiration
+ *
+ * The inner wheel has one bucket per tick, the outer one a bucket per
+ * lap of the inner wheel; leases further away wait in an overflow list
+ * checked once per outer lap. Renewing a lease doesn't touch the wheel,
+ * when its bucket fires it is filed again with the new deadline.
+ */
+class DhcpLeaseWheel {
+public:
+
+  static const uint32_t INNER_SLOTS;  /**< Ticks per inner lap */
+  static const uint32_t OUTER_SLOTS;  /**< Inner laps per outer lap */
+
+  DhcpLeaseWheel();
+
+  virtual
+  ~DhcpLeaseWheel();
+
+  /**
+   * Set wheel resolution, only while it's empty
+   */
+  void SetTick(Time tick);
+
+  /**
+   * Put a lease under expiration control, if not already
+   * \param lease       Lease to watch
+   * \param now         Current time
+   */
+  void Insert(Ptr<DhcpLease>lease,
+              Time          now);
+
+  /**
+   * \return true if no lease is being watched
+   */
+  bool IsEmpty(void) const;
+
+  /**
+   * \return time of the next bucket to be processed
+   */
+  Time GetNextTick(void) const;
+
+  /**
+   * Process the current bucket and move on
+   * \param now         Current time
+   * \return leases whose expiration time has passed
+   */
+  std::list<Ptr<DhcpLease> > Advance(Time now);
+
+private:
+
+  struct Item
+  {
+    Ptr<DhcpLease> lease;
+    uint32_t generation;  /**< Lease generation when filed */
+  };
+
+  typedef std::vector<Item> Bucket;
+
+  uint64_t TickOf(Time t) const;
+  void File(const Item& item);
+  void Refile(Bucket& bucket);
+  bool IsStale(const Item& item) const;
+
+  std::vector<Bucket> m_inner;  /**< One bucket per tick */
+  std::vector<Bucket> m_outer;  /**< One bucket per inner lap */
+  Bucket   m_overflow;          /**< Beyond the outer lap */
+  uint64_t m_current;           /**< Tick being processed */
+  Time     m_tick;              /**< Wheel resolution */
+  uint32_t m_count;             /**< Items filed, stale ones included */
+};
+} // namespace ns3
+
+#endif /* DHCP_LEASE_WHEEL_H */
@@ -34,6 +34,7 @@
 #include "ns3/socket-factory.h"
 #include "ns3/packet.h"
 #include "ns3/uinteger.h"
+#include "ns3/trace-source-accessor.h"
 #include "ns3/config.h"
 #include "ns3/ipv4.h"
 #include "ns3/udp-header.h"
@@ -73,6 +74,23 @@ DhcpServer::GetTypeId(void)
                                     UintegerValue(GRANTED_LEASE_TIME),
                                     MakeUintegerAccessor(&DhcpServer::m_leaseTime),
                                     MakeUintegerChecker<uint32_t>())
+                      .AddAttribute("OfferHoldTime",
+                                    "Time an offered address is held for the client REQUEST.",
+                                    UintegerValue(OFFER_HOLD_TIME),
+                                    MakeUintegerAccessor(&DhcpServer::m_offerHoldTime),
+                                    MakeUintegerChecker<uint32_t>(1))
+                      .AddTraceSource("ActiveLeases",
+                                      "Number of leases bound to clients",
+                                      MakeTraceSourceAccessor(&DhcpServer::m_activeLeases),
+                                      "ns3::TracedValueCallback::Uint32")
+                      .AddTraceSource("FreeAddresses",
+                                      "Number of addresses available, all pools",
+                                      MakeTraceSourceAccessor(&DhcpServer::m_freeAddresses),
+                                      "ns3::TracedValueCallback::Uint32")
+                      .AddTraceSource("ExpiredLeases",
+                                      "Number of leases removed on expiration",
+                                      MakeTraceSourceAccessor(&DhcpServer::m_expiredLeases),
+                                      "ns3::TracedValueCallback::Uint32")
   ;
 
   return tid;
@@ -170,6 +188,7 @@ DhcpServer::CreateServerSocket(void)
   InetSocketAddress local = InetSocketAddress(Ipv4Address::GetAny(), DHCP_BOOTPS_PORT);
   m_sock_udp->SetAllowBroadcast(true);
   m_sock_udp->Bind(local);
+  m_sock_udp->SetRecvCallback(MakeCallback(&DhcpServer::RelayHandler, this));
 
   NS_LOG_INFO(this << "DHCP server binded at " << m_netdev->GetAddress());
 }
@@ -204,14 +223,50 @@ DhcpServer::NetHandler(Ptr<Socket>socket)
   DhcpHeader dhcpHeader;
   packet->RemoveHeader(dhcpHeader);
 
+  /* Relayed messages are taken by the UDP socket */
+  if (dhcpHeader.GetGIAddr() != Ipv4Address::GetAny())
+    return;
+
   ReceivePacket(dhcpHeader, client_hwaddr);
 }
 
+void
+DhcpServer::RelayHandler(Ptr<Socket>socket)
+{
+  Ptr<Packet> packet;
+  Address from;
+
+  while ((packet = socket->RecvFrom(from)))
+  {
+    DhcpHeader dhcpHeader;
+    packet->RemoveHeader(dhcpHeader);
+
+    /* Local clients are taken by the packet socket */
+    if (dhcpHeader.GetGIAddr() == Ipv4Address::GetAny())
+      continue;
+
+    Mac48Address client_hwaddr = dhcpHeader.GetCHAddr();
+
+    ReceivePacket(dhcpHeader, client_hwaddr);
+  }
+}
+
 void
 DhcpServer::SendMessage(Mac48Address& clientId, DhcpHeader& response)
 {
   NS_LOG_FUNCTION(this << clientId);
 
+  /* Relayed client, the agent forwards it */
+  if (response.GetGIAddr() != Ipv4Address::GetAny())
+  {
+    Ptr<Packet> packet = Create<Packet>();
+    packet->AddHeader(response);
+
+    if (m_sock_udp->SendTo(packet, 0, InetSocketAddress(response.GetGIAddr(), DHCP_BOOTPS_PORT)) < 0)
+      NS_LOG_WARN(this << " Failed to send " << packet << " to relay " << response.GetGIAddr());
+    return;
+  }
+
   /* Create UDP Header */
   UdpHeader udp4_header;
   udp4_header.SetDestinationPort(DHCP_BOOTPC_PORT);
@@ -220,7 +275,10 @@ DhcpServer::SendMessage(Mac48Address& clientId, DhcpHeader& response)
   /* Create IPv4 Header */
   Ipv4Header ipHeader;
   ipHeader.SetSource(m_myAddr);
-  ipHeader.SetDestination(response.GetYIAddr());
+  if (response.GetYIAddr() == Ipv4Address::GetAny())
+    ipHeader.SetDestination(Ipv4Address::GetBroadcast()); /* NAK */
+  else
+    ipHeader.SetDestination(response.GetYIAddr());
   ipHeader.SetProtocol(UdpL4Protocol::PROT_NUMBER);
   ipHeader.SetTtl(64);
   ipHeader.SetPayloadSize(udp4_header.GetSerializedSize() + response.GetSerializedSize());
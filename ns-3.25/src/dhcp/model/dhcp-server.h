@@ -84,6 +84,11 @@ private:
 
   void NetHandler(Ptr<Socket>socket);
 
+  /**
+   * Receive messages forwarded by relay agents
+   */
+  void RelayHandler(Ptr<Socket>socket);
+
   /**
    * Send response to client
    * \param client                   Client HW address
@@ -0,0 +1,474 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+/*
+ * Copyright (c) 2015 UFRGS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Alexsander de Souza <asouza@inf.ufrgs.br>
+ */
+
+#include <list>
+#include <set>
+#include "ns3/test.h"
+#include "ns3/simulator.h"
+#include "ns3/dhcp-header.h"
+#include "ns3/dhcp-address-pool.h"
+#include "ns3/dhcp-lease-wheel.h"
+#include "ns3/abstract-dhcp-server.h"
+
+using namespace ns3;
+
+class DhcpAddressPoolAllocateTestCase : public TestCase
+{
+public:
+  DhcpAddressPoolAllocateTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+DhcpAddressPoolAllocateTestCase::DhcpAddressPoolAllocateTestCase ()
+  : TestCase ("Allocate, reserve and release addresses of a subnet")
+{
+}
+
+void
+DhcpAddressPoolAllocateTestCase::DoRun (void)
+{
+  Ptr<DhcpAddressPool> pool = Create<DhcpAddressPool> (Ipv4Address ("10.0.0.77"), Ipv4Mask ("/24"));
+
+  NS_TEST_ASSERT_MSG_EQ (pool->GetNetwork (), Ipv4Address ("10.0.0.0"), "Network not masked");
+  NS_TEST_ASSERT_MSG_EQ (pool->GetSize (), 254, "Network and broadcast must not be leased");
+  NS_TEST_ASSERT_MSG_EQ (pool->GetNFree (), 254, "Wrong number of free addresses");
+
+  NS_TEST_EXPECT_MSG_EQ (pool->Contains (Ipv4Address ("10.0.0.1")), true, "First host not in the pool");
+  NS_TEST_EXPECT_MSG_EQ (pool->Contains (Ipv4Address ("10.0.0.254")), true, "Last host not in the pool");
+  NS_TEST_EXPECT_MSG_EQ (pool->Contains (Ipv4Address ("10.0.0.0")), false, "Network address in the pool");
+  NS_TEST_EXPECT_MSG_EQ (pool->Contains (Ipv4Address ("10.0.0.255")), false, "Broadcast address in the pool");
+  NS_TEST_EXPECT_MSG_EQ (pool->Contains (Ipv4Address ("10.0.1.1")), false, "Other subnet in the pool");
+
+  /* Highest address first */
+  Ipv4Address first = pool->Allocate ();
+  NS_TEST_ASSERT_MSG_EQ (first, Ipv4Address ("10.0.0.254"), "Wrong first address");
+  NS_TEST_EXPECT_MSG_EQ (pool->IsFree (first), false, "Allocated address still free");
+  NS_TEST_EXPECT_MSG_EQ (pool->GetNFree (), 253, "Allocation not accounted");
+
+  /* Reserve takes a specific address, only once */
+  Ipv4Address next ("10.0.0.253");
+  NS_TEST_ASSERT_MSG_EQ (pool->Reserve (next), true, "Failed to reserve a free address");
+  NS_TEST_EXPECT_MSG_EQ (pool->Reserve (next), false, "Reserved an address twice");
+  NS_TEST_EXPECT_MSG_EQ (pool->Reserve (first), false, "Reserved an allocated address");
+  NS_TEST_EXPECT_MSG_EQ (pool->Reserve (Ipv4Address ("10.0.0.255")), false, "Reserved the broadcast address");
+  NS_TEST_EXPECT_MSG_EQ (pool->GetNFree (), 252, "Reservation not accounted");
+
+  /* The reserved address is skipped by the free list */
+  NS_TEST_EXPECT_MSG_EQ (pool->Allocate (), Ipv4Address ("10.0.0.252"), "Reserved address allocated");
+
+  pool->Release (next);
+  NS_TEST_EXPECT_MSG_EQ (pool->IsFree (next), true, "Released address not free");
+  NS_TEST_EXPECT_MSG_EQ (pool->GetNFree (), 252, "Release not accounted");
+
+  /* Releasing twice, or out of the subnet, changes nothing */
+  pool->Release (next);
+  pool->Release (Ipv4Address ("192.168.0.1"));
+  NS_TEST_EXPECT_MSG_EQ (pool->GetNFree (), 252, "Spurious release accounted");
+}
+
+class DhcpAddressPoolExhaustTestCase : public TestCase
+{
+public:
+  DhcpAddressPoolExhaustTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+DhcpAddressPoolExhaustTestCase::DhcpAddressPoolExhaustTestCase ()
+  : TestCase ("Exhaust a pool and reuse released addresses")
+{
+}
+
+void
+DhcpAddressPoolExhaustTestCase::DoRun (void)
+{
+  Ptr<DhcpAddressPool> pool = Create<DhcpAddressPool> (Ipv4Address ("10.1.0.0"), Ipv4Mask ("/28"));
+  std::set<Ipv4Address> leased;
+
+  /* Reserved behind the free list's back */
+  NS_TEST_ASSERT_MSG_EQ (pool->Reserve (Ipv4Address ("10.1.0.7")), true, "Failed to reserve");
+  leased.insert (Ipv4Address ("10.1.0.7"));
+
+  for (uint32_t i = 1; i < pool->GetSize (); ++i)
+    {
+      Ipv4Address addr = pool->Allocate ();
+
+      NS_TEST_ASSERT_MSG_EQ (pool->Contains (addr), true, "Allocated address out of the subnet");
+      NS_TEST_ASSERT_MSG_EQ (leased.insert (addr).second, true, "Address " << addr << " allocated twice");
+    }
+
+  NS_TEST_ASSERT_MSG_EQ (pool->GetNFree (), 0, "Pool not exhausted");
+  NS_TEST_EXPECT_MSG_EQ (pool->Allocate (), Ipv4Address::GetAny (), "Exhausted pool gave an address");
+  NS_TEST_EXPECT_MSG_EQ (pool->GetNFree (), 0, "Failed allocation accounted");
+
+  /* Released addresses are handed out again, and only once */
+  pool->Release (Ipv4Address ("10.1.0.3"));
+  pool->Release (Ipv4Address ("10.1.0.7"));
+  NS_TEST_ASSERT_MSG_EQ (pool->GetNFree (), 2, "Releases not accounted");
+
+  std::set<Ipv4Address> reused;
+  reused.insert (pool->Allocate ());
+  reused.insert (pool->Allocate ());
+
+  NS_TEST_EXPECT_MSG_EQ (reused.count (Ipv4Address ("10.1.0.3")), 1, "Released address not reused");
+  NS_TEST_EXPECT_MSG_EQ (reused.count (Ipv4Address ("10.1.0.7")), 1, "Released reservation not reused");
+  NS_TEST_EXPECT_MSG_EQ (pool->Allocate (), Ipv4Address::GetAny (), "Stale free list entry allocated");
+
+  /* A reserved, released and re-reserved address leaves a stale entry behind */
+  pool->Release (Ipv4Address ("10.1.0.3"));
+  NS_TEST_ASSERT_MSG_EQ (pool->Reserve (Ipv4Address ("10.1.0.3")), true, "Failed to reserve a released address");
+  NS_TEST_EXPECT_MSG_EQ (pool->Allocate (), Ipv4Address::GetAny (), "Reserved address allocated again");
+}
+
+class DhcpAddressPoolCycleTestCase : public TestCase
+{
+public:
+  DhcpAddressPoolCycleTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+DhcpAddressPoolCycleTestCase::DhcpAddressPoolCycleTestCase ()
+  : TestCase ("Large pools and repeated reserve and release")
+{
+}
+
+void
+DhcpAddressPoolCycleTestCase::DoRun (void)
+{
+  /* Never used addresses cost nothing */
+  Ptr<DhcpAddressPool> large = Create<DhcpAddressPool> (Ipv4Address ("10.0.0.0"), Ipv4Mask ("/8"));
+
+  NS_TEST_ASSERT_MSG_EQ (large->GetNFree (), 16777214, "Wrong number of free addresses");
+  NS_TEST_EXPECT_MSG_EQ (large->Allocate (), Ipv4Address ("10.255.255.254"), "Wrong first address");
+
+  /* Released addresses go first */
+  Ipv4Address low ("10.0.0.1");
+  NS_TEST_ASSERT_MSG_EQ (large->Reserve (low), true, "Failed to reserve");
+  large->Release (low);
+  NS_TEST_EXPECT_MSG_EQ (large->Allocate (), low, "Released address not reused");
+  NS_TEST_EXPECT_MSG_EQ (large->Allocate (), Ipv4Address ("10.255.255.253"), "Fresh address skipped");
+
+  Ptr<DhcpAddressPool> pool = Create<DhcpAddressPool> (Ipv4Address ("10.2.0.0"), Ipv4Mask ("/28"));
+  Ipv4Address cycled ("10.2.0.9");
+
+  /* Released, reserved and released again, over and over */
+  for (uint32_t i = 0; i < 1000; ++i)
+    {
+      NS_TEST_ASSERT_MSG_EQ (pool->Reserve (cycled), true, "Failed to reserve a released address");
+      pool->Release (cycled);
+    }
+
+  NS_TEST_ASSERT_MSG_EQ (pool->GetNFree (), pool->GetSize (), "Cycles not accounted");
+
+  std::set<Ipv4Address> leased;
+
+  for (uint32_t i = 0; i < pool->GetSize (); ++i)
+    {
+      Ipv4Address addr = pool->Allocate ();
+
+      NS_TEST_ASSERT_MSG_EQ (pool->Contains (addr), true, "Allocated address out of the subnet");
+      NS_TEST_ASSERT_MSG_EQ (leased.insert (addr).second, true, "Address " << addr << " allocated twice");
+    }
+
+  NS_TEST_EXPECT_MSG_EQ (pool->Allocate (), Ipv4Address::GetAny (), "Exhausted pool gave an address");
+
+  /* Allocated from the free list while its fresh slot is still ahead */
+  pool->Release (cycled);
+  pool->Release (Ipv4Address ("10.2.0.1"));
+  NS_TEST_EXPECT_MSG_EQ (pool->GetNFree (), 2, "Releases not accounted");
+  pool->Allocate ();
+  pool->Allocate ();
+  NS_TEST_EXPECT_MSG_EQ (pool->Allocate (), Ipv4Address::GetAny (), "Address allocated twice");
+}
+
+class DhcpLeaseWheelTestCase : public TestCase
+{
+public:
+  DhcpLeaseWheelTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+DhcpLeaseWheelTestCase::DhcpLeaseWheelTestCase ()
+  : TestCase ("Leases come out of the wheel on the first tick after their deadline")
+{
+}
+
+void
+DhcpLeaseWheelTestCase::DoRun (void)
+{
+  DhcpLeaseWheel wheel;
+  std::vector<Ptr<DhcpLease> > leases;
+  std::vector<Time> deadlines;
+
+  /* Inner wheel, outer wheel (256 ticks a lap) and overflow (64 laps) */
+  uint32_t expires[] = { 5, 300, 20000, 40, 50, 60 };
+
+  for (uint32_t i = 0; i < 6; ++i)
+    {
+      Mac48Address hwId = Mac48Address::Allocate ();
+      Ipv4Address addr (0x0a000001 + i);
+      Time deadline = Seconds (expires[i]);
+
+      leases.push_back (Create<DhcpLease> (hwId, addr));
+      leases.back ()->SetExpirationTime (deadline);
+      deadlines.push_back (deadline);
+    }
+
+  /* Renewed after filing, released, and static */
+  Time renewed = Seconds (1000);
+  uint32_t released = 4;
+  Ptr<DhcpLease> forever = leases[5];
+  forever->SetExpirationMode (true);
+
+  for (auto &lease : leases)
+    wheel.Insert (lease, Time (0));
+
+  leases[3]->SetExpirationTime (renewed);
+  deadlines[3] = renewed;
+  leases[released]->Invalidate ();
+
+  NS_TEST_ASSERT_MSG_EQ (wheel.IsEmpty (), false, "Nothing filed");
+
+  std::vector<Time> expired (leases.size (), Time (0));
+
+  while (!wheel.IsEmpty ())
+    {
+      Time now = wheel.GetNextTick ();
+
+      NS_TEST_ASSERT_MSG_LT (now, Seconds (30000), "Wheel never drained");
+
+      for (auto &lease : wheel.Advance (now))
+        {
+          for (uint32_t i = 0; i < leases.size (); ++i)
+            {
+              if (leases[i] != lease)
+                continue;
+
+              NS_TEST_EXPECT_MSG_EQ (expired[i], Time (0), "Lease " << i << " expired twice");
+              expired[i] = now;
+            }
+        }
+    }
+
+  for (uint32_t i = 0; i < 4; ++i)
+    NS_TEST_EXPECT_MSG_EQ (expired[i], deadlines[i] + Seconds (1), "Lease " << i << " expired at the wrong tick");
+
+  NS_TEST_EXPECT_MSG_EQ (expired[released], Time (0), "Released lease expired");
+  NS_TEST_EXPECT_MSG_EQ (expired[5], Time (0), "Static lease expired");
+
+  /* Armed again once out of the wheel */
+  Time later = Seconds (30010);
+  leases[0]->SetExpirationTime (later);
+  wheel.Insert (leases[0], Seconds (30000));
+  wheel.Insert (leases[0], Seconds (30000));
+
+  std::list<Ptr<DhcpLease> > last;
+
+  while (!wheel.IsEmpty ())
+    {
+      std::list<Ptr<DhcpLease> > out = wheel.Advance (wheel.GetNextTick ());
+      last.splice (last.end (), out);
+    }
+
+  NS_TEST_EXPECT_MSG_EQ (last.size (), 1, "Lease filed twice");
+}
+
+/*
+ * Server without sockets, responses are kept for inspection
+ */
+class TestDhcpServer : public AbstractDhcpServer
+{
+public:
+  TestDhcpServer (Ipv4Address address, Ipv4Mask mask);
+
+  /* Send a DISCOVER or REQUEST, return the response type or 0 */
+  uint8_t Exchange (Mac48Address client, uint8_t type, Ipv4Address requested, Ipv4Address &yiaddr);
+
+  uint32_t GetNFree (void) const;
+  uint32_t GetNActive (void) const;
+  uint32_t GetNExpired (void) const;
+
+private:
+  virtual void SendMessage (Mac48Address& clientId, DhcpHeader& response);
+
+  std::list<DhcpHeader> m_responses;
+};
+
+TestDhcpServer::TestDhcpServer (Ipv4Address address, Ipv4Mask mask)
+{
+  m_myMacAddr = Mac48Address::Allocate ();
+  m_myAddr = address;
+  m_poolAddress = address;
+  m_poolMask = mask;
+
+  GetOwnLease ();
+}
+
+uint8_t
+TestDhcpServer::Exchange (Mac48Address client, uint8_t type, Ipv4Address requested, Ipv4Address &yiaddr)
+{
+  DhcpHeader request;
+  DhcpHeader::DhcpOptionList options;
+
+  request.SetOp (DhcpHeader::BOOT_REQUEST);
+  request.SetTransactionId (1);
+  request.SetCHAddr (client);
+
+  options.push_back (DhcpOption ((uint8_t)DhcpOption::DHCP_OPT_MESSAGE_TYPE, type));
+  if (requested != Ipv4Address::GetAny ())
+    options.push_back (DhcpOption ((uint8_t)DhcpOption::DHCP_OPT_REQUESTED_IP_ADDRESS, requested.Get ()));
+  options.push_back (DhcpOption ((uint8_t)DhcpOption::DHCP_OPT_END));
+  request.AddOptionList (options);
+
+  ReceivePacket (request, client);
+
+  if (m_responses.empty ())
+    return 0;
+
+  DhcpHeader response = m_responses.front ();
+  m_responses.pop_front ();
+
+  yiaddr = response.GetYIAddr ();
+  return uint8_t (*response.GetOptionByType (DhcpOption::DHCP_OPT_MESSAGE_TYPE));
+}
+
+uint32_t
+TestDhcpServer::GetNFree (void) const
+{
+  return m_freeAddresses;
+}
+
+uint32_t
+TestDhcpServer::GetNActive (void) const
+{
+  return m_activeLeases;
+}
+
+uint32_t
+TestDhcpServer::GetNExpired (void) const
+{
+  return m_expiredLeases;
+}
+
+void
+TestDhcpServer::SendMessage (Mac48Address& clientId, DhcpHeader& response)
+{
+  m_responses.push_back (response);
+}
+
+class DhcpServerRequestTestCase : public TestCase
+{
+public:
+  DhcpServerRequestTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+DhcpServerRequestTestCase::DhcpServerRequestTestCase ()
+  : TestCase ("Refused REQUESTs don't hold addresses, leases and offers expire")
+{
+}
+
+void
+DhcpServerRequestTestCase::DoRun (void)
+{
+  Mac48Address owner = Mac48Address::Allocate ();
+  Mac48Address other = Mac48Address::Allocate ();
+  Mac48Address shy = Mac48Address::Allocate ();
+  Ipv4Address addr;
+
+  /* Hosts .1 to .6, the server keeps .1 */
+  TestDhcpServer *server = new TestDhcpServer (Ipv4Address ("10.0.0.1"), Ipv4Mask ("/29"));
+  NS_TEST_ASSERT_MSG_EQ (server->GetNFree (), 5, "Server address not reserved");
+
+  NS_TEST_ASSERT_MSG_EQ (server->Exchange (owner, DhcpOption::DHCP_TYPE_DISCOVER, Ipv4Address::GetAny (), addr),
+                         DhcpOption::DHCP_TYPE_OFFER, "No offer");
+  Ipv4Address taken = addr;
+
+  NS_TEST_ASSERT_MSG_EQ (server->Exchange (owner, DhcpOption::DHCP_TYPE_REQUEST, taken, addr),
+                         DhcpOption::DHCP_TYPE_ACK, "Offer not acknowledged");
+  NS_TEST_EXPECT_MSG_EQ (addr, taken, "Wrong address acknowledged");
+  NS_TEST_EXPECT_MSG_EQ (server->GetNFree (), 4, "Lease not accounted");
+  NS_TEST_EXPECT_MSG_EQ (server->GetNActive (), 1, "Lease not bound");
+
+  /* Another client asking for it, more times than there are addresses */
+  for (uint32_t i = 0; i < 10; ++i)
+    {
+      NS_TEST_ASSERT_MSG_EQ (server->Exchange (other, DhcpOption::DHCP_TYPE_REQUEST, taken, addr),
+                             DhcpOption::DHCP_TYPE_NACK, "Address of another client acknowledged");
+      NS_TEST_ASSERT_MSG_EQ (server->GetNFree (), 4, "Refused REQUEST kept an address");
+    }
+
+  /* A free address can still be asked for directly */
+  Ipv4Address wanted ("10.0.0.3");
+  NS_TEST_ASSERT_MSG_EQ (server->Exchange (other, DhcpOption::DHCP_TYPE_REQUEST, wanted, addr),
+                         DhcpOption::DHCP_TYPE_ACK, "Free address refused");
+  NS_TEST_EXPECT_MSG_EQ (server->GetNFree (), 3, "Lease not accounted");
+  NS_TEST_EXPECT_MSG_EQ (server->GetNActive (), 2, "Lease not bound");
+
+  /* An offer nobody takes is only held for a while */
+  NS_TEST_ASSERT_MSG_EQ (server->Exchange (shy, DhcpOption::DHCP_TYPE_DISCOVER, Ipv4Address::GetAny (), addr),
+                         DhcpOption::DHCP_TYPE_OFFER, "No offer");
+  NS_TEST_EXPECT_MSG_EQ (server->GetNFree (), 2, "Offer not held");
+
+  Simulator::Stop (Seconds (OFFER_HOLD_TIME + 1.5));
+  Simulator::Run ();
+
+  NS_TEST_EXPECT_MSG_EQ (server->GetNFree (), 3, "Offer not given back");
+  NS_TEST_EXPECT_MSG_EQ (server->GetNActive (), 2, "Offer expiration released a lease");
+  NS_TEST_EXPECT_MSG_EQ (server->GetNExpired (), 0, "Offer counted as an expired lease");
+
+  /* Nobody renews */
+  Simulator::Run ();
+
+  NS_TEST_EXPECT_MSG_EQ (server->GetNFree (), 5, "Leases not given back");
+  NS_TEST_EXPECT_MSG_EQ (server->GetNActive (), 0, "Expired leases still bound");
+  NS_TEST_EXPECT_MSG_EQ (server->GetNExpired (), 2, "Expired leases not counted");
+
+  delete server;
+  Simulator::Destroy ();
+}
+
+class DhcpTestSuite : public TestSuite
+{
+public:
+  DhcpTestSuite ();
+};
+
+DhcpTestSuite::DhcpTestSuite ()
+  : TestSuite ("dhcp", UNIT)
+{
+  AddTestCase (new DhcpAddressPoolAllocateTestCase, TestCase::QUICK);
+  AddTestCase (new DhcpAddressPoolExhaustTestCase, TestCase::QUICK);
+  AddTestCase (new DhcpAddressPoolCycleTestCase, TestCase::QUICK);
+  AddTestCase (new DhcpLeaseWheelTestCase, TestCase::QUICK);
+  AddTestCase (new DhcpServerRequestTestCase, TestCase::QUICK);
+}
+
+static DhcpTestSuite dhcpTestSuite;
@@ -0,0 +1,371 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2015 UFRGS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Alexsander de Souza <asouza@inf.ufrgs.br>
+ */
+
+#include <algorithm>
+#include <vector>
+#include "ns3/test.h"
+#include "ns3/packet.h"
+#include "ns3/stream-framer.h"
+
+using namespace ns3;
+
+/*
+ * Frames as ANCP puts them on TCP: a 2-byte tag, then the 16-bit length
+ * of what follows the 4-byte header.
+ */
+static const uint32_t LENGTH_OFFSET = 2;
+static const int32_t LENGTH_ADJUST = 4;
+static const uint32_t MIN_SIZE = 4;
+
+static std::vector<uint8_t>
+MakeFrame (uint8_t seq, uint16_t payload)
+{
+  std::vector<uint8_t> frame (payload + 4);
+
+  frame[0] = 0x88;
+  frame[1] = 0x0c;
+  frame[2] = payload >> 8;
+  frame[3] = payload & 0xff;
+
+  for (uint32_t i = 0; i < payload; ++i)
+    {
+      frame[4 + i] = seq + i;
+    }
+
+  return frame;
+}
+
+static Ptr<Packet>
+MakeSegment (const std::vector<uint8_t> &stream, uint32_t start, uint32_t size)
+{
+  return Create<Packet> (stream.data () + start, size);
+}
+
+class StreamFramerTestCase : public TestCase
+{
+public:
+  StreamFramerTestCase (std::string name);
+
+protected:
+  /* Pop the next frame and compare it, false lets the caller stop early */
+  bool CheckFrame (StreamFramer &framer, const std::vector<uint8_t> &expected);
+};
+
+StreamFramerTestCase::StreamFramerTestCase (std::string name)
+  : TestCase (name)
+{
+}
+
+bool
+StreamFramerTestCase::CheckFrame (StreamFramer &framer, const std::vector<uint8_t> &expected)
+{
+  Ptr<Packet> frame = framer.Pop ();
+
+  NS_TEST_EXPECT_MSG_NE ((frame == 0), true, "Missing frame");
+  if (frame == 0)
+    {
+      return false;
+    }
+
+  NS_TEST_EXPECT_MSG_EQ (frame->GetSize (), expected.size (), "Wrong frame size");
+  if (frame->GetSize () != expected.size ())
+    {
+      return false;
+    }
+
+  std::vector<uint8_t> data (frame->GetSize ());
+  frame->CopyData (data.data (), data.size ());
+
+  NS_TEST_EXPECT_MSG_EQ ((data == expected), true, "Wrong frame contents");
+  return data == expected;
+}
+
+class StreamFramerSplitTestCase : public StreamFramerTestCase
+{
+public:
+  StreamFramerSplitTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+StreamFramerSplitTestCase::StreamFramerSplitTestCase ()
+  : StreamFramerTestCase ("Length field split across segments")
+{
+}
+
+void
+StreamFramerSplitTestCase::DoRun (void)
+{
+  StreamFramer framer (LENGTH_OFFSET, LENGTH_ADJUST, MIN_SIZE);
+  std::vector<uint8_t> frame = MakeFrame (1, 300);
+
+  /* Tag and high byte of the length, then the rest */
+  framer.Push (MakeSegment (frame, 0, 3));
+  NS_TEST_ASSERT_MSG_EQ ((framer.Pop () == 0), true, "Frame popped without its length");
+  NS_TEST_ASSERT_MSG_EQ (framer.GetBufferedSize (), 3, "Partial header not buffered");
+
+  framer.Push (MakeSegment (frame, 3, 100));
+  NS_TEST_ASSERT_MSG_EQ ((framer.Pop () == 0), true, "Incomplete frame popped");
+
+  framer.Push (MakeSegment (frame, 103, frame.size () - 103));
+  NS_TEST_ASSERT_MSG_EQ (CheckFrame (framer, frame), true, "Split frame not rebuilt");
+  NS_TEST_ASSERT_MSG_EQ ((framer.Pop () == 0), true, "Frame popped twice");
+  NS_TEST_ASSERT_MSG_EQ (framer.GetBufferedSize (), 0, "Bytes left behind");
+  NS_TEST_ASSERT_MSG_EQ (framer.GetNErrors (), 0, "Spurious error");
+}
+
+class StreamFramerCoalescedTestCase : public StreamFramerTestCase
+{
+public:
+  StreamFramerCoalescedTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+StreamFramerCoalescedTestCase::StreamFramerCoalescedTestCase ()
+  : StreamFramerTestCase ("Several frames in one segment")
+{
+}
+
+void
+StreamFramerCoalescedTestCase::DoRun (void)
+{
+  StreamFramer framer (LENGTH_OFFSET, LENGTH_ADJUST, MIN_SIZE);
+  std::vector<std::vector<uint8_t> > frames;
+  std::vector<uint8_t> stream;
+
+  /* Header-only frame in the middle */
+  uint16_t sizes[] = { 10, 0, 200, 1 };
+  for (uint32_t i = 0; i < 4; ++i)
+    {
+      frames.push_back (MakeFrame (i * 16, sizes[i]));
+      stream.insert (stream.end (), frames.back ().begin (), frames.back ().end ());
+    }
+
+  /* Plus the head of one more */
+  std::vector<uint8_t> last = MakeFrame (99, 50);
+  stream.insert (stream.end (), last.begin (), last.begin () + 20);
+
+  framer.Push (MakeSegment (stream, 0, stream.size ()));
+
+  for (auto &frame : frames)
+    {
+      NS_TEST_ASSERT_MSG_EQ (CheckFrame (framer, frame), true, "Coalesced frame lost");
+    }
+
+  NS_TEST_ASSERT_MSG_EQ ((framer.Pop () == 0), true, "Incomplete frame popped");
+  NS_TEST_ASSERT_MSG_EQ (framer.GetBufferedSize (), 20, "Incomplete frame not kept");
+
+  framer.Push (MakeSegment (last, 20, last.size () - 20));
+  NS_TEST_ASSERT_MSG_EQ (CheckFrame (framer, last), true, "Trailing frame lost");
+  NS_TEST_ASSERT_MSG_EQ (framer.GetBufferedSize (), 0, "Bytes left behind");
+}
+
+class StreamFramerByteTestCase : public StreamFramerTestCase
+{
+public:
+  StreamFramerByteTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+StreamFramerByteTestCase::StreamFramerByteTestCase ()
+  : StreamFramerTestCase ("Stream fed one byte at a time")
+{
+}
+
+void
+StreamFramerByteTestCase::DoRun (void)
+{
+  StreamFramer framer (LENGTH_OFFSET, LENGTH_ADJUST, MIN_SIZE);
+  std::vector<std::vector<uint8_t> > frames;
+  std::vector<uint8_t> stream;
+
+  for (uint32_t i = 0; i < 20; ++i)
+    {
+      frames.push_back (MakeFrame (i, i * 7));
+      stream.insert (stream.end (), frames.back ().begin (), frames.back ().end ());
+    }
+
+  uint32_t popped = 0;
+
+  for (uint32_t i = 0; i < stream.size (); ++i)
+    {
+      framer.Push (MakeSegment (stream, i, 1));
+
+      Ptr<Packet> frame = framer.Pop ();
+      if (frame == 0)
+        {
+          continue;
+        }
+
+      NS_TEST_ASSERT_MSG_LT (popped, frames.size (), "Too many frames");
+      NS_TEST_ASSERT_MSG_EQ (frame->GetSize (), frames[popped].size (), "Wrong frame size");
+
+      std::vector<uint8_t> data (frame->GetSize ());
+      frame->CopyData (data.data (), data.size ());
+      NS_TEST_ASSERT_MSG_EQ ((data == frames[popped]), true, "Wrong frame contents");
+
+      /* Complete as soon as its last byte arrives */
+      ++popped;
+      NS_TEST_ASSERT_MSG_EQ (framer.GetBufferedSize (), 0, "Frame popped late");
+    }
+
+  NS_TEST_ASSERT_MSG_EQ (popped, frames.size (), "Frames lost");
+}
+
+class StreamFramerResyncTestCase : public StreamFramerTestCase
+{
+public:
+  StreamFramerResyncTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+StreamFramerResyncTestCase::StreamFramerResyncTestCase ()
+  : StreamFramerTestCase ("Invalid length discards the buffer")
+{
+}
+
+void
+StreamFramerResyncTestCase::DoRun (void)
+{
+  /* Length field covers the whole frame, so 0..3 are invalid */
+  StreamFramer framer (LENGTH_OFFSET, 0, MIN_SIZE);
+  uint8_t garbage[] = { 0x88, 0x0c, 0x00, 0x02, 0xde, 0xad, 0xbe, 0xef };
+
+  framer.Push (Create<Packet> (garbage, sizeof (garbage)));
+  NS_TEST_ASSERT_MSG_EQ ((framer.Pop () == 0), true, "Invalid frame popped");
+  NS_TEST_ASSERT_MSG_EQ (framer.GetNErrors (), 1, "Error not counted");
+  NS_TEST_ASSERT_MSG_EQ (framer.GetBufferedSize (), 0, "Buffer not discarded");
+
+  /* The next segment starts a frame again */
+  uint8_t valid[] = { 0x88, 0x0c, 0x00, 0x06, 0x01, 0x02 };
+  framer.Push (Create<Packet> (valid, sizeof (valid)));
+
+  Ptr<Packet> frame = framer.Pop ();
+  NS_TEST_ASSERT_MSG_NE ((frame == 0), true, "No resync after error");
+  NS_TEST_ASSERT_MSG_EQ (frame->GetSize (), sizeof (valid), "Wrong frame after resync");
+  NS_TEST_ASSERT_MSG_EQ (framer.GetNErrors (), 1, "Spurious error after resync");
+
+  /* Clear also drops partial frames, without counting an error */
+  framer.Push (Create<Packet> (valid, 3));
+  framer.Clear ();
+  NS_TEST_ASSERT_MSG_EQ (framer.GetBufferedSize (), 0, "Clear kept data");
+  NS_TEST_ASSERT_MSG_EQ (framer.GetNErrors (), 1, "Clear counted as an error");
+}
+
+class StreamFramerCompactTestCase : public StreamFramerTestCase
+{
+public:
+  StreamFramerCompactTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+StreamFramerCompactTestCase::StreamFramerCompactTestCase ()
+  : StreamFramerTestCase ("Consumed bytes are compacted on Push")
+{
+}
+
+void
+StreamFramerCompactTestCase::DoRun (void)
+{
+  StreamFramer framer (LENGTH_OFFSET, LENGTH_ADJUST, MIN_SIZE);
+  std::vector<std::vector<uint8_t> > frames;
+  std::vector<uint8_t> stream;
+
+  /* Large frames followed by small ones, so the consumed prefix outweighs
+   * the pending bytes on several pushes */
+  for (uint32_t i = 0; i < 50; ++i)
+    {
+      frames.push_back (MakeFrame (i, (i % 5 == 0) ? 1000 : 3));
+      stream.insert (stream.end (), frames.back ().begin (), frames.back ().end ());
+    }
+
+  /* Segments never aligned to frame boundaries */
+  uint32_t offset = 0;
+  uint32_t popped = 0;
+  uint32_t segment = 333;
+
+  while (offset < stream.size ())
+    {
+      uint32_t size = std::min<uint32_t> (segment, stream.size () - offset);
+      framer.Push (MakeSegment (stream, offset, size));
+      offset += size;
+
+      /* Leave a frame behind once in a while, the next Push compacts
+       * around it */
+      uint32_t budget = (offset / segment) % 2 ? 1 : frames.size ();
+
+      while (budget-- > 0 && popped < frames.size ())
+        {
+          Ptr<Packet> frame = framer.Pop ();
+          if (frame == 0)
+            {
+              break;
+            }
+
+          std::vector<uint8_t> data (frame->GetSize ());
+          frame->CopyData (data.data (), data.size ());
+          NS_TEST_ASSERT_MSG_EQ ((data == frames[popped]), true, "Frame " << popped << " corrupted");
+          ++popped;
+        }
+
+      uint32_t consumed = 0;
+      for (uint32_t i = 0; i < popped; ++i)
+        {
+          consumed += frames[i].size ();
+        }
+      NS_TEST_ASSERT_MSG_EQ (framer.GetBufferedSize (), offset - consumed, "Wrong buffered size");
+    }
+
+  while (popped < frames.size ())
+    {
+      NS_TEST_ASSERT_MSG_EQ (CheckFrame (framer, frames[popped]), true, "Frame " << popped << " corrupted");
+      ++popped;
+    }
+
+  NS_TEST_ASSERT_MSG_EQ (framer.GetBufferedSize (), 0, "Bytes left behind");
+  NS_TEST_ASSERT_MSG_EQ (framer.GetNErrors (), 0, "Spurious error");
+}
+
+class StreamFramerTestSuite : public TestSuite
+{
+public:
+  StreamFramerTestSuite ();
+};
+
+StreamFramerTestSuite::StreamFramerTestSuite ()
+  : TestSuite ("stream-framer", UNIT)
+{
+  AddTestCase (new StreamFramerSplitTestCase, TestCase::QUICK);
+  AddTestCase (new StreamFramerCoalescedTestCase, TestCase::QUICK);
+  AddTestCase (new StreamFramerByteTestCase, TestCase::QUICK);
+  AddTestCase (new StreamFramerResyncTestCase, TestCase::QUICK);
+  AddTestCase (new StreamFramerCompactTestCase, TestCase::QUICK);
+}
+
+static StreamFramerTestSuite streamFramerTestSuite;
@@ -0,0 +1,119 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2015 UFRGS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Alexsander de Souza <asouza@inf.ufrgs.br>
+ */
+
+#include "ns3/log.h"
+#include "ns3/assert.h"
+#include "ns3/packet.h"
+#include "stream-framer.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("StreamFramer");
+
+StreamFramer::StreamFramer (uint32_t lengthOffset, int32_t lengthAdjust, uint32_t minSize)
+  : m_lengthOffset (lengthOffset),
+    m_lengthAdjust (lengthAdjust),
+    m_minSize (minSize),
+    m_head (0),
+    m_errors (0)
+{
+  NS_LOG_FUNCTION (this << lengthOffset << lengthAdjust << minSize);
+  NS_ASSERT (minSize >= lengthOffset + 2);
+}
+
+void
+StreamFramer::Push (Ptr<const Packet> segment)
+{
+  NS_LOG_FUNCTION (this << segment->GetSize ());
+
+  /* Drop consumed bytes once they outweigh the pending ones, so the
+   * total copy cost stays linear in the stream size */
+  if (m_head > 0 && m_head >= m_buffer.size () - m_head)
+    {
+      m_buffer.erase (m_buffer.begin (), m_buffer.begin () + m_head);
+      m_head = 0;
+    }
+
+  uint32_t tail = m_buffer.size ();
+  m_buffer.resize (tail + segment->GetSize ());
+  segment->CopyData (m_buffer.data () + tail, segment->GetSize ());
+}
+
+Ptr<Packet>
+StreamFramer::Pop (void)
+{
+  uint32_t available = m_buffer.size () - m_head;
+
+  if (available < m_minSize)
+    {
+      return 0;
+    }
+
+  const uint8_t *frame = m_buffer.data () + m_head;
+  int32_t size = ((frame[m_lengthOffset] << 8) | frame[m_lengthOffset + 1]) + m_lengthAdjust;
+
+  if (size < (int32_t)m_minSize)
+    {
+      NS_LOG_WARN (this << " invalid frame length " << size << ", discarding " << available << " bytes");
+      ++m_errors;
+      Clear ();
+      return 0;
+    }
+
+  if ((uint32_t)size > available)
+    {
+      return 0;
+    }
+
+  NS_LOG_LOGIC (this << " frame of " << size << " bytes");
+  Ptr<Packet> packet = Create<Packet> (frame, size);
+
+  m_head += size;
+
+  if (m_head == m_buffer.size ())
+    {
+      m_buffer.clear ();
+      m_head = 0;
+    }
+
+  return packet;
+}
+
+uint32_t
+StreamFramer::GetBufferedSize (void) const
+{
+  return m_buffer.size () - m_head;
+}
+
+uint32_t
+StreamFramer::GetNErrors (void) const
+{
+  return m_errors;
+}
+
+void
+StreamFramer::Clear (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_buffer.clear ();
+  m_head = 0;
+}
+
+} // namespace ns3
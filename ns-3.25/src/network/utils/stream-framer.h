@@ -0,0 +1,95 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2015 UFRGS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Alexsander de Souza <asouza@inf.ufrgs.br>
+ */
+
+#ifndef STREAM_FRAMER_H
+#define STREAM_FRAMER_H
+
+#include <stdint.h>
+#include <vector>
+#include "ns3/ptr.h"
+
+namespace ns3 {
+
+class Packet;
+
+/**
+ * \ingroup network
+ *
+ * \brief Splits a byte stream into length-prefixed messages
+ *
+ * Stream sockets deliver arbitrary chunks of the peer's messages. The
+ * framer keeps the received bytes contiguous and only peeks the 16-bit
+ * length field (network order) of the message at the head, so each byte
+ * is copied once and every complete frame is handed out exactly once,
+ * regardless of how the stream was segmented.
+ */
+class StreamFramer
+{
+public:
+  /**
+   * \param lengthOffset offset of the length field inside the frame
+   * \param lengthAdjust added to the length field to get the frame size
+   * \param minSize smallest valid frame, must cover the length field
+   */
+  StreamFramer (uint32_t lengthOffset, int32_t lengthAdjust, uint32_t minSize);
+
+  /**
+   * \brief Append a segment received from the stream
+   * \param segment stream data
+   */
+  void Push (Ptr<const Packet> segment);
+
+  /**
+   * \brief Extract the next complete frame
+   * \return the frame, or 0 if more data is needed
+   *
+   * A length field smaller than the minimum frame size means the stream
+   * lost synchronization, the buffered data is discarded.
+   */
+  Ptr<Packet> Pop (void);
+
+  /**
+   * \return number of bytes waiting for the rest of their frame
+   */
+  uint32_t GetBufferedSize (void) const;
+
+  /**
+   * \return number of times the buffered data was discarded
+   */
+  uint32_t GetNErrors (void) const;
+
+  /**
+   * \brief Discard all buffered data
+   */
+  void Clear (void);
+
+private:
+  uint32_t m_lengthOffset;
+  int32_t m_lengthAdjust;
+  uint32_t m_minSize;
+
+  std::vector<uint8_t> m_buffer;  //!< received bytes, consumed up to m_head
+  uint32_t m_head;
+  uint32_t m_errors;
+};
+
+} // namespace ns3
+
+#endif /* STREAM_FRAMER_H */
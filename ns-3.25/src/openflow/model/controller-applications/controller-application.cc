@@ -87,6 +87,19 @@ ControllerApplication::SyncCompleted(int statedId)
   NS_LOG_FUNCTION(this << statedId);
 }
 
+void
+ControllerApplication::PortStatsReceived(Ptr<OfSwitch>      origin,
+                                         Ptr<PortStatsHeader>header)
+{
+  NS_LOG_FUNCTION(this << origin);
+}
+
+void
+ControllerApplication::TopologyChanged()
+{
+  NS_LOG_FUNCTION(this);
+}
+
 void
 ControllerApplication::AddApplicationToController(Ptr<Node>controllerNode)
 {
@@ -35,6 +35,7 @@ class Node;
 class Packet;
 class OfSwitch;
 class HostVertex;
+class PortStatsHeader;
 
 /**
  * \ingroup openflow
@@ -90,6 +91,19 @@ public:
 
   virtual void SyncCompleted(int statedId);
 
+  /**
+   * \brief Port counters received from a switch
+   * \param origin      Switch that sent the reply
+   * \param header      Counters of a single port
+   */
+  virtual void PortStatsReceived(Ptr<OfSwitch>      origin,
+                                 Ptr<PortStatsHeader>header);
+
+  /**
+   * \brief Hosts, switches, links or host addresses changed
+   */
+  virtual void TopologyChanged();
+
   friend bool operator<(const ControllerApplication& app1,
                         const ControllerApplication& app2);
 
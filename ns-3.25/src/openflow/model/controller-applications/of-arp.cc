@@ -141,9 +141,11 @@ ArpHandler::HandleArpRequest(Ptr<OfSwitch>origin, unsigned portIn, ArpHeader& ar
     Ptr<Adjacency>    adj = m_controller->AddEdge(sw, srcHost, portIn);
     m_controller->AddEdge(adj->Invert());
   }
+  else if (Ptr<SwitchVertex> sw = m_controller->LookupSwitch(origin->GetChassisId())) {
+    m_controller->MoveHost(srcHost, sw, portIn);
+  }
 
-  if (srcHost->HasAddress(sourceAddr) == false)
-    srcHost->AddAddress(sourceAddr);
+  m_controller->AddHostMapping(srcHost, sourceAddr);
 
   if (targetAddr == Ipv4Address::GetBroadcast())
     return true; // gratuitous ARP
@@ -190,8 +192,7 @@ ArpHandler::HandleArpReply(Ptr<OfSwitch>origin, unsigned portIn, ArpHeader& arpH
     m_controller->AddEdge(adj->Invert());
   }
 
-  if (!dstHost->HasAddress(targetAddr))
-    dstHost->AddAddress(targetAddr);
+  m_controller->AddHostMapping(dstHost, targetAddr);
 
   if (sourceAddr == targetAddr)
     return true; // Gratuitous ARP
@@ -23,9 +23,14 @@
 
 #ifdef NS3_OPENFLOW
 
+#include <algorithm>
+#include <cstring>
+#include <iterator>
 #include <ns3/simulator.h>
 #include <ns3/log.h>
+#include <ns3/hash.h>
 #include "ns3/uinteger.h"
+#include "ns3/boolean.h"
 #include <ns3/mac48-address.h>
 #include <ns3/ethernet-header.h>
 #include <ns3/ipv4-l3-protocol.h>
@@ -38,6 +43,7 @@
 #include <ns3/openflow-header.h>
 #include <ns3/flow-match-header.h>
 #include <ns3/flow-modification-header.h>
+#include <ns3/port-stats-header.h>
 #include <ns3/action-header.h>
 #include <ns3/adjacency.h>
 #include <ns3/vertex-host.h>
@@ -79,6 +85,32 @@ OFRouting::GetTypeId(void)
                                     UintegerValue((OFP_DEFAULT_PRIORITY / 2U)),
                                     MakeUintegerAccessor(&OFRouting::m_flowPrio),
                                     MakeUintegerChecker<uint16_t>())
+                      .AddAttribute("MaxPaths",
+                                    "Max number of equal cost paths a flow can be hashed to (1 disables ECMP)",
+                                    UintegerValue(8),
+                                    MakeUintegerAccessor(&OFRouting::m_maxPaths),
+                                    MakeUintegerChecker<uint32_t>(1))
+                      .AddAttribute("StatsInterval",
+                                    "Port statistics polling interval (zero disables load balancing)",
+                                    TimeValue(Seconds(0)),
+                                    MakeTimeAccessor(&OFRouting::m_statsInterval),
+                                    MakeTimeChecker())
+                      .AddAttribute("RebalanceThreshold",
+                                    "Load difference that moves a new flow away from its hashed path",
+                                    DataRateValue(DataRate("10Mbps")),
+                                    MakeDataRateAccessor(&OFRouting::m_rebalanceThreshold),
+                                    MakeDataRateChecker())
+                      .AddAttribute("Proactive",
+                                    "Pre-install one destination rule per host address on every switch",
+                                    BooleanValue(false),
+                                    MakeBooleanAccessor(&OFRouting::m_proactive),
+                                    MakeBooleanChecker())
+                      .AddAttribute("ProactivePriority",
+                                    "OF priority of the proactive destination rules, keep it below "
+                                    "FlowPriority so reactive exact-match rules take precedence",
+                                    UintegerValue((OFP_DEFAULT_PRIORITY / 4U)),
+                                    MakeUintegerAccessor(&OFRouting::m_proactivePrio),
+                                    MakeUintegerChecker<uint16_t>())
   ;
 
   return tid;
@@ -87,7 +119,12 @@ OFRouting::GetTypeId(void)
 OFRouting::OFRouting() :
   m_nspGw(Ipv4Address::GetAny()),
   m_accessNetPrefix(Ipv4Address::GetAny()),
-  m_accessNetMask(Ipv4Mask::GetZero())
+  m_accessNetMask(Ipv4Mask::GetZero()),
+  m_maxPaths(8),
+  m_proactive(false),
+  m_proactivePrio(OFP_DEFAULT_PRIORITY / 4U),
+  m_proactiveSync(-1),
+  m_refreshPending(false)
 {
   NS_LOG_FUNCTION_NOARGS();
 }
@@ -97,6 +134,27 @@ OFRouting::~OFRouting()
   NS_LOG_FUNCTION_NOARGS();
 }
 
+void
+OFRouting::DoDispose()
+{
+  NS_LOG_FUNCTION(this);
+  Simulator::Cancel(m_statsEvent);
+  Simulator::Cancel(m_refreshEvent);
+  ControllerApplication::DoDispose();
+}
+
+void
+OFRouting::InitMe()
+{
+  NS_LOG_FUNCTION(this);
+
+  if (m_proactive && (m_proactivePrio >= m_flowPrio))
+    NS_LOG_WARN("ProactivePriority " << m_proactivePrio << " shadows reactive rules at " << m_flowPrio);
+
+  if (m_statsInterval.IsStrictlyPositive())
+    m_statsEvent = Simulator::Schedule(m_statsInterval, &OFRouting::PollPortStats, this);
+}
+
 int
 OFRouting::GetPriority() const
 {
@@ -148,9 +206,10 @@ OFRouting::ReceiveFromSwitch(Ptr<OfSwitch>origin,
     return false;
   }
 
-  UndirectedGraph::GraphPath path = m_controller->FindShortestPath(srcHost, dstHost);
+  std::list<UndirectedGraph::GraphPath> paths =
+    m_controller->FindEqualCostPaths(srcHost, dstHost, m_maxPaths);
 
-  if (path.empty()) {
+  if (paths.empty()) {
     NS_LOG_WARN("OF-ROUTE: unknown route " << srcHost << " --> " << dstHost);
     return false;
   }
@@ -165,30 +224,269 @@ OFRouting::ReceiveFromSwitch(Ptr<OfSwitch>origin,
                                   ip4.GetSource().Get(),
                                   ip4.GetDestination().Get());
 
+  UndirectedGraph::GraphPath path = SelectPath(paths, matchHeader);
+
   SetupPath(matchHeader, path);
 
-  if (bufferId != OFP_NO_BUFFER)
-    RelayPacket(origin, bufferId, packetOrig);
+  int batchId = m_controller->CommitOpenflowMessages(MakeCallback(&OFRouting::BatchCommitted, this));
+
+  /* Release the packet once every switch in the path has the new rule */
+  if (bufferId != OFP_NO_BUFFER) {
+    PendingPacketType pp;
+
+    pp.bufferId = bufferId;
+    pp.origin   = origin;
+    pp.packet   = packetOrig;
+
+    m_pendingPacket[batchId] = pp;
+  }
 
   return true;
 }
 
+const UndirectedGraph::GraphPath&
+OFRouting::SelectPath(const std::list<UndirectedGraph::GraphPath>& paths,
+                      Ptr<FlowMatchHeader>                         matchHeader) const
+{
+  NS_ASSERT(!paths.empty());
+
+  auto selected = paths.begin();
+  std::advance(selected, HashFlow(matchHeader) % paths.size());
+
+  if ((paths.size() == 1) || m_portLoad.empty())
+    return *selected;
+
+  auto   leastLoaded = paths.begin();
+  double minLoad     = GetPathLoad(*leastLoaded);
+
+  for (auto it = std::next(paths.begin()); it != paths.end(); ++it) {
+    double load = GetPathLoad(*it);
+
+    if (load < minLoad) {
+      minLoad     = load;
+      leastLoaded = it;
+    }
+  }
+
+  double hashedLoad = GetPathLoad(*selected);
+
+  if ((hashedLoad - minLoad) * 8 > m_rebalanceThreshold.GetBitRate()) {
+    NS_LOG_LOGIC("OF-ROUTE: hashed path is " << hashedLoad - minLoad
+                 << " B/s busier than the least loaded one, moving flow");
+    return *leastLoaded;
+  }
+
+  return *selected;
+}
+
+uint32_t
+OFRouting::HashFlow(Ptr<FlowMatchHeader>matchHeader)
+{
+  uint32_t wildcards = matchHeader->GetWildcards();
+  Hasher   hasher;
+
+  hasher.clear();
+
+  /* Only fields that are part of the match, so a flow entry is never shared
+   * by packets hashed to different paths */
+  uint32_t nwSrc   = matchHeader->GetNwSrc();
+  uint32_t nwDst   = matchHeader->GetNwDst();
+  uint8_t  nwProto = matchHeader->GetNwProto();
+  uint16_t tpSrc   = (wildcards & OFPFW_TP_SRC) ? 0 : matchHeader->GetTpSrc();
+  uint16_t tpDst   = (wildcards & OFPFW_TP_DST) ? 0 : matchHeader->GetTpDst();
+
+  uint8_t key[13];
+  memcpy(key, &nwSrc, 4);
+  memcpy(key + 4, &nwDst, 4);
+  key[8] = nwProto;
+  memcpy(key + 9, &tpSrc, 2);
+  memcpy(key + 11, &tpDst, 2);
+
+  return hasher.GetHash32((const char *)key, sizeof(key));
+}
+
+double
+OFRouting::GetPathLoad(const UndirectedGraph::GraphPath& path) const
+{
+  double load = 0;
+
+  /* A path is as loaded as its busiest link */
+  for (auto& adj: path) {
+    if (adj->GetOrigin()->IsLeaf())
+      continue;
+
+    Ptr<SwitchVertex> sw = DynamicCast<SwitchVertex, Vertex>(adj->GetOrigin());
+    auto it = m_portLoad.find(PortKey(sw->GetChassisId(), adj->GetPortNumber()));
+
+    if (it != m_portLoad.end())
+      load = std::max(load, it->second.rate);
+  }
+
+  return load;
+}
+
+void
+OFRouting::PollPortStats()
+{
+  NS_LOG_FUNCTION(this);
+
+  for (auto& dev: m_controller->GetSwitchList())
+  {
+    for (int i = 0; i < dev->GetNPorts(); ++i)
+      dev->RequestPortStats(i);
+  }
+
+  m_statsEvent = Simulator::Schedule(m_statsInterval, &OFRouting::PollPortStats, this);
+}
+
+void
+OFRouting::PortStatsReceived(Ptr<OfSwitch>      origin,
+                             Ptr<PortStatsHeader>header)
+{
+  NS_LOG_FUNCTION(this << origin << header->GetPortNumber());
+
+  PortKey key(origin->GetChassisId(), header->GetPortNumber());
+  Time    now = Simulator::Now();
+  auto    it  = m_portLoad.find(key);
+
+  if (it == m_portLoad.end()) {
+    m_portLoad[key] = PortLoadType { header->GetTxBytes(), now, 0 };
+    return;
+  }
+
+  PortLoadType& port = it->second;
+
+  if (now > port.lastUpdate) {
+    uint64_t delta = header->GetTxBytes() - port.txBytes;
+
+    port.rate       = delta / (now - port.lastUpdate).GetSeconds();
+    port.txBytes    = header->GetTxBytes();
+    port.lastUpdate = now;
+  }
+}
+
+void
+OFRouting::TopologyChanged()
+{
+  NS_LOG_FUNCTION(this);
+
+  if (!m_proactive)
+    return;
+
+  if (m_proactiveSync >= 0) {
+    m_refreshPending = true; // wait for the current batch
+    return;
+  }
+
+  /* Coalesce all changes made by the current event */
+  if (!m_refreshEvent.IsRunning())
+    m_refreshEvent = Simulator::ScheduleNow(&OFRouting::RefreshProactiveRules, this);
+}
+
+void
+OFRouting::RefreshProactiveRules()
+{
+  NS_LOG_FUNCTION(this);
+
+  std::map<RuleKey, uint16_t> desired;
+  std::list<Ptr<Vertex> > leaves = m_controller->GetLeafVertices();
+
+  for (auto& dev: m_controller->GetSwitchList()) {
+    Ptr<SwitchVertex> sw = m_controller->LookupSwitch(dev->GetChassisId());
+
+    if (sw == nullptr)
+      continue;
+
+    for (auto& leaf: leaves) {
+      if (leaf->GetAddresses().empty())
+        continue;
+
+      UndirectedGraph::GraphPath path = m_controller->FindShortestPath(sw, leaf);
+
+      if (path.empty())
+        continue;
+
+      uint16_t port = path.front()->GetPortNumber();
+
+      for (auto& addr: leaf->GetAddresses()) {
+        if (Ipv4Address::IsMatchingType(addr))
+          desired[RuleKey(dev, Ipv4Address::ConvertFrom(addr).Get())] = port;
+      }
+    }
+  }
+
+  uint32_t changes = 0;
+
+  for (auto it = m_proactiveRules.begin(); it != m_proactiveRules.end();) {
+    if (desired.count(it->first) == 0) {
+      SendProactiveRule(it->first, OFPFC_DELETE_STRICT, OFPP_NONE);
+      it = m_proactiveRules.erase(it);
+      changes++;
+    }
+    else {
+      ++it;
+    }
+  }
+
+  for (auto& rule: desired) {
+    auto it = m_proactiveRules.find(rule.first);
+
+    if ((it == m_proactiveRules.end()) || (it->second != rule.second)) {
+      SendProactiveRule(rule.first, OFPFC_ADD, rule.second);
+      m_proactiveRules[rule.first] = rule.second;
+      changes++;
+    }
+  }
+
+  NS_LOG_LOGIC("OF-ROUTE: " << changes << " proactive rule changes, "
+               << m_proactiveRules.size() << " installed");
+
+  if (changes > 0)
+    m_proactiveSync = m_controller->CommitOpenflowMessages(MakeCallback(&OFRouting::BatchCommitted, this));
+}
+
+void
+OFRouting::SendProactiveRule(const RuleKey& rule,
+                             uint16_t       command,
+                             uint16_t       port)
+{
+  uint32_t wildcards = ~(OFPFW_DL_TYPE | OFPFW_NW_DST_MASK);
+
+  Ptr<FlowMatchHeader> matchHeader =
+    m_controller->CreateFlowMatch(2, wildcards,
+                                  Ipv4L3Protocol::PROT_NUMBER,
+                                  rule.second);
+
+  action_utils::ActionsList actions;
+
+  if (command != OFPFC_DELETE_STRICT)
+    action_utils::CreateOutputAction(&actions, port, 0);
+
+  Ptr<OpenflowHeader> ofHeader =
+    m_controller->CreateFlowModification(matchHeader, 0, command,
+                                         OFP_FLOW_PERMANENT, OFP_FLOW_PERMANENT,
+                                         m_proactivePrio, -1, OFPP_NONE, 0,
+                                         actions);
+
+  m_controller->QueueOpenflowMessage(rule.first, ofHeader);
+}
+
 void
 OFRouting::RelayPacket(Ptr<OfSwitch>origin,
                        unsigned     bufferId,
                        Ptr<Packet>  packet)
 {
-  int newState = m_controller->SwitchSync();
-
-  NS_LOG_LOGIC("OF-ROUTE: barrier ID " << newState);
+  NS_LOG_FUNCTION(this << bufferId);
 
-  PendingPacketType pp;
+  /* Output original packet through new path */
+  action_utils::ActionsList actionsList;
+  action_utils::CreateOutputAction(&actionsList, OFPP_TABLE, 0);
 
-  pp.bufferId = bufferId;
-  pp.origin   = origin;
-  pp.packet   = packet;
+  Ptr<OpenflowHeader> ofHeader =
+    m_controller->CreatePacketOut(bufferId, OFPP_NONE, sizeof(ofp_action_output),
+                                  actionsList, packet);
 
-  m_pendingPacket[newState] = pp;
+  m_controller->SendOpenflowMessage(origin, ofHeader);
 }
 
 void
@@ -214,7 +512,7 @@ OFRouting::SetupPath(Ptr<FlowMatchHeader>        matchHeader,
                                            OFPP_NONE, OFPFF_SEND_FLOW_REM,
                                            actions);
 
-    m_controller->SendOpenflowMessage(sw->GetSwitch(), ofHeader);
+    m_controller->QueueOpenflowMessage(sw->GetSwitch(), ofHeader);
   }
 }
 
@@ -241,31 +539,36 @@ OFRouting::TearDownPath(Ptr<FlowMatchHeader>        matchHeader,
                                            OFPP_NONE, OFPFF_SEND_FLOW_REM,
                                            actions);
 
-    m_controller->SendOpenflowMessage(sw->GetSwitch(), ofHeader);
+    m_controller->QueueOpenflowMessage(sw->GetSwitch(), ofHeader);
   }
+
+  m_controller->CommitOpenflowMessages(MakeNullCallback<void, int>());
 }
 
 void
-OFRouting::SyncCompleted(int statedId)
+OFRouting::BatchCommitted(int batchId)
 {
-  NS_LOG_FUNCTION(this << statedId);
+  NS_LOG_FUNCTION(this << batchId);
 
-  if (m_pendingPacket.count(statedId) == 0)
-    return;
+  if (batchId == m_proactiveSync) {
+    NS_LOG_INFO("OF-ROUTE: proactive rules committed");
+    m_proactiveSync = -1;
 
-  PendingPacketType& pp = m_pendingPacket[statedId];
+    if (m_refreshPending) {
+      m_refreshPending = false;
+      TopologyChanged();
+    }
+    return;
+  }
 
-  /* Output original packet through new path */
-  action_utils::ActionsList actionsList;
-  action_utils::CreateOutputAction(&actionsList, OFPP_TABLE, 0);
+  auto it = m_pendingPacket.find(batchId);
 
-  Ptr<OpenflowHeader> ofHeader =
-    m_controller->CreatePacketOut(pp.bufferId, OFPP_NONE, sizeof(ofp_action_output),
-                                  actionsList, pp.packet);
+  if (it == m_pendingPacket.end())
+    return;
 
-  m_controller->SendOpenflowMessage(pp.origin, ofHeader);
+  RelayPacket(it->second.origin, it->second.bufferId, it->second.packet);
 
-  m_pendingPacket.erase(statedId);
+  m_pendingPacket.erase(it);
 }
 } // namespace ns3
 #endif // NS3_OPENFLOW
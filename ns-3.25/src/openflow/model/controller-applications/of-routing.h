@@ -25,6 +25,9 @@
 #define OF_ROUTING_H
 
 #include <map>
+#include <ns3/event-id.h>
+#include <ns3/nstime.h>
+#include <ns3/data-rate.h>
 #include <ns3/controller.h>
 #include <ns3/controller-application.h>
 #include <ns3/undirected-graph.h>
@@ -56,8 +59,17 @@ public:
                                  unsigned     bufferId,
                                  Ptr<Packet>  packet);
 
-  virtual void SyncCompleted(int statedId);
+  virtual void PortStatsReceived(Ptr<OfSwitch>      origin,
+                                 Ptr<PortStatsHeader>header);
 
+  virtual void InitMe();
+
+  virtual void TopologyChanged();
+
+  /**
+   * \brief Queue one FLOW_MOD per switch in the path, sent by the next
+   * CommitOpenflowMessages
+   */
   void SetupPath(Ptr<FlowMatchHeader>        matchHeader,
                  UndirectedGraph::GraphPath& path);
 
@@ -68,10 +80,24 @@ public:
                    unsigned     bufferId,
                    Ptr<Packet>  packet);
 
+  void BatchCommitted(int batchId);
+
+  /**
+   * \brief Pick one of the equal cost paths for a flow.
+   *
+   * Flows are spread by a hash of the match fields. When port statistics
+   * are available, a path whose busiest link is loaded more than
+   * RebalanceThreshold above the least loaded candidate is skipped.
+   */
+  const UndirectedGraph::GraphPath& SelectPath(const std::list<UndirectedGraph::GraphPath>& paths,
+                                               Ptr<FlowMatchHeader>                         matchHeader) const;
+
 protected:
 
   virtual int GetPriority() const;
 
+  virtual void DoDispose();
+
 private:
 
   typedef struct {
@@ -80,14 +106,52 @@ private:
     Ptr<Packet>  packet;
   } PendingPacketType;
 
+  typedef struct {
+    uint64_t txBytes;
+    Time     lastUpdate;
+    double   rate; ///< transmitted bytes per second
+  } PortLoadType;
+
+  typedef std::pair<Mac48Address, uint16_t> PortKey;
+
+  static uint32_t HashFlow(Ptr<FlowMatchHeader>matchHeader);
+
+  double GetPathLoad(const UndirectedGraph::GraphPath& path) const;
+
+  void PollPortStats();
+
+  // switch, destination IPv4 address
+  typedef std::pair<Ptr<OfSwitch>, uint32_t> RuleKey;
+
+  /**
+   * \brief Recompute destination rules and send only the differences to
+   * the switches as a single committed batch.
+   */
+  void RefreshProactiveRules();
+
+  void SendProactiveRule(const RuleKey& rule,
+                         uint16_t       command,
+                         uint16_t       port);
+
 
   Ipv4Address m_nspGw;
   Ipv4Address m_accessNetPrefix;
   Ipv4Mask    m_accessNetMask;
   uint16_t    m_flowLifetime;
   uint16_t    m_flowPrio;
+  uint32_t    m_maxPaths;
+  Time        m_statsInterval;
+  DataRate    m_rebalanceThreshold;
+  EventId     m_statsEvent;
+  bool        m_proactive;
+  uint16_t    m_proactivePrio;  ///< below m_flowPrio, reactive rules win
+  EventId     m_refreshEvent;
+  int         m_proactiveSync;  ///< batch of the rules in flight, -1 if none
+  bool        m_refreshPending; ///< topology changed while rules were in flight
 
   std::map<int, PendingPacketType> m_pendingPacket;
+  std::map<PortKey, PortLoadType> m_portLoad;
+  std::map<RuleKey, uint16_t> m_proactiveRules; ///< installed output port
 };
 } // namespace ns3
 #endif  /* OF_ROUTING_H */
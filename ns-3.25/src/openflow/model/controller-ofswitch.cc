@@ -56,7 +56,8 @@ OfSwitch::OfSwitch(ControllerSbi *control,
   m_address(address),
   m_chassisId(Mac48Address::GetBroadcast()),
   m_xid(-1),
-  m_control(control)
+  m_control(control),
+  m_framer(OPENFLOW_LENGTH_OFFSET, 0, OPENFLOW_HEADER_LENGTH)
 {
   NS_LOG_FUNCTION(this);
 
@@ -149,6 +150,46 @@ OfSwitch::SyncSwitch(int stateId)
   m_control->SendOpenflowMessage(Ptr<OfSwitch>(this), barrier, true);
 }
 
+void
+OfSwitch::RequestPortStats(uint16_t port)
+{
+  NS_LOG_FUNCTION(this << port);
+
+  Ptr<OpenflowHeader> request = m_control->CreatePortStatsRequest(0, port);
+
+  m_stats_xids.insert(request->GetXId());
+
+  m_control->SendOpenflowMessage(Ptr<OfSwitch>(this), request);
+}
+
+void
+OfSwitch::QueueMessage(const OpenflowHeader& header)
+{
+  NS_LOG_FUNCTION(this);
+
+  Ptr<Packet> packet = Create<Packet>();
+  packet->AddHeader(header);
+
+  size_t offset = m_batch.size();
+  m_batch.resize(offset + packet->GetSize());
+  packet->CopyData(&m_batch[offset], packet->GetSize());
+}
+
+void
+OfSwitch::CommitMessages(int batchId)
+{
+  NS_LOG_FUNCTION(this << batchId << m_batch.size());
+
+  Ptr<OpenflowHeader> barrier = m_control->CreateDefault(OFPT_BARRIER_REQUEST);
+  barrier->SetXId(rand());
+
+  m_batch_map[barrier->GetXId()] = batchId;
+  QueueMessage(*barrier);
+
+  SendMessage(Create<Packet>(m_batch.data(), m_batch.size()));
+  m_batch.clear();
+}
+
 void
 OfSwitch::HandleHello(uint32_t xid)
 {
@@ -179,8 +220,18 @@ OfSwitch::HandleBarrier(uint32_t xid)
   auto pair = m_barrier_map.find(xid);
 
   if (pair != m_barrier_map.end()) {
+    int stateId = pair->second;
     m_barrier_map.erase(pair);
-    m_control->SwitchSyncCompleted(Ptr<OfSwitch>(this), pair->second);
+    m_control->SwitchSyncCompleted(Ptr<OfSwitch>(this), stateId);
+    return;
+  }
+
+  auto batch = m_batch_map.find(xid);
+
+  if (batch != m_batch_map.end()) {
+    int batchId = batch->second;
+    m_batch_map.erase(batch);
+    m_control->BatchCommitted(Ptr<OfSwitch>(this), batchId);
   }
 }
 
@@ -244,10 +295,7 @@ void
 OfSwitch::HandlePortStatus(Ptr<PortStatusHeader>header)
 {
   NS_LOG_FUNCTION(this << header);
-  Ptr<PhysicalPortHeader> phyPortHeader = header->GetPhysicalPort();
-
-  header->Print(std::cout);
-  phyPortHeader->Print(std::cout);
+  m_control->PortStatusChanged(Ptr<OfSwitch>(this), header);
 }
 
 void
@@ -255,14 +303,12 @@ OfSwitch::HandleStatsReply(uint32_t xid, Ptr<StatsReplyHeader>header)
 {
   NS_LOG_FUNCTION(this << xid << header);
 
-  if (m_xid != xid)
+  if ((m_xid != xid) && (m_stats_xids.erase(xid) == 0))
   {
     NS_LOG_WARN("Stats wasn't requested");
     return;
   }
 
-  header->Print(std::cout);
-
   switch (header->GetType())
   {
   case OFPST_FLOW:
@@ -294,7 +340,7 @@ void
 OfSwitch::HandlePortStatsReply(Ptr<PortStatsHeader>header)
 {
   NS_LOG_FUNCTION(this << header);
-  header->Print(std::cout);
+  m_control->PortStatsReceived(Ptr<OfSwitch>(this), header);
 }
 
 void
@@ -322,21 +368,16 @@ OfSwitch::OpenflowHandler(Ptr<Socket>socket)
 
   while ((packet = socket->RecvFrom(from)))
   {
-    while (packet->GetSize() > 0)
-    {
-      if (m_fragment != nullptr)
-      {
-        m_fragment->AddAtEnd(packet);
-        packet     = m_fragment;
-        m_fragment = nullptr;
-      }
+    m_framer.Push(packet);
 
+    while ((packet = m_framer.Pop()))
+    {
       OpenflowHeader openflowHeader;
 
       if (packet->RemoveHeader(openflowHeader) == 0)
       {
-        m_fragment = packet;
-        break;
+        NS_LOG_WARN(this << " Malformed OF message, discarding");
+        continue;
       }
 
       switch (openflowHeader.GetType())
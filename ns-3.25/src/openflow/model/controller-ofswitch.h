@@ -25,11 +25,14 @@
 #define CONTROLLER_OFSWITCH_H
 
 #include <map>
+#include <set>
+#include <vector>
 #include <ns3/ptr.h>
 #include <ns3/simple-ref-count.h>
 #include <ns3/inet-socket-address.h>
 #include <ns3/ipv4-address.h>
 #include <ns3/mac48-address.h>
+#include <ns3/stream-framer.h>
 #include <ns3/action-utils.h>
 
 namespace ns3 {
@@ -45,6 +48,7 @@ class ActionVlanVidHeader;
 class ActionVlanPcpHeader;
 class ControllerApplication;
 class ErrorMsgHeader;
+class OpenflowHeader;
 class FlowMatchHeader;
 class FlowRemovedHeader;
 class FlowStatsHeader;
@@ -97,6 +101,24 @@ public:
 
   void SyncSwitch(int stateId);
 
+  /**
+   * \brief Ask for the counters of one port, the reply is delivered to
+   * ControllerSbi::PortStatsReceived
+   * \param port        Port number
+   */
+  void RequestPortStats(uint16_t port);
+
+  /**
+   * \brief Append a message to the pending batch
+   */
+  void QueueMessage(const OpenflowHeader& header);
+
+  /**
+   * \brief Send the pending batch in a single write, followed by a barrier
+   * \param batchId     reported to ControllerSbi::BatchCommitted on the reply
+   */
+  void CommitMessages(int batchId);
+
   const Mac48Address& GetChassisId() const;
 
   int GetNPorts() const;
@@ -193,10 +215,13 @@ private:
   Mac48Address   m_chassisId;
   uint32_t       m_xid;
   ControllerSbi *m_control;
-  Ptr<Packet>    m_fragment;
+  StreamFramer   m_framer;
   std::map<int, Mac48Address> m_port_map;
   std::map<int, bool> m_flood_map;
   std::map<uint32_t, int> m_barrier_map;
+  std::set<uint32_t> m_stats_xids;
+  std::vector<uint8_t> m_batch;          ///< serialized messages waiting for commit
+  std::map<uint32_t, int> m_batch_map;   ///< barrier xid to batch ID
 };
 } // namespace ns3
 #endif  /* CONTROLLER_OFSWITCH_H */
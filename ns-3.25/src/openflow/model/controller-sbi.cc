@@ -53,7 +53,8 @@
 NS_LOG_COMPONENT_DEFINE("ControllerSbi");
 
 namespace ns3 {
-ControllerSbi::ControllerSbi()
+ControllerSbi::ControllerSbi() :
+  m_batchId(0)
 {
   NS_LOG_FUNCTION_NOARGS();
 }
@@ -383,6 +384,65 @@ ControllerSbi::SendOpenflowMessage(Ptr<OfSwitch>      target,
   target->SendMessage(packet);
 }
 
+void
+ControllerSbi::QueueOpenflowMessage(Ptr<OfSwitch>      target,
+                                    Ptr<OpenflowHeader>openflowHeader)
+{
+  NS_LOG_FUNCTION(this << target);
+
+  target->QueueMessage(*openflowHeader);
+  m_batched.insert(target);
+}
+
+int
+ControllerSbi::CommitOpenflowMessages(BatchCallback done)
+{
+  int batchId = ++m_batchId;
+
+  NS_LOG_FUNCTION(this << batchId << m_batched.size());
+
+  m_batches[batchId] = BatchType { (uint32_t)m_batched.size(), done };
+
+  for (auto& sw : m_batched)
+    sw->CommitMessages(batchId);
+
+  if (m_batched.empty())
+    Simulator::ScheduleNow(&ControllerSbi::FinishBatch, this, batchId);
+
+  m_batched.clear();
+
+  return batchId;
+}
+
+void
+ControllerSbi::BatchCommitted(Ptr<OfSwitch>origin, int batchId)
+{
+  NS_LOG_FUNCTION(this << origin << batchId);
+
+  auto it = m_batches.find(batchId);
+
+  if ((it == m_batches.end()) || (it->second.pending == 0))
+    return;
+
+  if (--it->second.pending == 0)
+    FinishBatch(batchId);
+}
+
+void
+ControllerSbi::FinishBatch(int batchId)
+{
+  auto it = m_batches.find(batchId);
+
+  if (it == m_batches.end())
+    return;
+
+  BatchCallback done = it->second.done;
+  m_batches.erase(it);
+
+  if (!done.IsNull())
+    done(batchId);
+}
+
 void
 ControllerSbi::AcceptHandler(Ptr<Socket>socket, const Address& from)
 {
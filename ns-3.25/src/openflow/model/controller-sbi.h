@@ -25,6 +25,8 @@
 #define CONTROLLER_SBI_H
 
 #include <set>
+#include <map>
+#include <ns3/callback.h>
 #include <ns3/simulator.h>
 #include <ns3/log.h>
 #include <ns3/ptr.h>
@@ -35,6 +37,8 @@
 namespace ns3 {
 class OpenflowHeader;
 class FlowMatchHeader;
+class PortStatsHeader;
+class PortStatusHeader;
 class OfSwitch;
 class Socket;
 
@@ -281,6 +285,32 @@ public:
                            Ptr<OpenflowHeader>openflowHeader,
                            bool               updateXid = false);
 
+  typedef Callback<void, int> BatchCallback;
+
+  /**
+   * \param target            Target OF switch
+   * \param openflowHeader    A pointer to the openflow header ready to be sent
+   * \brief Add a message to the switch batch, nothing is sent until
+   * CommitOpenflowMessages
+   */
+  void QueueOpenflowMessage(Ptr<OfSwitch>      target,
+                            Ptr<OpenflowHeader>openflowHeader);
+
+  /**
+   * \param done              Called with the batch ID once every switch
+   * acknowledged its barrier
+   * \brief Send every queued message, one write per switch closed by a
+   * BARRIER_REQUEST
+   * \return batch ID
+   */
+  int CommitOpenflowMessages(BatchCallback done);
+
+  /**
+   * \brief Barrier reply of a batch received from a switch
+   */
+  void BatchCommitted(Ptr<OfSwitch>origin,
+                      int          batchId);
+
   SwitchList GetSwitchList();
 
   Ptr<OfSwitch>GetSwitch(const Mac48Address& chassisId);
@@ -294,6 +324,12 @@ public:
 
   virtual void SwitchSyncCompleted(Ptr<OfSwitch>origin, int stateId) = 0;
 
+  virtual void PortStatsReceived(Ptr<OfSwitch>      origin,
+                                 Ptr<PortStatsHeader>header) = 0;
+
+  virtual void PortStatusChanged(Ptr<OfSwitch>       origin,
+                                 Ptr<PortStatusHeader>header) = 0;
+
 protected:
 
   void InitializeNetwork(Ptr<Node>          node,
@@ -304,8 +340,18 @@ private:
   void AcceptHandler(Ptr<Socket>    socket,
                      const Address& from);
 
+  void FinishBatch(int batchId);
+
+  typedef struct {
+    uint32_t      pending;  ///< switches yet to acknowledge
+    BatchCallback done;
+  } BatchType;
+
   SwitchList  m_swList;
   Ptr<Socket> m_socketListener;
+  std::set<Ptr<OfSwitch> > m_batched; ///< switches with queued messages
+  std::map<int, BatchType> m_batches;
+  int m_batchId;
 };
 } // namespace ns3
 #endif  /* CONTROLLER_SBI_H */
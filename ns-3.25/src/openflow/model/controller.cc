@@ -41,6 +41,8 @@
 #include "headers/flow-removed-header.h"
 #include "headers/port-status-header.h"
 #include "headers/stats-reply-header.h"
+#include "headers/port-stats-header.h"
+#include "headers/physical-port-header.h"
 #include "actions/action-header.h"
 #include "controller-applications/controller-application.h"
 // #include "controller-applications/of-dhcp.h"
@@ -89,6 +91,7 @@ Controller::GetTypeId(void)
 
 Controller::Controller() :
   m_myAddress(Ipv4Address::GetAny()),
+  m_nbiVersion(0),
   m_stateId(0),
   m_inband(nullptr),
   m_dftAccessProfile(""),
@@ -216,6 +219,8 @@ Controller::NewSwitch(Ptr<OfSwitch>origin)
   for (auto& app : m_applications) {
     app->InitSwitch(origin);
   }
+
+  CheckTopology();
 }
 
 int
@@ -252,6 +257,64 @@ Controller::SwitchSyncCompleted(Ptr<OfSwitch>origin, int stateId)
   }
 }
 
+void
+Controller::PortStatsReceived(Ptr<OfSwitch>origin, Ptr<PortStatsHeader>header)
+{
+  NS_LOG_FUNCTION(this << origin);
+
+  for (auto& app : m_applications) app->PortStatsReceived(origin, header);
+}
+
+void
+Controller::PortStatusChanged(Ptr<OfSwitch>origin, Ptr<PortStatusHeader>header)
+{
+  NS_LOG_FUNCTION(this << origin);
+
+  Ptr<PhysicalPortHeader> port = header->GetPhysicalPort();
+
+  if ((header->GetReason() != OFPPR_DELETE) && ((port->GetState() & OFPPS_LINK_DOWN) == 0))
+    return;
+
+  Ptr<SwitchVertex> sw = LookupSwitch(origin->GetChassisId());
+
+  if (sw == nullptr)
+    return;
+
+  NS_LOG_INFO("Port " << port->GetPortNumber() << " of " << *sw << " is down");
+
+  std::list<Ptr<Adjacency> > lost;
+
+  for (auto& adj : sw->GetEdges()) {
+    if (adj->GetPortNumber() == port->GetPortNumber())
+      lost.push_back(adj);
+  }
+
+  for (auto& adj : lost) {
+    m_nbi.RemoveEdge(adj);
+
+    // hosts can't report their side of the link
+    Ptr<Vertex> peer = adj->GetDestination();
+
+    if (peer->IsLeaf()) {
+      if (auto back = peer->GetEdge(sw))
+        m_nbi.RemoveEdge(back);
+    }
+  }
+
+  CheckTopology();
+}
+
+void
+Controller::CheckTopology(bool force)
+{
+  if (!force && (m_nbi.GetVersion() == m_nbiVersion))
+    return;
+
+  m_nbiVersion = m_nbi.GetVersion();
+
+  for (auto& app : m_applications) app->TopologyChanged();
+}
+
 Ptr<HostVertex>
 Controller::AddHost(const Mac48Address& mac)
 {
@@ -279,6 +342,7 @@ Controller::RemoveHost(const Mac48Address& mac)
   }
 
   m_nbi.RemoveVertex(mac);
+  CheckTopology();
 }
 
 void
@@ -293,21 +357,67 @@ void
 Controller::AddHostMapping(Ptr<HostVertex>host,
                            const Address& addr)
 {
+  if (host->HasAddress(addr))
+    return;
+
   host->AddAddress(addr);
+  CheckTopology(true);
 }
 
 void
 Controller::RemoveHostMapping(const Mac48Address& mac, const Address& addr)
 {
-  if (auto host = m_nbi.LookupVertex(mac))
+  auto host = m_nbi.LookupVertex(mac);
+
+  if (host && host->HasAddress(addr)) {
     host->RemoveAddress(addr);
+    CheckTopology(true);
+  }
 }
 
 void
 Controller::RemoveHostMapping(const Address& addr)
 {
-  if (auto host = m_nbi.LookupVertex(addr))
+  if (auto host = m_nbi.LookupVertex(addr)) {
     host->RemoveAddress(addr);
+    CheckTopology(true);
+  }
+}
+
+bool
+Controller::MoveHost(Ptr<HostVertex>  host,
+                     Ptr<SwitchVertex>sw,
+                     uint16_t         portNum)
+{
+  NS_LOG_FUNCTION(this << *host << *sw << portNum);
+
+  for (auto& adj : sw->GetEdges()) {
+    if (adj->GetPortNumber() != portNum)
+      continue;
+
+    if (adj->GetDestination() == host)
+      return false; // already there
+
+    if (!adj->GetDestination()->IsLeaf())
+      return false; // inter-switch link
+  }
+
+  NS_LOG_INFO("Host " << *host << " moved to " << *sw << " port " << portNum);
+
+  std::list<Ptr<Adjacency> > old(host->GetEdges().begin(), host->GetEdges().end());
+
+  for (auto& adj : old) {
+    if (auto back = adj->GetDestination()->GetEdge(host))
+      m_nbi.RemoveEdge(back);
+    m_nbi.RemoveEdge(adj);
+  }
+
+  Ptr<Adjacency> adj = m_nbi.AddEdge(sw, host);
+  adj->SetPortNumber(portNum);
+  m_nbi.AddEdge(adj->Invert());
+
+  CheckTopology();
+  return true;
 }
 
 Ptr<Adjacency>
@@ -320,27 +430,37 @@ Controller::AddEdge(Ptr<Vertex>from,
   if (adj)
     adj->SetPortNumber(portNum);
 
+  CheckTopology();
   return adj;
 }
 
 Ptr<Adjacency>
 Controller::AddEdge(Ptr<Adjacency>adj)
 {
-  return m_nbi.AddEdge(adj);
+  Ptr<Adjacency> edge = m_nbi.AddEdge(adj);
+
+  CheckTopology();
+  return edge;
 }
 
 Ptr<Adjacency>
 Controller::AddEdge(Ptr<Vertex>from,
                     Ptr<Vertex>to)
 {
-  return m_nbi.AddEdge(from, to);
+  Ptr<Adjacency> edge = m_nbi.AddEdge(from, to);
+
+  CheckTopology();
+  return edge;
 }
 
 Ptr<Adjacency>
 Controller::AddEdge(const Mac48Address& from,
                     const Mac48Address& to)
 {
-  return m_nbi.AddEdge(from, to);
+  Ptr<Adjacency> edge = m_nbi.AddEdge(from, to);
+
+  CheckTopology();
+  return edge;
 }
 
 Ptr<SwitchVertex>
@@ -361,6 +481,12 @@ Controller::LookupHost(const Address& addr) const
   return DynamicCast<HostVertex, Vertex>(m_nbi.LookupVertex(addr));
 }
 
+std::list<Ptr<Vertex> >
+Controller::GetLeafVertices() const
+{
+  return m_nbi.GetLeafVertices();
+}
+
 UndirectedGraph::GraphPath
 Controller::FindShortestPath(const Mac48Address& from,
                              const Mac48Address& to) const
@@ -375,6 +501,14 @@ Controller::FindShortestPath(Ptr<Vertex>from,
   return m_nbi.FindShortestPath(from, to);
 }
 
+std::list<UndirectedGraph::GraphPath>
+Controller::FindEqualCostPaths(Ptr<Vertex>from,
+                               Ptr<Vertex>to,
+                               uint32_t   maxPaths) const
+{
+  return m_nbi.FindEqualCostPaths(from, to, maxPaths);
+}
+
 Ipv4Address
 Controller::GetLocalAddress(Ptr<NetDevice>device) const
 {
@@ -105,6 +105,16 @@ public:
   virtual void SwitchSyncCompleted(Ptr<OfSwitch>origin,
                                    int          stateId);
 
+  virtual void PortStatsReceived(Ptr<OfSwitch>      origin,
+                                 Ptr<PortStatsHeader>header);
+
+  /**
+   * \brief Drop the edges behind a port that went down, links coming up
+   * are learned again by LLDP and ARP.
+   */
+  virtual void PortStatusChanged(Ptr<OfSwitch>       origin,
+                                 Ptr<PortStatusHeader>header);
+
   Ptr<HostVertex>AddHost(const Mac48Address& mac);
 
   void RemoveHost(const Mac48Address& mac);
@@ -120,6 +130,17 @@ public:
 
   void RemoveHostMapping(const Address& addr);
 
+  /**
+   * \brief Re-attach a host to a new switch port.
+   *
+   * No-op if the host is already attached there, or if the port leads to
+   * another switch (flooded packets seen on an inter-switch link).
+   * \return true if the host was moved
+   */
+  bool MoveHost(Ptr<HostVertex>  host,
+                Ptr<SwitchVertex>sw,
+                uint16_t         portNum);
+
   /**
    * \brief Adds adjacency to vertex adjacency list.
    */
@@ -157,12 +178,18 @@ public:
 
   Ptr<HostVertex>LookupHost(const Address& addr) const;
 
+  std::list<Ptr<Vertex> > GetLeafVertices() const;
+
   UndirectedGraph::GraphPath FindShortestPath(const Mac48Address& from,
                                               const Mac48Address& to) const;
 
   UndirectedGraph::GraphPath FindShortestPath(Ptr<Vertex>from,
                                               Ptr<Vertex>to) const;
 
+  std::list<UndirectedGraph::GraphPath> FindEqualCostPaths(Ptr<Vertex>from,
+                                                           Ptr<Vertex>to,
+                                                           uint32_t   maxPaths) const;
+
   Ipv4Address GetLocalAddress(Ptr<NetDevice>device) const;
 
 protected:
@@ -174,12 +201,19 @@ protected:
 
 private:
 
+  /**
+   * \brief Tell the applications the topology changed, if it did
+   * \param force       notify even if the graph is unchanged (address changes)
+   */
+  void CheckTopology(bool force = false);
+
   typedef std::list<Ptr<ControllerApplication> >AppsList;
   typedef std::multimap<int, Ptr<OfSwitch> >    SyncMap;
 
   Ipv4Address m_myAddress;
   AppsList    m_applications;
   UndirectedGraph m_nbi;
+  uint32_t        m_nbiVersion;
   SyncMap m_syncMap;
   int     m_stateId;
   Ipv4Address    m_inbandAddress;
@@ -28,6 +28,7 @@
 
 #define OFP_VERSION1            1
 #define OPENFLOW_HEADER_LENGTH  8
+#define OPENFLOW_LENGTH_OFFSET  2 /* ofp_header.length */
 
 namespace ns3
 {
@@ -0,0 +1,270 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2015 UFRGS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Alexsander de Souza <asouza@inf.ufrgs.br>
+ *
+ */
+
+#include <cstring>
+#include "ns3/log.h"
+#include "ns3/openflow-header.h"
+#include "ns3/flow-match-header.h"
+#include "ns3/packet-out-header.h"
+#include "ns3/switch-configuration-header.h"
+#include "ns3/openflow-wire-decoder.h"
+
+NS_LOG_COMPONENT_DEFINE("OpenflowWireDecoder");
+
+/* Wire sizes of the message bodies, as serialized by the controller */
+#define FLOW_MODIFICATION_BODY_LENGTH  (FLOW_MATCH_LENGTH + 24)
+#define ACTION_HEADER_LENGTH           4
+
+namespace ns3
+{
+NS_OBJECT_ENSURE_REGISTERED(OpenflowWireDecoder);
+
+OpenflowWireDecoder::OpenflowWireDecoder (void) :
+  m_length(0),
+  m_valid(false)
+{
+  NS_LOG_FUNCTION(this);
+}
+
+TypeId OpenflowWireDecoder::GetTypeId(void)
+{
+  static TypeId tid = TypeId("ns3::OpenflowWireDecoder")
+                      .SetParent<Header> ()
+                      .AddConstructor<OpenflowWireDecoder> ()
+  ;
+
+  return tid;
+}
+
+TypeId OpenflowWireDecoder::GetInstanceTypeId(void) const
+{
+  return GetTypeId();
+}
+
+void OpenflowWireDecoder::Print(std::ostream &os) const
+{
+  os << "Openflow wire message, length " << m_length;
+}
+
+uint32_t OpenflowWireDecoder::GetSerializedSize(void) const
+{
+  return m_length;
+}
+
+void OpenflowWireDecoder::Serialize(Buffer::Iterator start) const
+{
+  NS_FATAL_ERROR("OpenflowWireDecoder is decode only, use OpenflowHeader");
+}
+
+ofp_header* OpenflowWireDecoder::GetMessage(void)
+{
+  return m_valid ? (ofp_header *)m_scratch.data() : 0;
+}
+
+ofp_header* OpenflowWireDecoder::Reserve(uint32_t size)
+{
+  if (m_scratch.size() < size)
+    m_scratch.resize(size);
+
+  std::memset(m_scratch.data(), 0, size);
+
+  return (ofp_header *)m_scratch.data();
+}
+
+uint32_t OpenflowWireDecoder::Deserialize(Buffer::Iterator start)
+{
+  NS_LOG_FUNCTION(this << &start);
+
+  m_valid = false;
+  m_length = 0;
+
+  uint32_t size = start.GetSize();
+
+  if (size < OPENFLOW_HEADER_LENGTH)
+    return 0;
+
+  start.Next(1); /* version */
+  uint8_t type = start.ReadU8();
+  uint16_t length = start.ReadNtohU16();
+  uint32_t xid = start.ReadNtohU32();
+
+  if (length < OPENFLOW_HEADER_LENGTH || length > size)
+    return 0;
+
+  switch (type)
+    {
+    case OFPT_FLOW_MOD:
+      m_valid = DecodeFlowModification(start, length);
+      break;
+
+    case OFPT_PACKET_OUT:
+      m_valid = DecodePacketOut(start, length);
+      break;
+
+    case OFPT_SET_CONFIG:
+      m_valid = DecodeSetConfiguration(start, length);
+      break;
+
+    default:
+      Reserve(sizeof(ofp_header))->length = length;
+      m_valid = true;
+      break;
+    }
+
+  if (!m_valid)
+    return 0;
+
+  /* The datapath takes the xid in host order */
+  ofp_header *ofh = (ofp_header *)m_scratch.data();
+  ofh->version = OFP_VERSION;
+  ofh->type = type;
+  ofh->xid = xid;
+
+  m_length = length;
+  return length;
+}
+
+void OpenflowWireDecoder::ReadMatch(Buffer::Iterator &start, ofp_match &match)
+{
+  /* Same wire fields as FlowMatchHeader, left in network order */
+  start.Read((uint8_t *)&match.wildcards, sizeof(match.wildcards));
+  start.Read((uint8_t *)&match.in_port, sizeof(match.in_port));
+  start.Read(match.dl_src, OFP_ETH_ALEN);
+  start.Read(match.dl_dst, OFP_ETH_ALEN);
+  start.Read((uint8_t *)&match.dl_vlan, sizeof(match.dl_vlan));
+  start.Next(2);                    /* VlanPcp not implemented, pad */
+  start.Read((uint8_t *)&match.dl_type, sizeof(match.dl_type));
+  start.Next(1);                    /* nwToS not implemented */
+  match.nw_proto = start.ReadU8();
+  start.Next(2);                    /* pad */
+  start.Read((uint8_t *)&match.nw_src, sizeof(match.nw_src));
+  start.Read((uint8_t *)&match.nw_dst, sizeof(match.nw_dst));
+  start.Read((uint8_t *)&match.tp_src, sizeof(match.tp_src));
+  start.Read((uint8_t *)&match.tp_dst, sizeof(match.tp_dst));
+}
+
+void OpenflowWireDecoder::ReadActions(Buffer::Iterator &start, uint8_t *actions, uint32_t length)
+{
+  while (length >= ACTION_HEADER_LENGTH)
+    {
+      uint16_t type = start.ReadNtohU16();
+      uint16_t len = start.ReadNtohU16();
+
+      if (len < ACTION_HEADER_LENGTH || len > length)
+        {
+          NS_LOG_WARN(this << " Invalid action length " << len);
+          start.Next(length - ACTION_HEADER_LENGTH);
+          return;
+        }
+
+      ofp_action_header *ah = (ofp_action_header *)actions;
+      ah->type = htons(type);
+      ah->len = htons(len);
+
+      if (type == OFPAT_OUTPUT && len >= sizeof(ofp_action_output))
+        {
+          /* The datapath reads the output action in host order */
+          ofp_action_output *oa = (ofp_action_output *)ah;
+          oa->port = start.ReadNtohU16();
+          oa->max_len = start.ReadNtohU16();
+          start.Next(len - sizeof(ofp_action_output));
+        }
+      else
+        {
+          start.Read(actions + ACTION_HEADER_LENGTH, len - ACTION_HEADER_LENGTH);
+        }
+
+      actions += len;
+      length -= len;
+    }
+}
+
+bool OpenflowWireDecoder::DecodeFlowModification(Buffer::Iterator &start, uint32_t length)
+{
+  if (length < OPENFLOW_HEADER_LENGTH + FLOW_MODIFICATION_BODY_LENGTH)
+    return false;
+
+  uint32_t actionsLength = length - OPENFLOW_HEADER_LENGTH - FLOW_MODIFICATION_BODY_LENGTH;
+  uint32_t msgLength = sizeof(ofp_flow_mod) + actionsLength;
+  ofp_flow_mod *ofm = (ofp_flow_mod *)Reserve(msgLength);
+
+  ofm->header.length = htons(msgLength);
+
+  ReadMatch(start, ofm->match);
+
+  start.Next(8);                    /* cookie not implemented */
+  start.Read((uint8_t *)&ofm->command, sizeof(ofm->command));
+  start.Read((uint8_t *)&ofm->idle_timeout, sizeof(ofm->idle_timeout));
+  start.Read((uint8_t *)&ofm->hard_timeout, sizeof(ofm->hard_timeout));
+  start.Read((uint8_t *)&ofm->priority, sizeof(ofm->priority));
+  start.Read((uint8_t *)&ofm->buffer_id, sizeof(ofm->buffer_id));
+  ofm->out_port = start.ReadNtohU16();
+  start.Next(2);                    /* flags not implemented */
+
+  ReadActions(start, (uint8_t *)ofm->actions, actionsLength);
+
+  return true;
+}
+
+bool OpenflowWireDecoder::DecodePacketOut(Buffer::Iterator &start, uint32_t length)
+{
+  if (length < PACKET_OUT_LENGTH)
+    return false;
+
+  Buffer::Iterator body = start;
+  body.Next(6);
+  uint16_t actionsLength = body.ReadNtohU16();
+
+  if (actionsLength > length - PACKET_OUT_LENGTH)
+    return false;
+
+  uint32_t dataLength = length - PACKET_OUT_LENGTH - actionsLength;
+  uint32_t msgLength = sizeof(ofp_packet_out) + actionsLength + dataLength;
+  ofp_packet_out *opo = (ofp_packet_out *)Reserve(msgLength);
+
+  opo->header.length = htons(msgLength);
+
+  start.Read((uint8_t *)&opo->buffer_id, sizeof(opo->buffer_id));
+  start.Read((uint8_t *)&opo->in_port, sizeof(opo->in_port));
+  start.Read((uint8_t *)&opo->actions_len, sizeof(opo->actions_len));
+
+  ReadActions(start, (uint8_t *)opo->actions, actionsLength);
+  start.Read((uint8_t *)opo->actions + actionsLength, dataLength);
+
+  return true;
+}
+
+bool OpenflowWireDecoder::DecodeSetConfiguration(Buffer::Iterator &start, uint32_t length)
+{
+  if (length < SWITCH_SET_CONFIGURATION_LENGTH)
+    return false;
+
+  ofp_switch_config *osc = (ofp_switch_config *)Reserve(sizeof(ofp_switch_config));
+
+  /* Host order, unlike FLOW_MOD and PACKET_OUT */
+  osc->header.length = length;
+
+  osc->flags = start.ReadNtohU16();
+  osc->miss_send_len = start.ReadNtohU16();
+
+  return true;
+}
+} // namespace ns3
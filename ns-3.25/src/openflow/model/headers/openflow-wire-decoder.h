@@ -0,0 +1,75 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2015 UFRGS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Alexsander de Souza <asouza@inf.ufrgs.br>
+ *
+ */
+
+#ifndef OPENFLOW_WIRE_DECODER_H
+#define OPENFLOW_WIRE_DECODER_H
+
+#include <vector>
+#include "ns3/header.h"
+#include "ns3/openflow-lib.h"
+
+namespace ns3
+{
+/**
+ * \class OpenflowWireDecoder
+ * \brief Decodes switch bound Openflow messages into datapath structs
+ *
+ * Used with Packet::PeekHeader, fills the ofp_* struct handed to
+ * OpenFlowSwitchNetDevice::ForwardControlInput straight from the packet
+ * buffer, without building the OpenflowHeader sub-header objects. The
+ * storage is reused, so the decoded message is only valid until the next
+ * call.
+ *
+ * FLOW_MOD, PACKET_OUT and SET_CONFIG are fully decoded, any other type
+ * only gets its ofp_header.
+ */
+class OpenflowWireDecoder : public Header
+{
+public:
+  OpenflowWireDecoder (void);
+
+  static TypeId GetTypeId(void);
+  virtual TypeId GetInstanceTypeId(void) const;
+  virtual void Print(std::ostream &os) const;
+  virtual uint32_t GetSerializedSize(void) const;
+  virtual void Serialize(Buffer::Iterator start) const;
+  virtual uint32_t Deserialize(Buffer::Iterator start);
+
+  /**
+   * \return decoded message, null if the last one was malformed
+   */
+  ofp_header* GetMessage(void);
+
+private:
+  ofp_header* Reserve(uint32_t size);
+  void ReadMatch(Buffer::Iterator &start, ofp_match &match);
+  void ReadActions(Buffer::Iterator &start, uint8_t *actions, uint32_t length);
+
+  bool DecodeFlowModification(Buffer::Iterator &start, uint32_t length);
+  bool DecodePacketOut(Buffer::Iterator &start, uint32_t length);
+  bool DecodeSetConfiguration(Buffer::Iterator &start, uint32_t length);
+
+  std::vector<uint8_t> m_scratch;  /**< Decoded message storage */
+  uint32_t m_length;               /**< Wire length of the last message */
+  bool m_valid;
+};
+} // namespace ns3
+#endif /* OPENFLOW_WIRE_DECODER_H */
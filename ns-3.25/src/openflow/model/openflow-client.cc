@@ -79,7 +79,7 @@ OpenflowClient::OpenflowClient() :
   m_xid(0),
   m_ctrlAddress(Ipv4Address::GetAny()),
   m_myAddress(Ipv4Address::GetAny()),
-  m_fragment(nullptr)
+  m_framer(OPENFLOW_LENGTH_OFFSET, 0, OPENFLOW_HEADER_LENGTH)
 {
   NS_LOG_FUNCTION(this);
 }
@@ -295,100 +295,27 @@ OpenflowClient::SendBarrier(uint32_t xid)
 }
 
 void
-OpenflowClient::HandleSetConfiguration(ofp_header *ofh, Ptr<SwitchConfigurationHeader>header)
+OpenflowClient::HandleSetConfiguration(ofp_switch_config *osc)
 {
-  NS_LOG_FUNCTION(this << header);
-
-  ofp_switch_config ofsc;
-
-  ofsc.header        = *ofh;
-  ofsc.flags         = header->GetFlags();
-  ofsc.miss_send_len = header->GetMaxFlowLen();
+  NS_LOG_FUNCTION(this << osc);
 
-  m_ofSwNetDev->ForwardControlInput(&ofsc, ofh->length);
+  m_ofSwNetDev->ForwardControlInput(osc, osc->header.length);
 }
 
 void
-OpenflowClient::HandleFlowModification(ofp_header *ofh, Ptr<FlowModificationHeader>header)
+OpenflowClient::HandleFlowModification(ofp_flow_mod *ofm)
 {
-  NS_LOG_FUNCTION(this << header);
-
-  uint16_t actionsLength = ofh->length - sizeof(ofp_flow_mod);
-  ofp_flow_mod *ofm      = (ofp_flow_mod *)std::malloc(sizeof(ofp_flow_mod) + actionsLength);
-
-  ofm->header = *ofh;
-
-  ofm->header.version = OFP_VERSION;
-  ofm->header.type    = OFPT_FLOW_MOD;
-  ofm->header.length  = htons(ofm->header.length);
-
-  Ptr<FlowMatchHeader> matchHeader = header->GetFlowMatch();
-  FlowMatchHeader::ConvertToStruct(ofm->match, matchHeader);
-
-  ofm->match.wildcards = htonl(ofm->match.wildcards);
-  ofm->match.in_port   = htons(ofm->match.in_port);
-  ofm->match.dl_vlan   = htons(ofm->match.dl_vlan);
-  ofm->match.dl_type   = htons(ofm->match.dl_type);
-  ofm->match.nw_src    = htonl(ofm->match.nw_src);
-  ofm->match.nw_dst    = htonl(ofm->match.nw_dst);
-  ofm->match.tp_src    = htons(ofm->match.tp_src);
-  ofm->match.tp_dst    = htons(ofm->match.tp_dst);
-  ofm->command         = htons(header->GetCommand());
-  ofm->idle_timeout    = htons(header->GetIdleTimeout());
-  ofm->hard_timeout    = htons(header->GetHardTimeout());
-  ofm->priority        = header->GetPriority();
-  ofm->buffer_id       = htonl(header->GetBufferId());
-  ofm->out_port        = header->GetOutPort();
-
-  // cookie not implemented
-  // flags not implemented
-
-  Ptr<ActionHeader> actionOutputHeader = header->GetActionByType(OFPAT_OUTPUT);
-
-  ofp_action_output action;
-  ActionOutputHeader::ConvertToStruct(action, actionOutputHeader);
-  action.type = htons(action.type);
-  action.len  = htons(sizeof(ofp_action_output));
-  memcpy(ofm->actions, &action, sizeof(ofp_action_output));
+  NS_LOG_FUNCTION(this << ofm);
 
   m_ofSwNetDev->ForwardControlInput(ofm, ofm->header.length);
-
-  std::free(ofm);
 }
 
 void
-OpenflowClient::HandlePacketOut(ofp_header *ofh, Ptr<PacketOutHeader>header)
+OpenflowClient::HandlePacketOut(ofp_packet_out *opo)
 {
-  NS_LOG_FUNCTION(this << header);
-
-  uint16_t actionsLength = ofh->length - sizeof(ofp_packet_out);
-  uint16_t dataLength    = header->GetDataLength();
-
-  ofp_packet_out *opo = (ofp_packet_out *)std::malloc(sizeof(ofp_packet_out) + actionsLength + dataLength);
-
-  opo->header = *ofh;
-
-  opo->header.version = OFP_VERSION;
-  opo->header.type    = OFPT_PACKET_OUT;
-  opo->header.length  = htons(opo->header.length);
-  opo->buffer_id      = htonl(header->GetBufferId());
-  opo->in_port        = htons(header->GetInPort());
-  opo->actions_len    = htons(header->GetActionsLen());
-
-  action_utils::ActionsList actionsList = header->GetActionsList();
-  Ptr<ActionHeader> actionOutputHeader  = header->GetActionByType(OFPAT_OUTPUT);
-
-  ofp_action_output action;
-  ActionOutputHeader::ConvertToStruct(action, actionOutputHeader);
-  action.type = htons(action.type);
-  action.len  = htons(sizeof(ofp_action_output));
-  memcpy(opo->actions, &action, sizeof(ofp_action_output));
-
-  header->GetData((uint8_t *)opo->actions + ntohs(opo->actions_len), dataLength);
+  NS_LOG_FUNCTION(this << opo);
 
   m_ofSwNetDev->ForwardControlInput(opo, opo->header.length);
-
-  std::free(opo);
 }
 
 void
@@ -450,34 +377,26 @@ OpenflowClient::OpenflowHandler(Ptr<Socket>socket)
 
   while ((packet = socket->RecvFrom(from)))
   {
-    while (packet->GetSize() > 0)
-    {
-      if (m_fragment != nullptr)
-      {
-        m_fragment->AddAtEnd(packet);
-        packet     = m_fragment;
-        m_fragment = nullptr;
-      }
+    m_framer.Push(packet);
 
-      OpenflowHeader openflowHeader;
-
-      if (packet->RemoveHeader(openflowHeader) == 0)
+    while ((packet = m_framer.Pop()))
+    {
+      if (packet->PeekHeader(m_decoder) == 0)
       {
-        m_fragment = packet;
-        break;
+        NS_LOG_WARN(this << " Malformed OF message, discarding");
+        continue;
       }
 
-      ofp_header *ofh = (ofp_header *)std::malloc(sizeof(ofp_header));
-      OpenflowHeader::ConvertToStruct(*ofh, &openflowHeader);
+      ofp_header *ofh = m_decoder.GetMessage();
 
-      switch (openflowHeader.GetType())
+      switch (ofh->type)
       {
       case OFPT_HELLO:
-        SendHello(openflowHeader.GetXId());
+        SendHello(ofh->xid);
         break;
 
       case OFPT_BARRIER_REQUEST:
-        SendBarrier(openflowHeader.GetXId());
+        SendBarrier(ofh->xid);
         break;
 
       case OFPT_FEATURES_REQUEST:
@@ -486,30 +405,34 @@ OpenflowClient::OpenflowHandler(Ptr<Socket>socket)
         break;
 
       case OFPT_SET_CONFIG:
-        HandleSetConfiguration(ofh, openflowHeader.GetSwitchConfiguration());
+        HandleSetConfiguration((ofp_switch_config *)ofh);
         break;
 
       case OFPT_PACKET_OUT:
-        HandlePacketOut(ofh, openflowHeader.GetPacketOut());
+        HandlePacketOut((ofp_packet_out *)ofh);
         break;
 
       case OFPT_FLOW_MOD:
-        HandleFlowModification(ofh, openflowHeader.GetFlowModification());
+        HandleFlowModification((ofp_flow_mod *)ofh);
         break;
 
       case OFPT_PORT_MOD:
-        HandlePortModification(openflowHeader.GetPortModification());
-        break;
-
       case OFPT_STATS_REQUEST:
-        HandleStatsRequest(openflowHeader.GetXId(), openflowHeader.GetStatsRequest());
+      {
+        /* Rare, use the full header */
+        OpenflowHeader openflowHeader;
+        packet->RemoveHeader(openflowHeader);
+
+        if (ofh->type == OFPT_PORT_MOD)
+          HandlePortModification(openflowHeader.GetPortModification());
+        else
+          HandleStatsRequest(openflowHeader.GetXId(), openflowHeader.GetStatsRequest());
         break;
+      }
 
       default:
         NS_LOG_WARN(this << " Unsupported OF message received, discarding");
       }
-
-      std::free(ofh);
     }
   }
 }
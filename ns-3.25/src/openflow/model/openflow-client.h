@@ -26,10 +26,12 @@
 
 #include "ns3/application.h"
 #include "ns3/mac48-address.h"
+#include "ns3/stream-framer.h"
 #include "ns3/openflow-lib.h"
 #include "ns3/action-utils.h"
 #include "ns3/openflow-switch-net-device.h"
 #include "ns3/switch-features-header.h"
+#include "ns3/openflow-wire-decoder.h"
 
 namespace ns3 {
 class Socket;
@@ -187,31 +189,22 @@ private:
   void SendBarrier(uint32_t xid);
 
   /**
-   * \param ofh         Pointer to openflow header of type set configuration
-   *                    in struct format
-   * \param header      Pointer to switch configuration header
+   * \param osc         Decoded set configuration message
    * \brief Handle a switch set configuration message received
    */
-  void HandleSetConfiguration(ofp_header                   *ofh,
-                              Ptr<SwitchConfigurationHeader>header);
+  void HandleSetConfiguration(ofp_switch_config *osc);
 
   /**
-   * \param ofh         Pointer to openflow header of type flow modification
-   *                    in struct format
-   * \param header      Pointer to flow modification header
+   * \param ofm         Decoded flow modification message, actions included
    * \brief Handle a flow modification message received
    */
-  void HandleFlowModification(ofp_header                *ofh,
-                              Ptr<FlowModificationHeader>header);
+  void HandleFlowModification(ofp_flow_mod *ofm);
 
   /**
-   * \param ofh         Pointer to openflow header of type flow modification
-   *                    in struct format
-   * \param header      Pointer to packet out header
+   * \param opo         Decoded packet out message, actions and data included
    * \brief Handle a packet out message received
    */
-  void HandlePacketOut(ofp_header         *ofh,
-                       Ptr<PacketOutHeader>header);
+  void HandlePacketOut(ofp_packet_out *opo);
 
   /**
    * \param header      Port modification header
@@ -251,7 +244,8 @@ private:
   Ipv4Address  m_ctrlAddress;                /**< Controller IP address */
   Ipv4Address  m_myAddress;                  /**< IP address given to client */
   Mac48Address m_myMacAddress;               /**< local interface MAC address */
-  Ptr<Packet>  m_fragment;
+  StreamFramer m_framer;                     /**< Input stream reassembly */
+  OpenflowWireDecoder m_decoder;             /**< Control message decoding */
 };
 } // namespace ns3
 #endif /* OPENFLOW_CLIENT_H */
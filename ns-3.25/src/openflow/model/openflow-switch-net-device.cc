@@ -23,6 +23,7 @@
 #include "ns3/breakpoint.h"
 #include "ns3/log.h"
 #include "ns3/assert.h"
+#include "ns3/hash.h"
 #include "openflow-switch-net-device.h"
 #include "openflow-client.h"
 #include "openflow-lib.h"
@@ -32,6 +33,8 @@
 namespace ns3 {
 NS_LOG_COMPONENT_DEFINE("OpenFlowSwitchNetDevice");
 
+static const uint32_t NO_BUFFER = std::numeric_limits<uint32_t>::max();
+
 NS_OBJECT_ENSURE_REGISTERED(OpenFlowSwitchNetDevice);
 
 const char *
@@ -90,15 +93,30 @@ OpenFlowSwitchNetDevice::GetTypeId(void)
                                     MakeUintegerAccessor(&OpenFlowSwitchNetDevice::m_flags),
                                     MakeUintegerChecker<uint16_t>())
                       .AddAttribute("PacketCacheSize",
-                                    "Flags to turn different functionality on/off, such as whether to inform the controller when a flow expires, or how to handle fragments.",
+                                    "Number of packets the switch can buffer while waiting for the controller; the oldest one is evicted when the ring is full.",
                                     UintegerValue(2000),
-                                    MakeUintegerAccessor(&OpenFlowSwitchNetDevice::m_packetDataLimit),
-                                    MakeUintegerChecker<unsigned>())
+                                    MakeUintegerAccessor(&OpenFlowSwitchNetDevice::SetPacketCacheSize,
+                                                         &OpenFlowSwitchNetDevice::GetPacketCacheSize),
+                                    MakeUintegerChecker<uint32_t>(1, 1 << 24))
+                      .AddAttribute("MicroflowCacheSize",
+                                    "Max number of exact packet keys remembered in front of the flow table, 0 disables the cache.",
+                                    UintegerValue(8192),
+                                    MakeUintegerAccessor(&OpenFlowSwitchNetDevice::m_microflowLimit),
+                                    MakeUintegerChecker<uint32_t>())
+                      .AddAttribute("FlowExpiryTick",
+                                    "Resolution of the flow expiry timing wheel; FLOW_EXPIRED may be sent up to one tick after the deadline.",
+                                    TimeValue(MilliSeconds(100)),
+                                    MakeTimeAccessor(&OpenFlowSwitchNetDevice::m_expiryTick),
+                                    MakeTimeChecker(NanoSeconds(1)))
                       .AddAttribute("FlowTableMissSendLength",
                                     "When forwarding a packet the switch didn't match up to the controller, it can be more efficient to forward only the first x bytes.",
                                     UintegerValue(OFP_DEFAULT_MISS_SEND_LEN),
                                     MakeUintegerAccessor(&OpenFlowSwitchNetDevice::m_missSendLen),
                                     MakeUintegerChecker<uint16_t>())
+                      .AddTraceSource("PacketEvicted",
+                                      "A buffered packet was evicted from the packet buffer ring.",
+                                      MakeTraceSourceAccessor(&OpenFlowSwitchNetDevice::m_packetEvictTrace),
+                                      "ns3::OpenFlowSwitchNetDevice::PacketEvictedTracedCallback")
   ;
 
   return tid;
@@ -108,7 +126,13 @@ OpenFlowSwitchNetDevice::OpenFlowSwitchNetDevice()
   : m_node(0),
   m_ifIndex(0),
   m_mtu(DEFAULT_MTU),
-  m_application(0)
+  m_packetDataLimit(0),
+  m_packetDataNext(0),
+  m_packetSlotBits(0),
+  m_application(0),
+  m_expiryWheel(EXPIRY_SLOTS),
+  m_expiryPos(0),
+  m_expirySerial(0)
 {
   NS_LOG_FUNCTION(this);
 
@@ -126,7 +150,7 @@ OpenFlowSwitchNetDevice::OpenFlowSwitchNetDevice()
   m_ports.reserve(DP_MAX_PORTS);
 
   Simulator::Schedule(Seconds(1),
-                      &OpenFlowSwitchNetDevice::SweepExpiredFlows,
+                      &OpenFlowSwitchNetDevice::PollPortStatus,
                       this);
 }
 
@@ -546,6 +570,16 @@ OpenFlowSwitchNetDevice::DoDispose()
   }
   m_ports.clear();
 
+  for (uint32_t i = 0; i < m_packetData.size(); i++)
+  {
+    FreePacketBuffer(m_packetData[i].data.cookie);
+  }
+
+  Simulator::Cancel(m_expiryEvent);
+  m_flowTimers.clear();
+  m_expiryWheel.clear();
+
+  InvalidateMicroflows();
   chain_destroy(m_chain);
   m_channel     = 0;
   m_node        = 0;
@@ -554,35 +588,102 @@ OpenFlowSwitchNetDevice::DoDispose()
 }
 
 void
-OpenFlowSwitchNetDevice::FreePacketBuffer(uint32_t cookie)
+OpenFlowSwitchNetDevice::SetPacketCacheSize(uint32_t slots)
+{
+  NS_LOG_FUNCTION(this << slots);
+
+  for (uint32_t i = 0; i < m_packetData.size(); i++)
+  {
+    FreePacketBuffer(m_packetData[i].data.cookie);
+  }
+
+  PacketSlot blank;
+  blank.data.cookie = NO_BUFFER;
+  blank.data.buffer = nullptr;
+  blank.generation  = 0;
+  blank.used        = false;
+
+  m_packetData.assign(slots, blank);
+  m_packetDataLimit = slots;
+  m_packetDataNext  = 0;
+
+  for (m_packetSlotBits = 0; (1U << m_packetSlotBits) < slots; m_packetSlotBits++)
+  {
+  }
+}
+
+uint32_t
+OpenFlowSwitchNetDevice::GetPacketCacheSize() const
+{
+  return m_packetDataLimit;
+}
+
+ofi::SwitchPacketMetadata *
+OpenFlowSwitchNetDevice::FindPacketBuffer(uint32_t cookie)
 {
-  auto data = m_packetData.find(cookie);
+  uint32_t slot = cookie & ((1U << m_packetSlotBits) - 1);
 
-  if (data != m_packetData.end()) {
-    if (data->second.buffer != nullptr)
-      ofpbuf_delete(data->second.buffer);
+  if ((cookie == NO_BUFFER) || (slot >= m_packetData.size()))
+    return nullptr;
 
-    m_packetData.erase(data);
+  PacketSlot& s = m_packetData[slot];
+
+  if (!s.used || (s.data.cookie != cookie))
+  {
+    NS_LOG_LOGIC(this << " stale buffer id " << cookie);
+    return nullptr;
   }
+
+  return &s.data;
+}
+
+void
+OpenFlowSwitchNetDevice::FreePacketBuffer(uint32_t cookie)
+{
+  ofi::SwitchPacketMetadata *data = FindPacketBuffer(cookie);
+
+  if (data == nullptr)
+    return;
+
+  if (data->buffer != nullptr)
+    ofpbuf_delete(data->buffer);
+
+  data->buffer = nullptr;
+  data->packet = 0;
+  data->cookie = NO_BUFFER;
+
+  m_packetData[cookie & ((1U << m_packetSlotBits) - 1)].used = false;
 }
 
 ofi::SwitchPacketMetadata&
 OpenFlowSwitchNetDevice::GetPacketBuffer()
 {
-  static Ptr<UniformRandomVariable> x = CreateObject<UniformRandomVariable>();
+  uint32_t slot = m_packetDataNext;
+  PacketSlot& s = m_packetData[slot];
+
+  m_packetDataNext = (m_packetDataNext + 1) % m_packetData.size();
 
-  // Do cleanup
-  while (m_packetData.size() > m_packetDataLimit) {
-    FreePacketBuffer(m_packetData.begin()->first);
+  if (s.used)
+  {
+    m_packetEvictTrace(s.data.cookie, Simulator::Now() - s.created);
+    FreePacketBuffer(s.data.cookie);
   }
 
-  // Create new buffer
-  uint32_t cookie = x->GetInteger(0, std::numeric_limits<uint32_t>::max() - 1);
+  // The generation takes the bits left over by the slot index
+  uint32_t genMask = NO_BUFFER >> m_packetSlotBits;
 
-  m_packetData[cookie].ttl    = Simulator::Now() + Seconds(1);
-  m_packetData[cookie].cookie = cookie;
+  do
+  {
+    s.generation  = (s.generation + 1) & genMask;
+    s.data.cookie = (s.generation << m_packetSlotBits) | slot;
+  }
+  while (s.data.cookie == NO_BUFFER);
 
-  return m_packetData[cookie];
+  s.used     = true;
+  s.created  = Simulator::Now();
+  s.data.ttl = s.created + Seconds(1);
+
+  return s.data;
 }
 
 void
@@ -643,7 +744,7 @@ OpenFlowSwitchNetDevice::ReceiveFromDevice(Ptr<NetDevice>netdev, Ptr<const Packe
 }
 
 void
-OpenFlowSwitchNetDevice::SweepExpiredFlows()
+OpenFlowSwitchNetDevice::PollPortStatus()
 {
   // If port status is modified in any way, notify the controller.
   for (size_t i = 0; i < m_ports.size(); i++)
@@ -654,20 +755,180 @@ OpenFlowSwitchNetDevice::SweepExpiredFlows()
     }
   }
 
-  // If any flows have expired, delete them and notify the controller.
-  List deleted = LIST_INITIALIZER(&deleted);
-  sw_flow *f, *n;
-  chain_timeout(m_chain, &deleted);
-  LIST_FOR_EACH_SAFE(f, n, sw_flow, node, &deleted)
+  Simulator::Schedule(Seconds(1),
+                      &OpenFlowSwitchNetDevice::PollPortStatus,
+                      this);
+}
+
+uint32_t
+OpenFlowSwitchNetDevice::ExpirySlot(Time delay) const
+{
+  int64_t tick  = m_expiryTick.GetTimeStep();
+  int64_t ticks = (delay.GetTimeStep() + tick - 1) / tick;
+
+  // m_expiryPos fires on the next tick, far deadlines are re-filed later
+  ticks = std::min<int64_t>(std::max<int64_t>(ticks, 1), EXPIRY_SLOTS);
+
+  return (m_expiryPos + ticks - 1) % EXPIRY_SLOTS;
+}
+
+Time
+OpenFlowSwitchNetDevice::FlowDeadline(const sw_flow           *flow,
+                                      const FlowTimer&         timer,
+                                      ofp_flow_expired_reason *reason) const
+{
+  Time deadline = Time::Max();
+
+  if (flow->hard_timeout)
+  {
+    deadline = timer.created + Seconds(flow->hard_timeout);
+    *reason  = OFPER_HARD_TIMEOUT;
+  }
+
+  if (flow->idle_timeout && (timer.used + Seconds(flow->idle_timeout) < deadline))
   {
-    SendFlowExpired(f, (ofp_flow_expired_reason)f->reason);
-    list_remove(&f->node);
-    flow_free(f);
+    deadline = timer.used + Seconds(flow->idle_timeout);
+    *reason  = OFPER_IDLE_TIMEOUT;
   }
 
-  Simulator::Schedule(Seconds(1),
-                      &OpenFlowSwitchNetDevice::SweepExpiredFlows,
-                      this);
+  return deadline;
+}
+
+void
+OpenFlowSwitchNetDevice::ArmFlowTimer(sw_flow *flow)
+{
+  if ((flow->idle_timeout == 0) && (flow->hard_timeout == 0))
+  {
+    return;
+  }
+
+  FlowTimer& timer = m_flowTimers[flow];
+  timer.created = Simulator::Now();
+  timer.used    = timer.created;
+  timer.serial  = ++m_expirySerial;
+
+  ofp_flow_expired_reason reason;
+  Time deadline = FlowDeadline(flow, timer, &reason);
+
+  m_expiryWheel[ExpirySlot(deadline - timer.created)].push_back(std::make_pair(flow, timer.serial));
+
+  if (!m_expiryEvent.IsRunning())
+  {
+    m_expiryEvent = Simulator::Schedule(m_expiryTick,
+                                        &OpenFlowSwitchNetDevice::AdvanceExpiryWheel,
+                                        this);
+  }
+}
+
+struct FlowTimerMatch
+{
+  const sw_flow_key     *key;
+  uint16_t               priority;
+  bool                   strict;
+  std::vector<sw_flow *> flows;
+};
+
+static int
+CollectFlowTimerCallback(sw_flow *flow, void *state)
+{
+  FlowTimerMatch *m = (FlowTimerMatch *)state;
+
+  if (!m->strict || ((flow->priority == m->priority) && flow_matches_desc(&flow->key, m->key, 1)))
+  {
+    m->flows.push_back(flow);
+  }
+  return 0;
+}
+
+void
+OpenFlowSwitchNetDevice::ForgetFlowTimers(const sw_flow_key *key,
+                                          uint16_t           out_port,
+                                          uint16_t           priority,
+                                          bool               strict)
+{
+  if (m_flowTimers.empty())
+  {
+    return;
+  }
+
+  FlowTimerMatch match;
+  match.key      = key;
+  match.priority = priority;
+  match.strict   = strict;
+
+  for (int i = 0; i < m_chain->n_tables; i++)
+  {
+    sw_table *table = m_chain->tables[i];
+    sw_table_position position;
+
+    memset(&position, 0, sizeof position);
+    table->iterate(table, key, out_port, &position, CollectFlowTimerCallback, &match);
+  }
+
+  // Wheel references left behind are skipped when their bucket fires
+  for (size_t i = 0; i < match.flows.size(); i++)
+  {
+    m_flowTimers.erase(match.flows[i]);
+  }
+}
+
+void
+OpenFlowSwitchNetDevice::AdvanceExpiryWheel()
+{
+  NS_LOG_FUNCTION(this << m_expiryPos);
+
+  Time now         = Simulator::Now();
+  uint32_t current = m_expiryPos;
+  ExpiryBucket_t bucket;
+
+  bucket.swap(m_expiryWheel[current]);
+  m_expiryPos = (m_expiryPos + 1) % EXPIRY_SLOTS;
+
+  for (size_t i = 0; i < bucket.size(); i++)
+  {
+    FlowTimers_t::iterator timer = m_flowTimers.find(bucket[i].first);
+
+    // Deleted by the controller, maybe with its address reused since
+    if ((timer == m_flowTimers.end()) || (timer->second.serial != bucket[i].second))
+    {
+      continue;
+    }
+
+    sw_flow *flow = timer->first;
+    ofp_flow_expired_reason reason;
+    Time deadline = FlowDeadline(flow, timer->second, &reason);
+
+    if (deadline > now)
+    {
+      // Refreshed by a hit, or beyond the wheel span
+      m_expiryWheel[ExpirySlot(deadline - now)].push_back(bucket[i]);
+      continue;
+    }
+
+    NS_LOG_LOGIC(this << " flow " << flow << " expired, reason " << reason);
+
+    SendFlowExpired(flow, reason, deadline - timer->second.created);
+    m_flowTimers.erase(timer);
+
+    // A strict delete of its own match removes exactly this flow
+    sw_flow_key key = flow->key;
+    chain_delete(m_chain, &key, OFPP_NONE, flow->priority, 1);
+    InvalidateMicroflows();
+  }
+
+  // Give the storage back, avoid reallocating every lap
+  bucket.clear();
+  if (m_expiryWheel[current].empty())
+  {
+    m_expiryWheel[current].swap(bucket);
+  }
+
+  if (!m_flowTimers.empty())
+  {
+    m_expiryEvent = Simulator::Schedule(m_expiryTick,
+                                        &OpenFlowSwitchNetDevice::AdvanceExpiryWheel,
+                                        this);
+  }
 }
 
 int
@@ -715,7 +976,9 @@ OpenFlowSwitchNetDevice::AddFlow(const ofp_flow_mod *ofm)
   flow->packet_count         = 0;
   memcpy(flow->sf_acts->actions, ofm->actions, actions_len);
 
-  // Act.
+  // Act. An identical flow may be replaced (and freed) by the insertion.
+  InvalidateMicroflows();
+  ForgetFlowTimers(&flow->key, OFPP_NONE, flow->priority, true);
   int error = chain_insert(m_chain, flow);
 
   if (error)
@@ -730,20 +993,22 @@ OpenFlowSwitchNetDevice::AddFlow(const ofp_flow_mod *ofm)
     return error;
   }
 
+  ArmFlowTimer(flow);
+
   if (ntohl(ofm->buffer_id) != (uint32_t)-1) {
-    auto b = m_packetData.find(ntohl(ofm->buffer_id));
+    ofi::SwitchPacketMetadata *b = FindPacketBuffer(ntohl(ofm->buffer_id));
 
-    if (b == m_packetData.end())
+    if (b == nullptr)
       return -ESRCH;
 
-    ofpbuf *buffer = b->second.buffer;
+    ofpbuf *buffer = b->buffer;
 
     sw_flow_key key;
     flow_used(flow, buffer);
     flow_extract(buffer, ofm->match.in_port, &key.flow); // ntohs(ofm->match.in_port);
     ofi::ExecuteActions(this, ntohl(ofm->buffer_id), buffer, &key, ofm->actions, actions_len, false);
 
-    FreePacketBuffer(b->second.cookie);
+    FreePacketBuffer(ntohl(ofm->buffer_id));
   }
   return 0;
 }
@@ -771,21 +1036,22 @@ OpenFlowSwitchNetDevice::ModFlow(const ofp_flow_mod *ofm)
 
   uint16_t priority = key.wildcards ? ntohs(ofm->priority) : -1;
   int strict        = (ofm->command == htons(OFPFC_MODIFY_STRICT)) ? 1 : 0;
+  InvalidateMicroflows();
   chain_modify(m_chain, &key, priority, strict, ofm->actions, actions_len);
 
   if (ntohl(ofm->buffer_id) != (uint32_t)-1) {
-    auto b = m_packetData.find(ntohl(ofm->buffer_id));
+    ofi::SwitchPacketMetadata *b = FindPacketBuffer(ntohl(ofm->buffer_id));
 
-    if (b == m_packetData.end())
+    if (b == nullptr)
       return -ESRCH;
 
-    ofpbuf *buffer = b->second.buffer;
+    ofpbuf *buffer = b->buffer;
 
     sw_flow_key skb_key;
     flow_extract(buffer, ofm->match.in_port, &skb_key.flow); // ntohs(ofm->match.in_port);
     ofi::ExecuteActions(this, ntohl(ofm->buffer_id), buffer, &skb_key, ofm->actions, actions_len, false);
 
-    FreePacketBuffer(b->second.cookie);
+    FreePacketBuffer(ntohl(ofm->buffer_id));
   }
   return 0;
 }
@@ -836,11 +1102,11 @@ OpenFlowSwitchNetDevice::OutputPacket(uint32_t packet_uid, int out_port)
 
     if ((p.netdev != 0) && !(p.config & OFPPC_PORT_DOWN))
     {
-      auto pktPair = m_packetData.find(packet_uid);
+      ofi::SwitchPacketMetadata *pkt = FindPacketBuffer(packet_uid);
 
-      if (pktPair != m_packetData.end())
+      if (pkt != nullptr)
       {
-        ofi::SwitchPacketMetadata data = pktPair->second;
+        ofi::SwitchPacketMetadata data = *pkt;
         size_t bufsize                 = data.buffer->size;
         NS_LOG_LOGIC("Sending packet " << data.packet->GetUid() << " over port " << out_port);
 
@@ -903,7 +1169,15 @@ OpenFlowSwitchNetDevice::OutputControl(uint32_t packet_uid, int in_port, size_t
 {
   NS_LOG_FUNCTION(this << packet_uid << in_port << reason);
 
-  ofpbuf *buffer    = m_packetData.find(packet_uid)->second.buffer;
+  ofi::SwitchPacketMetadata *data = FindPacketBuffer(packet_uid);
+
+  if (data == nullptr)
+  {
+    NS_LOG_WARN("Packet id not found: ID " << packet_uid);
+    return;
+  }
+
+  ofpbuf *buffer    = data->buffer;
   size_t  total_len = buffer->size;
 
   if ((packet_uid != std::numeric_limits<uint32_t>::max()) && (max_len != 0) && (buffer->size > max_len))
@@ -949,7 +1223,7 @@ OpenFlowSwitchNetDevice::SendFeaturesReply(uint32_t xid)
 }
 
 void
-OpenFlowSwitchNetDevice::SendFlowExpired(sw_flow *flow, enum ofp_flow_expired_reason reason)
+OpenFlowSwitchNetDevice::SendFlowExpired(sw_flow *flow, enum ofp_flow_expired_reason reason, Time duration)
 {
   NS_LOG_FUNCTION(this);
   ofpbuf *buffer;
@@ -961,7 +1235,7 @@ OpenFlowSwitchNetDevice::SendFlowExpired(sw_flow *flow, enum ofp_flow_expired_re
   ofe->reason   = reason;
   memset(ofe->pad,  0, sizeof ofe->pad);
 
-  ofe->duration = htonl(time_now() - flow->created);
+  ofe->duration = htonl((uint32_t)duration.GetSeconds());
   memset(ofe->pad2, 0, sizeof ofe->pad2);
   ofe->packet_count = htonll(flow->packet_count);
   ofe->byte_count   = htonll(flow->byte_count);
@@ -1002,13 +1276,14 @@ OpenFlowSwitchNetDevice::RunThroughFlowTable(uint32_t packet_uid, int port, bool
 {
   NS_LOG_FUNCTION(this << packet_uid);
 
-  if (m_packetData.find(packet_uid) == m_packetData.end()) {
+  ofi::SwitchPacketMetadata *data = FindPacketBuffer(packet_uid);
+
+  if (data == nullptr) {
     NS_LOG_WARN(this << "packet not found");
     return;
   }
 
-  ofi::SwitchPacketMetadata& data = m_packetData.find(packet_uid)->second;
-  ofpbuf *buffer                  = data.buffer;
+  ofpbuf *buffer = data->buffer;
 
   sw_flow_key key;
 
@@ -1054,7 +1329,7 @@ OpenFlowSwitchNetDevice::FlowTableLookup(sw_flow_key key,
                                          bool        send_to_controller)
 {
   NS_LOG_FUNCTION(this << packet_uid << port);
-  sw_flow *flow = chain_lookup(m_chain, &key);
+  sw_flow *flow = MicroflowLookup(&key);
 
   if (flow != 0)
   {
@@ -1062,6 +1337,18 @@ OpenFlowSwitchNetDevice::FlowTableLookup(sw_flow_key key,
 
     key.flow.in_port = ntohs(key.flow.in_port);
     flow_used(flow, buffer);
+
+    // Idle deadline is re-armed lazily, when the flow's bucket fires
+    if (!m_flowTimers.empty())
+    {
+      FlowTimers_t::iterator timer = m_flowTimers.find(flow);
+
+      if (timer != m_flowTimers.end())
+      {
+        timer->second.used = Simulator::Now();
+      }
+    }
+
     ofi::ExecuteActions(this, packet_uid, buffer, &key, flow->sf_acts->actions, flow->sf_acts->actions_len, false);
   }
   else
@@ -1075,6 +1362,78 @@ OpenFlowSwitchNetDevice::FlowTableLookup(sw_flow_key key,
   }
 }
 
+sw_flow *
+OpenFlowSwitchNetDevice::MicroflowLookup(const sw_flow_key *key)
+{
+  if (m_microflowLimit == 0)
+  {
+    return chain_lookup(m_chain, key);
+  }
+
+  Microflows_t::const_iterator cached = m_microflows.find(key->flow);
+
+  if (cached != m_microflows.end())
+  {
+    // Keep table stats as chain_lookup() would have left them
+    for (int i = 0; i <= cached->second.table; i++)
+    {
+      m_chain->tables[i]->n_lookup++;
+    }
+    m_chain->tables[cached->second.table]->n_matched++;
+
+    return cached->second.flow;
+  }
+
+  for (int i = 0; i < m_chain->n_tables; i++)
+  {
+    sw_table *table = m_chain->tables[i];
+    sw_flow  *flow  = table->lookup(table, key);
+
+    table->n_lookup++;
+
+    if (flow != 0)
+    {
+      table->n_matched++;
+
+      if (m_microflows.size() >= m_microflowLimit)
+      {
+        m_microflows.clear();
+      }
+
+      Microflow entry = { flow, i };
+      m_microflows[key->flow] = entry;
+
+      return flow;
+    }
+  }
+
+  // Misses are not cached, they usually trigger a FLOW_MOD anyway
+  return 0;
+}
+
+void
+OpenFlowSwitchNetDevice::InvalidateMicroflows()
+{
+  if (!m_microflows.empty())
+  {
+    NS_LOG_LOGIC(this << " dropping " << m_microflows.size() << " microflows");
+    m_microflows.clear();
+  }
+}
+
+size_t
+OpenFlowSwitchNetDevice::MicroflowHash::operator()(const flow& key) const
+{
+  // flow_extract() zeroes the padding, the whole struct can be hashed
+  return Hash32(reinterpret_cast<const char *>(&key), sizeof key);
+}
+
+bool
+OpenFlowSwitchNetDevice::MicroflowEqual::operator()(const flow& a, const flow& b) const
+{
+  return memcmp(&a, &b, sizeof a) == 0;
+}
+
 int
 OpenFlowSwitchNetDevice::UpdatePortStatus(ofi::Port& p)
 {
@@ -1215,13 +1574,12 @@ OpenFlowSwitchNetDevice::ReceivePacketOut(const void *msg)
   }
   else
   {
-    auto pair = m_packetData.find(packetId);
+    ofi::SwitchPacketMetadata *metaData = FindPacketBuffer(packetId);
 
-    if (pair == m_packetData.end())
+    if (metaData == nullptr)
       return -ESRCH;
 
-    ofi::SwitchPacketMetadata& metaData = pair->second;
-    buffer = metaData.buffer;
+    buffer = metaData->buffer;
   }
 
   sw_flow_key key;
@@ -1262,6 +1620,8 @@ OpenFlowSwitchNetDevice::ReceiveFlow(const void *msg)
   {
     sw_flow_key key;
     flow_extract_match(&key, &ofm->match);
+    InvalidateMicroflows();
+    ForgetFlowTimers(&key, ofm->out_port, 0, false);
     return chain_delete(m_chain, &key, ofm->out_port, 0, 0) ? 0 : -ESRCH;
   }
   else if (command == OFPFC_DELETE_STRICT)
@@ -1270,6 +1630,8 @@ OpenFlowSwitchNetDevice::ReceiveFlow(const void *msg)
     uint16_t    priority;
     flow_extract_match(&key, &ofm->match);
     priority = key.wildcards ? ntohs(ofm->priority) : -1;
+    InvalidateMicroflows();
+    ForgetFlowTimers(&key, ofm->out_port, priority, true);
     return chain_delete(m_chain, &key, ofm->out_port, priority, 1) ? 0 : -ESRCH;
   }
   else
@@ -46,9 +46,11 @@
 #include "ns3/string.h"
 #include "ns3/integer.h"
 #include "ns3/uinteger.h"
+#include "ns3/traced-callback.h"
 
 #include <map>
 #include <set>
+#include <unordered_map>
 
 #include "openflow-lib.h"
 
@@ -107,6 +109,14 @@ public:
    */
   static TypeId GetTypeId(void);
 
+  /**
+   * TracedCallback signature for packet buffer evictions.
+   *
+   * \param [in] bufferId The buffer_id that is no longer valid.
+   * \param [in] age Time the packet spent in the buffer.
+   */
+  typedef void (* PacketEvictedTracedCallback)(uint32_t bufferId, Time age);
+
   /**
    * \name OpenFlowSwitchNetDevice Description Data
    * \brief These four data describe the OpenFlowSwitchNetDevice as if it were a
@@ -429,9 +439,11 @@ private:
    *
    * \param flow The flow that expired.
    * \param reason The reason for sending this expiration notification.
+   * \param duration Time the flow was installed.
    */
   void SendFlowExpired(sw_flow                     *flow,
-                       enum ofp_flow_expired_reason reason);
+                       enum ofp_flow_expired_reason reason,
+                       Time                         duration);
 
   /**
    * \internal
@@ -501,6 +513,26 @@ private:
                        int         port,
                        bool        send_to_controller);
 
+  /**
+   * \internal
+   *
+   * Look up a packet key, first in the microflow cache and then in the
+   * flow table chain. Table lookup/match counters are updated as if the
+   * chain had been searched.
+   *
+   * \param key Exact (non-wildcarded) key extracted from a packet.
+   * \return The matched flow, or 0 on a table miss.
+   */
+  sw_flow* MicroflowLookup(const sw_flow_key *key);
+
+  /**
+   * \internal
+   *
+   * Drop every cached lookup result; must be called whenever a flow is
+   * added to, modified in or removed from the chain.
+   */
+  void InvalidateMicroflows();
+
   /**
    * \internal
    *
@@ -560,11 +592,88 @@ private:
 
   // \}
 
+  /**
+   * \internal
+   *
+   * Take the next slot of the packet buffer ring, evicting the packet it
+   * still holds.
+   *
+   * \return Metadata of a blank buffer; its cookie is the buffer_id.
+   */
   ofi::SwitchPacketMetadata& GetPacketBuffer();
 
+  /**
+   * \internal
+   *
+   * \param cookie buffer_id of the packet.
+   * \return The buffered packet, or 0 if the id is stale or unknown.
+   */
+  ofi::SwitchPacketMetadata* FindPacketBuffer(uint32_t cookie);
+
   void FreePacketBuffer(uint32_t cookie);
 
-  void SweepExpiredFlows();
+  void SetPacketCacheSize(uint32_t slots);
+  uint32_t GetPacketCacheSize() const;
+
+  /**
+   * \internal
+   *
+   * Periodic port status check, changes are reported to the controller.
+   */
+  void PollPortStatus();
+
+  /**
+   * \name Flow expiry
+   *
+   * Flows with an idle or hard timeout are tracked in a timing wheel.
+   * A hit only refreshes the flow's last use; when its bucket fires the
+   * flow is either re-filed under its new deadline or expired, so the
+   * cost of a tick does not depend on the table size.
+   */
+  // \{
+  struct FlowTimer
+  {
+    Time     created;                ///< Install time
+    Time     used;                   ///< Last hit
+    uint32_t serial;                 ///< Tells wheel references of a reused
+                                     // sw_flow address apart
+  };
+
+  void ArmFlowTimer(sw_flow *flow);
+
+  /**
+   * \internal
+   *
+   * Stop tracking the flows a FLOW_MOD is about to free.
+   *
+   * \param key Match of the FLOW_MOD.
+   * \param out_port Out port filter (network byte order).
+   * \param priority Priority, only for strict matching.
+   * \param strict Only flows with exactly this match and priority.
+   */
+  void ForgetFlowTimers(const sw_flow_key *key,
+                        uint16_t           out_port,
+                        uint16_t           priority,
+                        bool               strict);
+
+  void AdvanceExpiryWheel();
+
+  /**
+   * \internal
+   *
+   * \return Wheel bucket that fires once delay has elapsed.
+   */
+  uint32_t ExpirySlot(Time delay) const;
+
+  /**
+   * \internal
+   *
+   * \return The earliest of the idle and hard deadlines of a flow.
+   */
+  Time FlowDeadline(const sw_flow           *flow,
+                    const FlowTimer&         timer,
+                    ofp_flow_expired_reason *reason) const;
+  // \}
 
   /// Callbacks
   NetDevice::ReceiveCallback m_rxCallback;
@@ -579,11 +688,27 @@ private:
   uint32_t m_ifIndex;           ///< Interface Index
   uint16_t m_mtu;               ///< Maximum Transmission Unit
 
-  typedef std::map<uint32_t, ofi::SwitchPacketMetadata>PacketData_t;
+  /**
+   * Packet buffer ring. A buffer_id carries the slot index in its low
+   * m_packetSlotBits bits and the slot generation above them, so a
+   * PACKET_OUT or FLOW_MOD naming an evicted buffer is detected.
+   */
+  struct PacketSlot
+  {
+    ofi::SwitchPacketMetadata data;
+    uint32_t generation;             ///< Bumped every time the slot is reused
+    bool     used;
+    Time     created;                ///< When the current packet was buffered
+  };
+
+  std::vector<PacketSlot> m_packetData; ///< Packet data, preallocated
 
-  PacketData_t m_packetData; ///< Packet data
+  uint32_t m_packetDataLimit;        ///< Number of slots in the ring
+  uint32_t m_packetDataNext;         ///< Next slot to hand out
+  uint32_t m_packetSlotBits;         ///< buffer_id bits used by the slot index
 
-  unsigned m_packetDataLimit;
+  /// Buffered packet evicted before use: buffer_id and time it was held
+  TracedCallback<uint32_t, Time> m_packetEvictTrace;
 
   Ports_t m_ports;                   ///< Switch's ports
 
@@ -599,6 +724,40 @@ private:
                                      // configurable by the controller.
 
   sw_chain *m_chain;                 ///< Flow Table; forwarding rules.
+
+  struct MicroflowHash
+  {
+    size_t operator()(const flow& key) const;
+  };
+
+  struct MicroflowEqual
+  {
+    bool operator()(const flow& a, const flow& b) const;
+  };
+
+  struct Microflow
+  {
+    sw_flow *flow;                   ///< Rule matched by this packet key
+    int      table;                  ///< Index of the table holding it
+  };
+
+  typedef std::unordered_map<flow, Microflow, MicroflowHash,
+                             MicroflowEqual>Microflows_t;
+
+  Microflows_t m_microflows;         ///< Exact packet key -> matched flow
+  uint32_t     m_microflowLimit;     ///< Max cache entries, 0 disables it
+
+  typedef std::unordered_map<sw_flow *, FlowTimer>FlowTimers_t;
+  typedef std::vector<std::pair<sw_flow *, uint32_t> >ExpiryBucket_t;
+
+  static const uint32_t EXPIRY_SLOTS = 256;
+
+  FlowTimers_t m_flowTimers;         ///< Flows with a timeout, always alive
+  std::vector<ExpiryBucket_t> m_expiryWheel;
+  uint32_t m_expiryPos;              ///< Bucket processed by the next tick
+  uint32_t m_expirySerial;
+  Time     m_expiryTick;             ///< Wheel resolution
+  EventId  m_expiryEvent;
 };
 } // namespace ns3
 #endif /* OPENFLOW_SWITCH_NET_DEVICE_H */
@@ -22,7 +22,10 @@
  */
 
 #ifdef NS3_OPENFLOW
-#include <climits>
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <vector>
 #include <ns3/adjacency.h>
 #include <ns3/log.h>
 #include <ns3/simple-ref-count.h>
@@ -35,7 +38,8 @@
 NS_LOG_COMPONENT_DEFINE("UndirectedGraph");
 
 namespace ns3 {
-UndirectedGraph::UndirectedGraph()
+UndirectedGraph::UndirectedGraph() :
+  m_version(0)
 {
   NS_LOG_FUNCTION_NOARGS();
 }
@@ -48,6 +52,9 @@ UndirectedGraph::AddHost(const Mac48Address& mac)
 
   const auto& pair = m_graph.emplace(mac, v);
 
+  if (pair.second)
+    m_version++;
+
   return StaticCast<HostVertex, Vertex>(pair.first->second);
 }
 
@@ -59,6 +66,9 @@ UndirectedGraph::AddServer(const Mac48Address& mac)
 
   const auto& pair = m_graph.emplace(mac, v);
 
+  if (pair.second)
+    m_version++;
+
   return StaticCast<ServerVertex, Vertex>(pair.first->second);
 }
 
@@ -70,6 +80,9 @@ UndirectedGraph::AddSwitch(Ptr<OfSwitch>dev)
 
   const auto& pair = m_graph.emplace(v->GetChassisId(), v);
 
+  if (pair.second)
+    m_version++;
+
   return StaticCast<SwitchVertex, Vertex>(pair.first->second);
 }
 
@@ -85,6 +98,8 @@ UndirectedGraph::AddEdge(Ptr<Vertex>from,
   Ptr<Adjacency> adj = Create<Adjacency>(from, to);
 
   m_graph[from->GetHwAddress()]->AddEdge(adj);
+  InvalidateByEdge(adj, true);
+  m_version++;
 
   return adj;
 }
@@ -112,9 +127,48 @@ void
 UndirectedGraph::RemoveVertex(const Mac48Address& mac)
 {
   NS_LOG_FUNCTION(this << mac);
-  m_graph.erase(mac);
+  auto it = m_graph.find(mac);
+
+  if (it == m_graph.end())
+    return;
+
+  Ptr<Vertex> vertex = it->second;
+  InvalidateByVertex(vertex);
+
+  m_graph.erase(it);
 
-  // FIXME remove edges pointing to this vertex
+  for (auto& pair: m_graph)
+    pair.second->RemoveEdge(vertex);
+
+  m_version++;
+}
+
+void
+UndirectedGraph::RemoveEdge(Ptr<Adjacency>adj)
+{
+  NS_LOG_FUNCTION(this << *adj);
+
+  if (adj->GetOrigin()->GetEdge(adj->GetDestination()) != adj)
+    return; /* not in the graph */
+
+  InvalidateByEdge(adj, false);
+  adj->GetOrigin()->RemoveEdge(adj->GetDestination());
+  m_version++;
+}
+
+void
+UndirectedGraph::SetEdgeWeight(Ptr<Adjacency>adj,
+                               uint32_t      weight)
+{
+  NS_LOG_FUNCTION(this << *adj << weight);
+  uint32_t previous = adj->GetWeight();
+
+  if (weight == previous)
+    return;
+
+  adj->SetWeight(weight);
+  InvalidateByEdge(adj, weight < previous);
+  m_version++;
 }
 
 Ptr<Vertex>
@@ -138,6 +192,24 @@ UndirectedGraph::LookupVertex(const Address& addr) const
   return nullptr;
 }
 
+std::list<Ptr<Vertex> >
+UndirectedGraph::GetLeafVertices() const
+{
+  std::list<Ptr<Vertex> > leaves;
+
+  for (auto& pair: m_graph) {
+    if (pair.second->IsLeaf())
+      leaves.push_back(pair.second);
+  }
+  return leaves;
+}
+
+uint32_t
+UndirectedGraph::GetVersion() const
+{
+  return m_version;
+}
+
 UndirectedGraph::GraphPath
 UndirectedGraph::FindShortestPath(const Mac48Address& from,
                                   const Mac48Address& to) const
@@ -162,93 +234,237 @@ UndirectedGraph::FindShortestPath(Ptr<Vertex>from,
   NS_LOG_FUNCTION(*from << *to);
   GraphPath path;
 
-  PreviousNodeMap previousNodes; ///< Map of node to its previous
-  CalculatePathsFromSource(previousNodes, from);
+  if (LookupVertex(from->GetHwAddress()) != from) {
+    NS_LOG_WARN("Source is not part of the graph");
+    return path;
+  }
 
-  Ptr<Vertex> currentNode = to;
+  const ShortestPathTree& tree = GetTree(from);
+  auto it = tree.find(to);
 
-  while (currentNode != nullptr)
+  while ((it != tree.end()) && (it->second.via != nullptr))
   {
-    Ptr<Vertex> prev = previousNodes[currentNode];
+    Ptr<Adjacency> adj = it->second.via;
+    path.push_front(adj);
 
-    if (prev) {
-      Ptr<Adjacency> adj = prev->GetEdge(currentNode);
-      path.push_front(adj);
-    }
-
-    currentNode = prev;
+    it = tree.find(adj->GetOrigin());
   }
 
-  if (path.empty() || (from != path.front()->GetOrigin())) {
+  if (path.empty()) {
     NS_LOG_WARN("Unable to find a path!");
-    path.clear();
   }
 
   return path;
 }
 
-Ptr<Vertex>
-UndirectedGraph::FindMinimumInSet(SourceDistanceMap& sourceDistances,
-                                  VertexSet          nodesSet) const
+std::list<UndirectedGraph::GraphPath>
+UndirectedGraph::FindEqualCostPaths(Ptr<Vertex>from,
+                                    Ptr<Vertex>to,
+                                    uint32_t   maxPaths) const
 {
-  std::pair<Ptr<Vertex>, int> minNodeDistance(nullptr, INT_MAX);
+  NS_ASSERT((from != nullptr) && (to != nullptr));
 
-  for (auto& v : nodesSet)  {
-    int dist = sourceDistances[v];
+  NS_LOG_FUNCTION(*from << *to << maxPaths);
+  std::list<GraphPath> paths;
 
-    if ((unsigned int)(dist) < (unsigned int)minNodeDistance.second)
-    {
-      minNodeDistance.first  = v;
-      minNodeDistance.second = dist;
-    }
+  if ((from == to) || (LookupVertex(from->GetHwAddress()) != from))
+    return paths;
+
+  const ShortestPathTree& tree = GetTree(from);
+
+  if (tree.count(to) > 0) {
+    GraphPath suffix;
+    CollectPaths(tree, to, suffix, paths, maxPaths);
   }
-  return minNodeDistance.first;
+
+  NS_LOG_LOGIC(paths.size() << " paths found");
+  return paths;
 }
 
 void
-UndirectedGraph::CalculatePathsFromSource(PreviousNodeMap& previousNodes,
-                                          Ptr<Vertex>      source) const
+UndirectedGraph::CollectPaths(const ShortestPathTree& tree,
+                              Ptr<Vertex>             vertex,
+                              GraphPath             & suffix,
+                              std::list<GraphPath>  & paths,
+                              uint32_t                maxPaths) const
 {
-  SourceDistanceMap sourceDistances;
-  VertexSet unvisitedNodesSet;
+  const TreeNode& node = tree.at(vertex);
 
-  for (auto& pair: m_graph) {
-    Ptr<Vertex> vertex = pair.second;
+  if (node.via == nullptr) {
+    paths.push_back(suffix); // reached the source
+    return;
+  }
+
+  // primary edge first, so the first path matches FindShortestPath
+  for (size_t i = 0; i <= node.ties.size(); ++i) {
+    if (paths.size() >= maxPaths)
+      return;
 
-    sourceDistances[vertex] = (vertex != source) ? INT_MAX : 0;
-    previousNodes[vertex]   = nullptr;
+    Ptr<Adjacency> adj = (i == 0) ? node.via : node.ties[i - 1];
 
-    unvisitedNodesSet.insert(vertex);
+    suffix.push_front(adj);
+    CollectPaths(tree, adj->GetOrigin(), suffix, paths, maxPaths);
+    suffix.pop_front();
   }
+}
 
-  while (!unvisitedNodesSet.empty())
+uint32_t
+UndirectedGraph::GetNCachedTrees() const
+{
+  return m_trees.size();
+}
+
+const UndirectedGraph::ShortestPathTree&
+UndirectedGraph::GetTree(Ptr<Vertex>source) const
+{
+  auto it = m_trees.find(source);
+
+  if (it != m_trees.end())
+    return it->second;
+
+  ShortestPathTree& tree = m_trees[source];
+  CalculatePathsFromSource(tree, source);
+
+  return tree;
+}
+
+void
+UndirectedGraph::CalculatePathsFromSource(ShortestPathTree& tree,
+                                          Ptr<Vertex>       source) const
+{
+  NS_LOG_FUNCTION(*source);
+
+  typedef std::pair<uint64_t, Ptr<Vertex> > QueueItem;
+
+  // binary heap with lazy deletion, stale entries are skipped when popped
+  std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem> > queue;
+
+  tree.clear();
+  tree[source] = TreeNode { 0, nullptr, {}, 0 };
+  queue.push(QueueItem(0, source));
+
+  while (!queue.empty())
   {
-    Ptr<Vertex> closestVertex = FindMinimumInSet(sourceDistances, unvisitedNodesSet);
+    QueueItem item = queue.top();
+    queue.pop();
 
-    if (closestVertex == nullptr) {
-      NS_LOG_LOGIC("Graph has unconnected vertexes, stopping path calculation");
-      break;
-    }
+    TreeNode& node = tree.at(item.second);
 
-    unvisitedNodesSet.erase(closestVertex);
+    if (item.first > node.distance)
+      continue;
 
-    for (auto& adj: closestVertex->GetEdges()) {
+    for (auto& adj: item.second->GetEdges()) {
       Ptr<Vertex> peer = adj->GetDestination();
+      uint64_t    alternativeDistance = node.distance + adj->GetWeight();
+      auto        it = tree.find(peer);
 
-      // where peer is still in unvisited nodes set.
-      if (unvisitedNodesSet.count(peer) > 0)
-      {
-        int alternativeDistance = sourceDistances[closestVertex] + adj->GetWeight();
-
-        // new path found?
-        if ((unsigned int)alternativeDistance < (unsigned int)sourceDistances[peer])
-        {
-          sourceDistances[peer] = alternativeDistance;
-          previousNodes[peer]   = closestVertex;
-        }
+      if (it == tree.end()) {
+        tree[peer] = TreeNode { alternativeDistance, adj, {}, 0 };
+      }
+      else if (alternativeDistance < it->second.distance) {
+        // new path found, detach from the previous hops
+        DetachNode(tree, it->second);
+        it->second.distance = alternativeDistance;
+        it->second.via      = adj;
       }
+      else if ((alternativeDistance == it->second.distance) && (it->second.via != nullptr)) {
+        // equal cost alternative, the peer is already queued
+        it->second.ties.push_back(adj);
+        node.children++;
+        continue;
+      }
+      else {
+        continue;
+      }
+
+      node.children++;
+      queue.push(QueueItem(alternativeDistance, peer));
+    }
+  }
+
+  NS_LOG_LOGIC(tree.size() << " vertexes reachable from " << *source);
+}
+
+void
+UndirectedGraph::DetachNode(ShortestPathTree& tree,
+                            TreeNode        & node)
+{
+  tree.at(node.via->GetOrigin()).children--;
+
+  for (auto& adj: node.ties)
+    tree.at(adj->GetOrigin()).children--;
+
+  node.ties.clear();
+}
+
+void
+UndirectedGraph::InvalidateByEdge(Ptr<Adjacency>adj,
+                                  bool          shorter)
+{
+  uint32_t dropped = 0;
+
+  for (auto it = m_trees.begin(); it != m_trees.end();)
+  {
+    const ShortestPathTree& tree = it->second;
+    auto dst = tree.find(adj->GetDestination());
+    bool affected;
+
+    if (shorter) {
+      // a cheaper edge only matters if it improves (or ties) its destination
+      auto org = tree.find(adj->GetOrigin());
+      affected = (org != tree.end())
+                 && ((dst == tree.end())
+                     || (org->second.distance + adj->GetWeight() <= dst->second.distance));
+    }
+    else {
+      // a costlier (or removed) edge only matters if the tree uses it
+      affected = (dst != tree.end())
+                 && ((dst->second.via == adj)
+                     || (std::find(dst->second.ties.begin(), dst->second.ties.end(), adj)
+                         != dst->second.ties.end()));
+    }
+
+    if (affected) {
+      it = m_trees.erase(it);
+      dropped++;
+    }
+    else {
+      ++it;
+    }
+  }
+
+  NS_LOG_LOGIC(*adj << " dropped " << dropped << " cached trees");
+}
+
+void
+UndirectedGraph::InvalidateByVertex(Ptr<Vertex>vertex)
+{
+  uint32_t dropped = 0;
+
+  m_trees.erase(vertex);
+
+  for (auto it = m_trees.begin(); it != m_trees.end();)
+  {
+    ShortestPathTree& tree = it->second;
+    auto node = tree.find(vertex);
+
+    if (node == tree.end()) {
+      ++it;
+    }
+    else if (node->second.children > 0) {
+      // other vertexes were reached through it
+      it = m_trees.erase(it);
+      dropped++;
+    }
+    else {
+      // leaf, prune it and keep the tree
+      DetachNode(tree, node->second);
+      tree.erase(node);
+      ++it;
     }
   }
+
+  NS_LOG_LOGIC(*vertex << " dropped " << dropped << " cached trees");
 }
 } // namespace ns3
 #endif // NS3_OPENFLOW
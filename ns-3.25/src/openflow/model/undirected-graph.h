@@ -27,6 +27,7 @@
 #include <map>
 #include <set>
 #include <list>
+#include <vector>
 #include <ns3/mac48-address.h>
 
 namespace ns3 {
@@ -85,35 +86,103 @@ public:
 
   Ptr<Adjacency>AddEdge(Ptr<Adjacency>adj);
 
+  /**
+   * \brief Removes an adjacency from its origin vertex.
+   * \param adj         Edge, as returned by AddEdge
+   */
+  void RemoveEdge(Ptr<Adjacency>adj);
+
+  /**
+   * \brief Change the cost of an edge.
+   * \param adj         Edge, as returned by AddEdge
+   * \param weight      New cost
+   */
+  void SetEdgeWeight(Ptr<Adjacency>adj,
+                     uint32_t      weight);
+
+  /**
+   * \brief Lowest cost path between two vertexes.
+   *
+   * Shortest-path trees are cached per source and only the trees affected
+   * by a topology change are dropped, so repeated lookups from the same
+   * source cost O(path length).
+   */
   GraphPath FindShortestPath(const Mac48Address& from,
                              const Mac48Address& to) const;
 
   GraphPath FindShortestPath(Ptr<Vertex>from,
                              Ptr<Vertex>to) const;
 
+  /**
+   * \brief All lowest cost paths between two vertexes (ECMP).
+   * \param from        Origin Vertex
+   * \param to          Destination Vertex
+   * \param maxPaths    Stop after this many paths
+   *
+   * The first path is the one returned by FindShortestPath.
+   */
+  std::list<GraphPath> FindEqualCostPaths(Ptr<Vertex>from,
+                                          Ptr<Vertex>to,
+                                          uint32_t   maxPaths) const;
+
   Ptr<Vertex>LookupVertex(const Mac48Address& mac) const;
 
   Ptr<Vertex>LookupVertex(const Address& addr) const;
 
+  /**
+   * \brief Hosts and servers currently in the graph.
+   */
+  std::list<Ptr<Vertex> > GetLeafVertices() const;
+
+  /**
+   * \brief Counter bumped by every change to vertexes, edges or weights.
+   */
+  uint32_t GetVersion() const;
+
+  /**
+   * \brief Number of cached shortest-path trees.
+   */
+  uint32_t GetNCachedTrees() const;
+
 private:
 
   typedef std::map<Mac48Address, Ptr<Vertex> >Graph;
 
-  // from current to previous ID in path
-  typedef std::map<Ptr<Vertex>, Ptr<Vertex> >PreviousNodeMap;
+  struct TreeNode {
+    uint64_t       distance; ///< cost from the tree source
+    Ptr<Adjacency> via;      ///< edge from the previous node, null at the source
+    std::vector<Ptr<Adjacency> > ties; ///< other edges with the same cost
+    uint32_t       children; ///< nodes reached through this one
+  };
+
+  // vertexes reachable from the source, with their previous hop
+  typedef std::map<Ptr<Vertex>, TreeNode>ShortestPathTree;
+
+  // from source to its shortest-path tree
+  typedef std::map<Ptr<Vertex>, ShortestPathTree>TreeCache;
+
+  const ShortestPathTree& GetTree(Ptr<Vertex>source) const;
+
+  void CalculatePathsFromSource(ShortestPathTree& tree,
+                                Ptr<Vertex>       source) const;
 
-  // from node to its distance from source
-  typedef std::map<Ptr<Vertex>, int>SourceDistanceMap;
+  static void DetachNode(ShortestPathTree& tree,
+                         TreeNode        & node);
 
-  typedef std::set<Ptr<Vertex> >VertexSet;
+  void CollectPaths(const ShortestPathTree& tree,
+                    Ptr<Vertex>             vertex,
+                    GraphPath             & suffix,
+                    std::list<GraphPath>  & paths,
+                    uint32_t                maxPaths) const;
 
-  void CalculatePathsFromSource(PreviousNodeMap& previousNodes,
-                                Ptr<Vertex>      source) const;
+  void InvalidateByEdge(Ptr<Adjacency>adj,
+                        bool          shorter);
 
-  Ptr<Vertex>FindMinimumInSet(SourceDistanceMap& sourceDistances,
-                              VertexSet          nodesSet) const;
+  void InvalidateByVertex(Ptr<Vertex>vertex);
 
   Graph m_graph;
+  mutable TreeCache m_trees;
+  uint32_t m_version;
 };
 } //  namespace ns3
 #endif  /* UNDIRECTED_GRAPH_H */
@@ -66,13 +66,26 @@ Vertex::HasAddress(const Address& addr) const
   return m_addresses.find(addr) != m_addresses.end();
 }
 
+const std::set<Address>&
+Vertex::GetAddresses() const
+{
+  return m_addresses;
+}
+
 void
 Vertex::AddEdge(Ptr<Adjacency>adj)
 {
   m_adjacencies.insert(adj);
 }
 
-const std::set<Ptr<Adjacency> >
+void
+Vertex::RemoveEdge(Ptr<Vertex>destination)
+{
+  if (auto adj = GetEdge(destination))
+    m_adjacencies.erase(adj);
+}
+
+const std::set<Ptr<Adjacency> >&
 Vertex::GetEdges() const
 {
   return m_adjacencies;
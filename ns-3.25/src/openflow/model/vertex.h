@@ -46,12 +46,15 @@ public:
   void AddAddress(const Address& addr);
   void RemoveAddress(const Address& addr);
   bool HasAddress(const Address& addr) const;
+  const std::set<Address>& GetAddresses() const;
 
   void AddEdge(Ptr<Adjacency>adj);
 
+  void RemoveEdge(Ptr<Vertex>destination);
+
   Ptr<Adjacency>GetEdge(Ptr<Vertex>destination);
 
-  const std::set<Ptr<Adjacency> >GetEdges() const;
+  const std::set<Ptr<Adjacency> >& GetEdges() const;
 
   friend bool operator<(const Vertex& v1,
                         const Vertex& v2);
@@ -0,0 +1,767 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2015 UFRGS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Alexsander de Souza <asouza@inf.ufrgs.br>
+ */
+
+#include <vector>
+#include "ns3/test.h"
+#include "ns3/simulator.h"
+#include "ns3/packet.h"
+#include "ns3/boolean.h"
+#include "ns3/uinteger.h"
+#include "ns3/node-container.h"
+#include "ns3/simple-channel.h"
+#include "ns3/simple-net-device.h"
+#include "ns3/internet-stack-helper.h"
+#include "ns3/ipv4-static-routing-helper.h"
+#include "ns3/inet-socket-address.h"
+#include "ns3/udp-socket-factory.h"
+#include "ns3/ipv4.h"
+#include "ns3/openflow-lib.h"
+#include "ns3/openflow-header.h"
+#include "ns3/openflow-wire-decoder.h"
+#include "ns3/flow-match-header.h"
+#include "ns3/flow-modification-header.h"
+#include "ns3/packet-out-header.h"
+#include "ns3/action-header.h"
+#include "ns3/action-utils.h"
+#include "ns3/adjacency.h"
+#include "ns3/vertex-host.h"
+#include "ns3/undirected-graph.h"
+#include "ns3/of-lldp.h"
+#include "ns3/of-arp.h"
+#include "ns3/of-routing.h"
+#include "ns3/openflow-switch-net-device.h"
+#include "ns3/openflow-controller-helper.h"
+#include "ns3/openflow-switch-helper.h"
+
+using namespace ns3;
+
+static Ptr<Packet>
+MakeFlowModification (uint32_t xid)
+{
+  Ptr<FlowMatchHeader> match =
+    Create<FlowMatchHeader> (ns3::OFPFW_IN_PORT | ns3::OFPFW_DL_SRC, 0,
+                             Mac48Address ("00:00:00:00:00:01"), Mac48Address ("00:00:00:00:00:02"),
+                             OFP_VLAN_NONE, 0, ETH_TYPE_IP, 0, IP_TYPE_UDP,
+                             Ipv4Address ("10.0.0.1").Get (), Ipv4Address ("10.0.0.2").Get (),
+                             5000, 80);
+
+  Ptr<FlowModificationHeader> flowMod =
+    Create<FlowModificationHeader> (0, OFPFC_ADD, 10, 20, 100, 1234, OFPP_NONE, 0);
+  flowMod->SetFlowMatch (match);
+
+  action_utils::ActionsList actions;
+  action_utils::CreateOutputAction (&actions, 3, 128);
+  action_utils::CreateOutputAction (&actions, 4, 0);
+  flowMod->AddActionsList (actions);
+
+  OpenflowHeader header (OFPT_FLOW_MOD, xid);
+  header.SetFlowModification (flowMod);
+
+  Ptr<Packet> packet = Create<Packet> ();
+  packet->AddHeader (header);
+  return packet;
+}
+
+static Ptr<Packet>
+MakeBasicMessage (uint8_t type, uint32_t xid)
+{
+  OpenflowHeader header (type, xid);
+
+  Ptr<Packet> packet = Create<Packet> ();
+  packet->AddHeader (header);
+  return packet;
+}
+
+class OpenflowWireDecoderTestCase : public TestCase
+{
+public:
+  OpenflowWireDecoderTestCase ();
+
+private:
+  virtual void DoRun (void);
+
+  void CheckFlowModification (void);
+  void CheckPacketOut (void);
+  void CheckMalformed (void);
+};
+
+OpenflowWireDecoderTestCase::OpenflowWireDecoderTestCase ()
+  : TestCase ("Decoded messages match what the header classes serialized")
+{
+}
+
+void
+OpenflowWireDecoderTestCase::CheckFlowModification (void)
+{
+  Ptr<Packet> packet = MakeFlowModification (42);
+
+  OpenflowWireDecoder decoder;
+  NS_TEST_ASSERT_MSG_EQ (packet->PeekHeader (decoder), packet->GetSize (), "FLOW_MOD not fully consumed");
+
+  ofp_flow_mod *ofm = (ofp_flow_mod *)decoder.GetMessage ();
+  NS_TEST_ASSERT_MSG_NE (ofm, 0, "Valid FLOW_MOD rejected");
+
+  NS_TEST_EXPECT_MSG_EQ (uint32_t (ofm->header.type), uint32_t (OFPT_FLOW_MOD), "Wrong type");
+  NS_TEST_EXPECT_MSG_EQ (ofm->header.xid, 42, "Wrong xid");
+  NS_TEST_EXPECT_MSG_EQ (ntohs (ofm->header.length), sizeof (ofp_flow_mod) + 2 * sizeof (ofp_action_output),
+                         "Actions not all copied");
+
+  /* The match and most of the body stay in network order */
+  NS_TEST_EXPECT_MSG_EQ (ntohl (ofm->match.wildcards), uint32_t (ns3::OFPFW_IN_PORT | ns3::OFPFW_DL_SRC), "Wrong wildcards");
+  Mac48Address dlDst;
+  dlDst.CopyFrom (ofm->match.dl_dst);
+  NS_TEST_EXPECT_MSG_EQ (dlDst, Mac48Address ("00:00:00:00:00:02"), "Wrong dl_dst");
+  NS_TEST_EXPECT_MSG_EQ (ntohs (ofm->match.dl_type), ETH_TYPE_IP, "Wrong dl_type");
+  NS_TEST_EXPECT_MSG_EQ (uint32_t (ofm->match.nw_proto), uint32_t (IP_TYPE_UDP), "Wrong nw_proto");
+  NS_TEST_EXPECT_MSG_EQ (Ipv4Address (ntohl (ofm->match.nw_dst)), Ipv4Address ("10.0.0.2"), "Wrong nw_dst");
+  NS_TEST_EXPECT_MSG_EQ (ntohs (ofm->match.tp_src), 5000, "Wrong tp_src");
+  NS_TEST_EXPECT_MSG_EQ (ntohs (ofm->match.tp_dst), 80, "Wrong tp_dst");
+  NS_TEST_EXPECT_MSG_EQ (ntohs (ofm->command), uint16_t (OFPFC_ADD), "Wrong command");
+  NS_TEST_EXPECT_MSG_EQ (ntohs (ofm->idle_timeout), 10, "Wrong idle timeout");
+  NS_TEST_EXPECT_MSG_EQ (ntohs (ofm->hard_timeout), 20, "Wrong hard timeout");
+  NS_TEST_EXPECT_MSG_EQ (ntohs (ofm->priority), 100, "Wrong priority");
+  NS_TEST_EXPECT_MSG_EQ (ntohl (ofm->buffer_id), 1234, "Wrong buffer id");
+
+  /* The datapath takes these in host order */
+  NS_TEST_EXPECT_MSG_EQ (ofm->out_port, uint16_t (OFPP_NONE), "Wrong out port");
+
+  ofp_action_output *oa = (ofp_action_output *)ofm->actions;
+  NS_TEST_EXPECT_MSG_EQ (ntohs (oa[0].type), uint16_t (ns3::OFPAT_OUTPUT), "Wrong first action");
+  NS_TEST_EXPECT_MSG_EQ (ntohs (oa[0].len), sizeof (ofp_action_output), "Wrong first action length");
+  NS_TEST_EXPECT_MSG_EQ (oa[0].port, 3, "Wrong first output port");
+  NS_TEST_EXPECT_MSG_EQ (oa[0].max_len, 128, "Wrong first max length");
+  NS_TEST_EXPECT_MSG_EQ (oa[1].port, 4, "Second action lost");
+}
+
+void
+OpenflowWireDecoderTestCase::CheckPacketOut (void)
+{
+  uint8_t payload[60];
+
+  for (uint32_t i = 0; i < sizeof (payload); ++i)
+    {
+      payload[i] = i;
+    }
+
+  Ptr<PacketOutHeader> packetOut =
+    Create<PacketOutHeader> (OFP_NO_BUFFER, 2, sizeof (ofp_action_output), Create<Packet> (payload, sizeof (payload)));
+
+  action_utils::ActionsList actions;
+  action_utils::CreateOutputAction (&actions, OFPP_FLOOD, 0);
+  packetOut->AddActionsList (actions);
+
+  OpenflowHeader header (OFPT_PACKET_OUT, 7);
+  header.SetPacketOut (packetOut);
+
+  Ptr<Packet> packet = Create<Packet> ();
+  packet->AddHeader (header);
+
+  OpenflowWireDecoder decoder;
+  NS_TEST_ASSERT_MSG_EQ (packet->PeekHeader (decoder), packet->GetSize (), "PACKET_OUT not fully consumed");
+
+  ofp_packet_out *opo = (ofp_packet_out *)decoder.GetMessage ();
+  NS_TEST_ASSERT_MSG_NE (opo, 0, "Valid PACKET_OUT rejected");
+
+  NS_TEST_EXPECT_MSG_EQ (uint32_t (opo->header.type), uint32_t (OFPT_PACKET_OUT), "Wrong type");
+  NS_TEST_EXPECT_MSG_EQ (opo->header.xid, 7, "Wrong xid");
+  NS_TEST_EXPECT_MSG_EQ (ntohs (opo->header.length), sizeof (ofp_packet_out) + sizeof (ofp_action_output) + sizeof (payload),
+                         "Wrong message length");
+  NS_TEST_EXPECT_MSG_EQ (ntohl (opo->buffer_id), OFP_NO_BUFFER, "Wrong buffer id");
+  NS_TEST_EXPECT_MSG_EQ (ntohs (opo->in_port), 2, "Wrong in port");
+  NS_TEST_ASSERT_MSG_EQ (ntohs (opo->actions_len), sizeof (ofp_action_output), "Wrong actions length");
+
+  ofp_action_output *oa = (ofp_action_output *)opo->actions;
+  NS_TEST_EXPECT_MSG_EQ (oa->port, uint16_t (OFPP_FLOOD), "Wrong output port");
+
+  const uint8_t *data = (const uint8_t *)opo->actions + sizeof (ofp_action_output);
+  NS_TEST_EXPECT_MSG_EQ (memcmp (data, payload, sizeof (payload)), 0, "Packet data not copied");
+}
+
+void
+OpenflowWireDecoderTestCase::CheckMalformed (void)
+{
+  OpenflowWireDecoder decoder;
+
+  /* Length field beyond the end of the message */
+  Ptr<Packet> packet = MakeFlowModification (1);
+  packet->RemoveAtEnd (4);
+
+  NS_TEST_EXPECT_MSG_EQ (packet->PeekHeader (decoder), 0, "Truncated FLOW_MOD accepted");
+  NS_TEST_EXPECT_MSG_EQ (decoder.GetMessage (), 0, "Truncated FLOW_MOD decoded");
+
+  /* The storage is reused, a good message after a bad one decodes */
+  packet = MakeBasicMessage (OFPT_BARRIER_REQUEST, 9);
+
+  NS_TEST_EXPECT_MSG_EQ (packet->PeekHeader (decoder), OPENFLOW_HEADER_LENGTH, "BARRIER_REQUEST rejected");
+  NS_TEST_ASSERT_MSG_NE (decoder.GetMessage (), 0, "BARRIER_REQUEST not decoded");
+  NS_TEST_EXPECT_MSG_EQ (uint32_t (decoder.GetMessage ()->type), uint32_t (OFPT_BARRIER_REQUEST), "Wrong type");
+  NS_TEST_EXPECT_MSG_EQ (decoder.GetMessage ()->xid, 9, "Wrong xid");
+}
+
+void
+OpenflowWireDecoderTestCase::DoRun (void)
+{
+  CheckFlowModification ();
+  CheckPacketOut ();
+  CheckMalformed ();
+}
+
+/*
+ * Diamond A-B-D / A-C-D, with an edge in each direction. Weights are
+ * distinct so the shortest paths do not depend on tie-breaking.
+ */
+class UndirectedGraphCacheTestCase : public TestCase
+{
+public:
+  UndirectedGraphCacheTestCase ();
+
+private:
+  virtual void DoRun (void);
+
+  void Connect (UndirectedGraph &graph, Ptr<Vertex> a, Ptr<Vertex> b, uint32_t weight);
+  void CheckPath (const UndirectedGraph::GraphPath &path, const std::vector<Ptr<Vertex> > &hops);
+};
+
+UndirectedGraphCacheTestCase::UndirectedGraphCacheTestCase ()
+  : TestCase ("Topology changes drop only the shortest-path trees they affect")
+{
+}
+
+void
+UndirectedGraphCacheTestCase::Connect (UndirectedGraph &graph, Ptr<Vertex> a, Ptr<Vertex> b, uint32_t weight)
+{
+  graph.SetEdgeWeight (graph.AddEdge (a, b), weight);
+  graph.SetEdgeWeight (graph.AddEdge (b, a), weight);
+}
+
+void
+UndirectedGraphCacheTestCase::CheckPath (const UndirectedGraph::GraphPath &path, const std::vector<Ptr<Vertex> > &hops)
+{
+  NS_TEST_ASSERT_MSG_EQ (path.size () + 1, hops.size (), "Wrong path length");
+
+  std::vector<Ptr<Vertex> >::const_iterator hop = hops.begin ();
+  for (UndirectedGraph::GraphPath::const_iterator it = path.begin (); it != path.end (); ++it, ++hop)
+    {
+      NS_TEST_EXPECT_MSG_EQ ((*it)->GetOrigin (), *hop, "Wrong hop");
+      NS_TEST_EXPECT_MSG_EQ ((*it)->GetDestination (), *(hop + 1), "Wrong hop");
+    }
+}
+
+void
+UndirectedGraphCacheTestCase::DoRun (void)
+{
+  UndirectedGraph graph;
+  Ptr<Vertex> a = graph.AddHost (Mac48Address ("00:00:00:00:00:0a"));
+  Ptr<Vertex> b = graph.AddHost (Mac48Address ("00:00:00:00:00:0b"));
+  Ptr<Vertex> c = graph.AddHost (Mac48Address ("00:00:00:00:00:0c"));
+  Ptr<Vertex> d = graph.AddHost (Mac48Address ("00:00:00:00:00:0d"));
+
+  Connect (graph, a, b, 1);
+  Connect (graph, a, c, 1);
+  Connect (graph, b, d, 1);
+  Connect (graph, c, d, 2);
+
+  std::vector<Ptr<Vertex> > abd;
+  abd.push_back (a);
+  abd.push_back (b);
+  abd.push_back (d);
+  std::vector<Ptr<Vertex> > acd;
+  acd.push_back (a);
+  acd.push_back (c);
+  acd.push_back (d);
+
+  CheckPath (graph.FindShortestPath (a, d), abd);
+  NS_TEST_EXPECT_MSG_EQ (graph.GetNCachedTrees (), 1, "Tree not cached");
+  CheckPath (graph.FindShortestPath (a, d), abd);
+  NS_TEST_EXPECT_MSG_EQ (graph.GetNCachedTrees (), 1, "Cached tree not reused");
+
+  graph.FindShortestPath (d, a);
+  NS_TEST_EXPECT_MSG_EQ (graph.GetNCachedTrees (), 2, "Tree not cached per source");
+
+  /* Neither tree uses C->D */
+  graph.SetEdgeWeight (c->GetEdge (d), 5);
+  NS_TEST_EXPECT_MSG_EQ (graph.GetNCachedTrees (), 2, "Unused edge invalidated a tree");
+
+  /* A reaches D through B->D, D is the source of its own tree */
+  graph.SetEdgeWeight (b->GetEdge (d), 10);
+  NS_TEST_EXPECT_MSG_EQ (graph.GetNCachedTrees (), 1, "Tree using the edge not invalidated");
+  CheckPath (graph.FindShortestPath (a, d), acd);
+
+  /* C is a leaf of D's tree and carries A's path to D */
+  graph.RemoveVertex (c->GetHwAddress ());
+  NS_TEST_EXPECT_MSG_EQ (graph.GetNCachedTrees (), 1, "Wrong trees invalidated by the vertex");
+  CheckPath (graph.FindShortestPath (a, d), abd);
+
+  std::vector<Ptr<Vertex> > dba;
+  dba.push_back (d);
+  dba.push_back (b);
+  dba.push_back (a);
+  CheckPath (graph.FindShortestPath (d, a), dba);
+  NS_TEST_EXPECT_MSG_EQ (graph.FindShortestPath (d, c).size (), 0, "Pruned vertex still reachable");
+}
+
+/*
+ * Two equal cost paths A-B-D and A-C-D, and a longer one A-E-F-D.
+ */
+class UndirectedGraphEcmpTestCase : public TestCase
+{
+public:
+  UndirectedGraphEcmpTestCase ();
+
+private:
+  virtual void DoRun (void);
+
+  void CheckPaths (void);
+  void CheckFlowSpreading (void);
+
+  UndirectedGraph m_graph;
+  Ptr<Vertex> m_a;
+  Ptr<Vertex> m_d;
+};
+
+UndirectedGraphEcmpTestCase::UndirectedGraphEcmpTestCase ()
+  : TestCase ("Equal cost paths are enumerated and flows hashed across them")
+{
+}
+
+void
+UndirectedGraphEcmpTestCase::CheckPaths (void)
+{
+  std::list<UndirectedGraph::GraphPath> paths = m_graph.FindEqualCostPaths (m_a, m_d, 4);
+  NS_TEST_ASSERT_MSG_EQ (paths.size (), 2, "Wrong number of equal cost paths");
+
+  NS_TEST_EXPECT_MSG_EQ ((paths.front () == m_graph.FindShortestPath (m_a, m_d)), true,
+                         "First path is not the shortest path");
+  NS_TEST_EXPECT_MSG_EQ ((paths.front () == paths.back ()), false, "Same path enumerated twice");
+
+  for (std::list<UndirectedGraph::GraphPath>::iterator it = paths.begin (); it != paths.end (); ++it)
+    {
+      NS_TEST_EXPECT_MSG_EQ (it->size (), 2, "Longer path taken as equal cost");
+      NS_TEST_EXPECT_MSG_EQ (it->front ()->GetOrigin (), m_a, "Path does not start at the source");
+      NS_TEST_EXPECT_MSG_EQ (it->back ()->GetDestination (), m_d, "Path does not end at the destination");
+    }
+
+  NS_TEST_EXPECT_MSG_EQ (m_graph.FindEqualCostPaths (m_a, m_d, 1).size (), 1, "maxPaths not honoured");
+  NS_TEST_EXPECT_MSG_EQ (m_graph.FindEqualCostPaths (m_a, m_a, 4).size (), 0, "Path to the source itself");
+}
+
+void
+UndirectedGraphEcmpTestCase::CheckFlowSpreading (void)
+{
+  std::list<UndirectedGraph::GraphPath> paths = m_graph.FindEqualCostPaths (m_a, m_d, 4);
+  NS_TEST_ASSERT_MSG_EQ (paths.size (), 2, "Wrong number of equal cost paths");
+
+  /* No port statistics, the hash alone picks the path */
+  Ptr<OFRouting> routing = CreateObject<OFRouting> ();
+  uint32_t wildcards = ns3::OFPFW_ALL & ~(ns3::OFPFW_DL_TYPE | ns3::OFPFW_NW_PROTO
+                                          | ns3::OFPFW_NW_SRC_MASK | ns3::OFPFW_NW_DST_MASK);
+  uint32_t onFirst = 0;
+
+  for (uint32_t i = 0; i < 64; ++i)
+    {
+      Ptr<FlowMatchHeader> match =
+        Create<FlowMatchHeader> (wildcards, 0, Mac48Address (), Mac48Address (),
+                                 OFP_VLAN_NONE, 0, ETH_TYPE_IP, 0, IP_TYPE_UDP,
+                                 Ipv4Address ("10.0.0.0").Get () + i, Ipv4Address ("10.1.0.1").Get (),
+                                 5000, 80);
+
+      const UndirectedGraph::GraphPath &path = routing->SelectPath (paths, match);
+      NS_TEST_EXPECT_MSG_EQ ((&path == &routing->SelectPath (paths, match)), true, "Flow hashed to different paths");
+
+      /* Wildcarded ports are not part of the flow */
+      match->SetTpSrc (5001);
+      NS_TEST_EXPECT_MSG_EQ ((&path == &routing->SelectPath (paths, match)), true, "Wildcarded field changed the path");
+
+      if (&path == &paths.front ())
+        {
+          ++onFirst;
+        }
+    }
+
+  NS_TEST_EXPECT_MSG_GT (onFirst, 16, "Flows not spread across the paths");
+  NS_TEST_EXPECT_MSG_LT (onFirst, 48, "Flows not spread across the paths");
+
+  routing->Dispose ();
+}
+
+void
+UndirectedGraphEcmpTestCase::DoRun (void)
+{
+  m_a = m_graph.AddHost (Mac48Address ("00:00:00:00:00:0a"));
+  Ptr<Vertex> b = m_graph.AddHost (Mac48Address ("00:00:00:00:00:0b"));
+  Ptr<Vertex> c = m_graph.AddHost (Mac48Address ("00:00:00:00:00:0c"));
+  m_d = m_graph.AddHost (Mac48Address ("00:00:00:00:00:0d"));
+  Ptr<Vertex> e = m_graph.AddHost (Mac48Address ("00:00:00:00:00:0e"));
+  Ptr<Vertex> f = m_graph.AddHost (Mac48Address ("00:00:00:00:00:0f"));
+
+  Ptr<Vertex> links[][2] = { { m_a, b }, { m_a, c }, { b, m_d }, { c, m_d }, { m_a, e }, { e, f }, { f, m_d } };
+
+  for (uint32_t i = 0; i < sizeof (links) / sizeof (links[0]); ++i)
+    {
+      m_graph.AddEdge (links[i][0], links[i][1]);
+      m_graph.AddEdge (links[i][1], links[i][0]);
+    }
+
+  CheckPaths ();
+  CheckFlowSpreading ();
+
+  m_a = 0;
+  m_d = 0;
+}
+
+/*
+ * Two switches in line with a host on each, the controller reaches them
+ * out-of-band, over a slower link to the second one, and has its in-band
+ * port on the second switch:
+ *
+ *   host0 -- sw0 -- sw1 -- host1
+ *                    |
+ *                controller
+ *
+ * LLDP finds the inter-switch link within a few seconds, traffic is sent
+ * from WARM on.
+ */
+static const Time WARM = Seconds (10);
+
+class OpenflowNetworkTestCase : public TestCase
+{
+public:
+  OpenflowNetworkTestCase (std::string name);
+
+  void Send (void);
+
+protected:
+  void Setup (Time delay);
+  void Teardown (void);
+
+  void Receive (Ptr<Socket> socket);
+
+  sw_flow *Lookup (Ptr<OpenFlowSwitchNetDevice> sw, Ipv4Address src, Ipv4Address dst);
+  Ptr<NetDevice> GetOutputPort (Ptr<OpenFlowSwitchNetDevice> sw, sw_flow *flow);
+
+  Ptr<OFRouting> m_routing;
+  Ptr<OpenFlowSwitchNetDevice> m_switches[2];
+  Ptr<NetDevice> m_hostPorts[2];           //!< Switch side of the host links
+  Ptr<NetDevice> m_trunkPorts[2];          //!< Switch side of the inter-switch link
+  Ipv4Address m_hostAddresses[2];
+
+  Ptr<Socket> m_source;
+  Ptr<Socket> m_sink;
+  uint32_t m_received;                     //!< Packets received by host1
+};
+
+OpenflowNetworkTestCase::OpenflowNetworkTestCase (std::string name)
+  : TestCase (name),
+    m_received (0)
+{
+}
+
+static Ptr<SimpleNetDevice>
+AddDevice (Ptr<Node> node, Ptr<SimpleChannel> channel)
+{
+  Ptr<SimpleNetDevice> dev = CreateObject<SimpleNetDevice> ();
+  dev->SetAddress (Mac48Address::Allocate ());
+  dev->SetChannel (channel);
+  node->AddDevice (dev);
+
+  return dev;
+}
+
+static Ptr<SimpleNetDevice>
+AddDevice (Ptr<Node> node, Ptr<SimpleChannel> channel, Ipv4Address address)
+{
+  Ptr<SimpleNetDevice> dev = AddDevice (node, channel);
+
+  Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
+  uint32_t i = ipv4->AddInterface (dev);
+  ipv4->AddAddress (i, Ipv4InterfaceAddress (address, Ipv4Mask ("255.255.255.0")));
+  ipv4->SetUp (i);
+
+  return dev;
+}
+
+void
+OpenflowNetworkTestCase::Setup (Time delay)
+{
+  NodeContainer hosts;
+  hosts.Create (2);
+  NodeContainer switches;
+  switches.Create (2);
+  Ptr<Node> controller = CreateObject<Node> ();
+
+  InternetStackHelper internet;
+  internet.Install (hosts);
+  internet.Install (switches);
+  internet.Install (controller);
+
+  m_hostAddresses[0] = Ipv4Address ("10.0.0.1");
+  m_hostAddresses[1] = Ipv4Address ("10.0.0.2");
+
+  for (uint32_t i = 0; i < 2; ++i)
+    {
+      Ptr<SimpleChannel> link = CreateObject<SimpleChannel> ();
+      AddDevice (hosts.Get (i), link, m_hostAddresses[i]);
+      m_hostPorts[i] = AddDevice (switches.Get (i), link);
+    }
+
+  Ptr<SimpleChannel> trunk = CreateObject<SimpleChannel> ();
+  m_trunkPorts[0] = AddDevice (switches.Get (0), trunk);
+  m_trunkPorts[1] = AddDevice (switches.Get (1), trunk);
+
+  Ptr<SimpleChannel> inband = CreateObject<SimpleChannel> ();
+  AddDevice (switches.Get (1), inband);
+  AddDevice (controller, inband, Ipv4Address ("10.0.0.254"));
+
+  /* sw1 has its own control link, routed to the controller address */
+  Ptr<SimpleChannel> control = CreateObject<SimpleChannel> ();
+  NetDeviceContainer controlPorts;
+  AddDevice (controller, control, Ipv4Address ("20.0.0.1"));
+  controlPorts.Add (AddDevice (switches.Get (0), control, Ipv4Address ("20.0.0.2")));
+
+  Ptr<SimpleChannel> slowControl = CreateObject<SimpleChannel> ();
+  slowControl->SetAttribute ("Delay", TimeValue (delay));
+  AddDevice (controller, slowControl, Ipv4Address ("20.0.1.1"));
+  controlPorts.Add (AddDevice (switches.Get (1), slowControl, Ipv4Address ("20.0.1.3")));
+
+  Ipv4StaticRoutingHelper staticRouting;
+  Ptr<Ipv4> ipv4 = switches.Get (1)->GetObject<Ipv4> ();
+  staticRouting.GetStaticRouting (ipv4)->AddHostRouteTo (Ipv4Address ("20.0.0.1"), Ipv4Address ("20.0.1.1"),
+                                                         ipv4->GetInterfaceForDevice (controlPorts.Get (1)));
+
+  OpenFlowControllerHelper controllerHelper;
+  controllerHelper.SetAttribute ("LocalAddress", Ipv4AddressValue ("20.0.0.1"));
+  controllerHelper.SetAttribute ("InbandAddress", Ipv4AddressValue ("10.0.0.254"));
+  ApplicationContainer apps = controllerHelper.Install (controller);
+
+  CreateObject<LldpHandler> ()->AddApplicationToController (controller);
+  CreateObject<ArpHandler> ()->AddApplicationToController (controller);
+  m_routing = CreateObject<OFRouting> ();
+  m_routing->AddApplicationToController (controller);
+
+  OpenFlowSwitchNetDeviceHelper switchHelper;
+  switchHelper.SetControllerAddress (Ipv4Address ("20.0.0.1"));
+  ApplicationContainer clients = switchHelper.Install (switches, controlPorts);
+  clients.Get (1)->SetAttribute ("LocalAddress", Ipv4AddressValue ("20.0.1.3"));
+  apps.Add (clients);
+  apps.Start (Seconds (1));
+
+  for (uint32_t i = 0; i < 2; ++i)
+    {
+      Ptr<Node> node = switches.Get (i);
+      m_switches[i] = DynamicCast<OpenFlowSwitchNetDevice> (node->GetDevice (node->GetNDevices () - 1));
+    }
+
+  m_sink = Socket::CreateSocket (hosts.Get (1), UdpSocketFactory::GetTypeId ());
+  m_sink->Bind (InetSocketAddress (Ipv4Address::GetAny (), 9));
+  m_sink->SetRecvCallback (MakeCallback (&OpenflowNetworkTestCase::Receive, this));
+
+  m_source = Socket::CreateSocket (hosts.Get (0), UdpSocketFactory::GetTypeId ());
+  m_source->Bind ();
+}
+
+void
+OpenflowNetworkTestCase::Teardown (void)
+{
+  m_routing = 0;
+  m_switches[0] = m_switches[1] = 0;
+  m_hostPorts[0] = m_hostPorts[1] = 0;
+  m_trunkPorts[0] = m_trunkPorts[1] = 0;
+  m_source = 0;
+  m_sink = 0;
+  Simulator::Destroy ();
+}
+
+void
+OpenflowNetworkTestCase::Send (void)
+{
+  m_source->SendTo (Create<Packet> (100), 0, InetSocketAddress (m_hostAddresses[1], 9));
+}
+
+void
+OpenflowNetworkTestCase::Receive (Ptr<Socket> socket)
+{
+  while (socket->Recv ())
+    {
+      ++m_received;
+    }
+}
+
+sw_flow *
+OpenflowNetworkTestCase::Lookup (Ptr<OpenFlowSwitchNetDevice> sw, Ipv4Address src, Ipv4Address dst)
+{
+  /* What the switch extracts from a datagram of the test traffic */
+  sw_flow_key key;
+  memset (&key, 0, sizeof key);
+  key.flow.dl_vlan = htons (OFP_VLAN_NONE);
+  key.flow.dl_type = htons (ETH_TYPE_IP);
+  key.flow.nw_proto = IP_TYPE_UDP;
+  key.flow.nw_src = htonl (src.Get ());
+  key.flow.nw_dst = htonl (dst.Get ());
+  key.flow.tp_dst = htons (9);
+
+  return chain_lookup (sw->GetChain (), &key);
+}
+
+Ptr<NetDevice>
+OpenflowNetworkTestCase::GetOutputPort (Ptr<OpenFlowSwitchNetDevice> sw, sw_flow *flow)
+{
+  if (flow->sf_acts->actions_len != sizeof (ofp_action_output))
+    {
+      return 0;
+    }
+
+  ofp_action_output *oa = (ofp_action_output *)flow->sf_acts->actions;
+  return sw->GetSwitchPort (oa->port).netdev;
+}
+
+class OpenflowProactiveRoutingTestCase : public OpenflowNetworkTestCase
+{
+public:
+  OpenflowProactiveRoutingTestCase ();
+
+private:
+  virtual void DoRun (void);
+
+  void CheckRule (Ptr<OpenFlowSwitchNetDevice> sw, Ipv4Address src, Ipv4Address dst, Ptr<NetDevice> port);
+};
+
+OpenflowProactiveRoutingTestCase::OpenflowProactiveRoutingTestCase ()
+  : OpenflowNetworkTestCase ("Proactive destination rules forward traffic between known hosts")
+{
+}
+
+void
+OpenflowProactiveRoutingTestCase::CheckRule (Ptr<OpenFlowSwitchNetDevice> sw, Ipv4Address src, Ipv4Address dst, Ptr<NetDevice> port)
+{
+  sw_flow *flow = Lookup (sw, src, dst);
+  NS_TEST_ASSERT_MSG_NE (flow, 0, "No rule for " << dst);
+  if (flow == 0)
+    {
+      return;
+    }
+
+  /* A reactive rule would shadow it, the traffic did not reach the controller */
+  NS_TEST_EXPECT_MSG_EQ (flow->priority, 100, "Traffic to " << dst << " not matched by its proactive rule");
+  NS_TEST_EXPECT_MSG_EQ (GetOutputPort (sw, flow), port, "Wrong output port towards " << dst);
+}
+
+void
+OpenflowProactiveRoutingTestCase::DoRun (void)
+{
+  Setup (MicroSeconds (10));
+
+  m_routing->SetAttribute ("Proactive", BooleanValue (true));
+  m_routing->SetAttribute ("ProactivePriority", UintegerValue (100));
+
+  for (uint32_t i = 0; i < 10; ++i)
+    {
+      Simulator::Schedule (WARM + MilliSeconds (500 * i), &OpenflowNetworkTestCase::Send, this);
+    }
+
+  Simulator::Stop (WARM + Seconds (10));
+  Simulator::Run ();
+
+  NS_TEST_EXPECT_MSG_EQ (m_received, 10, "Traffic not delivered");
+
+  /* host0 has sent, host1 answered ARP: both are known and routed to */
+  CheckRule (m_switches[0], m_hostAddresses[0], m_hostAddresses[1], m_trunkPorts[0]);
+  CheckRule (m_switches[1], m_hostAddresses[0], m_hostAddresses[1], m_hostPorts[1]);
+  CheckRule (m_switches[0], m_hostAddresses[1], m_hostAddresses[0], m_hostPorts[0]);
+  CheckRule (m_switches[1], m_hostAddresses[1], m_hostAddresses[0], m_trunkPorts[1]);
+
+  Teardown ();
+}
+
+class OpenflowReactiveRoutingTestCase : public OpenflowNetworkTestCase
+{
+public:
+  OpenflowReactiveRoutingTestCase ();
+
+private:
+  virtual void DoRun (void);
+
+  void CheckRule (Ptr<OpenFlowSwitchNetDevice> sw, Ptr<NetDevice> port);
+};
+
+OpenflowReactiveRoutingTestCase::OpenflowReactiveRoutingTestCase ()
+  : OpenflowNetworkTestCase ("Reactive paths are committed as a batch before the first packet is released")
+{
+}
+
+void
+OpenflowReactiveRoutingTestCase::CheckRule (Ptr<OpenFlowSwitchNetDevice> sw, Ptr<NetDevice> port)
+{
+  sw_flow *flow = Lookup (sw, m_hostAddresses[0], m_hostAddresses[1]);
+  NS_TEST_ASSERT_MSG_NE (flow, 0, "No rule for the flow");
+  if (flow == 0)
+    {
+      return;
+    }
+
+  NS_TEST_EXPECT_MSG_EQ (flow->priority, 200, "Flow not matched by its reactive rule");
+  NS_TEST_EXPECT_MSG_EQ (GetOutputPort (sw, flow), port, "Wrong output port");
+
+  /* The first packet is relayed through the table once the barrier of
+   * every switch in the path was answered: no switch sees it miss */
+  NS_TEST_EXPECT_MSG_EQ (flow->packet_count, 10, "Packets forwarded outside the rule");
+}
+
+void
+OpenflowReactiveRoutingTestCase::DoRun (void)
+{
+  /* A packet released before sw1 had its rule would reach it first */
+  Setup (MilliSeconds (50));
+
+  m_routing->SetAttribute ("Proactive", BooleanValue (false));
+  m_routing->SetAttribute ("FlowPriority", UintegerValue (200));
+
+  for (uint32_t i = 0; i < 10; ++i)
+    {
+      Simulator::Schedule (WARM + MilliSeconds (500 * i), &OpenflowNetworkTestCase::Send, this);
+    }
+
+  Simulator::Stop (WARM + Seconds (10));
+  Simulator::Run ();
+
+  NS_TEST_EXPECT_MSG_EQ (m_received, 10, "Traffic not delivered exactly once");
+
+  CheckRule (m_switches[0], m_trunkPorts[0]);
+  CheckRule (m_switches[1], m_hostPorts[1]);
+
+  Teardown ();
+}
+
+class OpenflowControllerTestSuite : public TestSuite
+{
+public:
+  OpenflowControllerTestSuite ();
+};
+
+OpenflowControllerTestSuite::OpenflowControllerTestSuite ()
+  : TestSuite ("openflow-controller", UNIT)
+{
+  AddTestCase (new OpenflowWireDecoderTestCase, TestCase::QUICK);
+  AddTestCase (new UndirectedGraphCacheTestCase, TestCase::QUICK);
+  AddTestCase (new UndirectedGraphEcmpTestCase, TestCase::QUICK);
+  AddTestCase (new OpenflowProactiveRoutingTestCase, TestCase::QUICK);
+  AddTestCase (new OpenflowReactiveRoutingTestCase, TestCase::QUICK);
+}
+
+static OpenflowControllerTestSuite openflowControllerTestSuite;
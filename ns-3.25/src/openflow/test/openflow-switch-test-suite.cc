@@ -20,7 +20,17 @@
  */
 
 // An essential include is test.h
+#include <vector>
 #include "ns3/test.h"
+#include "ns3/simulator.h"
+#include "ns3/uinteger.h"
+#include "ns3/node.h"
+#include "ns3/simple-channel.h"
+#include "ns3/simple-net-device.h"
+#include "ns3/ipv4-header.h"
+#include "ns3/udp-header.h"
+#include "ns3/ipv4-l3-protocol.h"
+#include "ns3/udp-l4-protocol.h"
 
 #include "ns3/openflow-switch-net-device.h"
 #include "ns3/openflow-lib.h"
@@ -173,6 +183,383 @@ SwitchFlowTableTestCase::DoRun(void)
   NS_TEST_ASSERT_MSG_EQ(chain_lookup(m_chain, &key), 0, "Key provided shouldn't match the flow but it does.");
 }
 
+/*
+ * A switch between two hosts, driven through ForwardControlInput as the
+ * OpenflowClient would, with no controller connected: misses are
+ * buffered and dropped. Rules match on the IPv4 destination.
+ *
+ *   host0 --(port 0)-- switch --(port 1)-- host1
+ */
+class SwitchDatapathTestCase : public TestCase
+{
+public:
+  SwitchDatapathTestCase (std::string name);
+
+  void Send (Ipv4Address dst);
+  void AddFlow (Ipv4Address dst, uint16_t priority, int port, uint16_t idle, uint16_t hard);
+  void ModifyFlow (Ipv4Address dst, uint16_t priority, int port);
+  void DeleteFlow (Ipv4Address dst, uint16_t priority, bool strict);
+  void CheckRule (Ipv4Address dst, bool installed);
+
+protected:
+  void Setup (void);
+  void Teardown (void);
+
+  int SendFlowMod (uint16_t command, Ipv4Address dst, uint16_t priority, int port,
+                   uint16_t idle, uint16_t hard, uint32_t bufferId);
+  int SendPacketOut (uint32_t bufferId, int port);
+
+  void Receive (Ptr<NetDevice> dev, Ptr<const Packet> packet, uint16_t protocol,
+                const Address &src, const Address &dst, NetDevice::PacketType type);
+
+  Ptr<OpenFlowSwitchNetDevice> m_switch;
+  Ptr<SimpleNetDevice> m_hosts[2];
+  std::vector<Time> m_received;            //!< Arrivals at host1
+};
+
+SwitchDatapathTestCase::SwitchDatapathTestCase (std::string name)
+  : TestCase (name)
+{
+}
+
+void
+SwitchDatapathTestCase::Setup (void)
+{
+  Ptr<Node> sw = CreateObject<Node> ();
+
+  m_switch = CreateObject<OpenFlowSwitchNetDevice> ();
+  m_switch->SetAddress (Mac48Address::Allocate ());
+  sw->AddDevice (m_switch);
+
+  for (uint32_t i = 0; i < 2; ++i)
+    {
+      Ptr<SimpleChannel> link = CreateObject<SimpleChannel> ();
+
+      Ptr<SimpleNetDevice> port = CreateObject<SimpleNetDevice> ();
+      port->SetAddress (Mac48Address::Allocate ());
+      port->SetChannel (link);
+      sw->AddDevice (port);
+      m_switch->AddSwitchPort (port);
+
+      Ptr<Node> host = CreateObject<Node> ();
+      m_hosts[i] = CreateObject<SimpleNetDevice> ();
+      m_hosts[i]->SetAddress (Mac48Address::Allocate ());
+      m_hosts[i]->SetChannel (link);
+      host->AddDevice (m_hosts[i]);
+    }
+
+  m_hosts[1]->GetNode ()->RegisterProtocolHandler (MakeCallback (&SwitchDatapathTestCase::Receive, this),
+                                                   Ipv4L3Protocol::PROT_NUMBER, m_hosts[1]);
+}
+
+void
+SwitchDatapathTestCase::Teardown (void)
+{
+  m_switch = 0;
+  m_hosts[0] = m_hosts[1] = 0;
+  Simulator::Destroy ();
+}
+
+void
+SwitchDatapathTestCase::Send (Ipv4Address dst)
+{
+  Ptr<Packet> packet = Create<Packet> (100);
+
+  UdpHeader udp;
+  udp.SetSourcePort (1234);
+  udp.SetDestinationPort (9);
+  packet->AddHeader (udp);
+
+  Ipv4Header ip;
+  ip.SetSource (Ipv4Address ("10.0.0.1"));
+  ip.SetDestination (dst);
+  ip.SetProtocol (UdpL4Protocol::PROT_NUMBER);
+  ip.SetPayloadSize (packet->GetSize ());
+  packet->AddHeader (ip);
+
+  m_hosts[0]->Send (packet, m_hosts[1]->GetAddress (), Ipv4L3Protocol::PROT_NUMBER);
+}
+
+void
+SwitchDatapathTestCase::Receive (Ptr<NetDevice> dev, Ptr<const Packet> packet, uint16_t protocol,
+                                 const Address &src, const Address &dst, NetDevice::PacketType type)
+{
+  m_received.push_back (Simulator::Now ());
+}
+
+int
+SwitchDatapathTestCase::SendFlowMod (uint16_t command, Ipv4Address dst, uint16_t priority, int port,
+                                     uint16_t idle, uint16_t hard, uint32_t bufferId)
+{
+  /* A negative port is a rule without actions, which drops */
+  size_t actionsLength = (port < 0) ? 0 : sizeof (ofp_action_output);
+  std::vector<uint8_t> msg (sizeof (ofp_flow_mod) + actionsLength);
+  ofp_flow_mod *ofm = (ofp_flow_mod *)&msg[0];
+
+  ofm->header.version = OFP_VERSION;
+  ofm->header.type = OFPT_FLOW_MOD;
+  ofm->header.length = htons (msg.size ());
+
+  ofm->match.wildcards = htonl (OFPFW_ALL & ~(OFPFW_DL_TYPE | OFPFW_NW_DST_MASK));
+  ofm->match.dl_type = htons (Ipv4L3Protocol::PROT_NUMBER);
+  ofm->match.nw_dst = htonl (dst.Get ());
+
+  ofm->command = htons (command);
+  ofm->idle_timeout = htons (idle);
+  ofm->hard_timeout = htons (hard);
+  ofm->priority = htons (priority);
+  ofm->buffer_id = htonl (bufferId);
+  ofm->out_port = OFPP_NONE;
+
+  /* The datapath takes output actions in host order */
+  if (port >= 0)
+    {
+      ofp_action_output *oa = (ofp_action_output *)ofm->actions;
+      oa->type = htons (OFPAT_OUTPUT);
+      oa->len = htons (sizeof (ofp_action_output));
+      oa->port = port;
+    }
+
+  return m_switch->ForwardControlInput (ofm, ofm->header.length);
+}
+
+int
+SwitchDatapathTestCase::SendPacketOut (uint32_t bufferId, int port)
+{
+  std::vector<uint8_t> msg (sizeof (ofp_packet_out) + sizeof (ofp_action_output));
+  ofp_packet_out *opo = (ofp_packet_out *)&msg[0];
+
+  opo->header.version = OFP_VERSION;
+  opo->header.type = OFPT_PACKET_OUT;
+  opo->header.length = htons (msg.size ());
+  opo->buffer_id = htonl (bufferId);
+  opo->in_port = OFPP_NONE;
+  opo->actions_len = htons (sizeof (ofp_action_output));
+
+  ofp_action_output *oa = (ofp_action_output *)opo->actions;
+  oa->type = htons (OFPAT_OUTPUT);
+  oa->len = htons (sizeof (ofp_action_output));
+  oa->port = port;
+
+  return m_switch->ForwardControlInput (opo, opo->header.length);
+}
+
+void
+SwitchDatapathTestCase::AddFlow (Ipv4Address dst, uint16_t priority, int port, uint16_t idle, uint16_t hard)
+{
+  int error = SendFlowMod (OFPFC_ADD, dst, priority, port, idle, hard, OFP_NO_BUFFER);
+  NS_TEST_EXPECT_MSG_EQ (error, 0, "Rule for " << dst << " not added");
+}
+
+void
+SwitchDatapathTestCase::ModifyFlow (Ipv4Address dst, uint16_t priority, int port)
+{
+  int error = SendFlowMod (OFPFC_MODIFY_STRICT, dst, priority, port, 0, 0, OFP_NO_BUFFER);
+  NS_TEST_EXPECT_MSG_EQ (error, 0, "Rule for " << dst << " not modified");
+}
+
+void
+SwitchDatapathTestCase::DeleteFlow (Ipv4Address dst, uint16_t priority, bool strict)
+{
+  int error = SendFlowMod (strict ? OFPFC_DELETE_STRICT : OFPFC_DELETE, dst, priority, -1, 0, 0, OFP_NO_BUFFER);
+  NS_TEST_EXPECT_MSG_EQ (error, 0, "Rule for " << dst << " not deleted");
+}
+
+void
+SwitchDatapathTestCase::CheckRule (Ipv4Address dst, bool installed)
+{
+  sw_flow_key key;
+  memset (&key, 0, sizeof key);
+  key.flow.dl_vlan = htons (OFP_VLAN_NONE);
+  key.flow.dl_type = htons (Ipv4L3Protocol::PROT_NUMBER);
+  key.flow.nw_dst = htonl (dst.Get ());
+
+  bool found = chain_lookup (m_switch->GetChain (), &key) != 0;
+  NS_TEST_EXPECT_MSG_EQ (found, installed, "Rule for " << dst << " at " << Simulator::Now ().GetSeconds () << "s");
+}
+
+class SwitchMicroflowTestCase : public SwitchDatapathTestCase
+{
+public:
+  SwitchMicroflowTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+SwitchMicroflowTestCase::SwitchMicroflowTestCase ()
+  : SwitchDatapathTestCase ("Cached microflows follow the flow table changes")
+{
+}
+
+void
+SwitchMicroflowTestCase::DoRun (void)
+{
+  Setup ();
+
+  Ipv4Address dst ("10.0.0.2");
+  AddFlow (dst, 100, 1, 0, 0);
+
+  /* One datagram a second; the second one on is a cache hit */
+  for (uint32_t i = 1; i <= 6; ++i)
+    {
+      Simulator::Schedule (Seconds (i), &SwitchDatapathTestCase::Send, this, dst);
+    }
+
+  /* Shadowed by a higher priority drop, then uncovered again */
+  Simulator::Schedule (Seconds (2.5), &SwitchDatapathTestCase::AddFlow, this, dst, 200, -1, 0, 0);
+  Simulator::Schedule (Seconds (3.5), &SwitchDatapathTestCase::DeleteFlow, this, dst, 200, true);
+
+  /* Changed to drop, then removed */
+  Simulator::Schedule (Seconds (4.5), &SwitchDatapathTestCase::ModifyFlow, this, dst, 100, -1);
+  Simulator::Schedule (Seconds (5.5), &SwitchDatapathTestCase::DeleteFlow, this, dst, 0, false);
+
+  Simulator::Stop (Seconds (10));
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_received.size (), 3, "Cache hits not following the flow table");
+  NS_TEST_EXPECT_MSG_EQ (uint32_t (m_received[0].GetSeconds ()), 1, "First datagram not forwarded");
+  NS_TEST_EXPECT_MSG_EQ (uint32_t (m_received[1].GetSeconds ()), 2, "Cache hit not forwarded");
+  NS_TEST_EXPECT_MSG_EQ (uint32_t (m_received[2].GetSeconds ()), 4, "Rule not uncovered by the delete");
+
+  Teardown ();
+}
+
+class SwitchPacketCacheTestCase : public SwitchDatapathTestCase
+{
+public:
+  SwitchPacketCacheTestCase ();
+
+private:
+  virtual void DoRun (void);
+
+  void Evicted (uint32_t bufferId, Time age);
+  void UseEvicted (void);
+
+  std::vector<uint32_t> m_evicted;
+  std::vector<Time> m_ages;
+};
+
+SwitchPacketCacheTestCase::SwitchPacketCacheTestCase ()
+  : SwitchDatapathTestCase ("A full packet buffer evicts the oldest packet, its id goes stale")
+{
+}
+
+void
+SwitchPacketCacheTestCase::Evicted (uint32_t bufferId, Time age)
+{
+  m_evicted.push_back (bufferId);
+  m_ages.push_back (age);
+}
+
+void
+SwitchPacketCacheTestCase::UseEvicted (void)
+{
+  NS_TEST_ASSERT_MSG_EQ (m_evicted.size (), 1, "Oldest packet not evicted");
+
+  /* Its slot holds the third packet now */
+  int error = SendPacketOut (m_evicted[0], 1);
+  NS_TEST_EXPECT_MSG_EQ (error, -ESRCH, "Evicted packet released");
+
+  /* The rule is installed anyway, only the packet is gone */
+  error = SendFlowMod (OFPFC_ADD, Ipv4Address ("10.0.0.2"), 100, 1, 0, 0, m_evicted[0]);
+  NS_TEST_EXPECT_MSG_EQ (error, -ESRCH, "Evicted packet released by FLOW_MOD");
+}
+
+void
+SwitchPacketCacheTestCase::DoRun (void)
+{
+  Setup ();
+
+  m_switch->SetAttribute ("PacketCacheSize", UintegerValue (2));
+  m_switch->TraceConnectWithoutContext ("PacketEvicted", MakeCallback (&SwitchPacketCacheTestCase::Evicted, this));
+
+  /* Misses, each one buffered for the absent controller */
+  for (uint32_t i = 1; i <= 3; ++i)
+    {
+      Simulator::Schedule (Seconds (i), &SwitchDatapathTestCase::Send, this, Ipv4Address ("10.0.0.2"));
+    }
+
+  Simulator::Schedule (Seconds (3.5), &SwitchPacketCacheTestCase::UseEvicted, this);
+  Simulator::Schedule (Seconds (4), &SwitchDatapathTestCase::Send, this, Ipv4Address ("10.0.0.2"));
+
+  Simulator::Stop (Seconds (10));
+  Simulator::Run ();
+
+  /* The fourth one evicts the second */
+  NS_TEST_ASSERT_MSG_EQ (m_ages.size (), 2, "Wrong number of evictions");
+  NS_TEST_EXPECT_MSG_EQ (m_ages[0], Seconds (2), "Wrong age of the evicted packet");
+  NS_TEST_EXPECT_MSG_EQ (m_ages[1], Seconds (2), "Wrong age of the evicted packet");
+  NS_TEST_EXPECT_MSG_NE (m_evicted[0], m_evicted[1], "Buffer ids reused");
+
+  NS_TEST_ASSERT_MSG_EQ (m_received.size (), 1, "Stale buffer id released a packet");
+  NS_TEST_EXPECT_MSG_EQ (uint32_t (m_received[0].GetSeconds ()), 4, "Rule not installed");
+
+  Teardown ();
+}
+
+class SwitchFlowExpiryTestCase : public SwitchDatapathTestCase
+{
+public:
+  SwitchFlowExpiryTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+SwitchFlowExpiryTestCase::SwitchFlowExpiryTestCase ()
+  : SwitchDatapathTestCase ("Rules expire within one tick of their idle or hard deadline")
+{
+}
+
+void
+SwitchFlowExpiryTestCase::DoRun (void)
+{
+  Setup ();
+
+  Ipv4Address hard ("10.0.0.2");
+  Ipv4Address idle ("10.0.0.3");
+  Ipv4Address replaced ("10.0.0.4");
+  Ipv4Address permanent ("10.0.0.5");
+
+  m_switch->SetAttribute ("FlowExpiryTick", TimeValue (MilliSeconds (100)));
+
+  Simulator::Schedule (Seconds (1), &SwitchDatapathTestCase::AddFlow, this, hard, 100, 1, 0, 2);
+  Simulator::Schedule (Seconds (1), &SwitchDatapathTestCase::AddFlow, this, idle, 100, 1, 1, 0);
+  Simulator::Schedule (Seconds (1), &SwitchDatapathTestCase::AddFlow, this, replaced, 100, 1, 0, 1);
+  Simulator::Schedule (Seconds (1), &SwitchDatapathTestCase::AddFlow, this, permanent, 100, 1, 0, 0);
+
+  /* Hard timeout, hits do not matter */
+  Simulator::Schedule (Seconds (2.5), &SwitchDatapathTestCase::Send, this, hard);
+  Simulator::Schedule (Seconds (2.95), &SwitchDatapathTestCase::CheckRule, this, hard, true);
+  Simulator::Schedule (Seconds (3.15), &SwitchDatapathTestCase::CheckRule, this, hard, false);
+
+  /* Idle timeout, pushed back by each hit; the last one at 2.5s */
+  for (uint32_t i = 0; i < 3; ++i)
+    {
+      Simulator::Schedule (Seconds (1.5 + 0.5 * i), &SwitchDatapathTestCase::Send, this, idle);
+    }
+  Simulator::Schedule (Seconds (3.45), &SwitchDatapathTestCase::CheckRule, this, idle, true);
+  Simulator::Schedule (Seconds (3.65), &SwitchDatapathTestCase::CheckRule, this, idle, false);
+
+  /* Deleted and added again with a longer timeout; the wheel still
+   * holds the first one at 2s */
+  Simulator::Schedule (Seconds (1.5), &SwitchDatapathTestCase::DeleteFlow, this, replaced, 100, true);
+  Simulator::Schedule (Seconds (1.5), &SwitchDatapathTestCase::AddFlow, this, replaced, 100, 1, 0, 4);
+  Simulator::Schedule (Seconds (2.5), &SwitchDatapathTestCase::CheckRule, this, replaced, true);
+  Simulator::Schedule (Seconds (5.45), &SwitchDatapathTestCase::CheckRule, this, replaced, true);
+  Simulator::Schedule (Seconds (5.65), &SwitchDatapathTestCase::CheckRule, this, replaced, false);
+
+  Simulator::Schedule (Seconds (9), &SwitchDatapathTestCase::CheckRule, this, permanent, true);
+
+  Simulator::Stop (Seconds (10));
+  Simulator::Run ();
+
+  NS_TEST_EXPECT_MSG_EQ (m_received.size (), 4, "Traffic not forwarded before the rules expired");
+
+  Teardown ();
+}
+
 class SwitchTestSuite : public TestSuite
 {
 public:
@@ -182,6 +569,9 @@ public:
 SwitchTestSuite::SwitchTestSuite () : TestSuite("openflow", UNIT)
 {
   AddTestCase(new SwitchFlowTableTestCase, TestCase::QUICK);
+  AddTestCase(new SwitchMicroflowTestCase, TestCase::QUICK);
+  AddTestCase(new SwitchPacketCacheTestCase, TestCase::QUICK);
+  AddTestCase(new SwitchFlowExpiryTestCase, TestCase::QUICK);
 }
 
 // Do not forget to allocate an instance of this TestSuite
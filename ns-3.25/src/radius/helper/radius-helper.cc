@@ -14,14 +14,11 @@ RadiusHelper::RadiusHelper(void)
 
 void RadiusHelper::SetAttribute (std::string name, const AttributeValue &value)
 {
-  bool set_server = true;
-  bool set_client = true;
+  struct TypeId::AttributeInformation info;
 
   /* filter exclusive parameters */
-  if (name == "ServerDelay")
-    set_client = false;
-  else if (name == "ServerAddress")
-    set_server = false;
+  bool set_server = m_srv_factory.GetTypeId ().LookupAttributeByName (name, &info);
+  bool set_client = m_client_factory.GetTypeId ().LookupAttributeByName (name, &info);
 
   if (set_server)
     m_srv_factory.Set (name, value);
@@ -26,6 +26,8 @@
 #include <ns3/string.h>
 #include <ns3/pointer.h>
 #include <ns3/log.h>
+#include <ns3/simulator.h>
+#include <ns3/trace-source-accessor.h>
 #include <arpa/inet.h>
 #include "radius-header.h"
 #include "radius-client.h"
@@ -36,10 +38,12 @@ namespace ns3
 {
 NS_OBJECT_ENSURE_REGISTERED(RadiusClient);
 
+const uint8_t RadiusClient::REQUEST_TIMEOUT = RadiusMessage::RAD_INVALID;
+
 TypeId RadiusClient::GetTypeId(void)
 {
   static TypeId tid = TypeId("ns3::RadiusClient")
-                      .SetParent<Header> ()
+                      .SetParent<Application> ()
                       .AddConstructor<RadiusClient> ()
                       .AddAttribute("ServerAddress",
                                     "RADIUS server IPv4 Address",
@@ -60,17 +64,55 @@ TypeId RadiusClient::GetTypeId(void)
                                     "RADIUS server secret",
                                     StringValue(""),
                                     MakeStringAccessor(&RadiusClient::m_server_secret),
-                                    MakeStringChecker());
+                                    MakeStringChecker())
+                      .AddAttribute("Sockets",
+                                    "Number of source ports, each one has 256 request identifiers",
+                                    UintegerValue(4),
+                                    MakeUintegerAccessor(&RadiusClient::m_n_sockets),
+                                    MakeUintegerChecker<uint32_t> (1))
+                      .AddAttribute("MaxInFlight",
+                                    "Maximum number of outstanding requests",
+                                    UintegerValue(256),
+                                    MakeUintegerAccessor(&RadiusClient::m_max_in_flight),
+                                    MakeUintegerChecker<uint32_t> (1))
+                      .AddAttribute("BacklogLimit",
+                                    "Maximum number of requests waiting for the window",
+                                    UintegerValue(65536),
+                                    MakeUintegerAccessor(&RadiusClient::m_backlog_limit),
+                                    MakeUintegerChecker<uint32_t> ())
+                      .AddAttribute("RetransmitTimeout",
+                                    "Initial retransmission timeout, doubled on every attempt",
+                                    TimeValue(Seconds(2)),
+                                    MakeTimeAccessor(&RadiusClient::m_retransmit_timeout),
+                                    MakeTimeChecker())
+                      .AddAttribute("MaxRetransmissions",
+                                    "Retransmissions before a request is abandoned",
+                                    UintegerValue(3),
+                                    MakeUintegerAccessor(&RadiusClient::m_max_retransmissions),
+                                    MakeUintegerChecker<uint32_t> ())
+                      .AddTraceSource("Latency",
+                                      "A request was answered",
+                                      MakeTraceSourceAccessor(&RadiusClient::m_latencyTrace),
+                                      "ns3::RadiusClient::LatencyTracedCallback")
+                      .AddTraceSource("Timeout",
+                                      "A request was abandoned after all retransmissions",
+                                      MakeTraceSourceAccessor(&RadiusClient::m_timeoutTrace),
+                                      "ns3::RadiusClient::TimeoutTracedCallback");
 
   return tid;
 }
 
 RadiusClient::RadiusClient ()
-  : m_socket(0),
-  m_request_counter(0),
+  : m_n_sockets(4),
+  m_max_in_flight(256),
+  m_backlog_limit(65536),
+  m_max_retransmissions(3),
+  m_next_socket(0),
+  m_in_flight(0),
   m_cb_request_completed(0)
 {
   NS_LOG_FUNCTION(this);
+  m_authenticator_rng = CreateObject<UniformRandomVariable>();
 }
 
 RadiusClient::~RadiusClient ()
@@ -94,54 +136,180 @@ void RadiusClient::StartApplication()
 {
   NS_LOG_FUNCTION(this);
 
-  if (m_socket == 0)
+  if (m_sockets.empty())
     {
       TypeId tid = TypeId::LookupByName("ns3::UdpSocketFactory");
-      m_socket = Socket::CreateSocket(GetNode(), tid);
-      m_socket->Bind();
+
+      m_sockets.resize(m_n_sockets);
+      m_free_ids.resize(m_n_sockets);
+      m_pending_reqs.resize(m_n_sockets * 256);
+
+      for (uint32_t i = 0; i < m_n_sockets; ++i)
+        {
+          m_sockets[i] = Socket::CreateSocket(GetNode(), tid);
+          m_sockets[i]->Bind();
+
+          /* Identifiers are handed out in increasing order */
+          for (int id = 255; id >= 0; --id)
+            m_free_ids[i].push_back(id);
+        }
     }
 
-  m_socket->SetRecvCallback(MakeCallback(&RadiusClient::NetHandler, this));
+  for (uint32_t i = 0; i < m_sockets.size(); ++i)
+    m_sockets[i]->SetRecvCallback(MakeCallback(&RadiusClient::NetHandler, this).Bind(i));
+
+  /* Requests issued before start */
+  DrainBacklog();
 }
 
 void RadiusClient::StopApplication()
 {
   NS_LOG_FUNCTION(this);
 
-  if (m_socket != 0)
+  for (auto &socket : m_sockets)
     {
-      m_socket->Close();
-      m_socket->SetRecvCallback(MakeNullCallback<void, Ptr<Socket> > ());
-      m_socket = 0;
+      socket->Close();
+      socket->SetRecvCallback(MakeNullCallback<void, Ptr<Socket> > ());
     }
+  m_sockets.clear();
+  m_free_ids.clear();
+
+  for (auto &req : m_pending_reqs)
+    Simulator::Cancel(req.timer);
   m_pending_reqs.clear();
+
+  m_backlog.clear();
+  m_in_flight = 0;
 }
 
 int RadiusClient::SendRequest(uint8_t code, RadiusMessage::RadiusAvpList &avp_list)
 {
   NS_LOG_FUNCTION(this);
 
-  Ptr<Packet> packet = Create<Packet>();
+  if (m_backlog.size() >= m_backlog_limit)
+    {
+      NS_LOG_WARN(this << " backlog full, dropping request");
+      return -1;
+    }
+
   RadiusMessage rad_req;
 
   rad_req.SetMessageCode(code);
-  rad_req.SetMessageID(++m_request_counter);
   rad_req.AddAttributeList(avp_list);
-  packet->AddHeader(rad_req);
 
-  if (code != RadiusMessage::RAD_ACCOUNTING_REQUEST)
-    m_socket->SendTo(packet, 0, InetSocketAddress(Ipv4Address::ConvertFrom(m_server_addr), m_server_port));
+  m_backlog.push_back(rad_req);
+  DrainBacklog();
+
+  return 0;
+}
+
+void RadiusClient::DrainBacklog()
+{
+  while (!m_backlog.empty() && m_in_flight < m_max_in_flight && !m_sockets.empty())
+    {
+      /* Round-robin over sockets with free identifiers */
+      uint32_t sock = m_next_socket;
+      uint32_t tries = 0;
+
+      while (m_free_ids[sock].empty() && tries++ < m_sockets.size())
+        sock = (sock + 1) % m_sockets.size();
+
+      if (m_free_ids[sock].empty())
+        {
+          NS_LOG_LOGIC(this << " identifier space exhausted");
+          return;
+        }
+
+      m_next_socket = (sock + 1) % m_sockets.size();
+
+      uint8_t id = m_free_ids[sock].back();
+      m_free_ids[sock].pop_back();
+
+      uint32_t slot = sock * 256 + id;
+      PendingRequest &req = m_pending_reqs[slot];
+
+      req.active = true;
+      req.message = m_backlog.front();
+      req.message.SetMessageID(id);
+
+      /* Fresh Request Authenticator, it tells a new request from a
+       * retransmission reusing the identifier. Accounting-Request would
+       * carry an MD5 over the packet and secret, not modeled here */
+      uint8_t authenticator[16];
+      for (auto &octet : authenticator)
+        octet = m_authenticator_rng->GetInteger(0, 255);
+      req.message.SetAutheticator(authenticator);
+      req.firstSent = Simulator::Now();
+      req.retries = 0;
+      m_backlog.pop_front();
+      ++m_in_flight;
+
+      Transmit(slot);
+    }
+}
+
+void RadiusClient::Transmit(uint32_t slot)
+{
+  NS_LOG_FUNCTION(this << slot);
+
+  PendingRequest &req = m_pending_reqs[slot];
+  Ptr<Socket> socket = m_sockets[slot / 256];
+
+  Ptr<Packet> packet = Create<Packet>();
+  packet->AddHeader(req.message);
+
+  if (req.message.GetMessageCode() != RadiusMessage::RAD_ACCOUNTING_REQUEST)
+    socket->SendTo(packet, 0, InetSocketAddress(Ipv4Address::ConvertFrom(m_server_addr), m_server_port));
   else
-    m_socket->SendTo(packet, 0, InetSocketAddress(Ipv4Address::ConvertFrom(m_server_addr), m_server_acc_port));
+    socket->SendTo(packet, 0, InetSocketAddress(Ipv4Address::ConvertFrom(m_server_addr), m_server_acc_port));
 
-  m_pending_reqs[rad_req.GetMessageID()] = rad_req;
+  /* Exponential back-off */
+  Time rt = m_retransmit_timeout * (1 << std::min<uint32_t>(req.retries, 16));
+  req.timer = Simulator::Schedule(rt, &RadiusClient::RequestTimeout, this, slot);
+}
 
-  return 0;
+void RadiusClient::RequestTimeout(uint32_t slot)
+{
+  PendingRequest &req = m_pending_reqs[slot];
+
+  NS_LOG_FUNCTION(this << slot << req.retries);
+
+  if (req.retries < m_max_retransmissions)
+    {
+      ++req.retries;
+      Transmit(slot);
+      return;
+    }
+
+  NS_LOG_WARN(this << " request " << uint32_t(req.message.GetMessageID()) << " timed out");
+  m_timeoutTrace(req.message.GetMessageCode());
+
+  /* The slot is reused by DrainBacklog, keep what the caller needs */
+  RadiusMessage::RadiusAvpList avps = req.message.GetAttributeList();
+
+  ReleaseSlot(slot);
+
+  if (!m_cb_request_completed.IsNull())
+    m_cb_request_completed(REQUEST_TIMEOUT, avps);
+
+  DrainBacklog();
 }
 
-void RadiusClient::NetHandler(Ptr<Socket> socket)
+void RadiusClient::ReleaseSlot(uint32_t slot)
 {
-  NS_LOG_FUNCTION(this << socket);
+  PendingRequest &req = m_pending_reqs[slot];
+
+  Simulator::Cancel(req.timer);
+  req.active = false;
+  req.message = RadiusMessage();
+
+  m_free_ids[slot / 256].push_back(slot % 256);
+  --m_in_flight;
+}
+
+void RadiusClient::NetHandler(uint32_t sockIndex, Ptr<Socket> socket)
+{
+  NS_LOG_FUNCTION(this << sockIndex << socket);
 
   Ptr<Packet> packet = 0;
   Address from;
@@ -155,20 +323,26 @@ void RadiusClient::NetHandler(Ptr<Socket> socket)
 
       packet->RemoveHeader(response);
 
-      RadiusClientPendingListIT it = m_pending_reqs.find(response.GetMessageID());
+      uint32_t slot = sockIndex * 256 + response.GetMessageID();
 
-      if (it == m_pending_reqs.end())
+      if (slot >= m_pending_reqs.size() || !m_pending_reqs[slot].active)
         {
+          /* Late answer to a retransmitted or abandoned request */
           NS_LOG_WARN(this << " Got unexpected response " << response);
           continue;
         }
 
-      m_pending_reqs.erase(it);
+      PendingRequest &req = m_pending_reqs[slot];
+      m_latencyTrace(req.message.GetMessageCode(), Simulator::Now() - req.firstSent);
+
+      ReleaseSlot(slot);
 
       if (!m_cb_request_completed.IsNull())
         m_cb_request_completed(response.GetMessageCode(),
                                response.GetAttributeList());
     }
+
+  DrainBacklog();
 }
 
 int RadiusClient::DoAuthentication(const std::string& username, const std::string& passwd,
@@ -226,4 +400,31 @@ int RadiusClient::DoStopAccounting(uint32_t acc_event, const std::string &sessio
 
   return SendRequest(RadiusMessage::RAD_ACCOUNTING_REQUEST, avp_list);
 }
+
+int RadiusClient::DoInterimAccounting(const std::string &session_id, uint32_t session_time,
+                                      uint64_t input_octets, uint64_t output_octets,
+                                      uint32_t input_packets, uint32_t output_packets)
+{
+  NS_LOG_FUNCTION(this << session_id << input_octets << output_octets);
+  RadiusMessage::RadiusAvpList avp_list;
+
+  avp_list.push_back(RadiusAVP(RadiusAVP::RAD_ATTR_ACCT_SESSION_ID,
+                               session_id.length(),
+                               (const uint8_t*)session_id.c_str()));
+  avp_list.push_back(RadiusAVP(RadiusAVP::RAD_ATTR_ACCT_STATUS_TYPE,
+                               (uint32_t)RadiusAVP::RAD_ACCT_UPDATE));
+  avp_list.push_back(RadiusAVP(RadiusAVP::RAD_ATTR_ACCT_SESSION_TIME, session_time));
+  avp_list.push_back(RadiusAVP(RadiusAVP::RAD_ATTR_ACCT_INPUT_OCTETS, (uint32_t)input_octets));
+  avp_list.push_back(RadiusAVP(RadiusAVP::RAD_ATTR_ACCT_OUTPUT_OCTETS, (uint32_t)output_octets));
+  avp_list.push_back(RadiusAVP(RadiusAVP::RAD_ATTR_ACCT_INPUT_PACKETS, input_packets));
+  avp_list.push_back(RadiusAVP(RadiusAVP::RAD_ATTR_ACCT_OUTPUT_PACKETS, output_packets));
+
+  /* RFC 2869, counter overflows */
+  if (input_octets >> 32)
+    avp_list.push_back(RadiusAVP(RadiusAVP::RAD_ATTR_ACCT_INPUT_GIGAWORDS, (uint32_t)(input_octets >> 32)));
+  if (output_octets >> 32)
+    avp_list.push_back(RadiusAVP(RadiusAVP::RAD_ATTR_ACCT_OUTPUT_GIGAWORDS, (uint32_t)(output_octets >> 32)));
+
+  return SendRequest(RadiusMessage::RAD_ACCOUNTING_REQUEST, avp_list);
+}
 }
@@ -21,10 +21,15 @@
 #ifndef __RADIUS_CLIENT_H__
 #define __RADIUS_CLIENT_H__
 
+#include <deque>
+#include <vector>
 #include <ns3/callback.h>
 #include <ns3/application.h>
 #include <ns3/event-id.h>
 #include <ns3/ptr.h>
+#include <ns3/nstime.h>
+#include <ns3/traced-callback.h>
+#include <ns3/random-variable-stream.h>
 #include <ns3/radius-header.h>
 
 namespace ns3
@@ -32,12 +37,41 @@ namespace ns3
 class Socket;
 class Packet;
 
+/**
+ * \brief RADIUS client (NAS side)
+ *
+ * Requests are spread over several UDP sockets, each with its own 8-bit
+ * identifier space. At most MaxInFlight requests are outstanding, the
+ * others wait in a backlog. Unanswered requests are retransmitted with
+ * the same identifier, authenticator and exponential back-off, as in
+ * RFC 5080, so the server can recognize them as duplicates. A request
+ * still unanswered after MaxRetransmissions completes with REQUEST_TIMEOUT.
+ */
 class RadiusClient : public Application
 {
 public:
+  /**
+   * Request completion, with the response code and attributes. Abandoned
+   * requests report REQUEST_TIMEOUT and the attributes they were sent with.
+   */
   typedef Callback<int, uint8_t,
                    RadiusMessage::RadiusAvpList > RadiusRequestCompletedCb;
 
+  static const uint8_t REQUEST_TIMEOUT;   /*!< Completion code of abandoned requests */
+
+  /**
+   * TracedCallback signature for completed requests
+   * \param [in] code       request code
+   * \param [in] latency    time since the first transmission
+   */
+  typedef void (* LatencyTracedCallback)(uint8_t code, Time latency);
+
+  /**
+   * TracedCallback signature for abandoned requests
+   * \param [in] code       request code
+   */
+  typedef void (* TimeoutTracedCallback)(uint8_t code);
+
   /**
    * \brief Get the type ID.
    * \return type ID
@@ -67,6 +101,16 @@ public:
   int DoStopAccounting(uint32_t acc_event, const std::string& session_id,
                        uint32_t session_time, uint32_t termination_cause);
 
+  /**
+   * \brief Send an Interim-Update with the session counters
+   *
+   * Only integer AVPs follow the Session-Id, the Gigawords are left
+   * out while the octet counters fit in 32 bits.
+   */
+  int DoInterimAccounting(const std::string& session_id, uint32_t session_time,
+                          uint64_t input_octets, uint64_t output_octets,
+                          uint32_t input_packets, uint32_t output_packets);
+
 protected:
   /**
    * \brief Dispose the instance.
@@ -74,8 +118,18 @@ protected:
   virtual void DoDispose();
 
 private:
-  typedef std::map<uint8_t, RadiusMessage> RadiusClientPendingList;
-  typedef std::map<uint8_t, RadiusMessage>::iterator RadiusClientPendingListIT;
+  struct PendingRequest
+  {
+    PendingRequest() : active(false), retries(0) {}
+
+    bool active;
+    RadiusMessage message;
+    Time firstSent;
+    uint32_t retries;
+    EventId timer;
+  };
+
+  typedef std::vector<PendingRequest> RadiusClientPendingList;
 
   /**
    * \brief Start the application.
@@ -87,16 +141,37 @@ private:
    */
   virtual void StopApplication();
 
-  void NetHandler(Ptr<Socket> socket);
+  void NetHandler(uint32_t sockIndex, Ptr<Socket> socket);
 
-  Ptr<Socket>                     m_socket;
+  /**
+   * \brief Send backlogged requests while the window allows
+   */
+  void DrainBacklog();
+
+  void Transmit(uint32_t slot);
+  void RequestTimeout(uint32_t slot);
+  void ReleaseSlot(uint32_t slot);
+
+  std::vector<Ptr<Socket> >       m_sockets;
+  std::vector<std::vector<uint8_t> > m_free_ids;  /*!< Free identifiers, per socket */
   Ipv4Address m_server_addr;
   uint16_t m_server_port;
   uint16_t m_server_acc_port;
   std::string m_server_secret;
-  uint8_t m_request_counter;
-  RadiusClientPendingList m_pending_reqs;
+  uint32_t m_n_sockets;
+  uint32_t m_max_in_flight;
+  uint32_t m_backlog_limit;
+  Time m_retransmit_timeout;
+  uint32_t m_max_retransmissions;
+  uint32_t m_next_socket;
+  uint32_t m_in_flight;
+  RadiusClientPendingList m_pending_reqs;        /*!< Indexed by socket * 256 + identifier */
+  std::deque<RadiusMessage> m_backlog;
+  Ptr<UniformRandomVariable> m_authenticator_rng;
   RadiusRequestCompletedCb m_cb_request_completed;
+
+  TracedCallback<uint8_t, Time> m_latencyTrace;
+  TracedCallback<uint8_t> m_timeoutTrace;
 };
 }
 #endif  /* __RADIUS_CLIENT_H__ */
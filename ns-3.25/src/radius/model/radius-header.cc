@@ -89,6 +89,7 @@ RadiusMessage::RadiusMessage ()
   m_identifier(0)
 {
   NS_LOG_FUNCTION(this);
+  memset(m_authenticator, 0, sizeof(m_authenticator));
 }
 
 RadiusMessage::~RadiusMessage ()
@@ -85,6 +85,8 @@ public:
     RAD_ATTR_ACCT_TERMINATE_CAUSE = 49,
     RAD_ATTR_ACCT_MULTI_SESSION_ID = 50,
     RAD_ATTR_ACCT_LINK_COUNT = 51,
+    RAD_ATTR_ACCT_INPUT_GIGAWORDS = 52,
+    RAD_ATTR_ACCT_OUTPUT_GIGAWORDS = 53,
     RAD_ATTR_CHAP_CHALLENGE = 60,
     RAD_ATTR_NAS_PORT_TYPE = 61,
     RAD_ATTR_PORT_LIMIT = 62,
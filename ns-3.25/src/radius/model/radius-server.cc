@@ -18,6 +18,7 @@
  * Author: Alexsander de Souza <asouza@inf.ufrgs.br>
  */
 
+#include <cstring>
 #include <ns3/ipv4.h>
 #include <ns3/ipv4-address.h>
 #include <ns3/socket-factory.h>
@@ -28,6 +29,9 @@
 #include <ns3/log.h>
 #include "ns3/nstime.h"
 #include "ns3/simulator.h"
+#include "ns3/inet-socket-address.h"
+#include "ns3/pointer.h"
+#include "ns3/trace-source-accessor.h"
 #include <arpa/inet.h>
 #include "radius-header.h"
 #include "radius-server.h"
@@ -41,7 +45,7 @@ NS_OBJECT_ENSURE_REGISTERED(RadiusServer);
 TypeId RadiusServer::GetTypeId(void)
 {
   static TypeId tid = TypeId("ns3::RadiusServer")
-                      .SetParent<Header> ()
+                      .SetParent<Application> ()
                       .AddConstructor<RadiusServer> ()
                       .AddAttribute("AuthPort",
                                     "RADIUS server Authentication UDP port",
@@ -58,18 +62,68 @@ TypeId RadiusServer::GetTypeId(void)
                                     StringValue(""),
                                     MakeStringAccessor(&RadiusServer::m_server_secret),
                                     MakeStringChecker())
-                      .AddAttribute("ServerDelay",
-                                    "RADIUS server response delay (ms)",
-                                    UintegerValue(500),
-                                    MakeUintegerAccessor(&RadiusServer::m_server_delay),
-                                    MakeUintegerChecker<uint64_t> ());
+                      .AddAttribute("Workers",
+                                    "Number of requests served in parallel",
+                                    UintegerValue(16),
+                                    MakeUintegerAccessor(&RadiusServer::m_n_workers),
+                                    MakeUintegerChecker<uint32_t> (1))
+                      .AddAttribute("QueueLimit",
+                                    "Maximum number of requests waiting for a worker",
+                                    UintegerValue(1024),
+                                    MakeUintegerAccessor(&RadiusServer::m_queue_limit),
+                                    MakeUintegerChecker<uint32_t> ())
+                      .AddAttribute("ServiceTime",
+                                    "Time a worker takes to serve a request (seconds)",
+                                    StringValue("ns3::ConstantRandomVariable[Constant=0.5]"),
+                                    MakePointerAccessor(&RadiusServer::m_service_time),
+                                    MakePointerChecker<RandomVariableStream> ())
+                      .AddAttribute("AccountingBatchSize",
+                                    "Accounting records committed together, 1 disables batching",
+                                    UintegerValue(1),
+                                    MakeUintegerAccessor(&RadiusServer::m_acc_batch_size),
+                                    MakeUintegerChecker<uint32_t> (1))
+                      .AddAttribute("AccountingBatchTimeout",
+                                    "Maximum time an accounting record waits for its batch",
+                                    TimeValue(MilliSeconds(50)),
+                                    MakeTimeAccessor(&RadiusServer::m_acc_batch_timeout),
+                                    MakeTimeChecker())
+                      .AddAttribute("CommitTime",
+                                    "Time to commit a batch of accounting records",
+                                    TimeValue(MilliSeconds(10)),
+                                    MakeTimeAccessor(&RadiusServer::m_commit_time),
+                                    MakeTimeChecker())
+                      .AddAttribute("ReplyCacheTime",
+                                    "Time an answer is kept to be sent again to retransmissions",
+                                    TimeValue(Seconds(5)),
+                                    MakeTimeAccessor(&RadiusServer::m_reply_cache_time),
+                                    MakeTimeChecker())
+                      .AddTraceSource("QueueLength",
+                                      "Requests waiting for a worker",
+                                      MakeTraceSourceAccessor(&RadiusServer::m_queue_length),
+                                      "ns3::TracedValueCallback::Uint32")
+                      .AddTraceSource("Sojourn",
+                                      "A request was answered",
+                                      MakeTraceSourceAccessor(&RadiusServer::m_sojourn_trace),
+                                      "ns3::RadiusServer::SojournTracedCallback")
+                      .AddTraceSource("Drop",
+                                      "A request was dropped on a full queue",
+                                      MakeTraceSourceAccessor(&RadiusServer::m_drop_trace),
+                                      "ns3::RadiusServer::DropTracedCallback")
+                      .AddTraceSource("Duplicate",
+                                      "A retransmitted request was recognized",
+                                      MakeTraceSourceAccessor(&RadiusServer::m_duplicate_trace),
+                                      "ns3::RadiusServer::DuplicateTracedCallback");
 
   return tid;
 }
 
 RadiusServer::RadiusServer ()
   : m_auth_sock(0),
-  m_acc_sock(0)
+  m_acc_sock(0),
+  m_n_workers(16),
+  m_queue_limit(1024),
+  m_acc_batch_size(1),
+  m_recent_serial(0)
 {
   NS_LOG_FUNCTION(this);
 }
@@ -119,6 +173,11 @@ void RadiusServer::StartApplication()
     {
       m_rad_db = CreateObject<RadiusDB>();
     }
+
+  m_workers.assign(m_n_workers, EventId());
+  m_idle_workers.clear();
+  for (uint32_t i = 0; i < m_n_workers; ++i)
+    m_idle_workers.push_back(i);
 }
 
 void RadiusServer::StopApplication()
@@ -139,13 +198,21 @@ void RadiusServer::StopApplication()
       m_acc_sock = 0;
     }
 
-  while (!m_peding_reqs.empty())
-    {
-      EventId evt = m_peding_reqs.front();
+  for (auto &evt : m_workers)
+    Simulator::Cancel(evt);
+  m_workers.clear();
+  m_idle_workers.clear();
 
-      Simulator::Cancel(evt);
-      m_peding_reqs.pop();
-    }
+  Simulator::Cancel(m_batch_timer);
+  Simulator::Cancel(m_commit_event);
+  m_acc_batch.clear();
+  m_committing.clear();
+
+  m_queue.clear();
+  m_queue_length = 0;
+
+  m_recent.clear();
+  m_recent_expiration.clear();
 
   if (m_rad_db != 0)
     {
@@ -163,7 +230,6 @@ void RadiusServer::HandleAuthentication(Ptr<Socket> socket)
   while ((packet = socket->RecvFrom(from)))
     {
       RadiusMessage request;
-      RadiusMessage response;
 
       if (packet->GetSize() <= 0)
         continue;
@@ -173,44 +239,7 @@ void RadiusServer::HandleAuthentication(Ptr<Socket> socket)
       NS_ASSERT(request.GetMessageCode() == RadiusMessage::RAD_ACCESS_REQUEST);
       NS_LOG_LOGIC("Message:" << request);
 
-      /* Read AVPs */
-      std::string user_name = *(request.GetAttributeByType(RadiusAVP::RAD_ATTR_USER_NAME));
-      std::string user_password = *(request.GetAttributeByType(RadiusAVP::RAD_ATTR_USER_PASSWORD));
-
-      RadiusUserEntry *user = m_rad_db->GetUser(user_name);
-      if (user == 0 || user->GetUserPassword() != user_password)
-        {
-          response.SetMessageCode(RadiusMessage::RAD_ACCESS_REJECT);
-        }
-      else
-        {
-          response.SetMessageCode(RadiusMessage::RAD_ACCESS_ACCEPT);
-
-          /* Update DB */
-          const RadiusAVP* avp_calledid = request.GetAttributeByType(RadiusAVP::RAD_ATTR_CALLED_STATION_ID);
-          const RadiusAVP* avp_callingid = request.GetAttributeByType(RadiusAVP::RAD_ATTR_CALLING_STATION_ID);
-          const RadiusAVP* avp_nasid = request.GetAttributeByType(RadiusAVP::RAD_ATTR_NAS_IDENTIFIER);
-          const RadiusAVP* avp_port = request.GetAttributeByType(RadiusAVP::RAD_ATTR_NAS_PORT);
-          const RadiusAVP* avp_port_type = request.GetAttributeByType(RadiusAVP::RAD_ATTR_NAS_PORT_TYPE);
-
-          /*TODO check mandatory AVPs*/
-          if (avp_calledid != 0)
-            user->SetCalledId(*avp_calledid);
-          if (avp_callingid != 0)
-            user->SetCallingId(*avp_callingid);
-          if (avp_nasid != 0)
-            user->SetNasIdentifier(*avp_nasid);
-          if (avp_port != 0)
-            user->SetNasPort(*avp_port);
-          if (avp_port_type != 0)
-            user->SetNasPortType(*avp_port_type);
-        }
-
-      response.SetMessageID(request.GetMessageID());
-
-      Time t = MilliSeconds(m_server_delay);
-
-      ScheduleTransmit(t, from, response);
+      Enqueue(request, from);
     }
 }
 
@@ -234,73 +263,297 @@ void RadiusServer::HandleAccounting(Ptr<Socket> socket)
 
       NS_LOG_LOGIC("Message:" << request);
 
-      const RadiusAVP* avp_event = request.GetAttributeByType(RadiusAVP::RAD_ATTR_ACCT_STATUS_TYPE);
-      const RadiusAVP* avp_session_id = request.GetAttributeByType(RadiusAVP::RAD_ATTR_ACCT_SESSION_ID);
+      Enqueue(request, from);
+    }
+}
+
+void RadiusServer::Enqueue(const RadiusMessage &request, const Address &client)
+{
+  NS_LOG_FUNCTION(this << client);
 
-      if (avp_event == 0 || avp_session_id == 0)
-        {
-          NS_LOG_WARN("Invalid request" << request);
-          continue;
-        }
+  InetSocketAddress inet = InetSocketAddress::ConvertFrom(client);
+  uint64_t key = (uint64_t(inet.GetIpv4().Get()) << 24) | (uint32_t(inet.GetPort()) << 8)
+    | request.GetMessageID();
 
-      std::string session_id = *avp_session_id;
+  if (!AdmitRequest(request, client, key))
+    return;
 
-      switch (uint32_t(*avp_event))
-        {
-        case RadiusAVP::RAD_ACCT_START:
-        {
-          const RadiusAVP* avp_username = request.GetAttributeByType(RadiusAVP::RAD_ATTR_USER_NAME);
-          NS_ASSERT(avp_username != 0);
+  if (m_queue.size() >= m_queue_limit && m_idle_workers.empty())
+    {
+      NS_LOG_WARN(this << " queue full, dropping request from " << client);
+      m_drop_trace(request.GetMessageCode());
+      return;
+    }
 
-          std::string username = *avp_username;
-          m_rad_db->StartUserSession(session_id, username);
-          break;
-        }
+  /* A new request, it replaces whatever used this identifier before */
+  RecentRequest &recent = m_recent[key];
+  request.GetAutheticator(recent.authenticator);
+  recent.answered = false;
+  recent.response = RadiusMessage();
+  recent.serial = ++m_recent_serial;
 
-        case RadiusAVP::RAD_ACCT_STOP:
-        {
-          const RadiusAVP* avp_session_time = request.GetAttributeByType(RadiusAVP::RAD_ATTR_ACCT_SESSION_TIME);
-          const RadiusAVP* avp_cause = request.GetAttributeByType(RadiusAVP::RAD_ATTR_ACCT_TERMINATE_CAUSE);
+  m_queue.push_back(Job {request, client, Simulator::Now(), key, recent.serial});
+  m_queue_length = m_queue.size();
 
-          NS_ASSERT(avp_session_time != 0);
-          NS_ASSERT(avp_cause != 0);
+  Dispatch();
+}
 
-          m_rad_db->StopUserSession(session_id, *avp_session_time, *avp_cause);
-          break;
-        }
+bool RadiusServer::AdmitRequest(const RadiusMessage &request, const Address &client, uint64_t key)
+{
+  PurgeReplyCache();
+
+  auto it = m_recent.find(key);
+
+  if (it == m_recent.end())
+    return true;
+
+  uint8_t authenticator[16];
+  request.GetAutheticator(authenticator);
+
+  /* Same identifier, new request */
+  if (memcmp(it->second.authenticator, authenticator, sizeof(authenticator)) != 0)
+    return true;
+
+  if (it->second.answered)
+    {
+      NS_LOG_LOGIC(this << " duplicate from " << client << ", sending the cached answer");
+      SendTo(it->second.response, client);
+    }
+  else
+    {
+      NS_LOG_LOGIC(this << " duplicate from " << client << ", still in service");
+    }
+
+  m_duplicate_trace(request.GetMessageCode(), it->second.answered);
+
+  return false;
+}
+
+void RadiusServer::PurgeReplyCache()
+{
+  Time now = Simulator::Now();
+
+  while (!m_recent_expiration.empty() && m_recent_expiration.front().expires <= now)
+    {
+      const CacheExpiration &record = m_recent_expiration.front();
+      auto it = m_recent.find(record.key);
+
+      /* The identifier may have been reused since */
+      if (it != m_recent.end() && it->second.serial == record.serial)
+        m_recent.erase(it);
+
+      m_recent_expiration.pop_front();
+    }
+}
+
+void RadiusServer::Dispatch()
+{
+  while (!m_queue.empty() && !m_idle_workers.empty())
+    {
+      uint32_t worker = m_idle_workers.back();
+      m_idle_workers.pop_back();
+
+      Job job = m_queue.front();
+      m_queue.pop_front();
+
+      Time service = Seconds(std::max(m_service_time->GetValue(), 0.0));
+      m_workers[worker] = Simulator::Schedule(service, &RadiusServer::ServiceDone, this, worker, job);
+    }
+
+  m_queue_length = m_queue.size();
+}
+
+void RadiusServer::ServiceDone(uint32_t worker, Job job)
+{
+  NS_LOG_FUNCTION(this << worker);
 
-        case RadiusAVP::RAD_ACCT_UPDATE:
-          NS_LOG_DEBUG("RADIUS ACC Interim-update handling not implemented");
-          break;
+  m_idle_workers.push_back(worker);
 
-        default:
+  if (job.request.GetMessageCode() == RadiusMessage::RAD_ACCESS_REQUEST)
+    {
+      Send(Reply {ProcessAuthentication(job.request), job.client, job.arrival, job.key, job.serial});
+    }
+  else
+    {
+      Reply reply {RadiusMessage(), job.client, job.arrival, job.key, job.serial};
+
+      if (ProcessAccounting(job.request, reply.response))
         {
-          NS_LOG_WARN("Unsuported Radius Event type:" << uint32_t(*avp_event));
-          continue;
+          if (m_acc_batch_size <= 1)
+            {
+              Send(reply);
+            }
+          else
+            {
+              m_acc_batch.push_back(reply);
+
+              if (m_acc_batch.size() >= m_acc_batch_size)
+                StartCommit();
+              else if (!m_batch_timer.IsRunning())
+                m_batch_timer = Simulator::Schedule(m_acc_batch_timeout, &RadiusServer::StartCommit, this);
+            }
         }
+      else
+        {
+          /* Ignored, retransmissions will be served (and ignored) again */
+          auto it = m_recent.find(job.key);
+          if (it != m_recent.end() && it->second.serial == job.serial)
+            m_recent.erase(it);
         }
+    }
 
-      /* Accounting-Resp doesn't have mandatory AVPs */
-      RadiusMessage response;
-      response.SetMessageCode(RadiusMessage::RAD_ACCOUNTING_RESPONSE);
-      response.SetMessageID(request.GetMessageID());
+  Dispatch();
+}
+
+RadiusMessage RadiusServer::ProcessAuthentication(const RadiusMessage &request)
+{
+  NS_LOG_FUNCTION(this);
 
-      Time t = MilliSeconds(m_server_delay);
+  RadiusMessage response;
 
-      ScheduleTransmit(t, from, response);
+  /* Read AVPs */
+  std::string user_name = *(request.GetAttributeByType(RadiusAVP::RAD_ATTR_USER_NAME));
+  std::string user_password = *(request.GetAttributeByType(RadiusAVP::RAD_ATTR_USER_PASSWORD));
+
+  RadiusUserEntry *user = m_rad_db->GetUser(user_name);
+  if (user == 0 || user->GetUserPassword() != user_password)
+    {
+      response.SetMessageCode(RadiusMessage::RAD_ACCESS_REJECT);
+    }
+  else
+    {
+      response.SetMessageCode(RadiusMessage::RAD_ACCESS_ACCEPT);
+
+      /* Update DB */
+      const RadiusAVP* avp_calledid = request.GetAttributeByType(RadiusAVP::RAD_ATTR_CALLED_STATION_ID);
+      const RadiusAVP* avp_callingid = request.GetAttributeByType(RadiusAVP::RAD_ATTR_CALLING_STATION_ID);
+      const RadiusAVP* avp_nasid = request.GetAttributeByType(RadiusAVP::RAD_ATTR_NAS_IDENTIFIER);
+      const RadiusAVP* avp_port = request.GetAttributeByType(RadiusAVP::RAD_ATTR_NAS_PORT);
+      const RadiusAVP* avp_port_type = request.GetAttributeByType(RadiusAVP::RAD_ATTR_NAS_PORT_TYPE);
+
+      /*TODO check mandatory AVPs*/
+      if (avp_calledid != 0)
+        user->SetCalledId(*avp_calledid);
+      if (avp_callingid != 0)
+        user->SetCallingId(*avp_callingid);
+      if (avp_nasid != 0)
+        user->SetNasIdentifier(*avp_nasid);
+      if (avp_port != 0)
+        user->SetNasPort(*avp_port);
+      if (avp_port_type != 0)
+        user->SetNasPortType(*avp_port_type);
     }
+
+  response.SetMessageID(request.GetMessageID());
+
+  return response;
 }
 
-void RadiusServer::ScheduleTransmit(Time dt, Address client, RadiusMessage &response)
+bool RadiusServer::ProcessAccounting(const RadiusMessage &request, RadiusMessage &response)
 {
-  NS_LOG_FUNCTION(this << dt << client << response);
+  NS_LOG_FUNCTION(this);
+
+  const RadiusAVP* avp_event = request.GetAttributeByType(RadiusAVP::RAD_ATTR_ACCT_STATUS_TYPE);
+  const RadiusAVP* avp_session_id = request.GetAttributeByType(RadiusAVP::RAD_ATTR_ACCT_SESSION_ID);
 
-  EventId eventId = Simulator::Schedule(dt, &RadiusServer::Send, this, client, response);
+  if (avp_event == 0 || avp_session_id == 0)
+    {
+      NS_LOG_WARN("Invalid request" << request);
+      return false;
+    }
 
-  m_peding_reqs.push(eventId);
+  std::string session_id = *avp_session_id;
+
+  switch (uint32_t(*avp_event))
+    {
+    case RadiusAVP::RAD_ACCT_START:
+    {
+      const RadiusAVP* avp_username = request.GetAttributeByType(RadiusAVP::RAD_ATTR_USER_NAME);
+      NS_ASSERT(avp_username != 0);
+
+      std::string username = *avp_username;
+      m_rad_db->StartUserSession(session_id, username);
+      break;
+    }
+
+    case RadiusAVP::RAD_ACCT_STOP:
+    {
+      const RadiusAVP* avp_session_time = request.GetAttributeByType(RadiusAVP::RAD_ATTR_ACCT_SESSION_TIME);
+      const RadiusAVP* avp_cause = request.GetAttributeByType(RadiusAVP::RAD_ATTR_ACCT_TERMINATE_CAUSE);
+
+      NS_ASSERT(avp_session_time != 0);
+      NS_ASSERT(avp_cause != 0);
+
+      m_rad_db->StopUserSession(session_id, *avp_session_time, *avp_cause);
+      break;
+    }
+
+    case RadiusAVP::RAD_ACCT_UPDATE:
+      NS_LOG_DEBUG("RADIUS ACC Interim-update handling not implemented");
+      break;
+
+    default:
+    {
+      NS_LOG_WARN("Unsuported Radius Event type:" << uint32_t(*avp_event));
+      return false;
+    }
+    }
+
+  /* Accounting-Resp doesn't have mandatory AVPs */
+  response.SetMessageCode(RadiusMessage::RAD_ACCOUNTING_RESPONSE);
+  response.SetMessageID(request.GetMessageID());
+
+  return true;
 }
 
-void RadiusServer::Send(Address client, RadiusMessage &response)
+void RadiusServer::StartCommit()
+{
+  NS_LOG_FUNCTION(this << m_acc_batch.size());
+
+  Simulator::Cancel(m_batch_timer);
+
+  /* One commit at a time, the next batch keeps growing meanwhile */
+  if (m_commit_event.IsRunning() || m_acc_batch.empty())
+    return;
+
+  m_committing.swap(m_acc_batch);
+  m_commit_event = Simulator::Schedule(m_commit_time, &RadiusServer::CommitDone, this);
+}
+
+void RadiusServer::CommitDone()
+{
+  NS_LOG_FUNCTION(this << m_committing.size());
+
+  for (auto &reply : m_committing)
+    Send(reply);
+  m_committing.clear();
+
+  if (m_acc_batch.size() >= m_acc_batch_size)
+    StartCommit();
+  else if (!m_acc_batch.empty() && !m_batch_timer.IsRunning())
+    m_batch_timer = Simulator::Schedule(m_acc_batch_timeout, &RadiusServer::StartCommit, this);
+}
+
+void RadiusServer::Send(const Reply &reply)
+{
+  NS_LOG_FUNCTION(this << reply.client << reply.response);
+
+  SendTo(reply.response, reply.client);
+  m_sojourn_trace(Simulator::Now() - reply.arrival);
+
+  /* Keep the answer for retransmissions already on their way */
+  auto it = m_recent.find(reply.key);
+
+  if (it == m_recent.end() || it->second.serial != reply.serial)
+    return;
+
+  it->second.answered = true;
+  it->second.response = reply.response;
+  m_recent_expiration.push_back(CacheExpiration {Simulator::Now() + m_reply_cache_time,
+                                                 reply.key, reply.serial});
+}
+
+void RadiusServer::SendTo(const RadiusMessage &response, const Address &client)
 {
   Ptr<Packet> pkt = Create<Packet> ();
 
@@ -310,8 +563,5 @@ void RadiusServer::Send(Address client, RadiusMessage &response)
     m_acc_sock->SendTo(pkt, 0, client);
   else
     m_auth_sock->SendTo(pkt, 0, client);
-
-  /* assume requests are serviced in order */
-  m_peding_reqs.pop();
 }
 }
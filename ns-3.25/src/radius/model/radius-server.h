@@ -21,11 +21,18 @@
 #ifndef __RADIUS_SERVER_H__
 #define __RADIUS_SERVER_H__
 
-#include <queue>
+#include <deque>
+#include <vector>
+#include <unordered_map>
 #include <ns3/callback.h>
 #include <ns3/application.h>
 #include <ns3/event-id.h>
 #include <ns3/ptr.h>
+#include <ns3/nstime.h>
+#include <ns3/traced-value.h>
+#include <ns3/traced-callback.h>
+#include <ns3/random-variable-stream.h>
+#include <ns3/radius-header.h>
 #include <ns3/radius-db.h>
 
 namespace ns3
@@ -34,9 +41,43 @@ namespace ns3
 class Socket;
 class Packet;
 
+/**
+ * \brief RADIUS server (AAA side)
+ *
+ * Requests wait in a bounded FIFO for one of the workers, each request
+ * keeps a worker busy for a time drawn from ServiceTime. Requests that
+ * find the queue full are dropped, the client is expected to retransmit.
+ *
+ * Accounting answers can be held until a batch of records is committed
+ * to the database, a commit takes CommitTime and commits don't overlap.
+ *
+ * Retransmissions are recognized by source address, port, identifier and
+ * authenticator (RFC 5080, section 2.2.2). A duplicate of a request still
+ * being served is dropped, one already answered gets the cached reply, so
+ * no request is processed twice.
+ */
 class RadiusServer : public Application
 {
 public:
+  /**
+   * TracedCallback signature for answered requests
+   * \param [in] sojourn    time from arrival to answer
+   */
+  typedef void (* SojournTracedCallback)(Time sojourn);
+
+  /**
+   * TracedCallback signature for requests dropped on a full queue
+   * \param [in] code       request code
+   */
+  typedef void (* DropTracedCallback)(uint8_t code);
+
+  /**
+   * TracedCallback signature for retransmitted requests
+   * \param [in] code       request code
+   * \param [in] answered   true if the cached reply was sent again
+   */
+  typedef void (* DuplicateTracedCallback)(uint8_t code, bool answered);
+
   /**
    * \brief Get the type ID.
    * \return type ID
@@ -62,7 +103,41 @@ protected:
   virtual void DoDispose ();
 
 private:
-  typedef std::queue<EventId> RadiusPendingRequests;
+  struct Job
+  {
+    RadiusMessage request;
+    Address client;
+    Time arrival;
+    uint64_t key;
+    uint32_t serial;
+  };
+
+  struct Reply
+  {
+    RadiusMessage response;
+    Address client;
+    Time arrival;
+    uint64_t key;
+    uint32_t serial;
+  };
+
+  /**
+   * Last request seen from a client port and identifier
+   */
+  struct RecentRequest
+  {
+    uint8_t authenticator[16];
+    bool answered;
+    RadiusMessage response;
+    uint32_t serial;           //!< Tells stale expiration records apart
+  };
+
+  struct CacheExpiration
+  {
+    Time expires;
+    uint64_t key;
+    uint32_t serial;
+  };
 
   /**
     * \brief Start the application.
@@ -86,9 +161,46 @@ private:
    */
   void HandleAccounting (Ptr<Socket> socket);
 
-  void ScheduleTransmit (Time dt, Address client, RadiusMessage &response);
+  /**
+   * \brief Queue a request, or drop it if the queue is full
+   */
+  void Enqueue (const RadiusMessage &request, const Address &client);
+
+  /**
+   * \brief Check a request against the recent ones
+   * \return false if it is a retransmission, already handled here
+   */
+  bool AdmitRequest (const RadiusMessage &request, const Address &client, uint64_t key);
+
+  /**
+   * \brief Forget answers older than ReplyCacheTime
+   */
+  void PurgeReplyCache ();
+
+  /**
+   * \brief Start queued requests while there are idle workers
+   */
+  void Dispatch ();
+
+  void ServiceDone (uint32_t worker, Job job);
+
+  /**
+   * \brief Authenticate an user
+   * \return response to be sent
+   */
+  RadiusMessage ProcessAuthentication (const RadiusMessage &request);
+
+  /**
+   * \brief Update user sessions
+   * \return false if the request is invalid and must be ignored
+   */
+  bool ProcessAccounting (const RadiusMessage &request, RadiusMessage &response);
+
+  void StartCommit ();
+  void CommitDone ();
 
-  void Send(Address client, RadiusMessage &response);
+  void Send(const Reply &reply);
+  void SendTo(const RadiusMessage &response, const Address &client);
 
   Ptr<RadiusDB>                   m_rad_db;
   Ptr<Socket>                     m_auth_sock;       //!< Auth socket
@@ -96,8 +208,30 @@ private:
   uint16_t                        m_srv_auth_port;
   uint16_t                        m_srv_acc_port;
   std::string                     m_server_secret;
-  uint64_t                        m_server_delay;
-  RadiusPendingRequests           m_peding_reqs;
+  uint32_t                        m_n_workers;
+  uint32_t                        m_queue_limit;
+  Ptr<RandomVariableStream>       m_service_time;    //!< Seconds
+  uint32_t                        m_acc_batch_size;
+  Time                            m_acc_batch_timeout;
+  Time                            m_commit_time;
+  Time                            m_reply_cache_time;
+
+  std::deque<Job>                 m_queue;
+  std::vector<EventId>            m_workers;         //!< Service event of each worker
+  std::vector<uint32_t>           m_idle_workers;
+  std::vector<Reply>              m_acc_batch;       //!< Waiting for the next commit
+  std::vector<Reply>              m_committing;      //!< Commit in progress
+  EventId                         m_batch_timer;
+  EventId                         m_commit_event;
+
+  std::unordered_map<uint64_t, RecentRequest> m_recent;  //!< Keyed by address, port and identifier
+  std::deque<CacheExpiration>     m_recent_expiration;   //!< In answer order
+  uint32_t                        m_recent_serial;
+
+  TracedValue<uint32_t>           m_queue_length;
+  TracedCallback<Time>            m_sojourn_trace;
+  TracedCallback<uint8_t>         m_drop_trace;
+  TracedCallback<uint8_t, bool>   m_duplicate_trace;
 };
 
 }
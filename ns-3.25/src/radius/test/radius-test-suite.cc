@@ -1,55 +1,311 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Alexsander de Souza
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Alexsander de Souza <asouza@inf.ufrgs.br>
+ */
 
-// Include a header file from your module to test.
-#include "ns3/radius.h"
-
-// An essential include is test.h
+#include <algorithm>
+#include <sstream>
+#include <vector>
 #include "ns3/test.h"
+#include "ns3/simulator.h"
+#include "ns3/string.h"
+#include "ns3/uinteger.h"
+#include "ns3/node-container.h"
+#include "ns3/net-device-container.h"
+#include "ns3/csma-helper.h"
+#include "ns3/internet-stack-helper.h"
+#include "ns3/ipv4-address-helper.h"
+#include "ns3/ipv4-interface-container.h"
+#include "ns3/radius-client.h"
+#include "ns3/radius-server.h"
 
-// Do not put your test classes in namespace ns3.  You may find it useful
-// to use the using directive to access the ns3 namespace directly
 using namespace ns3;
 
-// This is an example TestCase.
-class RadiusTestCase1 : public TestCase
+/*
+ * RADIUS client and server on both ends of a link. The ARP cache only
+ * learns from replies, so each case starts with a warm-up request and
+ * sends the requests under test from WARM.
+ */
+static const Time WARM = Seconds (5);
+
+class RadiusTestCase : public TestCase
+{
+public:
+  RadiusTestCase (std::string name);
+
+  void Authenticate (void);
+  void StartAccounting (std::string sessionId);
+
+protected:
+  void Setup (Time delay);
+  void Teardown (void);
+
+  int RequestDone (uint8_t code, RadiusMessage::RadiusAvpList avps);
+  void Sojourn (Time sojourn);
+  void Drop (uint8_t code);
+  void Duplicate (uint8_t code, bool answered);
+
+  Ptr<RadiusClient> m_client;
+  Ptr<RadiusServer> m_server;
+
+  std::vector<uint8_t> m_completed;    //!< Completion codes, after the warm-up
+  std::vector<Time> m_sojourn;         //!< Sojourn of answered requests, after the warm-up
+  uint32_t m_drops;                    //!< Warm-up is never dropped
+  std::vector<bool> m_duplicates;      //!< Answered flag of each duplicate, after the warm-up
+};
+
+RadiusTestCase::RadiusTestCase (std::string name)
+  : TestCase (name),
+    m_drops (0)
+{
+}
+
+void
+RadiusTestCase::Setup (Time delay)
+{
+  NodeContainer nodes;
+  nodes.Create (2);
+
+  CsmaHelper csma;
+  csma.SetChannelAttribute ("DataRate", StringValue ("1Gbps"));
+  csma.SetChannelAttribute ("Delay", TimeValue (delay));
+  NetDeviceContainer devices = csma.Install (nodes);
+
+  InternetStackHelper stack;
+  stack.Install (nodes);
+
+  Ipv4AddressHelper address;
+  address.SetBase ("10.0.0.0", "255.255.255.0");
+  Ipv4InterfaceContainer interfaces = address.Assign (devices);
+
+  m_server = CreateObject<RadiusServer> ();
+  nodes.Get (0)->AddApplication (m_server);
+
+  m_client = CreateObject<RadiusClient> ();
+  m_client->SetAttribute ("ServerAddress", Ipv4AddressValue (interfaces.GetAddress (0)));
+  m_client->SetRequestDoneCb (MakeCallback (&RadiusTestCase::RequestDone, this));
+  nodes.Get (1)->AddApplication (m_client);
+
+  m_server->TraceConnectWithoutContext ("Sojourn", MakeCallback (&RadiusTestCase::Sojourn, this));
+  m_server->TraceConnectWithoutContext ("Drop", MakeCallback (&RadiusTestCase::Drop, this));
+  m_server->TraceConnectWithoutContext ("Duplicate", MakeCallback (&RadiusTestCase::Duplicate, this));
+
+  /* After the applications started */
+  Simulator::Schedule (Seconds (1), &RadiusTestCase::Authenticate, this);
+}
+
+void
+RadiusTestCase::Authenticate (void)
+{
+  /* No such user, rejected */
+  m_client->DoAuthentication ("user1", "secret", "nas1", 1);
+}
+
+void
+RadiusTestCase::StartAccounting (std::string sessionId)
+{
+  m_client->DoStartAccounting (RadiusAVP::RAD_ACCT_START, sessionId, "user1");
+}
+
+void
+RadiusTestCase::Teardown (void)
+{
+  m_client = 0;
+  m_server = 0;
+  Simulator::Destroy ();
+}
+
+int
+RadiusTestCase::RequestDone (uint8_t code, RadiusMessage::RadiusAvpList avps)
+{
+  if (Simulator::Now () >= WARM)
+    m_completed.push_back (code);
+  return 0;
+}
+
+void
+RadiusTestCase::Sojourn (Time sojourn)
+{
+  if (Simulator::Now () >= WARM)
+    m_sojourn.push_back (sojourn);
+}
+
+void
+RadiusTestCase::Drop (uint8_t code)
+{
+  ++m_drops;
+}
+
+void
+RadiusTestCase::Duplicate (uint8_t code, bool answered)
+{
+  if (Simulator::Now () >= WARM)
+    m_duplicates.push_back (answered);
+}
+
+class RadiusQueueLimitTestCase : public RadiusTestCase
 {
 public:
-  RadiusTestCase1 ();
-  virtual ~RadiusTestCase1 ();
+  RadiusQueueLimitTestCase ();
 
 private:
   virtual void DoRun (void);
 };
 
-// Add some help text to this case to describe what it is intended to test
-RadiusTestCase1::RadiusTestCase1 ()
-  : TestCase ("Radius test case (does nothing)")
+RadiusQueueLimitTestCase::RadiusQueueLimitTestCase ()
+  : RadiusTestCase ("Requests finding the queue full are dropped, the others served in order")
 {
 }
 
-// This destructor does nothing but we include it as a reminder that
-// the test case should clean up after itself
-RadiusTestCase1::~RadiusTestCase1 ()
+void
+RadiusQueueLimitTestCase::DoRun (void)
+{
+  Setup (MicroSeconds (10));
+
+  /* One in service, two waiting */
+  m_server->SetAttribute ("Workers", UintegerValue (1));
+  m_server->SetAttribute ("QueueLimit", UintegerValue (2));
+  m_server->SetAttribute ("ServiceTime", StringValue ("ns3::ConstantRandomVariable[Constant=0.5]"));
+
+  /* Dropped requests are abandoned, not retransmitted */
+  m_client->SetAttribute ("RetransmitTimeout", TimeValue (Seconds (10)));
+  m_client->SetAttribute ("MaxRetransmissions", UintegerValue (0));
+
+  for (uint32_t i = 0; i < 5; ++i)
+    {
+      Simulator::Schedule (WARM, &RadiusTestCase::Authenticate, this);
+    }
+
+  Simulator::Run ();
+
+  NS_TEST_EXPECT_MSG_EQ (m_drops, 2, "Queue limit not enforced");
+
+  NS_TEST_ASSERT_MSG_EQ (m_sojourn.size (), 3, "Wrong number of requests served");
+  for (uint32_t i = 0; i < m_sojourn.size (); ++i)
+    {
+      NS_TEST_EXPECT_MSG_EQ_TOL (m_sojourn[i].GetSeconds (), 0.5 * (i + 1), 0.001, "Queued requests not served one after the other");
+    }
+
+  uint32_t rejected = std::count (m_completed.begin (), m_completed.end (), uint8_t (RadiusMessage::RAD_ACCESS_REJECT));
+  uint32_t timedOut = std::count (m_completed.begin (), m_completed.end (), RadiusClient::REQUEST_TIMEOUT);
+  NS_TEST_EXPECT_MSG_EQ (rejected, 3, "Served requests not answered");
+  NS_TEST_EXPECT_MSG_EQ (timedOut, 2, "Dropped requests not reported to the client");
+
+  Teardown ();
+}
+
+class RadiusDuplicateTestCase : public RadiusTestCase
+{
+public:
+  RadiusDuplicateTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+RadiusDuplicateTestCase::RadiusDuplicateTestCase ()
+  : RadiusTestCase ("Retransmissions are served once, answered ones get the cached reply")
 {
 }
 
-//
-// This method is the pure virtual method from class TestCase that every
-// TestCase must implement
-//
 void
-RadiusTestCase1::DoRun (void)
+RadiusDuplicateTestCase::DoRun (void)
+{
+  /* Request arrives at WARM + 0.2s, is answered at 0.7s, the answer gets
+   * to the client at 0.9s. Retransmissions sent at 0.25s and 0.75s arrive
+   * in service and after the answer. */
+  Setup (MilliSeconds (200));
+
+  m_server->SetAttribute ("ServiceTime", StringValue ("ns3::ConstantRandomVariable[Constant=0.5]"));
+  m_client->SetAttribute ("RetransmitTimeout", TimeValue (MilliSeconds (250)));
+  m_client->SetAttribute ("MaxRetransmissions", UintegerValue (3));
+
+  Simulator::Schedule (WARM, &RadiusTestCase::Authenticate, this);
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_duplicates.size (), 2, "Retransmissions not recognized");
+  NS_TEST_EXPECT_MSG_EQ (m_duplicates[0], false, "Duplicate of a request in service was answered");
+  NS_TEST_EXPECT_MSG_EQ (m_duplicates[1], true, "Duplicate of an answered request not replayed");
+
+  NS_TEST_EXPECT_MSG_EQ (m_sojourn.size (), 1, "Request served more than once");
+  NS_TEST_ASSERT_MSG_EQ (m_completed.size (), 1, "Request not completed once");
+  NS_TEST_EXPECT_MSG_EQ (uint32_t (m_completed[0]), uint32_t (RadiusMessage::RAD_ACCESS_REJECT), "Wrong answer");
+
+  Teardown ();
+}
+
+class RadiusAccountingBatchTestCase : public RadiusTestCase
+{
+public:
+  RadiusAccountingBatchTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+RadiusAccountingBatchTestCase::RadiusAccountingBatchTestCase ()
+  : RadiusTestCase ("Accounting batches are committed when full or on timeout")
 {
-  // A wide variety of test macros are available in src/core/test.h
-  NS_TEST_ASSERT_MSG_EQ (true, true, "true doesn't equal true for some reason");
-  // Use this one for floating point comparisons
-  NS_TEST_ASSERT_MSG_EQ_TOL (0.01, 0.01, 0.001, "Numbers are not equal within tolerance");
 }
 
-// The TestSuite class names the TestSuite, identifies what type of TestSuite,
-// and enables the TestCases to be run.  Typically, only the constructor for
-// this class must be defined
-//
+void
+RadiusAccountingBatchTestCase::DoRun (void)
+{
+  Setup (MicroSeconds (10));
+
+  m_server->SetAttribute ("ServiceTime", StringValue ("ns3::ConstantRandomVariable[Constant=0]"));
+  m_server->SetAttribute ("AccountingBatchSize", UintegerValue (4));
+  m_server->SetAttribute ("AccountingBatchTimeout", TimeValue (Seconds (1)));
+  m_server->SetAttribute ("CommitTime", TimeValue (MilliSeconds (10)));
+
+  /* A full batch, then one left waiting for the timeout */
+  for (uint32_t i = 0; i < 4; ++i)
+    {
+      std::ostringstream sid;
+      sid << "full-" << i;
+      Simulator::Schedule (WARM, &RadiusTestCase::StartAccounting, this, sid.str ());
+    }
+
+  for (uint32_t i = 0; i < 2; ++i)
+    {
+      std::ostringstream sid;
+      sid << "partial-" << i;
+      Simulator::Schedule (WARM + Seconds (2), &RadiusTestCase::StartAccounting, this, sid.str ());
+    }
+
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_sojourn.size (), 6, "Accounting requests not answered");
+  for (uint32_t i = 0; i < 4; ++i)
+    {
+      NS_TEST_EXPECT_MSG_EQ_TOL (m_sojourn[i].GetSeconds (), 0.010, 0.001, "Full batch waited for the timeout");
+    }
+  for (uint32_t i = 4; i < 6; ++i)
+    {
+      NS_TEST_EXPECT_MSG_EQ_TOL (m_sojourn[i].GetSeconds (), 1.010, 0.001, "Partial batch not committed on timeout");
+    }
+
+  uint32_t answered = std::count (m_completed.begin (), m_completed.end (), uint8_t (RadiusMessage::RAD_ACCOUNTING_RESPONSE));
+  NS_TEST_EXPECT_MSG_EQ (answered, 6, "Accounting requests not completed");
+
+  Teardown ();
+}
+
 class RadiusTestSuite : public TestSuite
 {
 public:
@@ -59,10 +315,9 @@ public:
 RadiusTestSuite::RadiusTestSuite ()
   : TestSuite ("radius", UNIT)
 {
-  // TestDuration for TestCase can be QUICK, EXTENSIVE or TAKES_FOREVER
-  AddTestCase (new RadiusTestCase1, TestCase::QUICK);
+  AddTestCase (new RadiusQueueLimitTestCase, TestCase::QUICK);
+  AddTestCase (new RadiusDuplicateTestCase, TestCase::QUICK);
+  AddTestCase (new RadiusAccountingBatchTestCase, TestCase::QUICK);
 }
 
-// Do not forget to allocate an instance of this TestSuite
 static RadiusTestSuite radiusTestSuite;
-